@@ -0,0 +1,1252 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <malloc.h>
+#include <unistd.h>
+
+#include "kv.h"
+#include "kv_stripe.h"
+#include "kv_rcu.h"
+#include "kv_frozen.h"
+#include "kv_map.h"
+
+/* number of pairs put before measuring */
+#define BENCH_PAIR_NUM      100000
+
+/* number of operations done by every thread */
+#define BENCH_OP_NUM        200000
+
+/* one of this many operations is a put, the others are gets */
+#define BENCH_PUT_RATIO     10
+
+/* put ratio of the read-mostly workload */
+#define BENCH_RARE_PUT_RATIO    1000
+
+/* maximum number of threads */
+#define BENCH_THREAD_NUM    32
+
+/* number of pairs of the batch lookup benchmark, far more than the LLC holds */
+#define BENCH_BATCH_PAIR_NUM    (1 << 22)
+
+/* number of keys looked up at a time */
+#define BENCH_BATCH_KEY_NUM     32
+
+/* number of puts of the durability benchmark, fsync'ing every one is slow */
+#define BENCH_WAL_PUT_NUM       200000
+#define BENCH_WAL_SYNC_PUT_NUM  2000
+
+/* number of prefix scans, each one visits 10 pairs */
+#define BENCH_SCAN_NUM          1000
+
+/* number of the hierarchical keys of the engine comparison */
+#define BENCH_PATH_NUM          (1 << 20)
+
+/* number of the distinct keys and the lookups of the cache benchmark */
+#define BENCH_CACHE_KEY_NUM     (1 << 20)
+#define BENCH_CACHE_OP_NUM      (1 << 22)
+
+/* number of the pairs expiring every second of the expiry benchmark */
+#define BENCH_TTL_RATE          1000
+
+/* number of the seconds the expiry benchmark simulates */
+#define BENCH_TTL_SECOND_NUM    10
+
+/* number of the distinct keys and the increments of the counting benchmark */
+#define BENCH_COUNT_KEY_NUM     (1 << 21)
+#define BENCH_COUNT_OP_NUM      (1 << 22)
+
+/* number of the pairs of the short pair benchmark */
+#define BENCH_SHORT_PAIR_NUM    (1 << 22)
+
+/* number of the pairs and the lookups of the filter benchmark, most lookups miss */
+#define BENCH_BLOOM_PAIR_NUM    (1 << 21)
+#define BENCH_BLOOM_OP_NUM      (1 << 22)
+#define BENCH_BLOOM_MISS_RATIO  80
+
+/* number of pairs of the integer keys */
+#define BENCH_MAP_PAIR_NUM      (1 << 20)
+
+/* number of lookups of the integer keys */
+#define BENCH_MAP_OP_NUM        (1 << 22)
+
+/* number of pairs loaded into the sharded set */
+#define BENCH_SHARD_PAIR_NUM    (1 << 20)
+
+/* most threads working on the sharded set */
+#define BENCH_SHARD_THREAD_NUM  16
+
+/* number of pairs of the set cloned */
+#define BENCH_CLONE_PAIR_NUM    (1 << 20)
+
+/* number of puts right after cloning */
+#define BENCH_CLONE_OP_NUM      (1 << 18)
+
+/* context of a benchmark thread */
+typedef struct bench_worker
+{
+    /* set shared by all threads, only one of them is used */
+    kv_set_t *set;
+    kv_stripe_set_t *stripe_set;
+    kv_rcu_set_t *rcu_set;
+
+    /* global lock of member 'set' */
+    pthread_mutex_t *mutex;
+
+    /* one of this many operations is a put */
+    uint64_t put_ratio;
+
+    /* seed of the key sequence */
+    uint64_t seed;
+} bench_worker_t;
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t bench_rand(uint64_t *seed)
+{
+    *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+
+    return *seed >> 33;
+}
+
+/* every operation of a plain kv set is serialized by one global mutex */
+static void *bench_global_main(void *arg)
+{
+    bench_worker_t *worker = (bench_worker_t *)arg;
+    const char *value;
+    char key[32];
+    uint64_t r;
+
+    for (size_t i = 0; i < BENCH_OP_NUM; i++)
+    {
+        r = bench_rand(&worker->seed);
+        sprintf(key, "key-%llu", (unsigned long long)(r % BENCH_PAIR_NUM));
+        pthread_mutex_lock(worker->mutex);
+        if (r % worker->put_ratio == 0)
+        {
+            kv_put(worker->set, key, "value");
+        }
+        else
+        {
+            kv_get(worker->set, key, &value);
+        }
+        pthread_mutex_unlock(worker->mutex);
+    }
+
+    return NULL;
+}
+
+static void *bench_stripe_main(void *arg)
+{
+    bench_worker_t *worker = (bench_worker_t *)arg;
+    kv_guard_t guard;
+    const char *value;
+    char key[32];
+    uint64_t r;
+
+    for (size_t i = 0; i < BENCH_OP_NUM; i++)
+    {
+        r = bench_rand(&worker->seed);
+        sprintf(key, "key-%llu", (unsigned long long)(r % BENCH_PAIR_NUM));
+        if (r % worker->put_ratio == 0)
+        {
+            kv_stripe_put(worker->stripe_set, key, "value");
+        }
+        else if (kv_stripe_get(worker->stripe_set, key, &value, &guard) == KV_OK)
+        {
+            kv_stripe_release(&guard);
+        }
+    }
+
+    return NULL;
+}
+
+/* the readers of the read-optimized set never take a lock */
+static void *bench_rcu_main(void *arg)
+{
+    bench_worker_t *worker = (bench_worker_t *)arg;
+    kv_rcu_reader_t *reader;
+    const char *value;
+    char key[32];
+    uint64_t r;
+
+    kv_rcu_register(worker->rcu_set, &reader);
+    for (size_t i = 0; i < BENCH_OP_NUM; i++)
+    {
+        r = bench_rand(&worker->seed);
+        sprintf(key, "key-%llu", (unsigned long long)(r % BENCH_PAIR_NUM));
+        if (r % worker->put_ratio == 0)
+        {
+            kv_rcu_put(worker->rcu_set, key, "value");
+        }
+        else
+        {
+            kv_rcu_read_lock(reader);
+            kv_rcu_get(worker->rcu_set, key, &value);
+            kv_rcu_read_unlock(reader);
+        }
+    }
+    kv_rcu_unregister(reader);
+
+    return NULL;
+}
+
+/**
+ * @brief run the workers on the set with the specified number of threads.
+ * @return  million operations per second.
+ */
+static double bench_run(void *(*main)(void *), bench_worker_t *proto, size_t thread_num)
+{
+    pthread_t threads[BENCH_THREAD_NUM];
+    bench_worker_t workers[BENCH_THREAD_NUM];
+    double start;
+
+    start = bench_now();
+    for (size_t i = 0; i < thread_num; i++)
+    {
+        workers[i] = *proto;
+        workers[i].seed = i + 1;
+        pthread_create(threads + i, NULL, main, workers + i);
+    }
+    for (size_t i = 0; i < thread_num; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    return thread_num * BENCH_OP_NUM / (bench_now() - start) / 1e6;
+}
+
+static void bench_stripe(void)
+{
+    static const int lock_types[] = {KV_LOCK_MUTEX, KV_LOCK_RWLOCK};
+    kv_stripe_conf_t conf;
+    bench_worker_t proto;
+    pthread_mutex_t mutex;
+    double mops[3];
+    char key[32];
+
+    memset(&proto, 0, sizeof(bench_worker_t));
+    proto.put_ratio = BENCH_PUT_RATIO;
+    pthread_mutex_init(&mutex, NULL);
+    proto.mutex = &mutex;
+    kv_create(&proto.set, NULL);
+    for (size_t i = 0; i < BENCH_PAIR_NUM; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        kv_put(proto.set, key, "value");
+    }
+
+    printf("striped set, %d%% puts, Mops/s\n", 100 / BENCH_PUT_RATIO);
+    printf("%8s %12s %12s %12s\n", "threads", "global", "mutex", "rwlock");
+    for (size_t thread_num = 1; thread_num <= BENCH_THREAD_NUM; thread_num *= 2)
+    {
+        mops[0] = bench_run(bench_global_main, &proto, thread_num);
+        for (int i = 0; i < 2; i++)
+        {
+            memset(&conf, 0, sizeof(kv_stripe_conf_t));
+            conf.stripe_num = 64;
+            conf.lock_type = lock_types[i];
+            kv_stripe_create(&proto.stripe_set, &conf);
+            for (size_t j = 0; j < BENCH_PAIR_NUM; j++)
+            {
+                sprintf(key, "key-%zu", j);
+                kv_stripe_put(proto.stripe_set, key, "value");
+            }
+            mops[i + 1] = bench_run(bench_stripe_main, &proto, thread_num);
+            kv_stripe_destroy(proto.stripe_set);
+        }
+        printf("%8zu %12.2f %12.2f %12.2f\n", thread_num, mops[0], mops[1], mops[2]);
+    }
+
+    kv_destroy(proto.set);
+    pthread_mutex_destroy(&mutex);
+}
+
+static void bench_rcu(void)
+{
+    kv_stripe_conf_t stripe_conf;
+    kv_rcu_conf_t rcu_conf;
+    bench_worker_t proto;
+    double mops[2];
+    char key[32];
+
+    memset(&proto, 0, sizeof(bench_worker_t));
+    proto.put_ratio = BENCH_RARE_PUT_RATIO;
+    memset(&stripe_conf, 0, sizeof(kv_stripe_conf_t));
+    stripe_conf.stripe_num = 64;
+    stripe_conf.lock_type = KV_LOCK_RWLOCK;
+    memset(&rcu_conf, 0, sizeof(kv_rcu_conf_t));
+    rcu_conf.reader_num = BENCH_THREAD_NUM;
+    kv_stripe_create(&proto.stripe_set, &stripe_conf);
+    kv_rcu_create(&proto.rcu_set, &rcu_conf);
+    for (size_t i = 0; i < BENCH_PAIR_NUM; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        kv_stripe_put(proto.stripe_set, key, "value");
+        kv_rcu_put(proto.rcu_set, key, "value");
+    }
+
+    printf("read-optimized set, %.1f%% puts, Mops/s\n", 100.0 / BENCH_RARE_PUT_RATIO);
+    printf("%8s %12s %12s\n", "threads", "rwlock", "rcu");
+    for (size_t thread_num = 1; thread_num <= BENCH_THREAD_NUM; thread_num *= 2)
+    {
+        mops[0] = bench_run(bench_stripe_main, &proto, thread_num);
+        mops[1] = bench_run(bench_rcu_main, &proto, thread_num);
+        printf("%8zu %12.2f %12.2f\n", thread_num, mops[0], mops[1]);
+    }
+
+    kv_stripe_destroy(proto.stripe_set);
+    kv_rcu_destroy(proto.rcu_set);
+}
+
+static void bench_batch(void)
+{
+    static const int engines[] = {KV_ENGINE_CHAIN, KV_ENGINE_FLAT};
+    static const char *engine_names[] = {"chain", "flat"};
+    kv_conf_t conf;
+    kv_set_t *set;
+    char (*key_bufs)[16];
+    const char **keys;
+    const char *values[BENCH_BATCH_KEY_NUM];
+    uint64_t seed;
+    double start;
+    double scalar_ns;
+    double batch_ns;
+
+    key_bufs = (char (*)[16])malloc(BENCH_BATCH_PAIR_NUM * sizeof(*key_bufs));
+    keys = (const char **)malloc(BENCH_BATCH_PAIR_NUM * sizeof(const char *));
+    for (size_t i = 0; i < BENCH_BATCH_PAIR_NUM; i++)
+    {
+        sprintf(key_bufs[i], "key-%zu", i);
+    }
+
+    /* look the keys up in a random order */
+    seed = 1;
+    for (size_t i = 0; i < BENCH_BATCH_PAIR_NUM; i++)
+    {
+        keys[i] = key_bufs[bench_rand(&seed) % BENCH_BATCH_PAIR_NUM];
+    }
+
+    printf("batch lookup, %d pairs, %d keys per batch, ns/key\n", BENCH_BATCH_PAIR_NUM, BENCH_BATCH_KEY_NUM);
+    printf("%8s %12s %12s\n", "engine", "scalar", "batch");
+    for (int i = 0; i < 2; i++)
+    {
+        memset(&conf, 0, sizeof(kv_conf_t));
+        conf.bucket_num = 1024;
+        conf.engine = engines[i];
+        kv_create(&set, &conf);
+        for (size_t j = 0; j < BENCH_BATCH_PAIR_NUM; j++)
+        {
+            kv_put(set, key_bufs[j], "value");
+        }
+
+        start = bench_now();
+        for (size_t j = 0; j < BENCH_BATCH_PAIR_NUM; j++)
+        {
+            kv_get(set, keys[j], values + j % BENCH_BATCH_KEY_NUM);
+        }
+        scalar_ns = (bench_now() - start) * 1e9 / BENCH_BATCH_PAIR_NUM;
+
+        start = bench_now();
+        for (size_t j = 0; j < BENCH_BATCH_PAIR_NUM; j += BENCH_BATCH_KEY_NUM)
+        {
+            kv_get_batch(set, keys + j, BENCH_BATCH_KEY_NUM, values);
+        }
+        batch_ns = (bench_now() - start) * 1e9 / BENCH_BATCH_PAIR_NUM;
+
+        printf("%8s %12.1f %12.1f\n", engine_names[i], scalar_ns, batch_ns);
+        kv_destroy(set);
+    }
+
+    free(keys);
+    free(key_bufs);
+}
+
+static void bench_image(void)
+{
+    kv_set_t *set;
+    kv_set_t *mapped_set;
+    const char *value;
+    char key[32];
+    double start;
+    double build_ms;
+    double open_ms;
+
+    start = bench_now();
+    kv_create(&set, NULL);
+    for (size_t i = 0; i < BENCH_BATCH_PAIR_NUM; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        kv_put(set, key, "value");
+    }
+    build_ms = (bench_now() - start) * 1e3;
+    kv_save(set, "bench.kvimage");
+    kv_destroy(set);
+
+    start = bench_now();
+    kv_open_mapped(&mapped_set, "bench.kvimage", NULL);
+    kv_get(mapped_set, "key-0", &value);
+    open_ms = (bench_now() - start) * 1e3;
+    kv_destroy(mapped_set);
+    remove("bench.kvimage");
+
+    printf("cold start, %d pairs, ms\n", BENCH_BATCH_PAIR_NUM);
+    printf("%12s %12s\n", "kv_put", "mapped");
+    printf("%12.1f %12.1f\n", build_ms, open_ms);
+}
+
+/* prefix the full scan filters the keys by */
+static char bench_prefix[32];
+
+static void bench_filter_cb(void *arg, const void *key, size_t key_len, const void *value, size_t value_len)
+{
+    size_t *visit_num = (size_t *)arg;
+    size_t prefix_len = strlen(bench_prefix);
+
+    if (key_len >= prefix_len && memcmp(key, bench_prefix, prefix_len) == 0)
+    {
+        (*visit_num)++;
+    }
+}
+
+static void bench_scan_cb(void *arg, const void *key, size_t key_len, const void *value, size_t value_len)
+{
+    (*(size_t *)arg)++;
+}
+
+static void bench_scan(void)
+{
+    kv_conf_t conf;
+    kv_set_t *set;
+    size_t visit_num;
+    uint64_t seed;
+    char key[32];
+    double start;
+    double filter_us;
+    double scan_us;
+
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 1024;
+    conf.ordered = KV_TRUE;
+    kv_create(&set, &conf);
+    for (size_t i = 0; i < BENCH_PAIR_NUM; i++)
+    {
+        sprintf(key, "user:%05zu:%zu", i / 10, i % 10);
+        kv_put(set, key, "value");
+    }
+
+    seed = 1;
+    visit_num = 0;
+    start = bench_now();
+    for (size_t i = 0; i < BENCH_SCAN_NUM / 100; i++)
+    {
+        sprintf(bench_prefix, "user:%05llu:", (unsigned long long)(bench_rand(&seed) % (BENCH_PAIR_NUM / 10)));
+        kv_foreach_n(set, bench_filter_cb, &visit_num);
+    }
+    filter_us = (bench_now() - start) * 1e6 / (BENCH_SCAN_NUM / 100);
+
+    start = bench_now();
+    for (size_t i = 0; i < BENCH_SCAN_NUM; i++)
+    {
+        sprintf(bench_prefix, "user:%05llu:", (unsigned long long)(bench_rand(&seed) % (BENCH_PAIR_NUM / 10)));
+        kv_scan_prefix(set, bench_prefix, strlen(bench_prefix), bench_scan_cb, &visit_num);
+    }
+    scan_us = (bench_now() - start) * 1e6 / BENCH_SCAN_NUM;
+    kv_destroy(set);
+
+    printf("prefix scan, %d pairs, 10 pairs per prefix, us/scan\n", BENCH_PAIR_NUM);
+    printf("%12s %12s\n", "filter", "ordered");
+    printf("%12.1f %12.1f\n", filter_us, scan_us);
+}
+
+static void bench_engine(void)
+{
+    static const int engines[] = {KV_ENGINE_CHAIN, KV_ENGINE_FLAT, KV_ENGINE_ART};
+    static const char *engine_names[] = {"chain", "flat", "art"};
+    kv_conf_t conf;
+    kv_set_t *set;
+    char (*key_bufs)[64];
+    const char *value;
+    uint64_t seed;
+    double start;
+    double put_ns;
+    double get_ns;
+
+    key_bufs = (char (*)[64])malloc(BENCH_PATH_NUM * sizeof(*key_bufs));
+    for (size_t i = 0; i < BENCH_PATH_NUM; i++)
+    {
+        sprintf(key_bufs[i], "/home/user/projects/repo-%zu/src/module-%zu/file-%zu.c", i % 16, i / 16 % 64, i);
+    }
+
+    printf("hierarchical keys, %d pairs, ns/key\n", BENCH_PATH_NUM);
+    printf("%8s %12s %12s\n", "engine", "put", "get");
+    for (int i = 0; i < 3; i++)
+    {
+        memset(&conf, 0, sizeof(kv_conf_t));
+        conf.bucket_num = 1024;
+        conf.engine = engines[i];
+        kv_create(&set, &conf);
+
+        start = bench_now();
+        for (size_t j = 0; j < BENCH_PATH_NUM; j++)
+        {
+            kv_put(set, key_bufs[j], "value");
+        }
+        put_ns = (bench_now() - start) * 1e9 / BENCH_PATH_NUM;
+
+        seed = 1;
+        start = bench_now();
+        for (size_t j = 0; j < BENCH_PATH_NUM; j++)
+        {
+            kv_get(set, key_bufs[bench_rand(&seed) % BENCH_PATH_NUM], &value);
+        }
+        get_ns = (bench_now() - start) * 1e9 / BENCH_PATH_NUM;
+
+        printf("%8s %12.1f %12.1f\n", engine_names[i], put_ns, get_ns);
+        kv_destroy(set);
+    }
+
+    free(key_bufs);
+}
+
+static void bench_frozen(void)
+{
+    kv_conf_t conf;
+    kv_set_t *set;
+    kv_frozen_t *frozen;
+    kv_stats_t stats;
+    char (*key_bufs)[16];
+    const char *value;
+    uint64_t seed;
+    double start;
+    double freeze_ms;
+    double set_ns;
+    double frozen_ns;
+
+    key_bufs = (char (*)[16])malloc(BENCH_BATCH_PAIR_NUM * sizeof(*key_bufs));
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 1024;
+    conf.arena_size = 1 << 20;
+    kv_create(&set, &conf);
+    for (size_t i = 0; i < BENCH_BATCH_PAIR_NUM; i++)
+    {
+        sprintf(key_bufs[i], "key-%zu", i);
+        kv_put(set, key_bufs[i], "value");
+    }
+    kv_stats(set, &stats);
+
+    start = bench_now();
+    kv_freeze(set, &frozen);
+    freeze_ms = (bench_now() - start) * 1e3;
+
+    seed = 1;
+    start = bench_now();
+    for (size_t i = 0; i < BENCH_BATCH_PAIR_NUM; i++)
+    {
+        kv_get(set, key_bufs[bench_rand(&seed) % BENCH_BATCH_PAIR_NUM], &value);
+    }
+    set_ns = (bench_now() - start) * 1e9 / BENCH_BATCH_PAIR_NUM;
+
+    seed = 1;
+    start = bench_now();
+    for (size_t i = 0; i < BENCH_BATCH_PAIR_NUM; i++)
+    {
+        kv_frozen_get(frozen, key_bufs[bench_rand(&seed) % BENCH_BATCH_PAIR_NUM], &value);
+    }
+    frozen_ns = (bench_now() - start) * 1e9 / BENCH_BATCH_PAIR_NUM;
+
+    printf("frozen set, %d pairs, freeze %.1f ms\n", BENCH_BATCH_PAIR_NUM, freeze_ms);
+    printf("%8s %12s %12s\n", "", "bytes/key", "get ns/key");
+    printf("%8s %12.1f %12.1f\n", "chain",
+           (double)(stats.arena_reserved + stats.bucket_num * sizeof(kv_bucket_t *)) / BENCH_BATCH_PAIR_NUM, set_ns);
+    printf("%8s %12.1f %12.1f\n", "frozen", (double)frozen->size / BENCH_BATCH_PAIR_NUM, frozen_ns);
+
+    kv_frozen_destroy(frozen);
+    kv_destroy(set);
+    free(key_bufs);
+}
+
+static void bench_wal(void)
+{
+    static const int syncs[] = {KV_SYNC_NONE, KV_SYNC_GROUP, KV_SYNC_ALWAYS};
+    static const char *sync_names[] = {"none", "group", "always"};
+    kv_conf_t conf;
+    kv_set_t *set;
+    size_t put_num;
+    char key[32];
+    double start;
+    double mem_kops;
+    double kops[3];
+
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 1024;
+    start = bench_now();
+    kv_create(&set, &conf);
+    for (size_t i = 0; i < BENCH_WAL_PUT_NUM; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        kv_put(set, key, "value");
+    }
+    kv_destroy(set);
+    mem_kops = BENCH_WAL_PUT_NUM / (bench_now() - start) / 1e3;
+
+    conf.wal_path = "bench.kvwal";
+    for (int i = 0; i < 3; i++)
+    {
+        put_num = syncs[i] == KV_SYNC_ALWAYS ? BENCH_WAL_SYNC_PUT_NUM : BENCH_WAL_PUT_NUM;
+        remove(conf.wal_path);
+        conf.wal_sync = syncs[i];
+        start = bench_now();
+        kv_create(&set, &conf);
+        for (size_t j = 0; j < put_num; j++)
+        {
+            sprintf(key, "key-%zu", j);
+            kv_put(set, key, "value");
+        }
+        kv_destroy(set);
+        kops[i] = put_num / (bench_now() - start) / 1e3;
+    }
+    remove(conf.wal_path);
+
+    printf("durable puts, fsync policy, Kops/s\n");
+    printf("%12s %12s %12s %12s\n", "memory", sync_names[0], sync_names[1], sync_names[2]);
+    printf("%12.1f %12.1f %12.1f %12.1f\n", mem_kops, kops[0], kops[1], kops[2]);
+}
+
+static void bench_cache(void)
+{
+    static const size_t percents[] = {1, 5, 20, 100};
+    kv_conf_t conf;
+    kv_set_t *set;
+    kv_stats_t stats;
+    char key[32];
+    const char *value;
+    uint64_t seed;
+    size_t full_bytes;
+    double start;
+    double ns;
+
+    /* bytes of the buckets of all the keys, measured with an unbounded cache */
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 1024;
+    conf.cache_bytes = SIZE_MAX;
+    kv_create(&set, &conf);
+    for (size_t i = 0; i < BENCH_CACHE_KEY_NUM; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        kv_put(set, key, "value of the key");
+    }
+    kv_stats(set, &stats);
+    full_bytes = stats.cache_used;
+    kv_destroy(set);
+
+    printf("cache-aside lookups, %d keys with zipf-like popularity\n", BENCH_CACHE_KEY_NUM);
+    printf("%8s %12s %12s %12s\n", "budget", "hit rate", "evictions", "ns/op");
+    for (int i = 0; i < 4; i++)
+    {
+        conf.cache_bytes = full_bytes / 100 * percents[i];
+        kv_create(&set, &conf);
+
+        /* the popularity of the keys falls off as 1/rank, a miss puts the key */
+        seed = 1;
+        start = bench_now();
+        for (size_t j = 0; j < BENCH_CACHE_OP_NUM; j++)
+        {
+            sprintf(key, "key-%zu", (size_t)pow(BENCH_CACHE_KEY_NUM, bench_rand(&seed) / 2147483648.0) - 1);
+            if (kv_get(set, key, &value) != KV_OK)
+            {
+                kv_put(set, key, "value of the key");
+            }
+        }
+        ns = (bench_now() - start) * 1e9 / BENCH_CACHE_OP_NUM;
+
+        kv_stats(set, &stats);
+        printf("%7zu%% %11.1f%% %12llu %12.1f\n", percents[i],
+               100.0 * stats.cache_hits / (stats.cache_hits + stats.cache_misses),
+               (unsigned long long)stats.cache_evictions, ns);
+        kv_destroy(set);
+    }
+}
+
+static void bench_count_cb(void *arg, const char *key, const char *value)
+{
+    (*(size_t *)arg) += (size_t)value[0];
+}
+
+static void bench_foreach(void)
+{
+    static const int engines[] = {KV_ENGINE_CHAIN, KV_ENGINE_FLAT, KV_ENGINE_ART, KV_ENGINE_COMPACT};
+    static const char *engine_names[] = {"chain", "flat", "art", "compact"};
+    kv_conf_t conf;
+    kv_set_t *set;
+    char key[32];
+    size_t sum;
+    double start;
+    double ns;
+
+    printf("full iteration, %d pairs, ns/pair\n", BENCH_BATCH_PAIR_NUM);
+    printf("%8s %12s\n", "engine", "foreach");
+    for (int i = 0; i < 4; i++)
+    {
+        memset(&conf, 0, sizeof(kv_conf_t));
+        conf.bucket_num = 1024;
+        conf.engine = engines[i];
+        kv_create(&set, &conf);
+        for (size_t j = 0; j < BENCH_BATCH_PAIR_NUM; j++)
+        {
+            sprintf(key, "key-%zu", j);
+            kv_put(set, key, "value");
+        }
+
+        sum = 0;
+        start = bench_now();
+        kv_foreach(set, bench_count_cb, &sum);
+        ns = (bench_now() - start) * 1e9 / BENCH_BATCH_PAIR_NUM;
+
+        printf("%8s %12.1f\n", engine_names[i], ns);
+        kv_destroy(set);
+    }
+}
+
+static uint64_t bench_clock_ms;
+
+static uint64_t bench_clock(void)
+{
+    return bench_clock_ms;
+}
+
+static void bench_sweep_cb(void *arg, const char *key, const char *value)
+{
+    /* the old way, the deadline is kept in the value and checked one by one */
+    if (strtoull(value, NULL, 10) <= bench_clock_ms)
+    {
+        (*(size_t *)arg)++;
+    }
+}
+
+static void bench_ttl(void)
+{
+    static const size_t pair_nums[] = {100000, 1000000, 4000000};
+    kv_conf_t conf;
+    kv_set_t *set;
+    size_t expired_num;
+    char key[32];
+    char value[32];
+    double start;
+    double sweep_us;
+    double wheel_us;
+
+    printf("expiry, %d pairs expiring per second, us per second\n", BENCH_TTL_RATE);
+    printf("%8s %12s %12s\n", "pairs", "sweep", "wheel");
+    for (int i = 0; i < 3; i++)
+    {
+        memset(&conf, 0, sizeof(kv_conf_t));
+        conf.bucket_num = 1024;
+        conf.ttl = KV_TRUE;
+        conf.clock_cb = bench_clock;
+        conf.arena_size = 1 << 20;
+        bench_clock_ms = 0;
+        kv_create(&set, &conf);
+
+        /* the long-lived pairs make up the most of the set */
+        for (size_t j = 0; j < pair_nums[i]; j++)
+        {
+            sprintf(key, "key-%zu", j);
+            if (j < BENCH_TTL_RATE * BENCH_TTL_SECOND_NUM)
+            {
+                sprintf(value, "%zu", (j / BENCH_TTL_RATE + 1) * 1000);
+                kv_put_ttl(set, key, value, (j / BENCH_TTL_RATE + 1) * 1000);
+            }
+            else
+            {
+                kv_put(set, key, "18446744073709551615");
+            }
+        }
+
+        sweep_us = 0;
+        wheel_us = 0;
+        for (int j = 0; j < BENCH_TTL_SECOND_NUM; j++)
+        {
+            bench_clock_ms += 1000;
+
+            start = bench_now();
+            kv_expire(set, SIZE_MAX);
+            wheel_us += (bench_now() - start) * 1e6;
+
+            /* the wheel left nothing for the sweep, which visits every pair anyway */
+            expired_num = 0;
+            start = bench_now();
+            kv_foreach(set, bench_sweep_cb, &expired_num);
+            sweep_us += (bench_now() - start) * 1e6;
+        }
+
+        printf("%8zu %12.1f %12.1f\n", pair_nums[i], sweep_us / BENCH_TTL_SECOND_NUM, wheel_us / BENCH_TTL_SECOND_NUM);
+        kv_destroy(set);
+    }
+}
+
+static const void *bench_upsert_cb(void *arg, const void *value, size_t value_len, size_t *new_len)
+{
+    uint64_t *count = (uint64_t *)arg;
+
+    *count = 1;
+    if (value != NULL)
+    {
+        memcpy(count, value, sizeof(uint64_t));
+        (*count)++;
+    }
+    *new_len = sizeof(uint64_t);
+
+    return count;
+}
+
+static void bench_upsert(void)
+{
+    kv_conf_t conf;
+    kv_set_t *set;
+    char key[32];
+    int key_len;
+    uint64_t count;
+    const void *value;
+    size_t value_len;
+    uint64_t seed;
+    double start;
+    double lookup_ns;
+    double upsert_ns;
+
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 1024;
+
+    /* the old way, the key is hashed and looked up by the get, then by the put */
+    kv_create(&set, &conf);
+    seed = 1;
+    start = bench_now();
+    for (size_t i = 0; i < BENCH_COUNT_OP_NUM; i++)
+    {
+        key_len = sprintf(key, "word-%llu", (unsigned long long)(bench_rand(&seed) % BENCH_COUNT_KEY_NUM));
+        count = 1;
+        if (kv_get_n(set, key, key_len, &value, &value_len) == KV_OK)
+        {
+            memcpy(&count, value, sizeof(uint64_t));
+            count++;
+        }
+        kv_put_n(set, key, key_len, &count, sizeof(uint64_t));
+    }
+    lookup_ns = (bench_now() - start) * 1e9 / BENCH_COUNT_OP_NUM;
+    kv_destroy(set);
+
+    kv_create(&set, &conf);
+    seed = 1;
+    start = bench_now();
+    for (size_t i = 0; i < BENCH_COUNT_OP_NUM; i++)
+    {
+        key_len = sprintf(key, "word-%llu", (unsigned long long)(bench_rand(&seed) % BENCH_COUNT_KEY_NUM));
+        kv_upsert_n(set, key, key_len, bench_upsert_cb, &count);
+    }
+    upsert_ns = (bench_now() - start) * 1e9 / BENCH_COUNT_OP_NUM;
+    kv_destroy(set);
+
+    printf("counting, %d increments of %d keys, ns/op\n", BENCH_COUNT_OP_NUM, BENCH_COUNT_KEY_NUM);
+    printf("%12s %12s\n", "get+put", "upsert");
+    printf("%12.1f %12.1f\n", lookup_ns, upsert_ns);
+}
+
+/**
+ * @brief get the resident memory of the process in bytes.
+ */
+static size_t bench_rss(void)
+{
+    FILE *file;
+    size_t pages;
+
+    pages = 0;
+    file = fopen("/proc/self/statm", "r");
+    if (file != NULL)
+    {
+        if (fscanf(file, "%*s %zu", &pages) != 1)
+        {
+            pages = 0;
+        }
+        fclose(file);
+    }
+
+    return pages * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static void bench_short(void)
+{
+    static const char *alloc_names[] = {"malloc", "pool", "arena"};
+    kv_conf_t conf;
+    kv_set_t *set;
+    char key[32];
+    char value[32];
+    const char *found;
+    uint64_t seed;
+    size_t index;
+    size_t rss;
+    double start;
+    double ns;
+
+    printf("short pairs, %d keys of 8-20 bytes with values of 8-23 bytes\n", BENCH_SHORT_PAIR_NUM);
+    printf("%8s %12s %12s\n", "alloc", "get ns", "rss B/pair");
+    for (int i = 0; i < 3; i++)
+    {
+        memset(&conf, 0, sizeof(kv_conf_t));
+        conf.bucket_num = 1024;
+        conf.pool = i == 1 ? KV_TRUE : KV_FALSE;
+        conf.arena_size = i == 2 ? 1 << 20 : 0;
+
+        malloc_trim(0);
+        rss = bench_rss();
+        kv_create(&set, &conf);
+        for (size_t j = 0; j < BENCH_SHORT_PAIR_NUM; j++)
+        {
+            sprintf(key, "u:%.*zu", (int)(6 + j % 13), j);
+            sprintf(value, "%.*zu", (int)(8 + j % 16), j * 7);
+            kv_put(set, key, value);
+        }
+        rss = bench_rss() - rss;
+
+        seed = 1;
+        start = bench_now();
+        for (size_t j = 0; j < BENCH_OP_NUM * 10; j++)
+        {
+            index = bench_rand(&seed) % BENCH_SHORT_PAIR_NUM;
+            sprintf(key, "u:%.*zu", (int)(6 + index % 13), index);
+            kv_get(set, key, &found);
+        }
+        ns = (bench_now() - start) * 1e9 / (BENCH_OP_NUM * 10);
+
+        printf("%8s %12.1f %12.1f\n", alloc_names[i], ns, (double)rss / BENCH_SHORT_PAIR_NUM);
+        kv_destroy(set);
+    }
+}
+
+static void bench_bloom(void)
+{
+    static const int engines[] = {KV_ENGINE_CHAIN, KV_ENGINE_FLAT};
+    static const char *engine_names[] = {"chain", "flat"};
+    static const double rates[] = {0, 0.01, 0.001};
+    kv_conf_t conf;
+    kv_set_t *set;
+    kv_stats_t stats;
+    char key[32];
+    uint64_t seed;
+    uint64_t index;
+    double start;
+    double ns;
+
+    printf("lookups, %d pairs, %d%% of %d lookups miss\n", BENCH_BLOOM_PAIR_NUM, BENCH_BLOOM_MISS_RATIO,
+           BENCH_BLOOM_OP_NUM);
+    printf("%8s %8s %12s %12s\n", "engine", "fpp", "ns/op", "MB");
+    for (int i = 0; i < 2; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            memset(&conf, 0, sizeof(kv_conf_t));
+            conf.bucket_num = 1024;
+            conf.engine = engines[i];
+            conf.bloom_fpp = rates[j];
+            kv_create(&set, &conf);
+            for (size_t k = 0; k < BENCH_BLOOM_PAIR_NUM; k++)
+            {
+                sprintf(key, "key-%zu", k);
+                kv_put(set, key, "value");
+            }
+
+            /* the missing keys look like the others */
+            seed = 1;
+            start = bench_now();
+            for (size_t k = 0; k < BENCH_BLOOM_OP_NUM; k++)
+            {
+                index = bench_rand(&seed);
+                if (index % 100 < BENCH_BLOOM_MISS_RATIO)
+                {
+                    sprintf(key, "key-%llu", (unsigned long long)(BENCH_BLOOM_PAIR_NUM + index));
+                }
+                else
+                {
+                    sprintf(key, "key-%llu", (unsigned long long)(index % BENCH_BLOOM_PAIR_NUM));
+                }
+                kv_contain(set, key);
+            }
+            ns = (bench_now() - start) * 1e9 / BENCH_BLOOM_OP_NUM;
+
+            kv_stats(set, &stats);
+            printf("%8s %8.3f %12.1f %12.1f\n", engine_names[i], rates[j], ns, stats.memory_bytes / 1048576.0);
+            kv_destroy(set);
+        }
+    }
+}
+
+KV_MAP_INIT(u64, uint64_t, uint64_t, kv_map_hash_u64, kv_map_equal)
+
+static void bench_map(void)
+{
+    static const char *kind_names[] = {"string", "binary", "typed"};
+    kv_conf_t conf;
+    kv_set_t *set;
+    kv_map_u64_t *map;
+    char key[32];
+    int key_len;
+    uint64_t value;
+    const void *found;
+    size_t found_len;
+    uint64_t seed;
+    uint64_t index;
+    double start;
+    double put_ns;
+    double get_ns;
+
+    printf("integer keys, %d pairs, %d lookups, ns/op\n", BENCH_MAP_PAIR_NUM, BENCH_MAP_OP_NUM);
+    printf("%8s %12s %12s\n", "keys", "put", "get");
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 1024;
+    conf.engine = KV_ENGINE_FLAT;
+
+    /* the keys formatted as decimal strings, then as their 8 bytes, both boxed in buckets */
+    for (int i = 0; i < 2; i++)
+    {
+        kv_create(&set, &conf);
+        start = bench_now();
+        for (uint64_t j = 0; j < BENCH_MAP_PAIR_NUM; j++)
+        {
+            value = j * 3;
+            if (i == 0)
+            {
+                key_len = sprintf(key, "%llu", (unsigned long long)(j * 7));
+                kv_put_n(set, key, key_len, &value, sizeof(uint64_t));
+            }
+            else
+            {
+                index = j * 7;
+                kv_put_n(set, &index, sizeof(uint64_t), &value, sizeof(uint64_t));
+            }
+        }
+        put_ns = (bench_now() - start) * 1e9 / BENCH_MAP_PAIR_NUM;
+
+        seed = 1;
+        start = bench_now();
+        for (size_t j = 0; j < BENCH_MAP_OP_NUM; j++)
+        {
+            index = bench_rand(&seed) % BENCH_MAP_PAIR_NUM * 7;
+            if (i == 0)
+            {
+                key_len = sprintf(key, "%llu", (unsigned long long)index);
+                kv_get_n(set, key, key_len, &found, &found_len);
+            }
+            else
+            {
+                kv_get_n(set, &index, sizeof(uint64_t), &found, &found_len);
+            }
+        }
+        get_ns = (bench_now() - start) * 1e9 / BENCH_MAP_OP_NUM;
+
+        printf("%8s %12.1f %12.1f\n", kind_names[i], put_ns, get_ns);
+        kv_destroy(set);
+    }
+
+    kv_map_u64_create(&map, 1024);
+    start = bench_now();
+    for (uint64_t j = 0; j < BENCH_MAP_PAIR_NUM; j++)
+    {
+        kv_map_u64_put(map, j * 7, j * 3);
+    }
+    put_ns = (bench_now() - start) * 1e9 / BENCH_MAP_PAIR_NUM;
+
+    seed = 1;
+    start = bench_now();
+    for (size_t j = 0; j < BENCH_MAP_OP_NUM; j++)
+    {
+        kv_map_u64_get(map, bench_rand(&seed) % BENCH_MAP_PAIR_NUM * 7, &value);
+    }
+    get_ns = (bench_now() - start) * 1e9 / BENCH_MAP_OP_NUM;
+
+    printf("%8s %12.1f %12.1f\n", kind_names[2], put_ns, get_ns);
+    kv_map_u64_destroy(map);
+}
+
+static void bench_shard_count_cb(void *arg, const char *key, const char *value)
+{
+    (*(size_t *)arg)++;
+}
+
+static void bench_shard(void)
+{
+    kv_stripe_conf_t conf;
+    kv_stripe_set_t *set;
+    char **keys;
+    char **values;
+    size_t counts[BENCH_SHARD_THREAD_NUM * 8];
+    void *args[BENCH_SHARD_THREAD_NUM];
+    double start;
+    double load_ms;
+    double foreach_ms;
+    double clear_ms;
+
+    keys = (char **)malloc(BENCH_SHARD_PAIR_NUM * sizeof(char *));
+    values = (char **)malloc(BENCH_SHARD_PAIR_NUM * sizeof(char *));
+    for (size_t i = 0; i < BENCH_SHARD_PAIR_NUM; i++)
+    {
+        keys[i] = (char *)malloc(32);
+        values[i] = (char *)malloc(32);
+        sprintf(keys[i], "key-%zu", i);
+        sprintf(values[i], "value-%zu", i);
+    }
+
+    /* the counters of the threads are a cache line apart */
+    for (size_t i = 0; i < BENCH_SHARD_THREAD_NUM; i++)
+    {
+        args[i] = counts + i * 8;
+    }
+
+    memset(&conf, 0, sizeof(kv_stripe_conf_t));
+    conf.stripe_num = 64;
+
+    kv_stripe_create(&set, &conf);
+    start = bench_now();
+    for (size_t i = 0; i < BENCH_SHARD_PAIR_NUM; i++)
+    {
+        kv_stripe_put(set, keys[i], values[i]);
+    }
+    load_ms = (bench_now() - start) * 1e3;
+    kv_stripe_destroy(set);
+
+    printf("sharded set, %d pairs in %zu shards, %ld cpus, ms\n", BENCH_SHARD_PAIR_NUM, conf.stripe_num,
+           sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%8s %12s %12s %12s\n", "threads", "load", "foreach", "clear");
+    printf("%8s %12.1f\n", "put", load_ms);
+    for (size_t thread_num = 1; thread_num <= BENCH_SHARD_THREAD_NUM; thread_num *= 2)
+    {
+        kv_stripe_create(&set, &conf);
+        start = bench_now();
+        kv_stripe_bulk_load(set, thread_num, (const char *const *)keys, (const char *const *)values,
+                            BENCH_SHARD_PAIR_NUM);
+        load_ms = (bench_now() - start) * 1e3;
+
+        start = bench_now();
+        kv_stripe_foreach_parallel(set, thread_num, bench_shard_count_cb, args);
+        foreach_ms = (bench_now() - start) * 1e3;
+
+        start = bench_now();
+        kv_stripe_clear_parallel(set, thread_num);
+        clear_ms = (bench_now() - start) * 1e3;
+
+        printf("%8zu %12.1f %12.1f %12.1f\n", thread_num, load_ms, foreach_ms, clear_ms);
+        kv_stripe_destroy(set);
+    }
+
+    for (size_t i = 0; i < BENCH_SHARD_PAIR_NUM; i++)
+    {
+        free(keys[i]);
+        free(values[i]);
+    }
+    free(keys);
+    free(values);
+}
+
+static void bench_copy_cb(void *arg, const char *key, const char *value)
+{
+    kv_put((kv_set_t *)arg, key, value);
+}
+
+/**
+ * @brief put random pairs in the set, return ns per put.
+ */
+static double bench_clone_puts(kv_set_t *set)
+{
+    char key[32];
+    uint64_t seed;
+    double start;
+
+    seed = 1;
+    start = bench_now();
+    for (size_t i = 0; i < BENCH_CLONE_OP_NUM; i++)
+    {
+        sprintf(key, "key-%llu", (unsigned long long)(bench_rand(&seed) % BENCH_CLONE_PAIR_NUM));
+        kv_put(set, key, "changed");
+    }
+
+    return (bench_now() - start) * 1e9 / BENCH_CLONE_OP_NUM;
+}
+
+static void bench_clone(void)
+{
+    kv_set_t *set;
+    kv_set_t *snapshot;
+    char key[32];
+    double start;
+    double copy_ms;
+    double clone_ms[2];
+    double put_ns[3];
+
+    kv_create(&set, NULL);
+    for (size_t i = 0; i < BENCH_CLONE_PAIR_NUM; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        kv_put(set, key, "value");
+    }
+    put_ns[0] = bench_clone_puts(set);
+
+    /* the old way, every pair is copied into a new set */
+    start = bench_now();
+    kv_create(&snapshot, NULL);
+    kv_foreach(set, bench_copy_cb, snapshot);
+    copy_ms = (bench_now() - start) * 1e3;
+    kv_destroy(snapshot);
+
+    /* the set is still rehashing from its last growth, which goes on in the clone */
+    start = bench_now();
+    kv_clone(set, &snapshot);
+    clone_ms[0] = (bench_now() - start) * 1e3;
+    kv_destroy(snapshot);
+
+    start = bench_now();
+    kv_clone(set, &snapshot);
+    clone_ms[1] = (bench_now() - start) * 1e3;
+
+    /* the first puts copy the pages they modify, the later ones don't */
+    put_ns[1] = bench_clone_puts(set);
+    put_ns[2] = bench_clone_puts(set);
+    kv_destroy(snapshot);
+    kv_destroy(set);
+
+    printf("snapshot, %d pairs, then %d random puts\n", BENCH_CLONE_PAIR_NUM, BENCH_CLONE_OP_NUM);
+    printf("%12s %12s %12s %12s %12s %12s\n", "copy ms", "rehash clone", "clone ms", "put ns", "1st put ns",
+           "2nd put ns");
+    printf("%12.1f %12.2f %12.2f %12.1f %12.1f %12.1f\n", copy_ms, clone_ms[0], clone_ms[1], put_ns[0], put_ns[1],
+           put_ns[2]);
+}
+
+int main(int argc, char *argv[])
+{
+    bench_image();
+    bench_batch();
+    bench_stripe();
+    bench_rcu();
+    bench_wal();
+    bench_scan();
+    bench_engine();
+    bench_frozen();
+    bench_cache();
+    bench_ttl();
+    bench_foreach();
+    bench_upsert();
+    bench_short();
+    bench_bloom();
+    bench_map();
+    bench_shard();
+    bench_clone();
+
+    return 0;
+}
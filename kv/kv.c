@@ -1,8 +1,10 @@
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "kv.h"
+#include "kv_inner.h"
 
 /* default size of bucket pointer array */
 #define DEF_BUCKET_NUM  128
@@ -10,36 +12,344 @@
 /* minimum size of bucket pointer array */
 #define MIN_BUCKET_NUM  16
 
-/* maximum size of bucket pointer array */
+/* maximum initial size of bucket pointer array */
 #define MAX_BUCKET_NUM  1024
 
-/* default hash callback function */
-#define DEF_HASH_CB     djb2
+/* default load factor(in percent) that triggers growing */
+#define DEF_MAX_LOAD    100
 
-static uint32_t djb2(const char *str)
-{
-    uint32_t hash = 5381;
-    int c;
+/* default built-in hash */
+#define DEF_HASH_TYPE   KV_HASH_WYHASH
 
-    while (c = *str++)
-    {
-        hash = ((hash << 5) + hash) + c;
-    }
+/* number of keys kv_get_batch() prefetches ahead of resolving them */
+#define BATCH_NUM       16
 
-    return hash;
-}
+/* number of the expired pairs every operation reclaims at most */
+#define TTL_STEP_NUM    8
 
 /* default configuration */
 static const kv_conf_t def_conf =
 {
     .bucket_num = DEF_BUCKET_NUM,
-    .hash_cb = DEF_HASH_CB,
+    .hash_type = DEF_HASH_TYPE,
+    .max_load = DEF_MAX_LOAD,
+    .engine = KV_ENGINE_CHAIN,
 };
 
+/**
+ * @brief carve memory space from the arena.
+ * @note  a new slab is added if the current one doesn't have enough space
+ *        left, allocations larger than the slab size get their own slabs.
+ * 
+ * @param set   kv set pointer.
+ * @param size  size of the memory space, multiple of 8.
+ * @return  memory pointer, or NULL if out of memory.
+ */
+static void *kv_arena_alloc(kv_set_t *set, size_t size)
+{
+    kv_slab_t *slab;
+    size_t slab_size;
+
+    slab = set->slab;
+    if (slab == NULL || slab->size - slab->used < size)
+    {
+        slab_size = size > set->arena_size ? size : set->arena_size;
+        slab = (kv_slab_t *)malloc(sizeof(kv_slab_t) + slab_size);
+        if (slab == NULL)
+        {
+            return NULL;
+        }
+        slab->size = slab_size;
+        slab->used = 0;
+        slab->next = set->slab;
+        set->slab = slab;
+        set->arena_reserved += slab_size;
+    }
+
+    slab->used += size;
+    set->arena_live += size;
+
+    return slab->data + slab->used - size;
+}
+
+/**
+ * @brief release all the memory space carved from the arena.
+ * @note  one slab is kept for the following allocations if 'keep' is true.
+ * 
+ * @param set   kv set pointer.
+ * @param keep  whether to keep one slab or not.
+ */
+static void kv_arena_reset(kv_set_t *set, int keep)
+{
+    kv_slab_t *curt_slab;
+    kv_slab_t *next_slab;
+    kv_slab_t *kept_slab;
+
+    kept_slab = NULL;
+    next_slab = set->slab;
+    while (next_slab != NULL)
+    {
+        curt_slab = next_slab;
+        next_slab = curt_slab->next;
+        if (keep == KV_TRUE && kept_slab == NULL && curt_slab->size == set->arena_size)
+        {
+            kept_slab = curt_slab;
+            continue;
+        }
+        free(curt_slab);
+    }
+
+    set->slab = kept_slab;
+    set->arena_reserved = 0;
+    set->arena_live = 0;
+    if (kept_slab != NULL)
+    {
+        kept_slab->next = NULL;
+        kept_slab->used = 0;
+        set->arena_reserved = kept_slab->size;
+    }
+}
+
+/**
+ * @brief allocate a bucket holding the copies of the key and value.
+ * @note  both of the copies are null-terminated. the allocation is rounded up to a multiple of 8 bytes, and the slack
+ *        is reserved for the value so it can be overwritten in place later.
+ *        the bucket is carved from the arena if it's enabled, or from the
+ *        pool if it's enabled and the bucket is small. the cache
+ *        entry and the expiry entry of the bucket, if any, are allocated in
+ *        front of it, and zeroed.
+ * 
+ * @param set         kv set pointer.
+ * @param hash        hash value of the key.
+ * @param key         key pointer.
+ * @param key_len     length of the key.
+ * @param value       value pointer.
+ * @param value_len   length of the value.
+ * @return  bucket pointer, or NULL if out of memory.
+ */
+kv_bucket_t *kv_bucket_alloc(kv_set_t *set, uint32_t hash, const char *key, size_t key_len, const char *value, size_t value_len)
+{
+    kv_bucket_t *bucket;
+    char *prefix;
+    size_t malloc_size;
+
+    if (key_len > UINT32_MAX / 2 || value_len > UINT32_MAX / 2)
+    {
+        return NULL;
+    }
+
+    malloc_size = (sizeof(kv_bucket_t) + key_len + 1 + value_len + 1 + 7) & ~(size_t)7;
+    if (set->arena_size != 0)
+    {
+        prefix = (char *)kv_arena_alloc(set, set->bucket_prefix + malloc_size);
+    }
+    else if (set->pool != NULL && set->bucket_prefix + malloc_size <= KV_POOL_MAX_SIZE)
+    {
+        prefix = (char *)kv_pool_alloc(set, set->bucket_prefix + malloc_size);
+    }
+    else
+    {
+        prefix = (char *)malloc(set->bucket_prefix + malloc_size);
+    }
+    if (prefix == NULL)
+    {
+        return NULL;
+    }
+    memset(prefix, 0, set->bucket_prefix);
+    bucket = (kv_bucket_t *)(prefix + set->bucket_prefix);
+
+    bucket->next = NULL;
+    bucket->hash = hash;
+    bucket->key_len = (uint32_t)key_len;
+    bucket->value_len = (uint32_t)value_len;
+    bucket->value_cap = (uint32_t)(malloc_size - sizeof(kv_bucket_t) - key_len - 1);
+    memcpy(KV_BUCKET_KEY(bucket), key, key_len);
+    KV_BUCKET_KEY(bucket)[key_len] = '\0';
+    memcpy(KV_BUCKET_VALUE(bucket), value, value_len);
+    KV_BUCKET_VALUE(bucket)[value_len] = '\0';
+
+    return bucket;
+}
+
+/**
+ * @brief free the bucket along with its key and value.
+ * @note  a bucket carved from the arena isn't reused until the set is cleared.
+ * 
+ * @param set     kv set pointer.
+ * @param bucket  bucket pointer.
+ */
+void kv_bucket_free(kv_set_t *set, kv_bucket_t *bucket)
+{
+    if (set->arena_size != 0)
+    {
+        set->arena_live -= set->bucket_prefix + KV_BUCKET_SIZE(bucket);
+    }
+    else if (set->pool != NULL && set->bucket_prefix + KV_BUCKET_SIZE(bucket) <= KV_POOL_MAX_SIZE)
+    {
+        kv_pool_free(set, (char *)bucket - set->bucket_prefix, set->bucket_prefix + KV_BUCKET_SIZE(bucket));
+    }
+    else
+    {
+        free((char *)bucket - set->bucket_prefix);
+    }
+}
+
+/**
+ * @brief remove the bucket from the set and free it, for the pairs evicted or
+ *        expired.
+ * @note  the removal isn't appended to the log.
+ * 
+ * @param set     kv set pointer.
+ * @param bucket  bucket pointer.
+ */
+void kv_bucket_drop(kv_set_t *set, kv_bucket_t *bucket)
+{
+    set->engine->unlink(set, set->engine->locate(set, KV_BUCKET_KEY(bucket), bucket->key_len, bucket->hash));
+    if (set->index != NULL)
+    {
+        kv_index_remove(set, bucket);
+    }
+    if (set->cache != NULL)
+    {
+        kv_cache_remove(set, bucket);
+    }
+    if (set->wheel != NULL)
+    {
+        kv_ttl_remove(set, bucket);
+    }
+    kv_bucket_free(set, bucket);
+    set->pair_num--;
+    if (set->bloom != NULL)
+    {
+        kv_bloom_remove(set);
+    }
+}
+
+/**
+ * @brief initialize the hash of the set with the configuration.
+ * @note  'conf->hash_n_cb' is preferred over 'conf->hash_cb', and the built-in
+ *        hash selected by 'conf->hash_type' is used if both of them are NULL.
+ * 
+ * @param set   kv set pointer.
+ * @param conf  configuration pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_hash_init(kv_set_t *set, const kv_conf_t *conf)
+{
+    if (conf->hash_n_cb != NULL)
+    {
+        set->hash_n = conf->hash_n_cb;
+        return KV_OK;
+    }
+    if (conf->hash_cb != NULL)
+    {
+        set->hash = conf->hash_cb;
+        return KV_OK;
+    }
+
+    switch (conf->hash_type)
+    {
+    case KV_HASH_WYHASH:
+        set->hash_seeded = kv_wyhash;
+        break;
+
+    case KV_HASH_XXH64:
+        set->hash_seeded = kv_xxh64;
+        break;
+
+    case KV_HASH_DJB2:
+        set->hash_seeded = kv_djb2;
+        break;
+
+    default:
+        return KV_ERR_BAD_CONF;
+    }
+
+    set->hash_seed = conf->hash_seed;
+    if (set->hash_seed == 0)
+    {
+        set->hash_seed = kv_hash_seed(set);
+    }
+
+    return KV_OK;
+}
+
+/**
+ * @brief fill the configuration with the defaults kv_create() uses for NULL.
+ * @note  kv_conf_t grows as features are added, and kv_create() reads every
+ *        field of it, so a configuration on the stack has to start from this
+ *        function (or be zeroed) before the wanted fields are set.
+ * 
+ * @param conf  configuration pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_conf_init(kv_conf_t *conf)
+{
+    if (conf == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    *conf = def_conf;
+
+    return KV_OK;
+}
+
 /**
  * @brief create kv set with specified hash callback function.
- * @note  if 'conf->hash_cb' is NULL, then this function will use default hash
- *        callback function(defined by marco DEF_HASH_CB) for this kv set.
+ * @note  if both 'conf->hash_n_cb' and 'conf->hash_cb' are NULL, then this
+ *        function will use the built-in hash selected by 'conf->hash_type',
+ *        seeded with 'conf->hash_seed' or a random seed if it's 0. a set
+ *        hashing with 'conf->hash_cb' can't be used by the length-delimited
+ *        functions(e.g. kv_put_n()).
+ *        the fields of 'conf' that aren't set must be 0, see kv_conf_init().
+ *        'conf->bucket_num' is only the initial size, the bucket array grows
+ *        once the load factor exceeds 'conf->max_load' percent, and the
+ *        buckets are migrated incrementally by the following operations.
+ *        with 'conf->engine' set to KV_ENGINE_FLAT, the pairs are stored in
+ *        an open addressing table instead, which ignores 'conf->max_load'
+ *        and is rebuilt at once when it's 7/8 full. with KV_ENGINE_ART, the
+ *        pairs are stored in an adaptive radix tree, whose lookups cost
+ *        O(key length) whatever the number of pairs is, and which ignores
+ *        'conf->bucket_num' and 'conf->max_load'. with KV_ENGINE_COMPACT,
+ *        a sparse index of 32-bit positions points into a dense array of
+ *        the buckets kept in insertion order, so kv_foreach() sweeps the
+ *        array linearly and visits the pairs in the order they were first
+ *        put. deletes leave tombstones, which are squeezed out once they
+ *        make up half of the array. 'conf->max_load' is ignored.
+ *        if 'conf->arena_size' isn't 0, the buckets are carved from slabs of
+ *        that size, which are released all at once by kv_clear() and
+ *        kv_destroy().
+ *        if 'conf->wal_path' isn't NULL, the set is rebuilt from that log
+ *        first, then every put, delete and clear is appended to it before
+ *        the set is modified, and fsync'ed according to 'conf->wal_sync'.
+ *        the log is rewritten in the background once most of its records
+ *        are dead.
+ *        if 'conf->ordered' isn't KV_FALSE, the keys are also kept in a
+ *        skiplist, so kv_scan_prefix() and kv_scan_range() visit them in
+ *        order without scanning the whole set. the KV_ENGINE_ART engine
+ *        keeps the keys in order by itself, so it needs no skiplist.
+ *        if 'conf->cache_bytes' isn't 0, the set is a cache: once the
+ *        buckets(the table not included) take more bytes than that, puts
+ *        evict the pairs not got recently, picked by the CLOCK algorithm.
+ *        a cache can't be carved from the arena. the evictions aren't
+ *        appended to the log.
+ *        if 'conf->pool' isn't KV_FALSE, the buckets of short pairs(up to
+ *        KV_POOL_MAX_SIZE bytes) are carved from shared slabs without the
+ *        header of the allocator, and reused through free lists of their
+ *        size classes once freed. it can't be used along with the arena.
+ *        if 'conf->bloom_fpp' isn't 0, a blocked Bloom filter with that false
+ *        positive rate is kept in front of the set, so kv_get() and
+ *        kv_contain() turn most of the missing keys away without looking
+ *        into the set. it's rebuilt as the set grows, and once half of the
+ *        keys in it are deleted, or by kv_rebuild_bloom(). it tests the
+ *        32-bit hashes of the keys, so the rate can't go much below the
+ *        number of the pairs over 2^32.
+ *        if 'conf->ttl' isn't KV_FALSE, the pairs put by kv_put_ttl() expire
+ *        after their time to live, measured with 'conf->clock_cb'. they are
+ *        kept in a hierarchical timer wheel, and every operation reclaims a
+ *        few of the expired ones, besides the one it looks up. such a set
+ *        can't have a log.
  * 
  * @param set   address of kv set pointer.
  * @param conf  configuration pointer.
@@ -47,9 +357,9 @@ static const kv_conf_t def_conf =
  */
 int kv_create(kv_set_t **set, const kv_conf_t *conf)
 {
-    size_t array_size;
     kv_set_t *inner_set;
     const kv_conf_t *real_conf;
+    int res;
 
     if (set == NULL)
     {
@@ -69,80 +379,1247 @@ int kv_create(kv_set_t **set, const kv_conf_t *conf)
     {
         return KV_ERR_BAD_CONF;
     }
-    array_size = sizeof(kv_bucket_t) * real_conf->bucket_num;
+    if ((real_conf->cache_bytes != 0 || real_conf->pool != KV_FALSE) && real_conf->arena_size != 0)
+    {
+        return KV_ERR_BAD_CONF;
+    }
+    if (real_conf->ttl != KV_FALSE && real_conf->wal_path != NULL)
+    {
+        return KV_ERR_BAD_CONF;
+    }
+    if (real_conf->bloom_fpp < 0 || real_conf->bloom_fpp >= 1)
+    {
+        return KV_ERR_BAD_CONF;
+    }
 
     /* allocate memory space for set */
-    inner_set = (kv_set_t *)malloc(sizeof(kv_set_t) + array_size);
+    inner_set = (kv_set_t *)malloc(sizeof(kv_set_t));
     if (inner_set == NULL)
     {
         return KV_ERR_BAD_MEM;
     }
+    memset(inner_set, 0, sizeof(kv_set_t));
+
+    /* pick the storage engine */
+    switch (real_conf->engine)
+    {
+    case KV_ENGINE_CHAIN:
+        inner_set->engine = &kv_chain_engine;
+        break;
+
+    case KV_ENGINE_FLAT:
+        inner_set->engine = &kv_flat_engine;
+        break;
+
+    case KV_ENGINE_ART:
+        inner_set->engine = &kv_art_engine;
+        break;
+
+    case KV_ENGINE_COMPACT:
+        inner_set->engine = &kv_compact_engine;
+        break;
+
+    default:
+        res = KV_ERR_BAD_CONF;
+        goto err_engine;
+    }
 
     /* initialize set and its hash callback function */
-    memset(inner_set, 0, sizeof(kv_set_t));
-    inner_set->bucket_num = real_conf->bucket_num;
-    if (real_conf->hash_cb != NULL)
+    res = kv_hash_init(inner_set, real_conf);
+    if (res != KV_OK)
+    {
+        goto err_engine;
+    }
+    if (real_conf->max_load != 0)
     {
-        inner_set->hash = real_conf->hash_cb;
+        inner_set->max_load = real_conf->max_load;
     }
     else
     {
-        inner_set->hash = DEF_HASH_CB;
+        inner_set->max_load = DEF_MAX_LOAD;
+    }
+    inner_set->arena_size = (real_conf->arena_size + 7) & ~(size_t)7;
+
+    res = inner_set->engine->create(inner_set, real_conf);
+    if (res != KV_OK)
+    {
+        goto err_engine;
+    }
+
+    if (real_conf->pool != KV_FALSE)
+    {
+        res = kv_pool_create(inner_set);
+        if (res != KV_OK)
+        {
+            goto err_pool;
+        }
+    }
+    if (real_conf->bloom_fpp != 0)
+    {
+        res = kv_bloom_create(inner_set, real_conf);
+        if (res != KV_OK)
+        {
+            goto err_bloom;
+        }
+    }
+    if (real_conf->cache_bytes != 0)
+    {
+        res = kv_cache_create(inner_set, real_conf);
+        if (res != KV_OK)
+        {
+            goto err_cache;
+        }
+        inner_set->bucket_prefix += sizeof(kv_cache_entry_t);
+    }
+    if (real_conf->ttl != KV_FALSE)
+    {
+        res = kv_ttl_create(inner_set, real_conf);
+        if (res != KV_OK)
+        {
+            goto err_ttl;
+        }
+        inner_set->bucket_prefix += sizeof(kv_ttl_entry_t);
+    }
+
+    /* the engine may keep the keys in order by itself */
+    if (real_conf->ordered != KV_FALSE && inner_set->engine->scan == NULL)
+    {
+        res = kv_index_create(inner_set);
+        if (res != KV_OK)
+        {
+            goto err_index;
+        }
+    }
+
+    /* rebuild the set from its log */
+    if (real_conf->wal_path != NULL)
+    {
+        res = kv_wal_open(inner_set, real_conf);
+        if (res != KV_OK)
+        {
+            goto err_wal;
+        }
+    }
+
+    *set = inner_set;
+
+    return KV_OK;
+
+err_wal:
+    inner_set->engine->clear(inner_set);
+    kv_arena_reset(inner_set, KV_FALSE);
+    if (inner_set->index != NULL)
+    {
+        kv_index_destroy(inner_set);
+    }
+err_index:
+    if (inner_set->wheel != NULL)
+    {
+        kv_ttl_destroy(inner_set);
+    }
+err_ttl:
+    if (inner_set->cache != NULL)
+    {
+        kv_cache_destroy(inner_set);
+    }
+err_cache:
+    if (inner_set->bloom != NULL)
+    {
+        kv_bloom_destroy(inner_set);
+    }
+err_bloom:
+    if (inner_set->pool != NULL)
+    {
+        kv_pool_destroy(inner_set);
+    }
+err_pool:
+    inner_set->engine->destroy(inner_set);
+err_engine:
+    free(inner_set);
+    return res;
+}
+
+/**
+ * @brief destroy the kv set.
+ * 
+ * @param set kv set pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_destroy(kv_set_t *set)
+{
+    int res;
+
+    if (set == NULL)
+    {
+        res = KV_ERR_BAD_ARG;
+        goto exit;
+    }
+
+    res = KV_OK;
+    if (set->wal != NULL)
+    {
+        res = kv_wal_close(set);
+    }
+    set->engine->clear(set);
+    kv_arena_reset(set, KV_FALSE);
+    if (set->index != NULL)
+    {
+        kv_index_destroy(set);
+    }
+    if (set->cache != NULL)
+    {
+        kv_cache_destroy(set);
+    }
+    if (set->wheel != NULL)
+    {
+        kv_ttl_destroy(set);
+    }
+    if (set->pool != NULL)
+    {
+        kv_pool_destroy(set);
+    }
+    if (set->bloom != NULL)
+    {
+        kv_bloom_destroy(set);
+    }
+    set->engine->destroy(set);
+    free(set);
+
+exit:
+    return res;
+}
+
+/**
+ * @brief get the number of key-value pairs in the kv set.
+ * @note  the value pointed by 'size' won't update if this function doesn't
+ *        return KV_OK.
+ * 
+ * @param set   kv set pointer.
+ * @param size  pointer to variable for storing size.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_size(kv_set_t *set, size_t *size)
+{
+    int res;
+
+    if (set == NULL)
+    {
+        res = KV_ERR_BAD_ARG;
+        goto exit;
+    }
+
+    *size = set->pair_num;
+
+    res = KV_OK;
+exit:
+    return res;
+}
+
+/**
+ * @brief scramble the bits of the hash value returned by the callback, so the
+ *        engines can select buckets with the high bits even if the callback
+ *        leaves them unused.
+ */
+static uint32_t kv_hash_mix(uint32_t hash)
+{
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+/**
+ * @brief hash the key with the length-aware callback or the built-in hash.
+ * @note  the caller makes sure the set doesn't hash with 'conf->hash_cb'.
+ * 
+ * @param set     kv set pointer.
+ * @param key     key pointer.
+ * @param key_len length of the key.
+ * @return  hash value of the key.
+ */
+uint32_t kv_hash_n(kv_set_t *set, const char *key, size_t key_len)
+{
+    uint64_t hash;
+
+    if (set->hash_n != NULL)
+    {
+        return kv_hash_mix(set->hash_n(key, key_len));
+    }
+
+    hash = set->hash_seeded(key, key_len, set->hash_seed);
+    if (set->hash_seeded == kv_djb2)
+    {
+        return kv_hash_mix((uint32_t)hash);
+    }
+
+    return (uint32_t)(hash >> 32) ^ (uint32_t)hash;
+}
+
+/**
+ * @brief hash the null-terminated key string.
+ * 
+ * @param set     kv set pointer.
+ * @param key     key string pointer.
+ * @param key_len length of the key string.
+ * @return  hash value of the key.
+ */
+uint32_t kv_hash_str(kv_set_t *set, const char *key, size_t key_len)
+{
+    if (set->hash != NULL)
+    {
+        return kv_hash_mix(set->hash(key));
+    }
+
+    return kv_hash_n(set, key, key_len);
+}
+
+/**
+ * @brief find the location which points to the bucket holding the key, like
+ *        'locate' of the engine.
+ * @note  if the pairs can expire, a few expired pairs are reclaimed first, and
+ *        the bucket found is reclaimed if it expired, as if it weren't there.
+ * 
+ * @param set     kv set pointer.
+ * @param key     key pointer.
+ * @param key_len length of the key.
+ * @param hash    hash value of the key.
+ * @return  the location found.
+ */
+static kv_bucket_t **kv_locate(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    kv_bucket_t **bucket_next;
+    uint64_t now;
+
+    if (set->wheel == NULL)
+    {
+        return set->engine->locate(set, key, key_len, hash);
+    }
+
+    now = kv_ttl_now(set);
+    kv_ttl_advance(set, now, TTL_STEP_NUM);
+    bucket_next = set->engine->locate(set, key, key_len, hash);
+    if (*bucket_next != NULL && kv_ttl_expired(set, *bucket_next, now) == KV_TRUE)
+    {
+        kv_bucket_drop(set, *bucket_next);
+        bucket_next = set->engine->locate(set, key, key_len, hash);
+    }
+
+    return bucket_next;
+}
+
+/**
+ * @brief find the bucket holding the key for a read.
+ * @note  the Bloom filter is tested first. if member 'read_shared' of the set
+ *        is set, the readers share a lock(or the read-only image), so the
+ *        set isn't modified: no
+ *        expired pair is reclaimed, and the expired bucket found is only
+ *        treated as missing.
+ * 
+ * @param set     kv set pointer.
+ * @param key     key pointer.
+ * @param key_len length of the key.
+ * @param hash    hash value of the key.
+ * @return  the bucket found, or NULL.
+ */
+static kv_bucket_t *kv_lookup(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    kv_bucket_t *curt_bucket;
+
+    if (set->bloom != NULL && kv_bloom_test(set, hash) == KV_FALSE)
+    {
+        return NULL;
+    }
+
+    if (set->read_shared == KV_FALSE)
+    {
+        return *kv_locate(set, key, key_len, hash);
+    }
+
+    curt_bucket = set->engine->find(set, key, key_len, hash);
+    if (curt_bucket != NULL && set->wheel != NULL &&
+        kv_ttl_expired(set, curt_bucket, kv_ttl_now(set)) == KV_TRUE)
+    {
+        return NULL;
+    }
+
+    return curt_bucket;
+}
+
+int kv_contain_hashed(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    KV_STATS_INC(set, lookup_num);
+    if (kv_lookup(set, key, key_len, hash) == NULL)
+    {
+        KV_STATS_INC(set, miss_num);
+        return KV_FALSE;
+    }
+
+    KV_STATS_INC(set, hit_num);
+    return KV_TRUE;
+}
+
+int kv_put_hashed(kv_set_t *set, const char *key, size_t key_len, uint32_t hash,
+                  const char *value, size_t value_len)
+{
+    return kv_put_ttl_hashed(set, key, key_len, hash, value, value_len, 0);
+}
+
+/**
+ * @brief put the pair at the location found by kv_locate(), the log isn't
+ *        written.
+ * @note  the value may point into the bucket being replaced.
+ * 
+ * @param set         kv set pointer.
+ * @param bucket_next location found for the key.
+ * @param hash        hash value of the key.
+ * @param key         key pointer.
+ * @param key_len     length of the key.
+ * @param value       value pointer.
+ * @param value_len   length of the value.
+ * @param deadline    time the pair expires at, 0 if it never expires.
+ * @param bucket      pointer to a variable for storing the bucket put, or NULL.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+static int kv_put_located(kv_set_t *set, kv_bucket_t **bucket_next, uint32_t hash, const char *key,
+                          size_t key_len, const char *value, size_t value_len, uint64_t deadline,
+                          kv_bucket_t **bucket)
+{
+    int res;
+    kv_bucket_t *curt_bucket;
+    kv_bucket_t *new_bucket;
+
+    curt_bucket = *bucket_next;
+
+    /* modify bucket or create new bucket */
+    if (curt_bucket != NULL)
+    {
+        if (value_len < curt_bucket->value_cap)
+        {
+            memmove(KV_BUCKET_VALUE(curt_bucket), value, value_len);
+            KV_BUCKET_VALUE(curt_bucket)[value_len] = '\0';
+            curt_bucket->value_len = (uint32_t)value_len;
+            new_bucket = curt_bucket;
+            if (set->cache != NULL)
+            {
+                KV_CACHE_ENTRY(curt_bucket)->referenced = KV_TRUE;
+            }
+        }
+        else
+        {
+            new_bucket = kv_bucket_alloc(set, hash, key, key_len, value, value_len);
+            if (new_bucket == NULL)
+            {
+                res = KV_ERR_BAD_MEM;
+                goto exit;
+            }
+
+            /* take the place of the old bucket */
+            new_bucket->next = curt_bucket->next;
+            *bucket_next = new_bucket;
+            if (set->index != NULL)
+            {
+                kv_index_replace(set, curt_bucket, new_bucket);
+            }
+            if (set->cache != NULL)
+            {
+                kv_cache_replace(set, curt_bucket, new_bucket);
+            }
+            if (set->wheel != NULL)
+            {
+                kv_ttl_remove(set, curt_bucket);
+            }
+            kv_bucket_free(set, curt_bucket);
+        }
+    }
+    else
+    {
+        new_bucket = kv_bucket_alloc(set, hash, key, key_len, value, value_len);
+        if (new_bucket == NULL)
+        {
+            res = KV_ERR_BAD_MEM;
+            goto exit;
+        }
+
+        if (set->cache != NULL)
+        {
+            res = kv_cache_insert(set, new_bucket);
+            if (res != KV_OK)
+            {
+                kv_bucket_free(set, new_bucket);
+                goto exit;
+            }
+        }
+        if (set->index != NULL)
+        {
+            res = kv_index_insert(set, new_bucket);
+            if (res != KV_OK)
+            {
+                goto err_index;
+            }
+        }
+
+        res = set->engine->link(set, bucket_next, new_bucket);
+        if (res != KV_OK)
+        {
+            if (set->index != NULL)
+            {
+                kv_index_remove(set, new_bucket);
+            }
+            goto err_index;
+        }
+
+        set->pair_num++;
+        if (set->bloom != NULL)
+        {
+            kv_bloom_insert(set, hash);
+        }
+    }
+
+    if (set->wheel != NULL)
+    {
+        kv_ttl_set(set, new_bucket, deadline);
+    }
+    if (set->cache != NULL)
+    {
+        kv_cache_evict(set, new_bucket);
+    }
+    if (bucket != NULL)
+    {
+        *bucket = new_bucket;
+    }
+
+    res = KV_OK;
+exit:
+    return res;
+
+err_index:
+    if (set->cache != NULL)
+    {
+        kv_cache_remove(set, new_bucket);
+    }
+    kv_bucket_free(set, new_bucket);
+    return res;
+}
+
+int kv_put_ttl_hashed(kv_set_t *set, const char *key, size_t key_len, uint32_t hash,
+                      const char *value, size_t value_len, uint64_t deadline)
+{
+    kv_bucket_t *new_bucket;
+    int res;
+
+    if (set->image != NULL)
+    {
+        return KV_ERR_READ_ONLY;
+    }
+    if (set->shared == KV_TRUE)
+    {
+        res = set->engine->own(set, hash);
+        if (res != KV_OK)
+        {
+            return res;
+        }
+    }
+    if (set->wal != NULL)
+    {
+        res = kv_wal_settle(set);
+        if (res != KV_OK)
+        {
+            return res;
+        }
+    }
+
+    res = kv_put_located(set, kv_locate(set, key, key_len, hash), hash, key, key_len, value, value_len,
+                         deadline, &new_bucket);
+
+    if (res == KV_OK && set->wal != NULL)
+    {
+        res = kv_wal_append(set, KV_WAL_PUT, key, key_len, KV_BUCKET_VALUE(new_bucket), new_bucket->value_len);
+        kv_wal_compact(set);
+    }
+
+    return res;
+}
+
+int kv_upsert_hashed(kv_set_t *set, const char *key, size_t key_len, uint32_t hash,
+                     kv_upsert_n_cb_t upsert_cb, void *arg)
+{
+    kv_bucket_t **bucket_next;
+    kv_bucket_t *curt_bucket;
+    const char *value;
+    size_t value_len;
+    uint64_t deadline;
+    int res;
+
+    if (set->image != NULL)
+    {
+        return KV_ERR_READ_ONLY;
+    }
+
+    if (set->shared == KV_TRUE)
+    {
+        res = set->engine->own(set, hash);
+        if (res != KV_OK)
+        {
+            return res;
+        }
+    }
+
+    if (set->wal != NULL)
+    {
+        res = kv_wal_settle(set);
+        if (res != KV_OK)
+        {
+            return res;
+        }
+    }
+
+    bucket_next = kv_locate(set, key, key_len, hash);
+    curt_bucket = *bucket_next;
+    deadline = 0;
+    if (curt_bucket != NULL)
+    {
+        value_len = curt_bucket->value_len;
+        value = upsert_cb(arg, KV_BUCKET_VALUE(curt_bucket), value_len, &value_len);
+        if (set->wheel != NULL)
+        {
+            deadline = KV_TTL_ENTRY(set, curt_bucket)->deadline;
+        }
+    }
+    else
+    {
+        value_len = 0;
+        value = upsert_cb(arg, NULL, 0, &value_len);
+    }
+    if (value == NULL)
+    {
+        return KV_OK;
+    }
+
+    /* the value may point into the old bucket, log the one put instead */
+    res = kv_put_located(set, bucket_next, hash, key, key_len, value, value_len, deadline, &curt_bucket);
+
+    if (res == KV_OK && set->wal != NULL)
+    {
+        res = kv_wal_append(set, KV_WAL_PUT, key, key_len, KV_BUCKET_VALUE(curt_bucket), curt_bucket->value_len);
+        kv_wal_compact(set);
+    }
+
+    return res;
+}
+
+int kv_get_or_insert_hashed(kv_set_t *set, const char *key, size_t key_len, uint32_t hash,
+                            const char *value, size_t value_len, char **slot, size_t *slot_len)
+{
+    kv_bucket_t **bucket_next;
+    kv_bucket_t *curt_bucket;
+    int res;
+
+    if (set->image != NULL)
+    {
+        return KV_ERR_READ_ONLY;
+    }
+
+    if (set->shared == KV_TRUE)
+    {
+        res = set->engine->own(set, hash);
+        if (res != KV_OK)
+        {
+            return res;
+        }
+    }
+
+    if (set->wal != NULL)
+    {
+        res = kv_wal_settle(set);
+        if (res != KV_OK)
+        {
+            return res;
+        }
+    }
+
+    KV_STATS_INC(set, lookup_num);
+    bucket_next = kv_locate(set, key, key_len, hash);
+    curt_bucket = *bucket_next;
+    if (curt_bucket != NULL)
+    {
+        KV_STATS_INC(set, hit_num);
+        if (set->cache != NULL)
+        {
+            kv_cache_touch(set, curt_bucket);
+        }
+        res = KV_FALSE;
+    }
+    else
+    {
+        KV_STATS_INC(set, miss_num);
+        res = kv_put_located(set, bucket_next, hash, key, key_len, value, value_len, 0, &curt_bucket);
+        /* the log isn't compacted while the slot is held, the next modification does it once settled */
+        if (res == KV_OK && set->wal != NULL)
+        {
+            res = kv_wal_append(set, KV_WAL_PUT, key, key_len, value, value_len);
+        }
+        if (res != KV_OK)
+        {
+            return res;
+        }
+        res = KV_TRUE;
+    }
+
+    /* the value may be written through the slot, it's logged later */
+    if (set->wal != NULL)
+    {
+        kv_wal_hold(set, curt_bucket);
+    }
+
+    *slot = KV_BUCKET_VALUE(curt_bucket);
+    if (slot_len != NULL)
+    {
+        *slot_len = curt_bucket->value_len;
+    }
+
+    return res;
+}
+
+int kv_del_hashed(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    kv_bucket_t **bucket_next;
+    kv_bucket_t *curt_bucket;
+    int res;
+
+    if (set->image != NULL)
+    {
+        return KV_ERR_READ_ONLY;
+    }
+
+    if (set->shared == KV_TRUE)
+    {
+        res = set->engine->own(set, hash);
+        if (res != KV_OK)
+        {
+            return res;
+        }
+    }
+
+    if (set->wal != NULL)
+    {
+        res = kv_wal_settle(set);
+        if (res != KV_OK)
+        {
+            return res;
+        }
+    }
+
+    bucket_next = kv_locate(set, key, key_len, hash);
+    curt_bucket = *bucket_next;
+    if (curt_bucket == NULL)
+    {
+        return KV_ERR_KEY_NOT_FOUND;
+    }
+    if (set->wal != NULL)
+    {
+        res = kv_wal_append(set, KV_WAL_DEL, key, key_len, NULL, 0);
+        if (res != KV_OK)
+        {
+            return res;
+        }
+    }
+
+    set->engine->unlink(set, bucket_next);
+    if (set->index != NULL)
+    {
+        kv_index_remove(set, curt_bucket);
+    }
+    if (set->cache != NULL)
+    {
+        kv_cache_remove(set, curt_bucket);
+    }
+    if (set->wheel != NULL)
+    {
+        kv_ttl_remove(set, curt_bucket);
+    }
+    kv_bucket_free(set, curt_bucket);
+    set->pair_num--;
+    if (set->bloom != NULL)
+    {
+        kv_bloom_remove(set);
+    }
+
+    if (set->wal != NULL)
+    {
+        kv_wal_compact(set);
+    }
+
+    return KV_OK;
+}
+
+int kv_get_hashed(kv_set_t *set, const char *key, size_t key_len, uint32_t hash,
+                  const char **value, size_t *value_len)
+{
+    kv_bucket_t *curt_bucket;
+
+    KV_STATS_INC(set, lookup_num);
+    curt_bucket = kv_lookup(set, key, key_len, hash);
+    if (set->cache != NULL)
+    {
+        kv_cache_touch(set, curt_bucket);
+    }
+    if (curt_bucket == NULL)
+    {
+        KV_STATS_INC(set, miss_num);
+        return KV_ERR_KEY_NOT_FOUND;
+    }
+    KV_STATS_INC(set, hit_num);
+
+    *value = KV_BUCKET_VALUE(curt_bucket);
+    if (value_len != NULL)
+    {
+        *value_len = curt_bucket->value_len;
+    }
+
+    return KV_OK;
+}
+
+/**
+ * @brief check if key is in the kv set or not.
+ * 
+ * @param set kv set pointer.
+ * @param key key string pointer.
+ * @return  return KV_FALSE or KV_TRUE if success, otherwise return other value.
+ */
+int kv_contain(kv_set_t *set, const char *key)
+{
+    size_t key_len;
+
+    if (set == NULL || key == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    key_len = strlen(key);
+
+    return kv_contain_hashed(set, key, key_len, kv_hash_str(set, key, key_len));
+}
+
+/**
+ * @brief put a key-value pair in the kv set.
+ * @note  this function will replace the value corresponding to the specified
+ *        key with the specified value if the specified key already exists in
+ *        this kv set. the value is overwritten in place if it fits in the
+ *        space of the old one, otherwise the bucket is reallocated.
+ * 
+ * @param set   kv set pointer.
+ * @param key   key string pointer.
+ * @param value value string pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_put(kv_set_t *set, const char *key, const char *value)
+{
+    size_t key_len;
+
+    if (set == NULL || key == NULL || value == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    key_len = strlen(key);
+
+    return kv_put_hashed(set, key, key_len, kv_hash_str(set, key, key_len), value, strlen(value));
+}
+
+/**
+ * @brief delete a key-value pair in the kv set.
+ * 
+ * @param set kv set pointer.
+ * @param key key string pointer.
+ * @return  return KV_OK if success, or return KV_ERR_KEY_NOT_FOUND if the 
+ *          specified key isn't found in kv set, otherwise return other value.
+ */
+int kv_del(kv_set_t *set, const char *key)
+{
+    size_t key_len;
+
+    if (set == NULL || key == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    key_len = strlen(key);
+
+    return kv_del_hashed(set, key, key_len, kv_hash_str(set, key, key_len));
+}
+
+/**
+ * @brief get the value string corresponding to the specified key in the kv set.
+ * @note  the value pointed by 'value' won't update if this function doesn't
+ *        return KV_OK.
+ * 
+ * @param set   kv set pointer.
+ * @param key   key string pointer.
+ * @param value pointer to a variable for storing value string pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_get(kv_set_t *set, const char *key, const char **value)
+{
+    size_t key_len;
+
+    if (set == NULL || key == NULL || value == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    key_len = strlen(key);
+
+    return kv_get_hashed(set, key, key_len, kv_hash_str(set, key, key_len), value, NULL);
+}
+
+/**
+ * @brief get the value strings corresponding to the specified keys in the kv
+ *        set.
+ * @note  the keys are handled 16 at a time: all of them are hashed and their
+ *        slots are prefetched first, then the first buckets of the slots are
+ *        prefetched, and the keys are looked up at last, so the cache misses
+ *        of different keys overlap instead of following one another.
+ *        the value of a key which isn't found is set to NULL.
+ * 
+ * @param set     kv set pointer.
+ * @param keys    array of key string pointers.
+ * @param key_num number of the keys.
+ * @param values  array for storing the value string pointers.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_get_batch(kv_set_t *set, const char **keys, size_t key_num, const char **values)
+{
+    uint32_t hashes[BATCH_NUM];
+    size_t key_lens[BATCH_NUM];
+    size_t batch_num;
+    const char **batch_keys;
+    const char **batch_values;
+
+    if (set == NULL || (key_num != 0 && (keys == NULL || values == NULL)))
+    {
+        return KV_ERR_BAD_ARG;
+    }
+    for (size_t i = 0; i < key_num; i++)
+    {
+        if (keys[i] == NULL)
+        {
+            return KV_ERR_BAD_ARG;
+        }
+    }
+
+    for (size_t base = 0; base < key_num; base += batch_num)
+    {
+        batch_num = key_num - base < BATCH_NUM ? key_num - base : BATCH_NUM;
+        batch_keys = keys + base;
+        batch_values = values + base;
+
+        for (size_t i = 0; i < batch_num; i++)
+        {
+            key_lens[i] = strlen(batch_keys[i]);
+            hashes[i] = kv_hash_str(set, batch_keys[i], key_lens[i]);
+            if (set->bloom != NULL)
+            {
+                kv_bloom_prefetch(set, hashes[i]);
+            }
+            set->engine->prefetch(set, hashes[i], 0);
+        }
+        for (size_t i = 0; i < batch_num; i++)
+        {
+            set->engine->prefetch(set, hashes[i], 1);
+        }
+        for (size_t i = 0; i < batch_num; i++)
+        {
+            if (kv_get_hashed(set, batch_keys[i], key_lens[i], hashes[i], batch_values + i, NULL) != KV_OK)
+            {
+                batch_values[i] = NULL;
+            }
+        }
+    }
+
+    return KV_OK;
+}
+
+/**
+ * @brief clear all key-value pairs in the kv set.
+ * @note  if the arena is enabled, the buckets aren't visited at all, and one
+ *        slab is kept for the following puts.
+ * 
+ * @param set kv set pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_clear(kv_set_t *set)
+{
+    int res;
+
+    if (set == NULL)
+    {
+        res = KV_ERR_BAD_ARG;
+        goto exit;
+    }
+    if (set->image != NULL)
+    {
+        res = KV_ERR_READ_ONLY;
+        goto exit;
+    }
+    if (set->wal != NULL)
+    {
+        res = kv_wal_append(set, KV_WAL_CLEAR, NULL, 0, NULL, 0);
+        if (res != KV_OK)
+        {
+            goto exit;
+        }
+    }
+
+    set->engine->clear(set);
+    if (set->arena_size != 0)
+    {
+        kv_arena_reset(set, KV_TRUE);
+    }
+    if (set->pool != NULL)
+    {
+        kv_pool_clear(set);
+    }
+    if (set->bloom != NULL)
+    {
+        kv_bloom_clear(set);
+    }
+    if (set->index != NULL)
+    {
+        kv_index_clear(set);
+    }
+    if (set->cache != NULL)
+    {
+        kv_cache_clear(set);
+    }
+    if (set->wheel != NULL)
+    {
+        kv_ttl_clear(set);
+    }
+
+    set->pair_num = 0;
+
+    res = KV_OK;
+exit:
+    return res;
+}
+
+/* context passed to the bucket visitors of kv_foreach() and kv_foreach_n() */
+typedef struct kv_foreach_ctx
+{
+    kv_foreach_cb_t foreach_cb;
+    kv_foreach_n_cb_t foreach_n_cb;
+    void *arg;
+
+    /* set whose expired pairs are skipped rather than reclaimed, or NULL */
+    kv_set_t *set;
+
+    /* time the pairs are checked against */
+    uint64_t now;
+} kv_foreach_ctx_t;
+
+/**
+ * @brief reclaim the expired pairs before the set is iterated, unless the
+ *        readers share a lock, then they're only skipped by the visitors.
+ */
+static void kv_foreach_expire(kv_set_t *set, kv_foreach_ctx_t *ctx)
+{
+    ctx->set = NULL;
+    if (set->wheel == NULL)
+    {
+        return;
+    }
+
+    if (set->read_shared == KV_FALSE)
+    {
+        kv_ttl_advance(set, kv_ttl_now(set), SIZE_MAX);
+    }
+    else
+    {
+        ctx->set = set;
+        ctx->now = kv_ttl_now(set);
+    }
+}
+
+static void kv_foreach_visit(void *arg, kv_bucket_t *bucket)
+{
+    kv_foreach_ctx_t *ctx = (kv_foreach_ctx_t *)arg;
+
+    if (ctx->set != NULL && kv_ttl_expired(ctx->set, bucket, ctx->now) == KV_TRUE)
+    {
+        return;
+    }
+    ctx->foreach_cb(ctx->arg, KV_BUCKET_KEY(bucket), KV_BUCKET_VALUE(bucket));
+}
+
+static void kv_foreach_n_visit(void *arg, kv_bucket_t *bucket)
+{
+    kv_foreach_ctx_t *ctx = (kv_foreach_ctx_t *)arg;
+
+    if (ctx->set != NULL && kv_ttl_expired(ctx->set, bucket, ctx->now) == KV_TRUE)
+    {
+        return;
+    }
+    ctx->foreach_n_cb(ctx->arg, KV_BUCKET_KEY(bucket), bucket->key_len,
+                      KV_BUCKET_VALUE(bucket), bucket->value_len);
+}
+
+/**
+ * @brief iterate all the key-value pairs in the kv set.
+ * @note  the expired pairs are reclaimed first, or only skipped if the
+ *        readers of the set share a lock.
+ * 
+ * @param set         kv set pointer.
+ * @param foreach_cb  pointer to iteration callback function.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_foreach(kv_set_t *set, kv_foreach_cb_t foreach_cb, void *arg)
+{
+    int res;
+    kv_foreach_ctx_t ctx;
+
+    if (set == NULL || foreach_cb == NULL)
+    {
+        res = KV_ERR_BAD_ARG;
+        goto exit;
+    }
+
+    ctx.foreach_cb = foreach_cb;
+    ctx.arg = arg;
+    kv_foreach_expire(set, &ctx);
+    set->engine->foreach(set, kv_foreach_visit, &ctx);
+
+    res = KV_OK;
+exit:
+    return res;
+}
+
+/**
+ * @brief check if key is in the kv set or not.
+ * @note  the set mustn't hash with a null-terminated string callback.
+ * 
+ * @param set     kv set pointer.
+ * @param key     key pointer.
+ * @param key_len length of the key.
+ * @return  return KV_FALSE or KV_TRUE if success, otherwise return other value.
+ */
+int kv_contain_n(kv_set_t *set, const void *key, size_t key_len)
+{
+    if (set == NULL || key == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+    if (set->hash != NULL)
+    {
+        return KV_ERR_BAD_CONF;
+    }
+
+    return kv_contain_hashed(set, key, key_len, kv_hash_n(set, key, key_len));
+}
+
+/**
+ * @brief put a key-value pair in the kv set, both of them can hold any bytes.
+ * @note  the set mustn't hash with a null-terminated string callback.
+ * 
+ * @param set       kv set pointer.
+ * @param key       key pointer.
+ * @param key_len   length of the key.
+ * @param value     value pointer.
+ * @param value_len length of the value.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_put_n(kv_set_t *set, const void *key, size_t key_len, const void *value, size_t value_len)
+{
+    if (set == NULL || key == NULL || value == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+    if (set->hash != NULL)
+    {
+        return KV_ERR_BAD_CONF;
+    }
+
+    return kv_put_hashed(set, key, key_len, kv_hash_n(set, key, key_len), value, value_len);
+}
+
+/**
+ * @brief delete a key-value pair in the kv set.
+ * @note  the set mustn't hash with a null-terminated string callback.
+ * 
+ * @param set     kv set pointer.
+ * @param key     key pointer.
+ * @param key_len length of the key.
+ * @return  return KV_OK if success, or return KV_ERR_KEY_NOT_FOUND if the
+ *          specified key isn't found in kv set, otherwise return other value.
+ */
+int kv_del_n(kv_set_t *set, const void *key, size_t key_len)
+{
+    if (set == NULL || key == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+    if (set->hash != NULL)
+    {
+        return KV_ERR_BAD_CONF;
     }
 
-    *set = inner_set;
-
-    return KV_OK;
+    return kv_del_hashed(set, key, key_len, kv_hash_n(set, key, key_len));
 }
 
 /**
- * @brief destroy the kv set.
+ * @brief get the value corresponding to the specified key in the kv set.
+ * @note  the set mustn't hash with a null-terminated string callback. the
+ *        value points into the set(it's followed by a null-terminator as
+ *        well) and stays valid until the pair is modified or deleted.
  * 
- * @param set kv set pointer.
+ * @param set       kv set pointer.
+ * @param key       key pointer.
+ * @param key_len   length of the key.
+ * @param value     pointer to a variable for storing value pointer.
+ * @param value_len pointer to a variable for storing value length.
  * @return  return KV_OK if success, otherwise return other value.
  */
-int kv_destroy(kv_set_t *set)
+int kv_get_n(kv_set_t *set, const void *key, size_t key_len, const void **value, size_t *value_len)
 {
-    int res;
-
-    if (set == NULL)
+    if (set == NULL || key == NULL || value == NULL || value_len == NULL)
     {
-        res = KV_ERR_BAD_ARG;
-        goto exit;
+        return KV_ERR_BAD_ARG;
     }
-
-    res = kv_clear(set);
-    if (res != KV_OK)
+    if (set->hash != NULL)
     {
-        goto exit;
+        return KV_ERR_BAD_CONF;
     }
-    free(set);
 
-    res = KV_OK;
-exit:
-    return res;
+    return kv_get_hashed(set, key, key_len, kv_hash_n(set, key, key_len), (const char **)value, value_len);
 }
 
 /**
- * @brief get the number of key-value pairs in the kv set.
- * @note  the value pointed by 'size' won't update if this function doesn't
- *        return KV_OK.
+ * @brief iterate all the key-value pairs in the kv set along with their
+ *        lengths.
+ * @note  the expired pairs are reclaimed first, or only skipped if the
+ *        readers of the set share a lock.
  * 
- * @param set   kv set pointer.
- * @param size  pointer to variable for storing size.
+ * @param set         kv set pointer.
+ * @param foreach_cb  pointer to iteration callback function.
  * @return  return KV_OK if success, otherwise return other value.
  */
-int kv_size(kv_set_t *set, size_t *size)
+int kv_foreach_n(kv_set_t *set, kv_foreach_n_cb_t foreach_cb, void *arg)
 {
     int res;
+    kv_foreach_ctx_t ctx;
 
-    if (set == NULL)
+    if (set == NULL || foreach_cb == NULL)
     {
         res = KV_ERR_BAD_ARG;
         goto exit;
     }
 
-    *size = set->pair_num;
+    ctx.foreach_n_cb = foreach_cb;
+    ctx.arg = arg;
+    kv_foreach_expire(set, &ctx);
+    set->engine->foreach(set, kv_foreach_n_visit, &ctx);
 
     res = KV_OK;
 exit:
@@ -150,302 +1627,388 @@ exit:
 }
 
 /**
- * @brief check if key is in the kv set or not.
+ * @brief get the deadline of a pair put now with the time to live.
+ */
+static uint64_t kv_ttl_deadline(kv_set_t *set, uint64_t ttl_ms)
+{
+    uint64_t now;
+
+    now = kv_ttl_now(set);
+
+    return ttl_ms < UINT64_MAX - now ? now + ttl_ms : UINT64_MAX;
+}
+
+/**
+ * @brief put a key-value pair in the kv set, which expires after the time to
+ *        live.
+ * @note  the set must be created with 'conf->ttl' set. an expired pair is
+ *        never found again, its memory is reclaimed once an operation looks
+ *        it up, or the wheel reaches its deadline. putting the key again by
+ *        kv_put() lets it live forever.
  * 
- * @param set kv set pointer.
- * @param key key string pointer.
- * @return  return KV_FALSE or KV_TRUE if success, otherwise return other value.
+ * @param set     kv set pointer.
+ * @param key     key string pointer.
+ * @param value   value string pointer.
+ * @param ttl_ms  time to live in milliseconds, greater than 0.
+ * @return  return KV_OK if success, or return KV_ERR_BAD_CONF if the pairs
+ *          of the set can't expire, otherwise return other value.
  */
-int kv_contain(kv_set_t *set, const char *key)
+int kv_put_ttl(kv_set_t *set, const char *key, const char *value, uint64_t ttl_ms)
 {
-    int res;
-    int array_index;
-    kv_bucket_t *curt_bucket;
-    int key_found;
+    size_t key_len;
 
-    if (set == NULL || key == NULL)
+    if (set == NULL || key == NULL || value == NULL || ttl_ms == 0)
     {
         return KV_ERR_BAD_ARG;
     }
-
-    key_found = KV_FALSE;
-    array_index = set->hash(key) % set->bucket_num;
-    curt_bucket = set->array[array_index];
-
-    /* seach this key on chain to check if it exists */
-    while (curt_bucket != NULL)
+    if (set->wheel == NULL)
     {
-        if (strcmp(key, curt_bucket->key) == 0)
-        {
-            key_found = KV_TRUE;
-            break;
-        }
-        curt_bucket = curt_bucket->next;
+        return KV_ERR_BAD_CONF;
     }
 
-    return key_found;
+    key_len = strlen(key);
+
+    return kv_put_ttl_hashed(set, key, key_len, kv_hash_str(set, key, key_len), value, strlen(value),
+                             kv_ttl_deadline(set, ttl_ms));
 }
 
 /**
- * @brief put a key-value pair in the kv set.
- * @note  this function will replace the value corresponding to the specified
- *        key with the specified value if the specified key already exists in
- *        this kv set.
+ * @brief put a key-value pair in the kv set, which expires after the time to
+ *        live, both of them can hold any bytes.
+ * @note  the set must be created with 'conf->ttl' set, and mustn't hash with
+ *        a null-terminated string callback.
  * 
- * @param set   kv set pointer.
- * @param key   key string pointer.
- * @param value value string pointer.
- * @return  return KV_OK if success, otherwise return other value.
+ * @param set       kv set pointer.
+ * @param key       key pointer.
+ * @param key_len   length of the key.
+ * @param value     value pointer.
+ * @param value_len length of the value.
+ * @param ttl_ms    time to live in milliseconds, greater than 0.
+ * @return  return KV_OK if success, or return KV_ERR_BAD_CONF if the pairs
+ *          of the set can't expire, otherwise return other value.
  */
-int kv_put(kv_set_t *set, const char *key, const char *value)
+int kv_put_ttl_n(kv_set_t *set, const void *key, size_t key_len, const void *value, size_t value_len,
+                 uint64_t ttl_ms)
 {
-    int res;
-    int array_index;
-    kv_bucket_t **bucket_next;
-    kv_bucket_t *curt_bucket;
-    kv_bucket_t *new_bucket;
-    int key_found;
-    char *inner_key;
-    char *inner_value;
-    size_t malloc_size;
-
-    if (set == NULL || key == NULL || value == NULL)
+    if (set == NULL || key == NULL || value == NULL || ttl_ms == 0)
     {
-        res = KV_ERR_BAD_ARG;
-        goto exit;
+        return KV_ERR_BAD_ARG;
+    }
+    if (set->hash != NULL || set->wheel == NULL)
+    {
+        return KV_ERR_BAD_CONF;
     }
 
-    key_found = KV_FALSE;
-    array_index = set->hash(key) % set->bucket_num;
-    curt_bucket = set->array[array_index];
-    bucket_next = set->array + array_index;
+    return kv_put_ttl_hashed(set, key, key_len, kv_hash_n(set, key, key_len), value, value_len,
+                             kv_ttl_deadline(set, ttl_ms));
+}
 
-    /* seach this key on chain to check if it exists */
-    while (curt_bucket != NULL)
+/**
+ * @brief reclaim the expired pairs of the kv set.
+ * @note  every operation reclaims a few expired pairs already, this function
+ *        lets an idle set catch up. the cost is proportional to the pairs
+ *        reclaimed, not to the pairs in the set.
+ * 
+ * @param set      kv set pointer.
+ * @param max_num  maximum number of the pairs reclaimed, SIZE_MAX for all.
+ * @return  return KV_OK if success, or return KV_ERR_BAD_CONF if the pairs
+ *          of the set can't expire, otherwise return other value.
+ */
+int kv_expire(kv_set_t *set, size_t max_num)
+{
+    if (set == NULL)
     {
-        if (strcmp(key, curt_bucket->key) == 0)
-        {
-            key_found = KV_TRUE;
-            break;
-        }
-        curt_bucket = curt_bucket->next;
-        bucket_next = &((*bucket_next)->next);
+        return KV_ERR_BAD_ARG;
     }
-
-    /* modify bucket or create new bucket */
-    if (key_found == KV_TRUE)
+    if (set->wheel == NULL)
     {
-        malloc_size = strlen(value) + 1;
-        inner_value = (char *)malloc(malloc_size);
-        if (inner_value == NULL)
-        {
-            res = KV_ERR_BAD_MEM;
-            goto exit;
-        }
-        memcpy(inner_value, value, malloc_size);
+        return KV_ERR_BAD_CONF;
+    }
+
+    kv_ttl_advance(set, kv_ttl_now(set), max_num);
+
+    return KV_OK;
+}
 
-        free(curt_bucket->value);
-        curt_bucket->value = inner_value;
+/**
+ * @brief build the Bloom filter of the set again from the keys in it.
+ * @note  the filter is rebuilt by itself as the set grows and once half of
+ *        its keys are deleted, this is for shrinking it at a chosen time,
+ *        after a lot of deletes for example.
+ * 
+ * @param set kv set pointer.
+ * @return  return KV_OK if success, or return KV_ERR_BAD_CONF if the set has
+ *          no filter, otherwise return other value.
+ */
+int kv_rebuild_bloom(kv_set_t *set)
+{
+    if (set == NULL)
+    {
+        return KV_ERR_BAD_ARG;
     }
-    else
+    if (set->bloom == NULL)
     {
-        /* create new bucket and be ready to be linked on the chain */
-        new_bucket = (kv_bucket_t *)malloc(sizeof(kv_bucket_t));
-        if (new_bucket == NULL)
-        {
-            goto err_malloc_bucket;
-        }
+        return KV_ERR_BAD_CONF;
+    }
 
-        /* create the copy of the key */
-        malloc_size = strlen(key) + 1;
-        inner_key = (char *)malloc(malloc_size);
-        if (inner_key == NULL)
-        {
-            goto err_malloc_key;
-        }
-        memcpy(inner_key, key, malloc_size);
+    return kv_bloom_rebuild(set);
+}
 
-        /* create the copy of the value */
-        malloc_size = strlen(value) + 1;
-        inner_value = (char *)malloc(malloc_size);
-        if (inner_value == NULL)
-        {
-            goto err_malloc_value;
-        }
-        memcpy(inner_value, value, malloc_size);
+/* context passed to the callback adapter of kv_upsert() */
+typedef struct kv_upsert_ctx
+{
+    kv_upsert_cb_t upsert_cb;
+    void *arg;
+} kv_upsert_ctx_t;
 
-        /* link every thing we just create */
-        new_bucket->key = inner_key;
-        new_bucket->value = inner_value;
-        new_bucket->next = NULL;
-        *bucket_next = new_bucket;
+static const void *kv_upsert_visit(void *arg, const void *value, size_t value_len, size_t *new_len)
+{
+    kv_upsert_ctx_t *ctx = (kv_upsert_ctx_t *)arg;
+    const char *new_value;
 
-        set->pair_num++;
+    new_value = ctx->upsert_cb(ctx->arg, (const char *)value);
+    if (new_value != NULL)
+    {
+        *new_len = strlen(new_value);
     }
 
-    return KV_OK;
-
-err_malloc_value:
-    free(inner_key);
-err_malloc_key:
-    free(new_bucket);
-err_malloc_bucket:
-    res = KV_ERR_BAD_MEM;
-exit:
-    return res;
+    return new_value;
 }
 
 /**
- * @brief delete a key-value pair in the kv set.
+ * @brief update the value of the key by the callback, or insert the value it
+ *        makes if the key isn't found, hashing the key and looking it up once.
+ * @note  the callback gets the old value, or NULL if the key isn't found, and
+ *        returns the new value, which may point into the old one, or NULL to
+ *        leave the set as it is. it mustn't modify the set. the deadline of
+ *        an expiring pair is kept.
  * 
- * @param set kv set pointer.
- * @param key key string pointer.
- * @return  return KV_OK if success, or return KV_ERR_KEY_NOT_FOUND if the 
- *          specified key isn't found in kv set, otherwise return other value.
+ * @param set       kv set pointer.
+ * @param key       key string pointer.
+ * @param upsert_cb pointer to the callback function making the new value.
+ * @param arg       argument passed to the callback.
+ * @return  return KV_OK if success, otherwise return other value.
  */
-int kv_del(kv_set_t *set, const char *key)
+int kv_upsert(kv_set_t *set, const char *key, kv_upsert_cb_t upsert_cb, void *arg)
 {
-    int res;
-    int array_index;
-    kv_bucket_t **bucket_next;
-    kv_bucket_t *curt_bucket;
-    kv_bucket_t *next_bucket;
-    int key_found;
+    kv_upsert_ctx_t ctx;
+    size_t key_len;
 
-    if (set == NULL || key == NULL)
+    if (set == NULL || key == NULL || upsert_cb == NULL)
     {
-        res = KV_ERR_BAD_ARG;
-        goto exit;
+        return KV_ERR_BAD_ARG;
     }
 
-    key_found = KV_FALSE;
-    array_index = set->hash(key) % set->bucket_num;
-    curt_bucket = set->array[array_index];
-    bucket_next = set->array + array_index;
+    ctx.upsert_cb = upsert_cb;
+    ctx.arg = arg;
+    key_len = strlen(key);
 
-    /* seach this key on chain to check if it exists */
-    while (curt_bucket != NULL)
-    {
-        if (strcmp(key, curt_bucket->key) == 0)
-        {
-            key_found = KV_TRUE;
-            break;
-        }
-        curt_bucket = curt_bucket->next;
-        bucket_next = &((*bucket_next)->next);
-    }
+    return kv_upsert_hashed(set, key, key_len, kv_hash_str(set, key, key_len), kv_upsert_visit, &ctx);
+}
 
-    if (key_found == KV_TRUE)
+/**
+ * @brief update the value of the key by the callback, or insert the value it
+ *        makes if the key isn't found, hashing the key and looking it up once.
+ * @note  the set mustn't hash with a null-terminated string callback. the
+ *        callback gets the old value and its length, or NULL and 0 if the key
+ *        isn't found, and returns the new value storing its length in the
+ *        last argument, or NULL to leave the set as it is.
+ * 
+ * @param set       kv set pointer.
+ * @param key       key pointer.
+ * @param key_len   length of the key.
+ * @param upsert_cb pointer to the callback function making the new value.
+ * @param arg       argument passed to the callback.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_upsert_n(kv_set_t *set, const void *key, size_t key_len, kv_upsert_n_cb_t upsert_cb, void *arg)
+{
+    if (set == NULL || key == NULL || upsert_cb == NULL)
     {
-        next_bucket = curt_bucket->next;
-        free(curt_bucket->key);
-        free(curt_bucket->value);
-        free(curt_bucket);
-        *bucket_next = next_bucket;
-        set->pair_num--;
+        return KV_ERR_BAD_ARG;
     }
-    else
+    if (set->hash != NULL)
     {
-        res = KV_ERR_KEY_NOT_FOUND;
-        goto exit;
+        return KV_ERR_BAD_CONF;
     }
 
-    res = KV_OK;
-exit:
-    return res;
+    return kv_upsert_hashed(set, key, key_len, kv_hash_n(set, key, key_len), upsert_cb, arg);
 }
 
 /**
- * @brief get the value string corresponding to the specified key in the kv set.
- * @note  the value pointed by 'value' won't update if this function doesn't
- *        return KV_OK.
+ * @brief get the value of the key, inserting the pair with the value given if
+ *        the key isn't found, hashing the key and looking it up once.
+ * @note  the slot points to the value in the set, its bytes may be rewritten
+ *        in place(without changing its length) until the pair is modified or
+ *        deleted. if the set is durable, the value is logged as it is when
+ *        the set is modified next or synced, and mustn't be written after
+ *        that, the log isn't compacted until then.
  * 
  * @param set   kv set pointer.
  * @param key   key string pointer.
- * @param value pointer to a variable for storing value string pointer.
- * @return  return KV_OK if success, otherwise return other value.
+ * @param value value string pointer inserted if the key isn't found.
+ * @param slot  pointer to a variable for storing the value pointer.
+ * @return  return KV_TRUE if the pair is inserted, or return KV_FALSE if the
+ *          key is found, otherwise return other value.
  */
-int kv_get(kv_set_t *set, const char *key, const char **value)
+int kv_get_or_insert(kv_set_t *set, const char *key, const char *value, char **slot)
 {
-    int res;
-    int array_index;
-    kv_bucket_t *curt_bucket;
-    int key_found;
+    size_t key_len;
 
-    if (set == NULL || key == NULL || value == NULL)
+    if (set == NULL || key == NULL || value == NULL || slot == NULL)
     {
-        res = KV_ERR_BAD_ARG;
-        goto exit;
+        return KV_ERR_BAD_ARG;
     }
 
-    key_found = KV_FALSE;
-    array_index = set->hash(key) % set->bucket_num;
-    curt_bucket = set->array[array_index];
+    key_len = strlen(key);
+
+    return kv_get_or_insert_hashed(set, key, key_len, kv_hash_str(set, key, key_len), value, strlen(value),
+                                   slot, NULL);
+}
 
-    /* seach this key on chain to check if it exists */
-    while (curt_bucket != NULL)
+/**
+ * @brief get the value of the key, inserting the pair with the value given if
+ *        the key isn't found, hashing the key and looking it up once.
+ * @note  the set mustn't hash with a null-terminated string callback. the
+ *        slot is like the one of kv_get_or_insert().
+ * 
+ * @param set       kv set pointer.
+ * @param key       key pointer.
+ * @param key_len   length of the key.
+ * @param value     value pointer inserted if the key isn't found.
+ * @param value_len length of the value.
+ * @param slot      pointer to a variable for storing the value pointer.
+ * @param slot_len  pointer to a variable for storing the value length.
+ * @return  return KV_TRUE if the pair is inserted, or return KV_FALSE if the
+ *          key is found, otherwise return other value.
+ */
+int kv_get_or_insert_n(kv_set_t *set, const void *key, size_t key_len, const void *value, size_t value_len,
+                       void **slot, size_t *slot_len)
+{
+    if (set == NULL || key == NULL || value == NULL || slot == NULL || slot_len == NULL)
     {
-        if (strcmp(key, curt_bucket->key) == 0)
-        {
-            key_found = KV_TRUE;
-            break;
-        }
-        curt_bucket = curt_bucket->next;
+        return KV_ERR_BAD_ARG;
     }
+    if (set->hash != NULL)
+    {
+        return KV_ERR_BAD_CONF;
+    }
+
+    return kv_get_or_insert_hashed(set, key, key_len, kv_hash_n(set, key, key_len), value, value_len,
+                                   (char **)slot, slot_len);
+}
 
-    if (key_found == KV_FALSE)
+/**
+ * @brief write and fsync all the records appended to the write-ahead log so
+ *        far, whatever the fsync policy is.
+ * 
+ * @param set kv set pointer.
+ * @return  return KV_OK if success, or return KV_ERR_BAD_CONF if the set
+ *          isn't durable, otherwise return other value.
+ */
+int kv_sync(kv_set_t *set)
+{
+    if (set == NULL)
     {
-        res = KV_ERR_KEY_NOT_FOUND;
-        goto exit;
+        return KV_ERR_BAD_ARG;
+    }
+    if (set->wal == NULL)
+    {
+        return KV_ERR_BAD_CONF;
     }
 
-    *value = curt_bucket->value;
+    return kv_wal_sync(set);
+}
 
-    res = KV_OK;
-exit:
-    return res;
+/**
+ * @brief count a chain(or probe) length in the histogram of the statistics.
+ */
+void kv_stats_length(kv_stats_t *stats, size_t length)
+{
+    stats->chain_hist[length < KV_STATS_HIST_NUM ? length : KV_STATS_HIST_NUM - 1]++;
+    if (length > stats->longest_chain)
+    {
+        stats->longest_chain = length;
+    }
+}
+
+static void kv_stats_visit(void *arg, kv_bucket_t *bucket)
+{
+    kv_stats_t *stats = (kv_stats_t *)arg;
+
+    stats->memory_bytes += KV_BUCKET_SIZE(bucket);
 }
 
 /**
- * @brief clear all key-value pairs in the kv set.
+ * @brief get the statistics of the kv set.
+ * @note  the histogram and the memory are measured by walking the whole set,
+ *        which costs O(n). the lookups are counted by kv_get(), kv_contain()
+ *        and their variants, the counters are compiled away if
+ *        KV_STATS_DISABLE is defined.
  * 
- * @param set kv set pointer.
+ * @param set   kv set pointer.
+ * @param stats pointer to a variable for storing statistics.
  * @return  return KV_OK if success, otherwise return other value.
  */
-int kv_clear(kv_set_t *set)
+int kv_stats(kv_set_t *set, kv_stats_t *stats)
 {
     int res;
-    kv_bucket_t *curt_bucket;
-    kv_bucket_t *next_bucket;
 
-    if (set == NULL)
+    if (set == NULL || stats == NULL)
     {
         res = KV_ERR_BAD_ARG;
         goto exit;
     }
 
-    /* free every chain on the set array */
-    for (int i = 0; i < set->bucket_num; i++)
+    memset(stats, 0, sizeof(kv_stats_t));
+    stats->pair_num = set->pair_num;
+    stats->bucket_num = set->bucket_num;
+    stats->arena_reserved = set->arena_reserved;
+    stats->arena_live = set->arena_live;
+    if (set->bucket_num != 0)
     {
-        if (set->array[i] != NULL)
-        {
-            next_bucket = set->array[i];
-            do
-            {
-                curt_bucket = next_bucket;
-                next_bucket = curt_bucket->next;
-
-                /* free the property of current bucket */
-                free(curt_bucket->key);
-                free(curt_bucket->value);
-
-                free(curt_bucket);
-            } while (next_bucket != NULL);
-            set->array[i] = NULL;
-        }
+        stats->load_factor = set->pair_num * 100 / set->bucket_num;
+    }
+    stats->lookups = set->lookup_num;
+    stats->hits = set->hit_num;
+    stats->misses = set->miss_num;
+    stats->rehashes = set->rehash_num;
+
+    /* the buckets of an image are in the mapping, not in the heap */
+    stats->memory_bytes = sizeof(kv_set_t);
+    if (set->engine->measure != NULL)
+    {
+        set->engine->measure(set, stats);
+    }
+    if (set->arena_size != 0)
+    {
+        stats->memory_bytes += set->arena_reserved;
+    }
+    else if (set->image == NULL)
+    {
+        set->engine->foreach(set, kv_stats_visit, stats);
+        stats->memory_bytes += set->pair_num * set->bucket_prefix;
+    }
+    if (set->index != NULL)
+    {
+        kv_index_stats(set, stats);
+    }
+    if (set->cache != NULL)
+    {
+        kv_cache_stats(set, stats);
+    }
+    if (set->wheel != NULL)
+    {
+        kv_ttl_stats(set, stats);
+    }
+    if (set->pool != NULL)
+    {
+        kv_pool_stats(set, stats);
+    }
+    if (set->bloom != NULL)
+    {
+        kv_bloom_stats(set, stats);
     }
-
-    set->pair_num = 0;
 
     res = KV_OK;
 exit:
@@ -453,38 +2016,63 @@ exit:
 }
 
 /**
- * @brief iterate all the key-value pairs in the kv set.
+ * @brief create a snapshot of the kv set, which shares the pairs with it.
+ * @note  nothing is copied, the set and the clone hold the same table of
+ *        the chains, split into pages of 256 chains, until one of them
+ *        modifies a chain, which copies the page pointers of the table, and
+ *        the chains of that page, for itself. so cloning takes a constant
+ *        time whatever the size of the set, and the pairs are copied a page
+ *        at a time as they're modified. an unfinished rehashing of the set
+ *        goes on in both of them. the set and the clone can be used by
+ *        different threads, only the counters of the tables and the pages
+ *        shared are touched by both.
+ *        the clone has the same configuration as the set, but no log.
+ *        the clone can only be made with the default engine(the others
+ *        return KV_ERR_BAD_CONF), and without the arena, the pool, the Bloom
+ *        filter, the cache mode, the expiry and the ordered index, otherwise
+ *        KV_ERR_BAD_CONF is returned. the slots returned by
+ *        kv_get_or_insert() before mustn't be written to.
  * 
- * @param set         kv set pointer.
- * @param foreach_cb  pointer to iteration callback function.
+ * @param set   kv set pointer.
+ * @param clone address of the clone pointer.
  * @return  return KV_OK if success, otherwise return other value.
  */
-int kv_foreach(kv_set_t *set, kv_foreach_cb_t foreach_cb, void *arg)
+int kv_clone(kv_set_t *set, kv_set_t **clone)
 {
+    kv_set_t *inner_clone;
     int res;
-    kv_bucket_t *curt_bucket;
 
-    if (set == NULL)
+    if (set == NULL || clone == NULL)
     {
-        res = KV_ERR_BAD_ARG;
-        goto exit;
+        return KV_ERR_BAD_ARG;
+    }
+    if (set->arena_size != 0 || set->pool != NULL || set->bloom != NULL ||
+        set->cache != NULL || set->wheel != NULL || set->index != NULL)
+    {
+        return KV_ERR_BAD_CONF;
     }
 
-    /* free every chain on the set array */
-    for (int i = 0; i < set->bucket_num; i++)
+    inner_clone = (kv_set_t *)malloc(sizeof(kv_set_t));
+    if (inner_clone == NULL)
     {
-        if (set->array[i] != NULL)
-        {
-            curt_bucket = set->array[i];
-            while (curt_bucket != NULL)
-            {
-                foreach_cb(arg, curt_bucket->key, curt_bucket->value);
-                curt_bucket = curt_bucket->next;
-            }
-        }
+        return KV_ERR_BAD_MEM;
+    }
+    memcpy(inner_clone, set, sizeof(kv_set_t));
+    inner_clone->wal = NULL;
+    inner_clone->read_shared = KV_FALSE;
+    inner_clone->lookup_num = 0;
+    inner_clone->hit_num = 0;
+    inner_clone->miss_num = 0;
+    inner_clone->rehash_num = 0;
+
+    res = set->engine->clone(set, inner_clone);
+    if (res != KV_OK)
+    {
+        free(inner_clone);
+        return res;
     }
 
-    res = KV_OK;
-exit:
-    return res;
+    *clone = inner_clone;
+
+    return KV_OK;
 }
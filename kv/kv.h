@@ -1,10 +1,17 @@
 #ifndef __KV_H__
 #define __KV_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 typedef uint32_t (* kv_hash_cb_t)(const char *);
+typedef uint32_t (* kv_hash_n_cb_t)(const void *, size_t);
+typedef uint64_t (* kv_hash_seeded_cb_t)(const void *, size_t, uint64_t);
 typedef void (* kv_foreach_cb_t)(void *, const char *, const char *);
+typedef void (* kv_foreach_n_cb_t)(void *, const void *, size_t, const void *, size_t);
+typedef uint64_t (* kv_clock_cb_t)(void);
+typedef const char *(* kv_upsert_cb_t)(void *, const char *);
+typedef const void *(* kv_upsert_n_cb_t)(void *, const void *, size_t, size_t *);
 
 enum
 {
@@ -18,43 +25,170 @@ enum
     KV_ERR_BAD_MEM          = -2,
     KV_ERR_BAD_CONF         = -3,
     KV_ERR_KEY_NOT_FOUND    = -4,
+    KV_ERR_BAD_LOCK         = -5,
+    KV_ERR_BAD_FILE         = -6,
+    KV_ERR_READ_ONLY        = -7,
+
+    /* storage engine types */
+    KV_ENGINE_CHAIN         = 0,
+    KV_ENGINE_FLAT          = 1,
+    KV_ENGINE_ART           = 2,
+    KV_ENGINE_COMPACT       = 3,
+
+    /* built-in hash types */
+    KV_HASH_WYHASH          = 0,
+    KV_HASH_XXH64           = 1,
+    KV_HASH_DJB2            = 2,
+
+    /* fsync policies of the write-ahead log */
+    KV_SYNC_GROUP           = 0,
+    KV_SYNC_ALWAYS          = 1,
+    KV_SYNC_NONE            = 2,
+
+    /* number of the lengths counted by the histogram of kv_stats() */
+    KV_STATS_HIST_NUM       = 16,
 };
 
-/* structure used to store one key-value pair */
+/**
+ * structure used to store one key-value pair, the key and value bytes are
+ * stored right after it in the same allocation.
+ */
 typedef struct kv_bucket
 {
-    /* key string(null-terminated) */
-    char *key;
-
-    /* value string(null-terminated) */
-    char *value;
-
     /* point to the next bucket on chain */
     struct kv_bucket *next;
+
+    /* hash value of the key */
+    uint32_t hash;
+
+    /* length of the key */
+    uint32_t key_len;
+
+    /* length of the value */
+    uint32_t value_len;
+
+    /* space reserved for the value(null-terminator included) */
+    uint32_t value_cap;
+
+    /* key bytes(null-terminated) followed by value bytes(null-terminated) */
+    char data[];
 } kv_bucket_t;
 
-/* structure used to configure kv set */
+/* structure used to configure kv set, the fields left out must be 0, start from kv_conf_init() */
 typedef struct kv_conf
 {
+    /* initial number of buckets */
     size_t bucket_num;
+
+    /* hash callback function, NULL for the default one */
     kv_hash_cb_t hash_cb;
+
+    /* length-aware hash callback function, preferred over 'hash_cb' */
+    kv_hash_n_cb_t hash_n_cb;
+
+    /* built-in hash used if no callback is given, KV_HASH_WYHASH by default */
+    int hash_type;
+
+    /* seed of the built-in hash, 0 for a random one */
+    uint64_t hash_seed;
+
+    /* load factor(in percent) that triggers growing, 0 for the default one */
+    size_t max_load;
+
+    /* storage engine, KV_ENGINE_CHAIN by default */
+    int engine;
+
+    /* size of the slabs buckets are carved from, 0 to allocate every bucket */
+    size_t arena_size;
+
+    /* path of the write-ahead log, NULL if the set isn't durable */
+    const char *wal_path;
+
+    /* when the log is fsync'ed, KV_SYNC_GROUP by default */
+    int wal_sync;
+
+    /* bytes of records fsync'ed together, 0 for the default */
+    size_t wal_sync_bytes;
+
+    /* milliseconds a record may wait for its group, 0 for the default */
+    uint32_t wal_sync_ms;
+
+    /* whether the keys are indexed in order for kv_scan_prefix() and kv_scan_range() */
+    int ordered;
+
+    /* byte budget of the buckets, cold pairs are evicted beyond it, 0 if the set isn't a cache */
+    size_t cache_bytes;
+
+    /* whether the pairs can expire, for kv_put_ttl() */
+    int ttl;
+
+    /* clock in milliseconds the expiry is measured with, NULL for the monotonic clock */
+    kv_clock_cb_t clock_cb;
+
+    /* whether the buckets of short pairs are pooled in slabs instead of allocated one by one */
+    int pool;
+
+    /* false positive rate of the Bloom filter in front of the lookups, 0 if there is no filter */
+    double bloom_fpp;
 } kv_conf_t;
 
-/* key-value set structure */
-typedef struct kv_set
+/* structure used to report the statistics of kv set */
+typedef struct kv_stats
 {
-    /* number of the key-value pairs in this set */
+    /* number of the key-value pairs */
     size_t pair_num;
 
-    /* number of buckets in member 'array' */
+    /* number of buckets(or slots of the flat engine, or nodes of the art engine, or index slots of the compact engine) */
     size_t bucket_num;
 
-    /* hash callback function pointer */
-    kv_hash_cb_t hash;
+    /* bytes of the slabs owned by the arena */
+    size_t arena_reserved;
+
+    /* bytes of the buckets still alive in the arena */
+    size_t arena_live;
+
+    /* bytes of the buckets charged to the cache budget */
+    size_t cache_used;
+
+    /* number of the lookups in the cache which found the key */
+    uint64_t cache_hits;
+
+    /* number of the lookups in the cache which didn't find the key */
+    uint64_t cache_misses;
 
-    /* store all the bucket chains of this set */
-    kv_bucket_t *array[];
-} kv_set_t;
+    /* number of the pairs evicted from the cache */
+    uint64_t cache_evictions;
+
+    /* pairs per bucket(or slot, or node), in percent */
+    size_t load_factor;
+
+    /**
+     * number of the chains of every length, or of the keys found at every
+     * probe length(groups probed by the flat engine, slots probed by the
+     * compact engine, nodes passed by the art engine). the last one counts
+     * all the longer ones.
+     */
+    size_t chain_hist[KV_STATS_HIST_NUM];
+
+    /* length of the longest chain, or the longest probe length */
+    size_t longest_chain;
+
+    /* bytes of the memory allocated by the set, the log not included */
+    size_t memory_bytes;
+
+    /* cumulative counters of the lookups, all 0 if KV_STATS_DISABLE is defined */
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t misses;
+
+    /* number of the times the table was rebuilt or started growing */
+    uint64_t rehashes;
+} kv_stats_t;
+
+/* key-value set structure, opaque to the users */
+typedef struct kv_set kv_set_t;
+
+int kv_conf_init(kv_conf_t *conf);
 
 int kv_create(kv_set_t **set, const kv_conf_t *conf);
 
@@ -70,8 +204,61 @@ int kv_del(kv_set_t *set, const char *key);
 
 int kv_get(kv_set_t *set, const char *key, const char ** value);
 
+int kv_get_batch(kv_set_t *set, const char **keys, size_t key_num, const char **values);
+
 int kv_clear(kv_set_t *set);
 
 int kv_foreach(kv_set_t *set, kv_foreach_cb_t foreach_cb, void *arg);
 
+int kv_contain_n(kv_set_t *set, const void *key, size_t key_len);
+
+int kv_put_n(kv_set_t *set, const void *key, size_t key_len, const void *value, size_t value_len);
+
+int kv_del_n(kv_set_t *set, const void *key, size_t key_len);
+
+int kv_get_n(kv_set_t *set, const void *key, size_t key_len, const void **value, size_t *value_len);
+
+int kv_foreach_n(kv_set_t *set, kv_foreach_n_cb_t foreach_cb, void *arg);
+
+int kv_put_ttl(kv_set_t *set, const char *key, const char *value, uint64_t ttl_ms);
+
+int kv_put_ttl_n(kv_set_t *set, const void *key, size_t key_len, const void *value, size_t value_len,
+                 uint64_t ttl_ms);
+
+int kv_expire(kv_set_t *set, size_t max_num);
+
+int kv_rebuild_bloom(kv_set_t *set);
+
+int kv_upsert(kv_set_t *set, const char *key, kv_upsert_cb_t upsert_cb, void *arg);
+
+int kv_upsert_n(kv_set_t *set, const void *key, size_t key_len, kv_upsert_n_cb_t upsert_cb, void *arg);
+
+int kv_get_or_insert(kv_set_t *set, const char *key, const char *value, char **slot);
+
+int kv_get_or_insert_n(kv_set_t *set, const void *key, size_t key_len, const void *value, size_t value_len,
+                       void **slot, size_t *slot_len);
+
+int kv_scan_prefix(kv_set_t *set, const void *prefix, size_t prefix_len, kv_foreach_n_cb_t foreach_cb, void *arg);
+
+int kv_scan_range(kv_set_t *set, const void *start, size_t start_len, const void *end, size_t end_len,
+                  kv_foreach_n_cb_t foreach_cb, void *arg);
+
+uint64_t kv_wyhash(const void *key, size_t key_len, uint64_t seed);
+
+uint64_t kv_xxh64(const void *key, size_t key_len, uint64_t seed);
+
+uint64_t kv_djb2(const void *key, size_t key_len, uint64_t seed);
+
+int kv_stats(kv_set_t *set, kv_stats_t *stats);
+
+int kv_sync(kv_set_t *set);
+
+int kv_save(kv_set_t *set, const char *path);
+
+int kv_open_mapped(kv_set_t **set, const char *path, const kv_conf_t *conf);
+
+/* constant time snapshot, only for the default engine without the arena, the pool, the Bloom filter,
+   the cache mode, the expiry and the ordered index, otherwise KV_ERR_BAD_CONF is returned */
+int kv_clone(kv_set_t *set, kv_set_t **clone);
+
 #endif
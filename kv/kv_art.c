@@ -0,0 +1,1135 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "kv.h"
+#include "kv_inner.h"
+
+/* node types, named after their maximum number of children */
+#define ART_NODE4       4
+#define ART_NODE16      16
+#define ART_NODE48      48
+#define ART_NODE256     256
+
+/* bytes of the compressed path stored in a node, the rest is checked at the leaf */
+#define ART_MAX_PREFIX  12
+
+/* a node shrinks once it has this many children left */
+#define ART_SHRINK16    3
+#define ART_SHRINK48    12
+#define ART_SHRINK256   37
+
+/**
+ * a reference is either a bucket, or a node tagged by its lowest bit, which
+ * is never set in a bucket pointer since the buckets are 8-byte aligned.
+ */
+#define ART_IS_NODE(ref)    (((uintptr_t)(ref) & 1) != 0)
+#define ART_NODE(ref)       ((kv_art_node_t *)((uintptr_t)(ref) - 1))
+#define ART_REF(node)       ((kv_bucket_t *)((uintptr_t)(node) + 1))
+
+/* header shared by all the node types */
+typedef struct kv_art_node
+{
+    /* ART_NODE4, ART_NODE16, ART_NODE48 or ART_NODE256 */
+    uint16_t type;
+
+    /* number of the children */
+    uint16_t child_num;
+
+    /* length of the compressed path in front of the children */
+    uint32_t prefix_len;
+
+    /* first bytes of the compressed path */
+    uint8_t prefix[ART_MAX_PREFIX];
+
+    /* bucket whose key ends right after the compressed path, or NULL */
+    kv_bucket_t *leaf;
+} kv_art_node_t;
+
+/* node with up to 4 children, sorted by their bytes */
+typedef struct kv_art_node4
+{
+    kv_art_node_t node;
+    uint8_t keys[4];
+    kv_bucket_t *children[4];
+} kv_art_node4_t;
+
+/* node with up to 16 children, sorted by their bytes */
+typedef struct kv_art_node16
+{
+    kv_art_node_t node;
+    uint8_t keys[16];
+    kv_bucket_t *children[16];
+} kv_art_node16_t;
+
+/* node with up to 48 children, indexed by their bytes */
+typedef struct kv_art_node48
+{
+    kv_art_node_t node;
+
+    /* 0 if there isn't a child for the byte, otherwise index of it plus 1 */
+    uint8_t index[256];
+    kv_bucket_t *children[48];
+} kv_art_node48_t;
+
+/* node with a child for every byte */
+typedef struct kv_art_node256
+{
+    kv_art_node_t node;
+    kv_bucket_t *children[256];
+} kv_art_node256_t;
+
+/* location returned by 'locate' if the key isn't found, it always holds NULL */
+static kv_bucket_t *kv_art_miss;
+
+static size_t kv_art_node_size(int type)
+{
+    switch (type)
+    {
+    case ART_NODE4:
+        return sizeof(kv_art_node4_t);
+
+    case ART_NODE16:
+        return sizeof(kv_art_node16_t);
+
+    case ART_NODE48:
+        return sizeof(kv_art_node48_t);
+
+    default:
+        return sizeof(kv_art_node256_t);
+    }
+}
+
+/**
+ * @brief allocate an empty node, the number of the nodes is kept in member
+ *        'bucket_num' of the set.
+ */
+static kv_art_node_t *kv_art_node_alloc(kv_set_t *set, int type)
+{
+    kv_art_node_t *node;
+
+    node = (kv_art_node_t *)calloc(1, kv_art_node_size(type));
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    node->type = (uint16_t)type;
+    set->bucket_num++;
+
+    return node;
+}
+
+static void kv_art_node_free(kv_set_t *set, kv_art_node_t *node)
+{
+    free(node);
+    set->bucket_num--;
+}
+
+/**
+ * @brief find the child of the node for the byte.
+ *
+ * @param node  node pointer.
+ * @param byte  byte of the key right after the compressed path.
+ * @return  location of the child, or NULL if there isn't one.
+ */
+static kv_bucket_t **kv_art_child(kv_art_node_t *node, uint8_t byte)
+{
+    kv_art_node4_t *node4;
+    kv_art_node16_t *node16;
+    kv_art_node48_t *node48;
+    kv_art_node256_t *node256;
+
+    switch (node->type)
+    {
+    case ART_NODE4:
+        node4 = (kv_art_node4_t *)node;
+        for (int i = 0; i < node->child_num; i++)
+        {
+            if (node4->keys[i] == byte)
+            {
+                return node4->children + i;
+            }
+        }
+        return NULL;
+
+    case ART_NODE16:
+    {
+        uint32_t mask;
+
+        node16 = (kv_art_node16_t *)node;
+#ifdef __SSE2__
+        mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8((char)byte),
+                                                          _mm_loadu_si128((const __m128i *)node16->keys)));
+#else
+        mask = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            if (node16->keys[i] == byte)
+            {
+                mask |= 1U << i;
+            }
+        }
+#endif
+        mask &= (1U << node->child_num) - 1;
+
+        return mask != 0 ? node16->children + __builtin_ctz(mask) : NULL;
+    }
+
+    case ART_NODE48:
+        node48 = (kv_art_node48_t *)node;
+        return node48->index[byte] != 0 ? node48->children + node48->index[byte] - 1 : NULL;
+
+    default:
+        node256 = (kv_art_node256_t *)node;
+        return node256->children[byte] != NULL ? node256->children + byte : NULL;
+    }
+}
+
+/**
+ * @brief find the first child of the node whose byte isn't less than the
+ *        specified one.
+ *
+ * @param node  node pointer.
+ * @param byte  pointer to the byte, which is updated to the byte of the
+ *              child found.
+ * @return  location of the child, or NULL if there isn't one.
+ */
+static kv_bucket_t **kv_art_next(kv_art_node_t *node, int *byte)
+{
+    kv_art_node4_t *node4;
+    kv_art_node16_t *node16;
+    kv_art_node48_t *node48;
+    kv_art_node256_t *node256;
+
+    switch (node->type)
+    {
+    case ART_NODE4:
+        node4 = (kv_art_node4_t *)node;
+        for (int i = 0; i < node->child_num; i++)
+        {
+            if (node4->keys[i] >= *byte)
+            {
+                *byte = node4->keys[i];
+                return node4->children + i;
+            }
+        }
+        return NULL;
+
+    case ART_NODE16:
+        node16 = (kv_art_node16_t *)node;
+        for (int i = 0; i < node->child_num; i++)
+        {
+            if (node16->keys[i] >= *byte)
+            {
+                *byte = node16->keys[i];
+                return node16->children + i;
+            }
+        }
+        return NULL;
+
+    case ART_NODE48:
+        node48 = (kv_art_node48_t *)node;
+        for (int i = *byte; i < 256; i++)
+        {
+            if (node48->index[i] != 0)
+            {
+                *byte = i;
+                return node48->children + node48->index[i] - 1;
+            }
+        }
+        return NULL;
+
+    default:
+        node256 = (kv_art_node256_t *)node;
+        for (int i = *byte; i < 256; i++)
+        {
+            if (node256->children[i] != NULL)
+            {
+                *byte = i;
+                return node256->children + i;
+            }
+        }
+        return NULL;
+    }
+}
+
+/**
+ * @brief get the bucket with the smallest key under the reference, whose key
+ *        holds the full compressed paths along the way.
+ */
+static kv_bucket_t *kv_art_min_leaf(kv_bucket_t *ref)
+{
+    kv_art_node_t *node;
+    int byte;
+
+    while (ART_IS_NODE(ref))
+    {
+        node = ART_NODE(ref);
+        if (node->leaf != NULL)
+        {
+            return node->leaf;
+        }
+        byte = 0;
+        ref = *kv_art_next(node, &byte);
+    }
+
+    return ref;
+}
+
+/**
+ * @brief add a child to the node, which grows into a bigger type if it's full.
+ *
+ * @param set   kv set pointer.
+ * @param ref   location referring to the node.
+ * @param node  node pointer.
+ * @param byte  byte of the child.
+ * @param child reference of the child.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+static int kv_art_add_child(kv_set_t *set, kv_bucket_t **ref, kv_art_node_t *node, uint8_t byte, kv_bucket_t *child)
+{
+    kv_art_node4_t *node4;
+    kv_art_node16_t *node16;
+    kv_art_node48_t *node48;
+    kv_art_node256_t *node256;
+    kv_art_node_t *new_node;
+    uint8_t *keys;
+    kv_bucket_t **children;
+    int max_num;
+    int pos;
+
+    if (node->type == ART_NODE4 || node->type == ART_NODE16)
+    {
+        if (node->type == ART_NODE4)
+        {
+            node4 = (kv_art_node4_t *)node;
+            keys = node4->keys;
+            children = node4->children;
+            max_num = 4;
+        }
+        else
+        {
+            node16 = (kv_art_node16_t *)node;
+            keys = node16->keys;
+            children = node16->children;
+            max_num = 16;
+        }
+
+        if (node->child_num < max_num)
+        {
+            /* keep the children sorted */
+            for (pos = 0; pos < node->child_num && keys[pos] < byte; pos++);
+            memmove(keys + pos + 1, keys + pos, node->child_num - pos);
+            memmove(children + pos + 1, children + pos, (node->child_num - pos) * sizeof(kv_bucket_t *));
+            keys[pos] = byte;
+            children[pos] = child;
+            node->child_num++;
+            return KV_OK;
+        }
+
+        new_node = kv_art_node_alloc(set, max_num == 4 ? ART_NODE16 : ART_NODE48);
+        if (new_node == NULL)
+        {
+            return KV_ERR_BAD_MEM;
+        }
+        memcpy(new_node, node, offsetof(kv_art_node_t, prefix) + sizeof(node->prefix));
+        new_node->type = max_num == 4 ? ART_NODE16 : ART_NODE48;
+        new_node->leaf = node->leaf;
+        if (max_num == 4)
+        {
+            memcpy(((kv_art_node16_t *)new_node)->keys, keys, 4);
+            memcpy(((kv_art_node16_t *)new_node)->children, children, 4 * sizeof(kv_bucket_t *));
+        }
+        else
+        {
+            node48 = (kv_art_node48_t *)new_node;
+            for (int i = 0; i < 16; i++)
+            {
+                node48->index[keys[i]] = (uint8_t)(i + 1);
+                node48->children[i] = children[i];
+            }
+        }
+    }
+    else if (node->type == ART_NODE48)
+    {
+        node48 = (kv_art_node48_t *)node;
+        if (node->child_num < 48)
+        {
+            for (pos = 0; node48->children[pos] != NULL; pos++);
+            node48->index[byte] = (uint8_t)(pos + 1);
+            node48->children[pos] = child;
+            node->child_num++;
+            return KV_OK;
+        }
+
+        new_node = kv_art_node_alloc(set, ART_NODE256);
+        if (new_node == NULL)
+        {
+            return KV_ERR_BAD_MEM;
+        }
+        memcpy(new_node, node, offsetof(kv_art_node_t, prefix) + sizeof(node->prefix));
+        new_node->type = ART_NODE256;
+        new_node->leaf = node->leaf;
+        node256 = (kv_art_node256_t *)new_node;
+        for (int i = 0; i < 256; i++)
+        {
+            if (node48->index[i] != 0)
+            {
+                node256->children[i] = node48->children[node48->index[i] - 1];
+            }
+        }
+    }
+    else
+    {
+        node256 = (kv_art_node256_t *)node;
+        node256->children[byte] = child;
+        node->child_num++;
+        return KV_OK;
+    }
+
+    *ref = ART_REF(new_node);
+    kv_art_node_free(set, node);
+
+    return kv_art_add_child(set, ref, new_node, byte, child);
+}
+
+/**
+ * @brief move the children of the node into a smaller one once few enough of
+ *        them are left. the node is kept if the smaller one can't be
+ *        allocated.
+ */
+static void kv_art_shrink(kv_set_t *set, kv_bucket_t **ref, kv_art_node_t *node)
+{
+    kv_art_node_t *new_node;
+    uint8_t *keys;
+    kv_bucket_t **children;
+    kv_bucket_t **child;
+    int new_type;
+    int byte;
+    int pos;
+
+    if (node->type == ART_NODE16 && node->child_num <= ART_SHRINK16)
+    {
+        new_type = ART_NODE4;
+    }
+    else if (node->type == ART_NODE48 && node->child_num <= ART_SHRINK48)
+    {
+        new_type = ART_NODE16;
+    }
+    else if (node->type == ART_NODE256 && node->child_num <= ART_SHRINK256)
+    {
+        new_type = ART_NODE48;
+    }
+    else
+    {
+        return;
+    }
+
+    new_node = kv_art_node_alloc(set, new_type);
+    if (new_node == NULL)
+    {
+        return;
+    }
+    memcpy(new_node, node, offsetof(kv_art_node_t, prefix) + sizeof(node->prefix));
+    new_node->type = (uint16_t)new_type;
+    new_node->leaf = node->leaf;
+
+    if (new_type == ART_NODE48)
+    {
+        pos = 0;
+        for (byte = 0; (child = kv_art_next(node, &byte)) != NULL; byte++)
+        {
+            ((kv_art_node48_t *)new_node)->index[byte] = (uint8_t)(pos + 1);
+            ((kv_art_node48_t *)new_node)->children[pos++] = *child;
+        }
+    }
+    else
+    {
+        if (new_type == ART_NODE4)
+        {
+            keys = ((kv_art_node4_t *)new_node)->keys;
+            children = ((kv_art_node4_t *)new_node)->children;
+        }
+        else
+        {
+            keys = ((kv_art_node16_t *)new_node)->keys;
+            children = ((kv_art_node16_t *)new_node)->children;
+        }
+        pos = 0;
+        for (byte = 0; (child = kv_art_next(node, &byte)) != NULL; byte++)
+        {
+            keys[pos] = (uint8_t)byte;
+            children[pos++] = *child;
+        }
+    }
+
+    *ref = ART_REF(new_node);
+    kv_art_node_free(set, node);
+}
+
+/**
+ * @brief remove the child of the node for the byte.
+ */
+static void kv_art_remove_child(kv_set_t *set, kv_bucket_t **ref, kv_art_node_t *node, uint8_t byte, kv_bucket_t **child)
+{
+    kv_art_node4_t *node4;
+    kv_art_node16_t *node16;
+    kv_art_node48_t *node48;
+    int pos;
+
+    switch (node->type)
+    {
+    case ART_NODE4:
+        node4 = (kv_art_node4_t *)node;
+        pos = (int)(child - node4->children);
+        memmove(node4->keys + pos, node4->keys + pos + 1, node->child_num - pos - 1);
+        memmove(node4->children + pos, node4->children + pos + 1, (node->child_num - pos - 1) * sizeof(kv_bucket_t *));
+        break;
+
+    case ART_NODE16:
+        node16 = (kv_art_node16_t *)node;
+        pos = (int)(child - node16->children);
+        memmove(node16->keys + pos, node16->keys + pos + 1, node->child_num - pos - 1);
+        memmove(node16->children + pos, node16->children + pos + 1, (node->child_num - pos - 1) * sizeof(kv_bucket_t *));
+        break;
+
+    case ART_NODE48:
+        node48 = (kv_art_node48_t *)node;
+        node48->index[byte] = 0;
+        *child = NULL;
+        break;
+
+    default:
+        *child = NULL;
+        break;
+    }
+    node->child_num--;
+
+    kv_art_shrink(set, ref, node);
+}
+
+/**
+ * @brief replace the node by its only child or its leaf, if it has nothing
+ *        else left. a child node takes over the compressed path of the node.
+ */
+static void kv_art_collapse(kv_set_t *set, kv_bucket_t **ref, kv_art_node_t *node)
+{
+    kv_art_node_t *child_node;
+    kv_bucket_t *child;
+    uint8_t prefix[ART_MAX_PREFIX];
+    size_t prefix_num;
+    int byte;
+
+    if (node->child_num == 0)
+    {
+        *ref = node->leaf;
+        kv_art_node_free(set, node);
+        return;
+    }
+    if (node->child_num != 1 || node->leaf != NULL)
+    {
+        return;
+    }
+
+    byte = 0;
+    child = *kv_art_next(node, &byte);
+    if (ART_IS_NODE(child))
+    {
+        /* the path of the child is appended to the path of the node and the byte */
+        child_node = ART_NODE(child);
+        prefix_num = node->prefix_len < ART_MAX_PREFIX ? node->prefix_len : ART_MAX_PREFIX;
+        memcpy(prefix, node->prefix, prefix_num);
+        if (prefix_num < ART_MAX_PREFIX)
+        {
+            prefix[prefix_num++] = (uint8_t)byte;
+        }
+        for (size_t i = 0; prefix_num < ART_MAX_PREFIX && i < child_node->prefix_len && i < ART_MAX_PREFIX; i++)
+        {
+            prefix[prefix_num++] = child_node->prefix[i];
+        }
+        memcpy(child_node->prefix, prefix, prefix_num);
+        child_node->prefix_len += node->prefix_len + 1;
+    }
+
+    *ref = child;
+    kv_art_node_free(set, node);
+}
+
+/**
+ * @brief get the number of the bytes of the compressed path which match the
+ *        key from the depth on.
+ */
+static uint32_t kv_art_prefix_match(kv_art_node_t *node, const char *key, size_t key_len, size_t depth)
+{
+    kv_bucket_t *leaf;
+    size_t max_num;
+    size_t i;
+
+    max_num = key_len - depth < node->prefix_len ? key_len - depth : node->prefix_len;
+    for (i = 0; i < max_num && i < ART_MAX_PREFIX; i++)
+    {
+        if (node->prefix[i] != (uint8_t)key[depth + i])
+        {
+            return (uint32_t)i;
+        }
+    }
+
+    /* the rest of the path is only held by the keys under the node */
+    if (max_num > ART_MAX_PREFIX)
+    {
+        leaf = kv_art_min_leaf(ART_REF(node));
+        for (; i < max_num; i++)
+        {
+            if (KV_BUCKET_KEY(leaf)[depth + i] != key[depth + i])
+            {
+                return (uint32_t)i;
+            }
+        }
+    }
+
+    return (uint32_t)i;
+}
+
+/**
+ * @brief find the location holding the bucket of the key.
+ * @note  the bytes of the compressed paths beyond ART_MAX_PREFIX are skipped,
+ *        the key of the bucket is compared at last instead.
+ *
+ * @param set     kv set pointer.
+ * @param key     key pointer.
+ * @param key_len length of the key.
+ * @param hash    hash value of the key.
+ * @return  location of the bucket, or NULL if the key isn't found.
+ */
+static kv_bucket_t **kv_art_search(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    kv_bucket_t **ref;
+    kv_art_node_t *node;
+    size_t depth;
+
+    ref = &set->art_root;
+    depth = 0;
+    while (*ref != NULL)
+    {
+        if (!ART_IS_NODE(*ref))
+        {
+            return KV_BUCKET_MATCH(*ref, key, key_len, hash) ? ref : NULL;
+        }
+
+        node = ART_NODE(*ref);
+        if (node->prefix_len != 0)
+        {
+            if (key_len - depth < node->prefix_len ||
+                memcmp(node->prefix, key + depth, node->prefix_len < ART_MAX_PREFIX ? node->prefix_len : ART_MAX_PREFIX) != 0)
+            {
+                return NULL;
+            }
+            depth += node->prefix_len;
+        }
+
+        if (depth == key_len)
+        {
+            return node->leaf != NULL && KV_BUCKET_MATCH(node->leaf, key, key_len, hash) ? &node->leaf : NULL;
+        }
+        ref = kv_art_child(node, (uint8_t)key[depth]);
+        if (ref == NULL)
+        {
+            return NULL;
+        }
+        depth++;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief replace the bucket at the location by a node holding it along with
+ *        the new bucket, whose key differs.
+ */
+static int kv_art_split_leaf(kv_set_t *set, kv_bucket_t **ref, kv_bucket_t *bucket, size_t depth)
+{
+    kv_bucket_t *old_bucket;
+    kv_art_node_t *new_node;
+    size_t min_len;
+    size_t i;
+
+    old_bucket = *ref;
+    new_node = kv_art_node_alloc(set, ART_NODE4);
+    if (new_node == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+
+    min_len = old_bucket->key_len < bucket->key_len ? old_bucket->key_len : bucket->key_len;
+    for (i = depth; i < min_len && KV_BUCKET_KEY(old_bucket)[i] == KV_BUCKET_KEY(bucket)[i]; i++);
+    new_node->prefix_len = (uint32_t)(i - depth);
+    memcpy(new_node->prefix, KV_BUCKET_KEY(bucket) + depth,
+           new_node->prefix_len < ART_MAX_PREFIX ? new_node->prefix_len : ART_MAX_PREFIX);
+
+    /* a node4 never grows here, the keys end at the node or take two bytes */
+    if (old_bucket->key_len == i)
+    {
+        new_node->leaf = old_bucket;
+    }
+    else
+    {
+        kv_art_add_child(set, ref, new_node, (uint8_t)KV_BUCKET_KEY(old_bucket)[i], old_bucket);
+    }
+    if (bucket->key_len == i)
+    {
+        new_node->leaf = bucket;
+    }
+    else
+    {
+        kv_art_add_child(set, ref, new_node, (uint8_t)KV_BUCKET_KEY(bucket)[i], bucket);
+    }
+    *ref = ART_REF(new_node);
+
+    return KV_OK;
+}
+
+/**
+ * @brief put a node in front of the node at the location, holding the part
+ *        of the compressed path which matches the new key.
+ */
+static int kv_art_split_node(kv_set_t *set, kv_bucket_t **ref, kv_bucket_t *bucket, size_t depth, uint32_t match_len)
+{
+    kv_art_node_t *node;
+    kv_art_node_t *new_node;
+    kv_bucket_t *leaf;
+    uint8_t byte;
+
+    node = ART_NODE(*ref);
+    new_node = kv_art_node_alloc(set, ART_NODE4);
+    if (new_node == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    new_node->prefix_len = match_len;
+    memcpy(new_node->prefix, node->prefix, match_len < ART_MAX_PREFIX ? match_len : ART_MAX_PREFIX);
+
+    /* the node keeps the part of the path after the mismatching byte */
+    if (node->prefix_len <= ART_MAX_PREFIX)
+    {
+        byte = node->prefix[match_len];
+        node->prefix_len -= match_len + 1;
+        memmove(node->prefix, node->prefix + match_len + 1, node->prefix_len);
+    }
+    else
+    {
+        leaf = kv_art_min_leaf(*ref);
+        byte = (uint8_t)KV_BUCKET_KEY(leaf)[depth + match_len];
+        node->prefix_len -= match_len + 1;
+        memcpy(node->prefix, KV_BUCKET_KEY(leaf) + depth + match_len + 1,
+               node->prefix_len < ART_MAX_PREFIX ? node->prefix_len : ART_MAX_PREFIX);
+    }
+    kv_art_add_child(set, ref, new_node, byte, *ref);
+
+    if (bucket->key_len == depth + match_len)
+    {
+        new_node->leaf = bucket;
+    }
+    else
+    {
+        kv_art_add_child(set, ref, new_node, (uint8_t)KV_BUCKET_KEY(bucket)[depth + match_len], bucket);
+    }
+    *ref = ART_REF(new_node);
+
+    return KV_OK;
+}
+
+/**
+ * @brief insert the bucket whose key isn't in the set yet.
+ */
+static int kv_art_insert(kv_set_t *set, kv_bucket_t *bucket)
+{
+    kv_bucket_t **ref;
+    kv_bucket_t **child;
+    kv_art_node_t *node;
+    const char *key;
+    size_t key_len;
+    uint32_t match_len;
+    size_t depth;
+
+    key = KV_BUCKET_KEY(bucket);
+    key_len = bucket->key_len;
+    ref = &set->art_root;
+    depth = 0;
+    while (KV_TRUE)
+    {
+        if (*ref == NULL)
+        {
+            *ref = bucket;
+            return KV_OK;
+        }
+        if (!ART_IS_NODE(*ref))
+        {
+            return kv_art_split_leaf(set, ref, bucket, depth);
+        }
+
+        node = ART_NODE(*ref);
+        if (node->prefix_len != 0)
+        {
+            match_len = kv_art_prefix_match(node, key, key_len, depth);
+            if (match_len < node->prefix_len)
+            {
+                return kv_art_split_node(set, ref, bucket, depth, match_len);
+            }
+            depth += node->prefix_len;
+        }
+
+        if (depth == key_len)
+        {
+            node->leaf = bucket;
+            return KV_OK;
+        }
+        child = kv_art_child(node, (uint8_t)key[depth]);
+        if (child == NULL)
+        {
+            return kv_art_add_child(set, ref, node, (uint8_t)key[depth], bucket);
+        }
+        ref = child;
+        depth++;
+    }
+}
+
+/**
+ * @brief remove the bucket of the key from the node at the location, and
+ *        the nodes left empty along the way.
+ */
+static void kv_art_delete(kv_set_t *set, kv_bucket_t **ref, const char *key, size_t key_len, size_t depth)
+{
+    kv_art_node_t *node;
+    kv_bucket_t **child;
+    uint8_t byte;
+
+    node = ART_NODE(*ref);
+    depth += node->prefix_len;
+    if (depth == key_len)
+    {
+        node->leaf = NULL;
+    }
+    else
+    {
+        byte = (uint8_t)key[depth];
+        child = kv_art_child(node, byte);
+        if (ART_IS_NODE(*child))
+        {
+            kv_art_delete(set, child, key, key_len, depth + 1);
+        }
+        else
+        {
+            *child = NULL;
+        }
+        if (*child == NULL)
+        {
+            kv_art_remove_child(set, ref, node, byte, child);
+            node = ART_NODE(*ref);
+        }
+    }
+
+    kv_art_collapse(set, ref, node);
+}
+
+static void kv_art_free(kv_set_t *set, kv_bucket_t *ref)
+{
+    kv_art_node_t *node;
+    kv_bucket_t **child;
+    int byte;
+
+    if (!ART_IS_NODE(ref))
+    {
+        if (set->arena_size == 0)
+        {
+            kv_bucket_free(set, ref);
+        }
+        return;
+    }
+
+    node = ART_NODE(ref);
+    if (node->leaf != NULL)
+    {
+        kv_art_free(set, node->leaf);
+    }
+    for (byte = 0; (child = kv_art_next(node, &byte)) != NULL; byte++)
+    {
+        kv_art_free(set, *child);
+    }
+    kv_art_node_free(set, node);
+}
+
+static void kv_art_visit(kv_bucket_t *ref, kv_visit_cb_t visit_cb, void *arg)
+{
+    kv_art_node_t *node;
+    kv_bucket_t **child;
+    int byte;
+
+    if (!ART_IS_NODE(ref))
+    {
+        visit_cb(arg, ref);
+        return;
+    }
+
+    node = ART_NODE(ref);
+    if (node->leaf != NULL)
+    {
+        visit_cb(arg, node->leaf);
+    }
+    for (byte = 0; (child = kv_art_next(node, &byte)) != NULL; byte++)
+    {
+        kv_art_visit(*child, visit_cb, arg);
+    }
+}
+
+/**
+ * @brief count the nodes passed to reach every bucket under the reference,
+ *        and the bytes of the nodes.
+ */
+static void kv_art_measure_ref(kv_bucket_t *ref, size_t depth, kv_stats_t *stats)
+{
+    kv_art_node_t *node;
+    kv_bucket_t **child;
+    int byte;
+
+    if (!ART_IS_NODE(ref))
+    {
+        kv_stats_length(stats, depth);
+        return;
+    }
+
+    node = ART_NODE(ref);
+    stats->memory_bytes += kv_art_node_size(node->type);
+    if (node->leaf != NULL)
+    {
+        kv_stats_length(stats, depth + 1);
+    }
+    for (byte = 0; (child = kv_art_next(node, &byte)) != NULL; byte++)
+    {
+        kv_art_measure_ref(*child, depth + 1, stats);
+    }
+}
+
+/**
+ * @brief visit the buckets under the reference in key order.
+ *
+ * @param ref       reference pointer.
+ * @param start     key the visiting starts from.
+ * @param start_len length of the key.
+ * @param depth     number of the key bytes consumed above the reference.
+ * @param bounded   whether the keys less than 'start' may be under the
+ *                  reference or not.
+ * @param scan_cb   pointer to visiting callback function.
+ * @param arg       argument of the callback function.
+ * @return  return KV_FALSE if the callback function stopped the visiting,
+ *          otherwise return KV_TRUE.
+ */
+static int kv_art_scan_ref(kv_bucket_t *ref, const char *start, size_t start_len, size_t depth, int bounded,
+                           kv_scan_cb_t scan_cb, void *arg)
+{
+    kv_art_node_t *node;
+    kv_bucket_t **child;
+    kv_bucket_t *leaf;
+    const uint8_t *prefix;
+    size_t min_len;
+    int res;
+    int byte;
+
+    if (!ART_IS_NODE(ref))
+    {
+        if (bounded == KV_TRUE)
+        {
+            min_len = ref->key_len < start_len ? ref->key_len : start_len;
+            res = memcmp(KV_BUCKET_KEY(ref), start, min_len);
+            if (res < 0 || (res == 0 && ref->key_len < start_len))
+            {
+                return KV_TRUE;
+            }
+        }
+        return scan_cb(arg, ref);
+    }
+
+    node = ART_NODE(ref);
+    if (bounded == KV_TRUE)
+    {
+        /* the whole compressed path is needed to compare it with the key */
+        prefix = node->prefix;
+        if (node->prefix_len > ART_MAX_PREFIX)
+        {
+            leaf = kv_art_min_leaf(ref);
+            prefix = (const uint8_t *)KV_BUCKET_KEY(leaf) + depth;
+        }
+        for (size_t i = 0; i < node->prefix_len; i++)
+        {
+            if (depth + i == start_len || prefix[i] > (uint8_t)start[depth + i])
+            {
+                bounded = KV_FALSE;
+                break;
+            }
+            if (prefix[i] < (uint8_t)start[depth + i])
+            {
+                return KV_TRUE;
+            }
+        }
+        depth += node->prefix_len;
+        if (depth >= start_len)
+        {
+            bounded = KV_FALSE;
+        }
+    }
+
+    if (bounded == KV_FALSE)
+    {
+        if (node->leaf != NULL && scan_cb(arg, node->leaf) == KV_FALSE)
+        {
+            return KV_FALSE;
+        }
+        byte = 0;
+    }
+    else
+    {
+        /* the leaf of the node is a proper prefix of the key, thus less */
+        byte = (uint8_t)start[depth];
+    }
+
+    for (; (child = kv_art_next(node, &byte)) != NULL; byte++)
+    {
+        res = kv_art_scan_ref(*child, start, start_len, depth + 1,
+                              bounded == KV_TRUE && byte == (uint8_t)start[depth] ? KV_TRUE : KV_FALSE,
+                              scan_cb, arg);
+        if (res == KV_FALSE)
+        {
+            return KV_FALSE;
+        }
+    }
+
+    return KV_TRUE;
+}
+
+static int kv_art_create(kv_set_t *set, const kv_conf_t *conf)
+{
+    set->art_root = NULL;
+    set->bucket_num = 0;
+
+    return KV_OK;
+}
+
+static void kv_art_clear(kv_set_t *set)
+{
+    if (set->art_root != NULL)
+    {
+        kv_art_free(set, set->art_root);
+        set->art_root = NULL;
+    }
+}
+
+static void kv_art_destroy(kv_set_t *set)
+{
+}
+
+static kv_bucket_t **kv_art_locate(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    kv_bucket_t **ref;
+
+    ref = kv_art_search(set, key, key_len, hash);
+
+    return ref != NULL ? ref : &kv_art_miss;
+}
+
+static kv_bucket_t *kv_art_find(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    kv_bucket_t **ref;
+
+    ref = kv_art_search(set, key, key_len, hash);
+
+    return ref != NULL ? *ref : NULL;
+}
+
+/**
+ * @brief the nodes to be visited depend on the key rather than the hash, only
+ *        the root is worth prefetching.
+ */
+static void kv_art_prefetch(kv_set_t *set, uint32_t hash, int stage)
+{
+    if (stage == 0 && ART_IS_NODE(set->art_root))
+    {
+        __builtin_prefetch(ART_NODE(set->art_root));
+    }
+}
+
+/**
+ * @brief the location is ignored, the bucket is inserted by its key instead,
+ *        since inserting may restructure the nodes on the path.
+ */
+static int kv_art_link(kv_set_t *set, kv_bucket_t **link, kv_bucket_t *bucket)
+{
+    bucket->next = NULL;
+
+    return kv_art_insert(set, bucket);
+}
+
+static void kv_art_unlink(kv_set_t *set, kv_bucket_t **link)
+{
+    kv_bucket_t *bucket;
+
+    bucket = *link;
+    if (!ART_IS_NODE(set->art_root))
+    {
+        set->art_root = NULL;
+        return;
+    }
+    kv_art_delete(set, &set->art_root, KV_BUCKET_KEY(bucket), bucket->key_len, 0);
+}
+
+static void kv_art_foreach(kv_set_t *set, kv_visit_cb_t visit_cb, void *arg)
+{
+    if (set->art_root != NULL)
+    {
+        kv_art_visit(set->art_root, visit_cb, arg);
+    }
+}
+
+static void kv_art_scan(kv_set_t *set, const char *start, size_t start_len, kv_scan_cb_t scan_cb, void *arg)
+{
+    if (set->art_root != NULL)
+    {
+        kv_art_scan_ref(set->art_root, start, start_len, 0, KV_TRUE, scan_cb, arg);
+    }
+}
+
+/* adaptive radix tree engine, the keys are kept in byte order */
+static void kv_art_measure(kv_set_t *set, kv_stats_t *stats)
+{
+    if (set->art_root != NULL)
+    {
+        kv_art_measure_ref(set->art_root, 0, stats);
+    }
+}
+
+/**
+ * @brief the nodes are modified in place, they can't be shared with a clone.
+ */
+static int kv_art_clone(kv_set_t *set, kv_set_t *clone)
+{
+    return KV_ERR_BAD_CONF;
+}
+
+const kv_engine_t kv_art_engine =
+{
+    .create = kv_art_create,
+    .clear = kv_art_clear,
+    .destroy = kv_art_destroy,
+    .locate = kv_art_locate,
+    .find = kv_art_find,
+    .prefetch = kv_art_prefetch,
+    .link = kv_art_link,
+    .unlink = kv_art_unlink,
+    .foreach = kv_art_foreach,
+    .scan = kv_art_scan,
+    .measure = kv_art_measure,
+    .clone = kv_art_clone,
+};
@@ -0,0 +1,249 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kv.h"
+#include "kv_inner.h"
+
+/* bits of a block, all the bits of a key are in one cache line */
+#define BLOCK_BITS      512
+
+/* number of the words of a block */
+#define BLOCK_WORDS     (BLOCK_BITS / 64)
+
+/* least number of the keys the filter is sized for */
+#define MIN_CAPACITY    256
+
+/* most bits set for a key */
+#define MAX_PROBE_NUM   16
+
+/* move on to the next bit of a key, a step of a 64-bit linear congruential generator */
+#define NEXT_PROBE(probe)   ((probe) * 0xFF51AFD7ED558CCDULL + 1)
+
+/* get the position in the block of a bit of a key */
+#define PROBE_BIT(probe)    ((probe) >> 55)
+
+/**
+ * blocked Bloom filter in front of the lookups. the bits of a key are all set
+ * in the block picked by its hash, so a lookup costs one cache miss at most.
+ * the bits of the deleted keys can't be cleared, so the filter is rebuilt
+ * from the set once they make up half of it, and when it outgrows its size.
+ */
+typedef struct kv_bloom
+{
+    /* blocks of the bits, aligned to cache lines */
+    uint64_t *blocks;
+
+    /* number of the blocks */
+    size_t block_num;
+
+    /* bits set for every key */
+    int probe_num;
+
+    /* bits per key needed to meet the false positive rate */
+    size_t bits_per_key;
+
+    /* number of the keys the filter is sized for */
+    size_t capacity;
+
+    /* number of the keys added since the filter was built */
+    size_t key_num;
+
+    /* number of the keys deleted since the filter was built */
+    size_t dead_num;
+} kv_bloom_t;
+
+/**
+ * @brief get the block of the hash, and the seed of the bits in the block.
+ */
+static uint64_t *kv_bloom_block(const kv_bloom_t *bloom, uint32_t hash, uint64_t *probe)
+{
+    /* the table picks its slot by the low bits, so they're mixed up first */
+    *probe = (uint64_t)hash * 0x9E3779B97F4A7C15ULL;
+
+    return bloom->blocks + ((*probe >> 32) * bloom->block_num >> 32) * BLOCK_WORDS;
+}
+
+static void kv_bloom_set(kv_bloom_t *bloom, uint32_t hash)
+{
+    uint64_t *block;
+    uint64_t probe;
+
+    block = kv_bloom_block(bloom, hash, &probe);
+    for (int i = 0; i < bloom->probe_num; i++)
+    {
+        probe = NEXT_PROBE(probe);
+        block[PROBE_BIT(probe) / 64] |= 1ULL << (PROBE_BIT(probe) % 64);
+    }
+    bloom->key_num++;
+}
+
+static void kv_bloom_visit(void *arg, kv_bucket_t *bucket)
+{
+    kv_bloom_set((kv_bloom_t *)arg, bucket->hash);
+}
+
+int kv_bloom_create(kv_set_t *set, const kv_conf_t *conf)
+{
+    kv_bloom_t *bloom;
+    size_t log_num;
+    double rate;
+
+    bloom = (kv_bloom_t *)malloc(sizeof(kv_bloom_t));
+    if (bloom == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    memset(bloom, 0, sizeof(kv_bloom_t));
+
+    /**
+     * an ideal filter needs log2(1 / rate) / ln(2) bits per key, about 1.44
+     * times the bits of the rate. the blocks fill unevenly, which costs a
+     * couple of bits more.
+     */
+    log_num = 0;
+    for (rate = conf->bloom_fpp; rate < 1; rate *= 2)
+    {
+        log_num++;
+    }
+    bloom->bits_per_key = log_num * 3 / 2 + 2;
+    bloom->probe_num = (int)(bloom->bits_per_key * 69 / 100);
+    if (bloom->probe_num > MAX_PROBE_NUM)
+    {
+        bloom->probe_num = MAX_PROBE_NUM;
+    }
+
+    set->bloom = bloom;
+    if (kv_bloom_rebuild(set) != KV_OK)
+    {
+        free(bloom);
+        set->bloom = NULL;
+        return KV_ERR_BAD_MEM;
+    }
+
+    return KV_OK;
+}
+
+void kv_bloom_clear(kv_set_t *set)
+{
+    memset(set->bloom->blocks, 0, set->bloom->block_num * BLOCK_WORDS * sizeof(uint64_t));
+    set->bloom->key_num = 0;
+    set->bloom->dead_num = 0;
+}
+
+void kv_bloom_destroy(kv_set_t *set)
+{
+    free(set->bloom->blocks);
+    free(set->bloom);
+    set->bloom = NULL;
+}
+
+/**
+ * @brief build the filter again from the keys in the set, sized for twice
+ *        their number.
+ * @note  the old filter is kept if out of memory, it has no false negatives
+ *        either, only more false positives.
+ *
+ * @param set kv set pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_bloom_rebuild(kv_set_t *set)
+{
+    kv_bloom_t *bloom;
+    uint64_t *blocks;
+    size_t block_num;
+    size_t capacity;
+
+    bloom = set->bloom;
+    capacity = set->pair_num * 2 > MIN_CAPACITY ? set->pair_num * 2 : MIN_CAPACITY;
+    block_num = (capacity * bloom->bits_per_key + BLOCK_BITS - 1) / BLOCK_BITS;
+    if (block_num > UINT32_MAX)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+
+    blocks = (uint64_t *)aligned_alloc(BLOCK_WORDS * sizeof(uint64_t), block_num * BLOCK_WORDS * sizeof(uint64_t));
+    if (blocks == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    memset(blocks, 0, block_num * BLOCK_WORDS * sizeof(uint64_t));
+
+    free(bloom->blocks);
+    bloom->blocks = blocks;
+    bloom->block_num = block_num;
+    bloom->capacity = block_num * BLOCK_BITS / bloom->bits_per_key;
+    bloom->key_num = 0;
+    bloom->dead_num = 0;
+    set->engine->foreach(set, kv_bloom_visit, bloom);
+
+    return KV_OK;
+}
+
+/**
+ * @brief add the key of a bucket just linked to the set.
+ * @note  the filter is rebuilt if it gets more keys than it's sized for.
+ */
+void kv_bloom_insert(kv_set_t *set, uint32_t hash)
+{
+    if (set->bloom->key_num >= set->bloom->capacity && kv_bloom_rebuild(set) == KV_OK)
+    {
+        return;
+    }
+
+    kv_bloom_set(set->bloom, hash);
+}
+
+/**
+ * @brief record a key unlinked from the set.
+ * @note  the filter is rebuilt once half of its keys are deleted.
+ */
+void kv_bloom_remove(kv_set_t *set)
+{
+    set->bloom->dead_num++;
+    if (set->bloom->dead_num > MIN_CAPACITY && set->bloom->dead_num > set->bloom->key_num / 2)
+    {
+        kv_bloom_rebuild(set);
+    }
+}
+
+/**
+ * @brief check if the key may be in the set.
+ *
+ * @param set   kv set pointer.
+ * @param hash  hash value of the key.
+ * @return  return KV_FALSE if the key isn't in the set, otherwise KV_TRUE.
+ */
+int kv_bloom_test(kv_set_t *set, uint32_t hash)
+{
+    const uint64_t *block;
+    uint64_t probe;
+
+    block = kv_bloom_block(set->bloom, hash, &probe);
+    for (int i = 0; i < set->bloom->probe_num; i++)
+    {
+        probe = NEXT_PROBE(probe);
+        if ((block[PROBE_BIT(probe) / 64] & (1ULL << (PROBE_BIT(probe) % 64))) == 0)
+        {
+            return KV_FALSE;
+        }
+    }
+
+    return KV_TRUE;
+}
+
+void kv_bloom_prefetch(kv_set_t *set, uint32_t hash)
+{
+    uint64_t probe;
+
+    __builtin_prefetch(kv_bloom_block(set->bloom, hash, &probe));
+}
+
+/**
+ * @brief add the bytes of the filter.
+ */
+void kv_bloom_stats(kv_set_t *set, kv_stats_t *stats)
+{
+    stats->memory_bytes += sizeof(kv_bloom_t) + set->bloom->block_num * BLOCK_WORDS * sizeof(uint64_t);
+}
@@ -0,0 +1,231 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kv.h"
+#include "kv_inner.h"
+
+/* initial number of the entries the ring can hold */
+#define DEF_RING_CAP    64
+
+/* bytes charged to the budget for the bucket */
+#define CHARGE_SIZE(set, bucket)    ((set)->bucket_prefix + KV_BUCKET_SIZE(bucket))
+
+/**
+ * clock of the cache mode, the buckets are kept in a ring swept by a hand,
+ * which evicts the first bucket not referenced since the last sweep.
+ */
+typedef struct kv_cache
+{
+    /* byte budget of the buckets */
+    size_t budget;
+
+    /* bytes charged for the buckets in the ring */
+    size_t used;
+
+    /* buckets in the ring */
+    kv_bucket_t **ring;
+
+    /* number of the buckets in member 'ring' */
+    size_t ring_num;
+
+    /* capacity of member 'ring' */
+    size_t ring_cap;
+
+    /* position of the hand in member 'ring' */
+    size_t hand;
+
+    /* number of the lookups which found the key */
+    uint64_t hits;
+
+    /* number of the lookups which didn't find the key */
+    uint64_t misses;
+
+    /* number of the buckets evicted */
+    uint64_t evictions;
+} kv_cache_t;
+
+int kv_cache_create(kv_set_t *set, const kv_conf_t *conf)
+{
+    kv_cache_t *cache;
+
+    cache = (kv_cache_t *)malloc(sizeof(kv_cache_t));
+    if (cache == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    memset(cache, 0, sizeof(kv_cache_t));
+    cache->budget = conf->cache_bytes;
+    cache->ring = (kv_bucket_t **)malloc(DEF_RING_CAP * sizeof(kv_bucket_t *));
+    if (cache->ring == NULL)
+    {
+        free(cache);
+        return KV_ERR_BAD_MEM;
+    }
+    cache->ring_cap = DEF_RING_CAP;
+
+    set->cache = cache;
+
+    return KV_OK;
+}
+
+void kv_cache_clear(kv_set_t *set)
+{
+    set->cache->ring_num = 0;
+    set->cache->used = 0;
+    set->cache->hand = 0;
+}
+
+void kv_cache_destroy(kv_set_t *set)
+{
+    free(set->cache->ring);
+    free(set->cache);
+    set->cache = NULL;
+}
+
+/**
+ * @brief add a new bucket to the ring.
+ * @note  the bucket isn't referenced until it's got, so a burst of new pairs
+ *        which are never got again are the first to be evicted.
+ *
+ * @param set     kv set pointer.
+ * @param bucket  bucket pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_cache_insert(kv_set_t *set, kv_bucket_t *bucket)
+{
+    kv_cache_t *cache;
+    kv_bucket_t **ring;
+
+    cache = set->cache;
+    if (cache->ring_num == cache->ring_cap)
+    {
+        if (cache->ring_cap > UINT32_MAX / 2)
+        {
+            return KV_ERR_BAD_MEM;
+        }
+        ring = (kv_bucket_t **)realloc(cache->ring, cache->ring_cap * 2 * sizeof(kv_bucket_t *));
+        if (ring == NULL)
+        {
+            return KV_ERR_BAD_MEM;
+        }
+        cache->ring = ring;
+        cache->ring_cap *= 2;
+    }
+
+    KV_CACHE_ENTRY(bucket)->slot = (uint32_t)cache->ring_num;
+    KV_CACHE_ENTRY(bucket)->referenced = KV_FALSE;
+    cache->ring[cache->ring_num++] = bucket;
+    cache->used += CHARGE_SIZE(set, bucket);
+
+    return KV_OK;
+}
+
+/**
+ * @brief let the new bucket take the place of the old one in the ring.
+ */
+void kv_cache_replace(kv_set_t *set, kv_bucket_t *old_bucket, kv_bucket_t *new_bucket)
+{
+    kv_cache_t *cache;
+    uint32_t slot;
+
+    cache = set->cache;
+    slot = KV_CACHE_ENTRY(old_bucket)->slot;
+    KV_CACHE_ENTRY(new_bucket)->slot = slot;
+    KV_CACHE_ENTRY(new_bucket)->referenced = KV_TRUE;
+    cache->ring[slot] = new_bucket;
+    cache->used += CHARGE_SIZE(set, new_bucket) - CHARGE_SIZE(set, old_bucket);
+}
+
+/**
+ * @brief remove the bucket from the ring before it's freed, the last bucket
+ *        of the ring fills the hole.
+ */
+void kv_cache_remove(kv_set_t *set, kv_bucket_t *bucket)
+{
+    kv_cache_t *cache;
+    kv_bucket_t *last_bucket;
+    uint32_t slot;
+
+    cache = set->cache;
+    slot = KV_CACHE_ENTRY(bucket)->slot;
+    last_bucket = cache->ring[--cache->ring_num];
+    cache->ring[slot] = last_bucket;
+    KV_CACHE_ENTRY(last_bucket)->slot = slot;
+    cache->used -= CHARGE_SIZE(set, bucket);
+}
+
+/**
+ * @brief record a lookup, and mark the bucket found as referenced.
+ * @note  only the bit of the bucket is written, no list is relinked, and the
+ *        bit isn't written again if it's already set, so concurrent readers
+ *        under a shared lock don't contend on it.
+ *
+ * @param set     kv set pointer.
+ * @param bucket  bucket found, or NULL.
+ */
+void kv_cache_touch(kv_set_t *set, kv_bucket_t *bucket)
+{
+    if (bucket == NULL)
+    {
+        __atomic_fetch_add(&set->cache->misses, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    __atomic_fetch_add(&set->cache->hits, 1, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&KV_CACHE_ENTRY(bucket)->referenced, __ATOMIC_RELAXED) == KV_FALSE)
+    {
+        __atomic_store_n(&KV_CACHE_ENTRY(bucket)->referenced, KV_TRUE, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief evict the cold buckets until the buckets fit in the budget.
+ * @note  the hand clears the referenced buckets it passes, and evicts the
+ *        first one not referenced. the bucket just put is never evicted, even
+ *        if it alone exceeds the budget.
+ *
+ * @param set   kv set pointer.
+ * @param keep  bucket just put.
+ */
+void kv_cache_evict(kv_set_t *set, kv_bucket_t *keep)
+{
+    kv_cache_t *cache;
+    kv_bucket_t *bucket;
+    kv_cache_entry_t *entry;
+
+    cache = set->cache;
+    while (cache->used > cache->budget && cache->ring_num > 1)
+    {
+        if (cache->hand >= cache->ring_num)
+        {
+            cache->hand = 0;
+        }
+        bucket = cache->ring[cache->hand];
+        entry = KV_CACHE_ENTRY(bucket);
+        if (bucket == keep || entry->referenced == KV_TRUE)
+        {
+            __atomic_store_n(&entry->referenced, KV_FALSE, __ATOMIC_RELAXED);
+            cache->hand++;
+            continue;
+        }
+
+        /* the hand stays, pointing to the bucket which fills the hole */
+        kv_bucket_drop(set, bucket);
+        cache->evictions++;
+    }
+}
+
+/**
+ * @brief report the budget usage and the counters of the cache, and add the
+ *        bytes of the clock.
+ */
+void kv_cache_stats(kv_set_t *set, kv_stats_t *stats)
+{
+    stats->memory_bytes += sizeof(kv_cache_t) + set->cache->ring_cap * sizeof(kv_bucket_t *);
+    stats->cache_used = set->cache->used;
+    stats->cache_hits = __atomic_load_n(&set->cache->hits, __ATOMIC_RELAXED);
+    stats->cache_misses = __atomic_load_n(&set->cache->misses, __ATOMIC_RELAXED);
+    stats->cache_evictions = set->cache->evictions;
+}
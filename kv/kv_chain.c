@@ -0,0 +1,697 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kv.h"
+#include "kv_inner.h"
+
+/* number of old buckets migrated by every operation while rehashing */
+#define REHASH_STEP_NUM 4
+
+/* map the hash to a bucket by its high bits, no division is needed */
+#define BUCKET_INDEX(hash, bucket_num)  ((size_t)(((uint64_t)(hash) * (bucket_num)) >> 32))
+
+/* number of the pages checked by every modification for the clones which still hold them */
+#define OWN_CHECK_NUM   4
+
+/* number of the chain heads of a page is 1 << PAGE_SHIFT */
+#define PAGE_SHIFT      8
+
+/* number of the chain heads of a page, the heads are shared and copied a page at a time */
+#define PAGE_SIZE       ((size_t)1 << PAGE_SHIFT)
+
+/* get the link to the head of the chain at the index of the table */
+#define TABLE_HEAD(table, index)    ((table)->pages[(index) >> PAGE_SHIFT]->heads + ((index) & (PAGE_SIZE - 1)))
+
+/* page of the chain heads, held by the tables of a set and its clones */
+typedef struct kv_page
+{
+    /* number of the tables holding the page, its chains are only modified while it's 1 */
+    size_t ref;
+
+    /* heads of the chains, PAGE_SIZE of them unless it's the last page */
+    kv_bucket_t *heads[];
+} kv_page_t;
+
+/**
+ * bucket table of the chain engine, held by a set and its clones. a clone
+ * holds the same tables as the set, and either of them copies a table(the
+ * page pointers only) and then a page(along with its chains) for itself
+ * before modifying a chain held by the other.
+ */
+typedef struct kv_table
+{
+    /* number of the sets holding the table, its pages are only replaced while it's 1 */
+    size_t ref;
+
+    /* number of buckets */
+    size_t bucket_num;
+
+    /* number of the pages in member 'pages' */
+    size_t page_num;
+
+    /* pages of the chain heads */
+    kv_page_t *pages[];
+} kv_table_t;
+
+/* page of the empty table, never freed */
+static kv_page_t kv_empty_page = { .ref = 1, .heads = { NULL } };
+
+/* table left to a cleared set whose table was shared if a new one can't be allocated, copied before it's modified */
+static kv_table_t kv_empty_table = { .ref = 1, .bucket_num = 1, .page_num = 1, .pages = { &kv_empty_page } };
+
+/**
+ * @brief get the number of the chain heads of the page.
+ */
+static size_t kv_page_len(const kv_table_t *table, size_t page)
+{
+    return page + 1 < table->page_num ? PAGE_SIZE : table->bucket_num - page * PAGE_SIZE;
+}
+
+/**
+ * @brief free the buckets of the chains, the chains are only dropped if the
+ *        buckets belong to the arena.
+ */
+static void kv_free_chains(kv_set_t *set, kv_bucket_t **heads, size_t len)
+{
+    kv_bucket_t *curt_bucket;
+    kv_bucket_t *next_bucket;
+
+    if (set->arena_size != 0)
+    {
+        memset(heads, 0, len * sizeof(kv_bucket_t *));
+        return;
+    }
+
+    for (size_t i = 0; i < len; i++)
+    {
+        next_bucket = heads[i];
+        while (next_bucket != NULL)
+        {
+            curt_bucket = next_bucket;
+            next_bucket = curt_bucket->next;
+            kv_bucket_free(set, curt_bucket);
+        }
+        heads[i] = NULL;
+    }
+}
+
+/**
+ * @brief stop holding the page, it's freed along with its chains once no
+ *        table holds it.
+ */
+static void kv_page_release(kv_set_t *set, kv_page_t *page, size_t len)
+{
+    if (__atomic_sub_fetch(&page->ref, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        kv_free_chains(set, page->heads, len);
+        free(page);
+    }
+}
+
+/**
+ * @brief copy the page along with its chains, the buckets keep their order.
+ * @return  the new page held by nobody yet, or NULL if out of memory.
+ */
+static kv_page_t *kv_page_copy(kv_set_t *set, const kv_page_t *page, size_t len)
+{
+    kv_page_t *new_page;
+    kv_bucket_t **link;
+    kv_bucket_t *curt_bucket;
+    kv_bucket_t *new_bucket;
+
+    new_page = (kv_page_t *)malloc(sizeof(kv_page_t) + len * sizeof(kv_bucket_t *));
+    if (new_page == NULL)
+    {
+        return NULL;
+    }
+    new_page->ref = 1;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        link = new_page->heads + i;
+        for (curt_bucket = page->heads[i]; curt_bucket != NULL; curt_bucket = curt_bucket->next)
+        {
+            new_bucket = kv_bucket_alloc(set, curt_bucket->hash, KV_BUCKET_KEY(curt_bucket), curt_bucket->key_len,
+                                         KV_BUCKET_VALUE(curt_bucket), curt_bucket->value_len);
+            if (new_bucket == NULL)
+            {
+                *link = NULL;
+                kv_free_chains(set, new_page->heads, i + 1);
+                free(new_page);
+                return NULL;
+            }
+            *link = new_bucket;
+            link = &new_bucket->next;
+        }
+        *link = NULL;
+    }
+
+    return new_page;
+}
+
+/**
+ * @brief allocate a table of empty chains.
+ * @return  the new table held by nobody yet, or NULL if out of memory.
+ */
+static kv_table_t *kv_table_alloc(size_t bucket_num)
+{
+    kv_table_t *table;
+    size_t page_num;
+    size_t len;
+
+    page_num = (bucket_num + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (page_num > (SIZE_MAX - sizeof(kv_table_t)) / sizeof(kv_page_t *) / PAGE_SIZE)
+    {
+        return NULL;
+    }
+
+    table = (kv_table_t *)malloc(sizeof(kv_table_t) + page_num * sizeof(kv_page_t *));
+    if (table == NULL)
+    {
+        return NULL;
+    }
+    table->ref = 1;
+    table->bucket_num = bucket_num;
+    table->page_num = page_num;
+
+    for (size_t i = 0; i < page_num; i++)
+    {
+        len = kv_page_len(table, i);
+        table->pages[i] = (kv_page_t *)calloc(1, sizeof(kv_page_t) + len * sizeof(kv_bucket_t *));
+        if (table->pages[i] == NULL)
+        {
+            while (i-- > 0)
+            {
+                free(table->pages[i]);
+            }
+            free(table);
+            return NULL;
+        }
+        table->pages[i]->ref = 1;
+    }
+
+    return table;
+}
+
+/**
+ * @brief stop holding the table, it's freed along with its pages once no set
+ *        holds it.
+ */
+static void kv_table_release(kv_set_t *set, kv_table_t *table)
+{
+    if (__atomic_sub_fetch(&table->ref, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        for (size_t i = 0; i < table->page_num; i++)
+        {
+            kv_page_release(set, table->pages[i], kv_page_len(table, i));
+        }
+        free(table);
+    }
+}
+
+/**
+ * @brief give the set its own copy of the page of the table, and of the
+ *        table itself, unless they're only held by the set.
+ * @note  the copies are only made while the set may share the table with
+ *        its clones, the table is replaced at its location in the set.
+ *
+ * @param set   kv set pointer.
+ * @param table location of the table in the set.
+ * @param page  index of the page.
+ * @return  return KV_OK if success, or KV_ERR_BAD_MEM if the copies can't be
+ *          made, then nothing is modified.
+ */
+static int kv_table_own(kv_set_t *set, kv_table_t **table, size_t page)
+{
+    kv_table_t *new_table;
+    kv_page_t *new_page;
+    size_t len;
+
+    if (__atomic_load_n(&(*table)->ref, __ATOMIC_ACQUIRE) != 1)
+    {
+        new_table = (kv_table_t *)malloc(sizeof(kv_table_t) + (*table)->page_num * sizeof(kv_page_t *));
+        if (new_table == NULL)
+        {
+            return KV_ERR_BAD_MEM;
+        }
+        new_table->ref = 1;
+        new_table->bucket_num = (*table)->bucket_num;
+        new_table->page_num = (*table)->page_num;
+        memcpy(new_table->pages, (*table)->pages, new_table->page_num * sizeof(kv_page_t *));
+        for (size_t i = 0; i < new_table->page_num; i++)
+        {
+            __atomic_add_fetch(&new_table->pages[i]->ref, 1, __ATOMIC_RELAXED);
+        }
+        kv_table_release(set, *table);
+        *table = new_table;
+    }
+
+    if (__atomic_load_n(&(*table)->pages[page]->ref, __ATOMIC_ACQUIRE) != 1)
+    {
+        len = kv_page_len(*table, page);
+        new_page = kv_page_copy(set, (*table)->pages[page], len);
+        if (new_page == NULL)
+        {
+            return KV_ERR_BAD_MEM;
+        }
+        kv_page_release(set, (*table)->pages[page], len);
+        (*table)->pages[page] = new_page;
+    }
+
+    return KV_OK;
+}
+
+/**
+ * @brief migrate a few buckets from the old table to the new one.
+ * @note  the old table is released once all of its buckets are migrated.
+ *        the buckets of an old chain at index i go to the chains at 2i and
+ *        2i+1 of the new table, which are on the same page.
+ * 
+ * @param set kv set pointer.
+ */
+static void kv_rehash_step(kv_set_t *set)
+{
+    kv_bucket_t **old_head;
+    kv_bucket_t **new_head;
+    kv_bucket_t *curt_bucket;
+    kv_bucket_t *next_bucket;
+
+    if (set->old_table == NULL)
+    {
+        return;
+    }
+
+    for (int i = 0; i < REHASH_STEP_NUM; i++)
+    {
+        if (set->rehash_index == set->old_table->bucket_num)
+        {
+            break;
+        }
+
+        /* the chains shared are copied before they're moved, or left for later if out of memory */
+        if (set->shared == KV_TRUE &&
+            (kv_table_own(set, &set->old_table, set->rehash_index >> PAGE_SHIFT) != KV_OK ||
+             kv_table_own(set, &set->table, (set->rehash_index * 2) >> PAGE_SHIFT) != KV_OK))
+        {
+            break;
+        }
+
+        /* move every bucket on this chain to the head of its new chain */
+        old_head = TABLE_HEAD(set->old_table, set->rehash_index);
+        curt_bucket = *old_head;
+        while (curt_bucket != NULL)
+        {
+            next_bucket = curt_bucket->next;
+            new_head = TABLE_HEAD(set->table, BUCKET_INDEX(curt_bucket->hash, set->bucket_num));
+            curt_bucket->next = *new_head;
+            *new_head = curt_bucket;
+            curt_bucket = next_bucket;
+        }
+        *old_head = NULL;
+        set->rehash_index++;
+    }
+
+    if (set->rehash_index == set->old_table->bucket_num)
+    {
+        kv_table_release(set, set->old_table);
+        set->old_table = NULL;
+        set->rehash_index = 0;
+    }
+}
+
+/**
+ * @brief start growing the bucket table if the load factor is exceeded.
+ * @note  the buckets are migrated later by kv_rehash_step(), if the new table
+ *        can't be allocated, the set just keeps using the current one.
+ * 
+ * @param set kv set pointer.
+ */
+static void kv_grow(kv_set_t *set)
+{
+    kv_table_t *new_table;
+
+    /* one rehashing at a time */
+    if (set->old_table != NULL)
+    {
+        return;
+    }
+
+    if (set->pair_num * 100 < set->bucket_num * set->max_load)
+    {
+        return;
+    }
+
+    if (set->bucket_num > SIZE_MAX / 2 / sizeof(kv_bucket_t *))
+    {
+        return;
+    }
+
+    new_table = kv_table_alloc(set->bucket_num * 2);
+    if (new_table == NULL)
+    {
+        return;
+    }
+
+    set->old_table = set->table;
+    set->rehash_index = 0;
+    set->table = new_table;
+    set->bucket_num *= 2;
+    set->own_index = 0;
+    KV_STATS_INC(set, rehash_num);
+}
+
+static int kv_chain_create(kv_set_t *set, const kv_conf_t *conf)
+{
+    set->table = kv_table_alloc(conf->bucket_num);
+    if (set->table == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    set->bucket_num = conf->bucket_num;
+
+    return KV_OK;
+}
+
+/**
+ * @brief free all the chains, any unfinished rehashing is dropped along with
+ *        the old table.
+ * @note  if the set may share its table with the clones, the table is
+ *        released instead, and replaced by a new one of the same size, so the
+ *        set no longer shares anything. if the new table can't be allocated,
+ *        the set is left with the empty table of one bucket, which is copied
+ *        before it's modified.
+ * 
+ * @param set kv set pointer.
+ */
+static void kv_chain_clear(kv_set_t *set)
+{
+    kv_table_t *new_table;
+
+    if (set->old_table != NULL)
+    {
+        kv_table_release(set, set->old_table);
+        set->old_table = NULL;
+        set->rehash_index = 0;
+    }
+
+    if (set->shared == KV_TRUE)
+    {
+        kv_table_release(set, set->table);
+        new_table = kv_table_alloc(set->bucket_num);
+        if (new_table == NULL)
+        {
+            __atomic_add_fetch(&kv_empty_table.ref, 1, __ATOMIC_RELAXED);
+            new_table = &kv_empty_table;
+        }
+        else
+        {
+            set->shared = KV_FALSE;
+        }
+        set->table = new_table;
+        set->bucket_num = new_table->bucket_num;
+        set->own_index = 0;
+        return;
+    }
+
+    for (size_t i = 0; i < set->table->page_num; i++)
+    {
+        kv_free_chains(set, set->table->pages[i]->heads, kv_page_len(set->table, i));
+    }
+}
+
+static void kv_chain_destroy(kv_set_t *set)
+{
+    kv_table_release(set, set->table);
+}
+
+/**
+ * @brief get the head of the chain the hash belongs to.
+ * @note  the old table holds the chain if its bucket hasn't been migrated yet.
+ */
+static kv_bucket_t **kv_chain_head(kv_set_t *set, uint32_t hash)
+{
+    size_t array_index;
+
+    if (set->old_table != NULL)
+    {
+        array_index = BUCKET_INDEX(hash, set->old_table->bucket_num);
+        if (array_index >= set->rehash_index)
+        {
+            return TABLE_HEAD(set->old_table, array_index);
+        }
+    }
+
+    return TABLE_HEAD(set->table, BUCKET_INDEX(hash, set->bucket_num));
+}
+
+/**
+ * @brief find the link on chain which points to the bucket holding the key.
+ * @note  the key is searched in the old table if its old bucket hasn't been
+ *        migrated yet, otherwise in the new table. if the key isn't found,
+ *        the returned link is the tail of that chain, which points to NULL.
+ * 
+ * @param set     kv set pointer.
+ * @param key     key pointer.
+ * @param key_len length of the key.
+ * @param hash    hash value of the key.
+ * @return  pointer to the link.
+ */
+static kv_bucket_t **kv_chain_search(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    kv_bucket_t **bucket_next;
+
+    bucket_next = kv_chain_head(set, hash);
+
+    /* seach this key on chain, only compare the keys with the same hash */
+    while (*bucket_next != NULL)
+    {
+        if (KV_BUCKET_MATCH(*bucket_next, key, key_len, hash))
+        {
+            break;
+        }
+        bucket_next = &((*bucket_next)->next);
+    }
+
+    return bucket_next;
+}
+
+/**
+ * @brief migrate a few buckets if the set is rehashing, then find the link
+ *        on chain which points to the bucket holding the key.
+ */
+static kv_bucket_t **kv_chain_locate(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    kv_rehash_step(set);
+
+    return kv_chain_search(set, key, key_len, hash);
+}
+
+/**
+ * @brief find the bucket holding the key without modifying the set.
+ */
+static kv_bucket_t *kv_chain_find(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    return *kv_chain_search(set, key, key_len, hash);
+}
+
+static void kv_chain_prefetch(kv_set_t *set, uint32_t hash, int stage)
+{
+    kv_bucket_t **head;
+
+    head = kv_chain_head(set, hash);
+    if (stage == 0)
+    {
+        __builtin_prefetch(head);
+    }
+    else if (*head != NULL)
+    {
+        __builtin_prefetch(*head);
+    }
+}
+
+static int kv_chain_link(kv_set_t *set, kv_bucket_t **link, kv_bucket_t *bucket)
+{
+    bucket->next = NULL;
+    *link = bucket;
+
+    kv_grow(set);
+
+    return KV_OK;
+}
+
+static void kv_chain_unlink(kv_set_t *set, kv_bucket_t **link)
+{
+    *link = (*link)->next;
+}
+
+/**
+ * @brief visit the buckets on the chains of the table, starting from the
+ *        chain at the index.
+ */
+static void kv_table_foreach(kv_table_t *table, size_t start, kv_visit_cb_t visit_cb, void *arg)
+{
+    kv_bucket_t *curt_bucket;
+
+    for (size_t i = start; i < table->bucket_num; i++)
+    {
+        curt_bucket = *TABLE_HEAD(table, i);
+        while (curt_bucket != NULL)
+        {
+            visit_cb(arg, curt_bucket);
+            curt_bucket = curt_bucket->next;
+        }
+    }
+}
+
+static void kv_chain_foreach(kv_set_t *set, kv_visit_cb_t visit_cb, void *arg)
+{
+    /* visit the buckets which haven't been migrated yet */
+    if (set->old_table != NULL)
+    {
+        kv_table_foreach(set->old_table, set->rehash_index, visit_cb, arg);
+    }
+
+    kv_table_foreach(set->table, 0, visit_cb, arg);
+}
+
+/**
+ * @brief count the length of every chain of the table, starting from the
+ *        chain at the index, and add the bytes of the table.
+ */
+static void kv_table_measure(kv_table_t *table, size_t start, kv_stats_t *stats)
+{
+    kv_bucket_t *curt_bucket;
+    size_t length;
+
+    for (size_t i = start; i < table->bucket_num; i++)
+    {
+        length = 0;
+        for (curt_bucket = *TABLE_HEAD(table, i); curt_bucket != NULL; curt_bucket = curt_bucket->next)
+        {
+            length++;
+        }
+        kv_stats_length(stats, length);
+    }
+
+    stats->memory_bytes += sizeof(kv_table_t) + table->page_num * (sizeof(kv_page_t *) + sizeof(kv_page_t)) +
+                           table->bucket_num * sizeof(kv_bucket_t *);
+}
+
+/**
+ * @brief count the length of every chain, the ones on the old table which
+ *        haven't been migrated included.
+ * @note  the tables and the pages shared with the clones are counted by
+ *        every set holding them.
+ */
+static void kv_chain_measure(kv_set_t *set, kv_stats_t *stats)
+{
+    if (set->old_table != NULL)
+    {
+        kv_table_measure(set->old_table, set->rehash_index, stats);
+    }
+    kv_table_measure(set->table, 0, stats);
+}
+
+/**
+ * @brief check a few more pages of the table for the clones which still
+ *        hold them, the set stops sharing once none of them is held.
+ * @note  member 'own_index' of the set is the number of the first pages
+ *        found to be held by the table only, which stay so until the set is
+ *        cloned again, as long as the table itself is only held by the set.
+ */
+static void kv_chain_unshare(kv_set_t *set)
+{
+    kv_table_t *table;
+
+    table = set->table;
+    if (set->old_table != NULL || __atomic_load_n(&table->ref, __ATOMIC_ACQUIRE) != 1)
+    {
+        set->own_index = 0;
+        return;
+    }
+
+    for (int i = 0; i < OWN_CHECK_NUM && set->own_index < table->page_num; i++)
+    {
+        if (__atomic_load_n(&table->pages[set->own_index]->ref, __ATOMIC_ACQUIRE) != 1)
+        {
+            return;
+        }
+        set->own_index++;
+    }
+
+    if (set->own_index == table->page_num)
+    {
+        set->shared = KV_FALSE;
+        set->own_index = 0;
+    }
+}
+
+/**
+ * @brief copy the pages the chain of the hash is on, if they're shared.
+ * @note  the page of the new table is owned as well while rehashing, since
+ *        the chain may be migrated before it's modified.
+ */
+static int kv_chain_own(kv_set_t *set, uint32_t hash)
+{
+    size_t array_index;
+    int res;
+
+    if (set->old_table != NULL)
+    {
+        array_index = BUCKET_INDEX(hash, set->old_table->bucket_num);
+        if (array_index >= set->rehash_index)
+        {
+            res = kv_table_own(set, &set->old_table, array_index >> PAGE_SHIFT);
+            if (res != KV_OK)
+            {
+                return res;
+            }
+        }
+    }
+
+    res = kv_table_own(set, &set->table, BUCKET_INDEX(hash, set->bucket_num) >> PAGE_SHIFT);
+    if (res == KV_OK)
+    {
+        kv_chain_unshare(set);
+    }
+
+    return res;
+}
+
+/**
+ * @brief share the tables with the clone, whose other members are copies of
+ *        the set's, an unfinished rehashing goes on in both of them.
+ */
+static int kv_chain_clone(kv_set_t *set, kv_set_t *clone)
+{
+    __atomic_add_fetch(&set->table->ref, 1, __ATOMIC_RELAXED);
+    if (set->old_table != NULL)
+    {
+        __atomic_add_fetch(&set->old_table->ref, 1, __ATOMIC_RELAXED);
+    }
+    set->shared = KV_TRUE;
+    set->own_index = 0;
+    clone->shared = KV_TRUE;
+    clone->own_index = 0;
+
+    return KV_OK;
+}
+
+/* separate chaining engine, the default one */
+const kv_engine_t kv_chain_engine =
+{
+    .create = kv_chain_create,
+    .clear = kv_chain_clear,
+    .destroy = kv_chain_destroy,
+    .locate = kv_chain_locate,
+    .find = kv_chain_find,
+    .prefetch = kv_chain_prefetch,
+    .link = kv_chain_link,
+    .unlink = kv_chain_unlink,
+    .foreach = kv_chain_foreach,
+    .measure = kv_chain_measure,
+    .clone = kv_chain_clone,
+    .own = kv_chain_own,
+};
@@ -0,0 +1,358 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kv.h"
+#include "kv_inner.h"
+
+/* index slot which has never been used */
+#define INDEX_EMPTY     UINT32_MAX
+
+/* index slot whose entry has been deleted */
+#define INDEX_DUMMY     (UINT32_MAX - 1)
+
+/* at most 2/3 of the index slots are used, so the probe sequences stay short */
+#define USABLE(slot_num)    ((slot_num) - (slot_num) / 3)
+
+/* entry of the dense array, in the order the keys were put */
+typedef struct kv_entry
+{
+    /* bucket holding the pair, NULL if it has been deleted */
+    kv_bucket_t *bucket;
+
+    /* hash value of the key, checked before the bucket is touched */
+    uint32_t hash;
+} kv_entry_t;
+
+/* location returned by 'locate' if the key isn't found, it always holds NULL */
+static kv_bucket_t *kv_compact_miss;
+
+/**
+ * @brief store the position of an entry in the first unused slot on the probe
+ *        sequence of the hash.
+ * @note  there is always an empty slot since the index never gets full.
+ */
+static void kv_compact_index(kv_set_t *set, uint32_t hash, uint32_t position)
+{
+    size_t mask;
+    size_t slot;
+
+    mask = set->bucket_num - 1;
+    slot = hash & mask;
+    while (set->indices[slot] < INDEX_DUMMY)
+    {
+        slot = (slot + 1) & mask;
+    }
+    set->indices[slot] = position;
+}
+
+/**
+ * @brief squeeze the deleted entries out of the dense array in place, keeping
+ *        the order of the others, and rebuild the index.
+ */
+static void kv_compact_squeeze(kv_set_t *set)
+{
+    size_t entry_num;
+
+    entry_num = 0;
+    for (size_t i = 0; i < set->entry_num; i++)
+    {
+        if (set->entries[i].bucket != NULL)
+        {
+            set->entries[entry_num++] = set->entries[i];
+        }
+    }
+    set->entry_num = entry_num;
+    set->dead_num = 0;
+
+    memset(set->indices, 0xFF, set->bucket_num * sizeof(uint32_t));
+    for (size_t i = 0; i < set->entry_num; i++)
+    {
+        kv_compact_index(set, set->entries[i].hash, (uint32_t)i);
+    }
+}
+
+/**
+ * @brief double the index and the dense array, the deleted entries are
+ *        squeezed out on the way.
+ *
+ * @param set kv set pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+static int kv_compact_grow(kv_set_t *set)
+{
+    size_t new_slot_num;
+    uint32_t *new_indices;
+    kv_entry_t *new_entries;
+
+    if (set->bucket_num > UINT32_MAX / 2)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    new_slot_num = set->bucket_num * 2;
+    KV_STATS_INC(set, rehash_num);
+
+    new_indices = (uint32_t *)malloc(new_slot_num * sizeof(uint32_t));
+    if (new_indices == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    new_entries = (kv_entry_t *)realloc(set->entries, USABLE(new_slot_num) * sizeof(kv_entry_t));
+    if (new_entries == NULL)
+    {
+        free(new_indices);
+        return KV_ERR_BAD_MEM;
+    }
+
+    free(set->indices);
+    set->indices = new_indices;
+    set->entries = new_entries;
+    set->bucket_num = new_slot_num;
+    kv_compact_squeeze(set);
+
+    return KV_OK;
+}
+
+/**
+ * @brief allocate the index and the dense array, the number of the index
+ *        slots is rounded up to a power of two.
+ */
+static int kv_compact_create(kv_set_t *set, const kv_conf_t *conf)
+{
+    size_t slot_num;
+
+    slot_num = 16;
+    while (slot_num < conf->bucket_num)
+    {
+        slot_num *= 2;
+    }
+
+    set->indices = (uint32_t *)malloc(slot_num * sizeof(uint32_t));
+    if (set->indices == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    set->entries = (kv_entry_t *)malloc(USABLE(slot_num) * sizeof(kv_entry_t));
+    if (set->entries == NULL)
+    {
+        free(set->indices);
+        return KV_ERR_BAD_MEM;
+    }
+    memset(set->indices, 0xFF, slot_num * sizeof(uint32_t));
+    set->bucket_num = slot_num;
+
+    return KV_OK;
+}
+
+static void kv_compact_clear(kv_set_t *set)
+{
+    if (set->arena_size == 0)
+    {
+        for (size_t i = 0; i < set->entry_num; i++)
+        {
+            if (set->entries[i].bucket != NULL)
+            {
+                kv_bucket_free(set, set->entries[i].bucket);
+            }
+        }
+    }
+    memset(set->indices, 0xFF, set->bucket_num * sizeof(uint32_t));
+    set->entry_num = 0;
+    set->dead_num = 0;
+}
+
+static void kv_compact_destroy(kv_set_t *set)
+{
+    free(set->indices);
+    free(set->entries);
+}
+
+/**
+ * @brief probe the index linearly for the entry holding the key.
+ * @note  only the entries whose hash values are the same get their buckets
+ *        compared. the location returned points into the dense array, so the
+ *        bucket can be replaced in place without changing the order.
+ *
+ * @param set     kv set pointer.
+ * @param key     key pointer.
+ * @param key_len length of the key.
+ * @param hash    hash value of the key.
+ * @return  pointer to the bucket of the entry, or to NULL if not found.
+ */
+static kv_bucket_t **kv_compact_locate(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    size_t mask;
+    size_t slot;
+    uint32_t position;
+    kv_entry_t *entry;
+
+    mask = set->bucket_num - 1;
+    for (slot = hash & mask; ; slot = (slot + 1) & mask)
+    {
+        position = set->indices[slot];
+        if (position == INDEX_EMPTY)
+        {
+            return &kv_compact_miss;
+        }
+        if (position == INDEX_DUMMY)
+        {
+            continue;
+        }
+
+        entry = set->entries + position;
+        if (entry->hash == hash && KV_BUCKET_MATCH(entry->bucket, key, key_len, hash))
+        {
+            return &entry->bucket;
+        }
+    }
+}
+
+static kv_bucket_t *kv_compact_find(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    return *kv_compact_locate(set, key, key_len, hash);
+}
+
+/**
+ * @brief prefetch the first index slot on the probe sequence, then the entry
+ *        it points to.
+ */
+static void kv_compact_prefetch(kv_set_t *set, uint32_t hash, int stage)
+{
+    uint32_t position;
+
+    if (stage == 0)
+    {
+        __builtin_prefetch(set->indices + (hash & (set->bucket_num - 1)));
+        return;
+    }
+
+    position = set->indices[hash & (set->bucket_num - 1)];
+    if (position < INDEX_DUMMY)
+    {
+        __builtin_prefetch(set->entries + position);
+    }
+}
+
+/**
+ * @brief append the bucket to the dense array, the array is squeezed if half
+ *        of it is deleted once it gets full, otherwise it grows.
+ */
+static int kv_compact_link(kv_set_t *set, kv_bucket_t **link, kv_bucket_t *bucket)
+{
+    int res;
+
+    if (set->entry_num == USABLE(set->bucket_num))
+    {
+        if (set->dead_num >= set->entry_num / 2)
+        {
+            kv_compact_squeeze(set);
+            KV_STATS_INC(set, rehash_num);
+        }
+        else
+        {
+            res = kv_compact_grow(set);
+            if (res != KV_OK)
+            {
+                return res;
+            }
+        }
+    }
+
+    bucket->next = NULL;
+    set->entries[set->entry_num].bucket = bucket;
+    set->entries[set->entry_num].hash = bucket->hash;
+    kv_compact_index(set, bucket->hash, (uint32_t)set->entry_num);
+    set->entry_num++;
+
+    return KV_OK;
+}
+
+/**
+ * @brief leave a tombstone in the dense array and in the index, the array is
+ *        squeezed once most of it is tombstones.
+ */
+static void kv_compact_unlink(kv_set_t *set, kv_bucket_t **link)
+{
+    kv_entry_t *entry;
+    uint32_t position;
+    size_t mask;
+    size_t slot;
+
+    entry = (kv_entry_t *)((char *)link - offsetof(kv_entry_t, bucket));
+    position = (uint32_t)(entry - set->entries);
+
+    mask = set->bucket_num - 1;
+    slot = entry->hash & mask;
+    while (set->indices[slot] != position)
+    {
+        slot = (slot + 1) & mask;
+    }
+    set->indices[slot] = INDEX_DUMMY;
+    entry->bucket = NULL;
+    set->dead_num++;
+
+    if (set->dead_num > set->entry_num / 2 + 8)
+    {
+        kv_compact_squeeze(set);
+        KV_STATS_INC(set, rehash_num);
+    }
+}
+
+static void kv_compact_foreach(kv_set_t *set, kv_visit_cb_t visit_cb, void *arg)
+{
+    for (size_t i = 0; i < set->entry_num; i++)
+    {
+        if (set->entries[i].bucket != NULL)
+        {
+            visit_cb(arg, set->entries[i].bucket);
+        }
+    }
+}
+
+/**
+ * @brief count the index slots probed to find every key.
+ */
+static void kv_compact_measure(kv_set_t *set, kv_stats_t *stats)
+{
+    size_t mask;
+    size_t slot;
+
+    mask = set->bucket_num - 1;
+    for (size_t i = 0; i < set->bucket_num; i++)
+    {
+        if (set->indices[i] >= INDEX_DUMMY)
+        {
+            continue;
+        }
+
+        slot = set->entries[set->indices[i]].hash & mask;
+        kv_stats_length(stats, ((i - slot) & mask) + 1);
+    }
+
+    stats->memory_bytes += set->bucket_num * sizeof(uint32_t) + USABLE(set->bucket_num) * sizeof(kv_entry_t);
+}
+
+/**
+ * @brief the dense array is squeezed in place, it can't be shared with a clone.
+ */
+static int kv_compact_clone(kv_set_t *set, kv_set_t *clone)
+{
+    return KV_ERR_BAD_CONF;
+}
+
+/* compact engine, a sparse index into a dense array kept in insertion order */
+const kv_engine_t kv_compact_engine =
+{
+    .create = kv_compact_create,
+    .clear = kv_compact_clear,
+    .destroy = kv_compact_destroy,
+    .locate = kv_compact_locate,
+    .find = kv_compact_find,
+    .prefetch = kv_compact_prefetch,
+    .link = kv_compact_link,
+    .unlink = kv_compact_unlink,
+    .foreach = kv_compact_foreach,
+    .measure = kv_compact_measure,
+    .clone = kv_compact_clone,
+};
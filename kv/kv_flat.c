@@ -0,0 +1,433 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "kv.h"
+#include "kv_inner.h"
+
+/* number of slots probed at once */
+#define GROUP_WIDTH     16
+
+/* control byte of a slot which has never been used */
+#define CTRL_EMPTY      0x80
+
+/* control byte of a slot whose bucket has been deleted */
+#define CTRL_DELETED    0xFE
+
+/* high 25 bits of the hash select the group to start probing */
+#define H1(hash)        ((hash) >> 7)
+
+/* low 7 bits of the hash are stored in the control byte of a full slot */
+#define H2(hash)        ((uint8_t)((hash) & 0x7F))
+
+/* at most 7/8 of the slots are used before growing */
+#define MAX_LOAD(cap)   ((cap) - (cap) / 8)
+
+/**
+ * @brief get the mask of the slots in the group whose control byte equals to
+ *        the specified one.
+ */
+static uint32_t kv_group_match(const uint8_t *group, uint8_t ctrl)
+{
+#ifdef __SSE2__
+    __m128i group_ctrl = _mm_loadu_si128((const __m128i *)group);
+
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8((char)ctrl), group_ctrl));
+#else
+    uint32_t mask = 0;
+
+    for (int i = 0; i < GROUP_WIDTH; i++)
+    {
+        if (group[i] == ctrl)
+        {
+            mask |= 1U << i;
+        }
+    }
+
+    return mask;
+#endif
+}
+
+/**
+ * @brief get the mask of the empty or deleted slots in the group.
+ */
+static uint32_t kv_group_match_free(const uint8_t *group)
+{
+#ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+    uint32_t mask = 0;
+
+    for (int i = 0; i < GROUP_WIDTH; i++)
+    {
+        if (group[i] & 0x80)
+        {
+            mask |= 1U << i;
+        }
+    }
+
+    return mask;
+#endif
+}
+
+/**
+ * @brief find the first empty or deleted slot on the probe sequence.
+ * @note  there is always an empty slot since the table never gets full.
+ * 
+ * @param set   kv set pointer.
+ * @param hash  hash value.
+ * @return  index of the slot.
+ */
+static size_t kv_flat_find_free(kv_set_t *set, uint32_t hash)
+{
+    size_t group_mask;
+    size_t group_index;
+    uint32_t mask;
+
+    group_mask = set->bucket_num / GROUP_WIDTH - 1;
+    group_index = H1(hash) & group_mask;
+    for (size_t i = 1; ; i++)
+    {
+        mask = kv_group_match_free(set->ctrl + group_index * GROUP_WIDTH);
+        if (mask != 0)
+        {
+            return group_index * GROUP_WIDTH + __builtin_ctz(mask);
+        }
+        group_index = (group_index + i) & group_mask;
+    }
+}
+
+/**
+ * @brief rebuild the table, the capacity is doubled if more than half of the
+ *        usable slots are full, otherwise only the deleted slots are purged.
+ * 
+ * @param set kv set pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+static int kv_flat_rehash(kv_set_t *set)
+{
+    size_t new_cap;
+    uint8_t *new_ctrl;
+    kv_bucket_t **new_array;
+    uint8_t *old_ctrl;
+    kv_bucket_t **old_array;
+    size_t old_cap;
+    uint32_t hash;
+    size_t index;
+
+    KV_STATS_INC(set, rehash_num);
+    old_cap = set->bucket_num;
+    new_cap = old_cap;
+    if (set->pair_num >= MAX_LOAD(old_cap) / 2)
+    {
+        if (old_cap > SIZE_MAX / 2 / sizeof(kv_bucket_t *))
+        {
+            return KV_ERR_BAD_MEM;
+        }
+        new_cap = old_cap * 2;
+    }
+
+    new_ctrl = (uint8_t *)malloc(new_cap);
+    if (new_ctrl == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    new_array = (kv_bucket_t **)calloc(new_cap, sizeof(kv_bucket_t *));
+    if (new_array == NULL)
+    {
+        free(new_ctrl);
+        return KV_ERR_BAD_MEM;
+    }
+    memset(new_ctrl, CTRL_EMPTY, new_cap);
+
+    old_ctrl = set->ctrl;
+    old_array = set->array;
+    set->ctrl = new_ctrl;
+    set->array = new_array;
+    set->bucket_num = new_cap;
+
+    /* move every bucket into the new table */
+    for (size_t i = 0; i < old_cap; i++)
+    {
+        if (old_ctrl[i] & 0x80)
+        {
+            continue;
+        }
+        hash = old_array[i]->hash;
+        index = kv_flat_find_free(set, hash);
+        set->ctrl[index] = H2(hash);
+        set->array[index] = old_array[i];
+    }
+    set->growth_left = MAX_LOAD(new_cap) - set->pair_num;
+
+    free(old_ctrl);
+    free(old_array);
+
+    return KV_OK;
+}
+
+/**
+ * @brief allocate the table, the capacity is rounded up to a power of two.
+ */
+static int kv_flat_create(kv_set_t *set, const kv_conf_t *conf)
+{
+    size_t cap;
+
+    cap = GROUP_WIDTH;
+    while (cap < conf->bucket_num)
+    {
+        cap *= 2;
+    }
+
+    set->ctrl = (uint8_t *)malloc(cap);
+    if (set->ctrl == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    set->array = (kv_bucket_t **)calloc(cap, sizeof(kv_bucket_t *));
+    if (set->array == NULL)
+    {
+        free(set->ctrl);
+        return KV_ERR_BAD_MEM;
+    }
+    memset(set->ctrl, CTRL_EMPTY, cap);
+    set->bucket_num = cap;
+    set->growth_left = MAX_LOAD(cap);
+
+    return KV_OK;
+}
+
+static void kv_flat_clear(kv_set_t *set)
+{
+    if (set->arena_size == 0)
+    {
+        for (size_t i = 0; i < set->bucket_num; i++)
+        {
+            if ((set->ctrl[i] & 0x80) == 0)
+            {
+                kv_bucket_free(set, set->array[i]);
+            }
+        }
+    }
+    memset(set->array, 0, set->bucket_num * sizeof(kv_bucket_t *));
+    memset(set->ctrl, CTRL_EMPTY, set->bucket_num);
+    set->growth_left = MAX_LOAD(set->bucket_num);
+}
+
+static void kv_flat_destroy(kv_set_t *set)
+{
+    free(set->ctrl);
+    free(set->array);
+}
+
+/**
+ * @brief probe the table group by group for the slot holding the key.
+ * @note  only the slots whose control byte matches the 7-bit fingerprint of
+ *        the hash are checked, and the keys are compared only if the full
+ *        hash values are the same. if the key isn't found, the first empty or
+ *        deleted slot on the probe sequence is returned for inserting.
+ * 
+ * @param set     kv set pointer.
+ * @param key     key pointer.
+ * @param key_len length of the key.
+ * @param hash    hash value of the key.
+ * @return  pointer to the slot.
+ */
+static kv_bucket_t **kv_flat_locate(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    size_t group_mask;
+    size_t group_index;
+    const uint8_t *group;
+    kv_bucket_t **free_slot;
+    size_t index;
+    uint32_t mask;
+    uint8_t h2;
+
+    h2 = H2(hash);
+    free_slot = NULL;
+    group_mask = set->bucket_num / GROUP_WIDTH - 1;
+    group_index = H1(hash) & group_mask;
+    for (size_t i = 1; ; i++)
+    {
+        group = set->ctrl + group_index * GROUP_WIDTH;
+
+        mask = kv_group_match(group, h2);
+        while (mask != 0)
+        {
+            index = group_index * GROUP_WIDTH + __builtin_ctz(mask);
+            if (KV_BUCKET_MATCH(set->array[index], key, key_len, hash))
+            {
+                return set->array + index;
+            }
+            mask &= mask - 1;
+        }
+
+        if (free_slot == NULL)
+        {
+            mask = kv_group_match_free(group);
+            if (mask != 0)
+            {
+                free_slot = set->array + group_index * GROUP_WIDTH + __builtin_ctz(mask);
+            }
+        }
+
+        /* the key would have been put in this group if it existed */
+        if (kv_group_match(group, CTRL_EMPTY) != 0)
+        {
+            return free_slot;
+        }
+
+        group_index = (group_index + i) & group_mask;
+    }
+}
+
+static kv_bucket_t *kv_flat_find(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    return *kv_flat_locate(set, key, key_len, hash);
+}
+
+/**
+ * @brief prefetch the first group on the probe sequence, then the bucket of
+ *        the first slot in it whose control byte matches the fingerprint.
+ */
+static void kv_flat_prefetch(kv_set_t *set, uint32_t hash, int stage)
+{
+    size_t group_index;
+    uint32_t mask;
+
+    group_index = H1(hash) & (set->bucket_num / GROUP_WIDTH - 1);
+    if (stage == 0)
+    {
+        __builtin_prefetch(set->ctrl + group_index * GROUP_WIDTH);
+        __builtin_prefetch(set->array + group_index * GROUP_WIDTH);
+        __builtin_prefetch(set->array + group_index * GROUP_WIDTH + GROUP_WIDTH / 2);
+        return;
+    }
+
+    mask = kv_group_match(set->ctrl + group_index * GROUP_WIDTH, H2(hash));
+    if (mask != 0)
+    {
+        __builtin_prefetch(set->array[group_index * GROUP_WIDTH + __builtin_ctz(mask)]);
+    }
+}
+
+static int kv_flat_link(kv_set_t *set, kv_bucket_t **link, kv_bucket_t *bucket)
+{
+    size_t index;
+    uint32_t hash;
+    int res;
+
+    hash = bucket->hash;
+    index = link - set->array;
+
+    /* reusing a deleted slot doesn't consume the empty ones */
+    if (set->ctrl[index] == CTRL_EMPTY)
+    {
+        if (set->growth_left == 0)
+        {
+            res = kv_flat_rehash(set);
+            if (res != KV_OK)
+            {
+                return res;
+            }
+            index = kv_flat_find_free(set, hash);
+        }
+        set->growth_left--;
+    }
+
+    bucket->next = NULL;
+    set->ctrl[index] = H2(hash);
+    set->array[index] = bucket;
+
+    return KV_OK;
+}
+
+static void kv_flat_unlink(kv_set_t *set, kv_bucket_t **link)
+{
+    size_t index;
+
+    index = link - set->array;
+    set->array[index] = NULL;
+
+    /**
+     * no probe sequence has ever passed through a group which still has an
+     * empty slot, so the slot can become empty again.
+     */
+    if (kv_group_match(set->ctrl + index / GROUP_WIDTH * GROUP_WIDTH, CTRL_EMPTY) != 0)
+    {
+        set->ctrl[index] = CTRL_EMPTY;
+        set->growth_left++;
+    }
+    else
+    {
+        set->ctrl[index] = CTRL_DELETED;
+    }
+}
+
+static void kv_flat_foreach(kv_set_t *set, kv_visit_cb_t visit_cb, void *arg)
+{
+    for (size_t i = 0; i < set->bucket_num; i++)
+    {
+        if ((set->ctrl[i] & 0x80) == 0)
+        {
+            visit_cb(arg, set->array[i]);
+        }
+    }
+}
+
+/**
+ * @brief count the groups probed to find every key.
+ */
+static void kv_flat_measure(kv_set_t *set, kv_stats_t *stats)
+{
+    size_t group_mask;
+    size_t group_index;
+    size_t length;
+
+    group_mask = set->bucket_num / GROUP_WIDTH - 1;
+    for (size_t i = 0; i < set->bucket_num; i++)
+    {
+        if (set->ctrl[i] & 0x80)
+        {
+            continue;
+        }
+
+        group_index = H1(set->array[i]->hash) & group_mask;
+        for (length = 1; group_index != i / GROUP_WIDTH; length++)
+        {
+            group_index = (group_index + length) & group_mask;
+        }
+        kv_stats_length(stats, length);
+    }
+
+    stats->memory_bytes += set->bucket_num * (sizeof(uint8_t) + sizeof(kv_bucket_t *));
+}
+
+/**
+ * @brief the slots are moved by every growing, they can't be shared with a clone.
+ */
+static int kv_flat_clone(kv_set_t *set, kv_set_t *clone)
+{
+    return KV_ERR_BAD_CONF;
+}
+
+/* open addressing engine probing 16 control bytes at once */
+const kv_engine_t kv_flat_engine =
+{
+    .create = kv_flat_create,
+    .clear = kv_flat_clear,
+    .destroy = kv_flat_destroy,
+    .locate = kv_flat_locate,
+    .find = kv_flat_find,
+    .prefetch = kv_flat_prefetch,
+    .link = kv_flat_link,
+    .unlink = kv_flat_unlink,
+    .foreach = kv_flat_foreach,
+    .measure = kv_flat_measure,
+    .clone = kv_flat_clone,
+};
@@ -0,0 +1,581 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kv.h"
+#include "kv_inner.h"
+#include "kv_frozen.h"
+
+/* average number of keys per displacement bucket */
+#define KEYS_PER_DISP   3
+
+/* a bucket holding one key refers to its slot directly */
+#define DISP_SLOT       0x80000000U
+
+/* displacements tried for a bucket before the hash is reseeded */
+#define DISP_MAX_TRY    (1 << 20)
+
+/* seeds tried before giving up */
+#define SEED_MAX_TRY    8
+
+/* map the hash to a displacement bucket by its high bits */
+#define DISP_INDEX(hash, disp_num)  ((size_t)(((hash) >> 32) * (disp_num) >> 32))
+
+/* get the size of the record holding the key and value */
+#define RECORD_SIZE(key_len, value_len) \
+    ((sizeof(kv_frozen_record_t) + (key_len) + 1 + (value_len) + 1 + 7) & ~(size_t)7)
+
+/* record of a key-value pair, 8-byte aligned in member 'records' */
+typedef struct kv_frozen_record
+{
+    /* length of the key */
+    uint32_t key_len;
+
+    /* length of the value */
+    uint32_t value_len;
+
+    /* key bytes(null-terminated) followed by value bytes(null-terminated) */
+    char data[];
+} kv_frozen_record_t;
+
+/* buckets of the set collected by kv_freeze() */
+typedef struct kv_frozen_ctx
+{
+    kv_bucket_t **buckets;
+    size_t bucket_num;
+} kv_frozen_ctx_t;
+
+/**
+ * @brief get the slot of the key with the displacement, the steps are odd so
+ *        every displacement leads to another slot.
+ */
+static size_t kv_frozen_slot(uint64_t hash, uint32_t disp, size_t pair_num)
+{
+    uint32_t h1;
+    uint32_t h2;
+
+    h1 = (uint32_t)hash;
+    h2 = (uint32_t)((hash * 0x9E3779B97F4A7C15ULL) >> 32) | 1;
+
+    return (size_t)((uint64_t)(uint32_t)(h1 + disp * h2) * pair_num >> 32);
+}
+
+static const kv_frozen_record_t *kv_frozen_find(kv_frozen_t *frozen, const char *key, size_t key_len)
+{
+    const kv_frozen_record_t *record;
+    uint64_t hash;
+    uint32_t disp;
+    size_t slot;
+
+    if (frozen->pair_num == 0)
+    {
+        return NULL;
+    }
+
+    hash = kv_wyhash(key, key_len, frozen->hash_seed);
+    disp = frozen->disps[DISP_INDEX(hash, frozen->disp_num)];
+    if (disp == 0)
+    {
+        return NULL;
+    }
+    if (disp & DISP_SLOT)
+    {
+        slot = disp & ~DISP_SLOT;
+    }
+    else
+    {
+        slot = kv_frozen_slot(hash, disp - 1, frozen->pair_num);
+    }
+
+    record = (const kv_frozen_record_t *)(frozen->records + (size_t)frozen->offsets[slot] * 8);
+    if (record->key_len != key_len || memcmp(record->data, key, key_len) != 0)
+    {
+        return NULL;
+    }
+
+    return record;
+}
+
+static void kv_frozen_collect(void *arg, kv_bucket_t *bucket)
+{
+    kv_frozen_ctx_t *ctx = (kv_frozen_ctx_t *)arg;
+
+    ctx->buckets[ctx->bucket_num++] = bucket;
+}
+
+/**
+ * @brief assign a slot to every key, the buckets of more keys are displaced
+ *        first while most of the slots are free, and the buckets of one key
+ *        take the slots left at last.
+ *
+ * @param frozen    frozen kv set pointer, whose seed and sizes are set.
+ * @param hashes    hash of every key.
+ * @param slot_keys array for storing the key of every slot.
+ * @return  return KV_OK if success, or return KV_ERR_KEY_NOT_FOUND if some
+ *          bucket can't be displaced with this seed, otherwise return other
+ *          value.
+ */
+static int kv_frozen_place(kv_frozen_t *frozen, const uint64_t *hashes, uint32_t *slot_keys)
+{
+    uint32_t *starts;
+    uint32_t *order;
+    uint32_t *sorted;
+    uint32_t *size_starts;
+    uint8_t *taken;
+    size_t *slots;
+    size_t pair_num;
+    size_t disp_num;
+    size_t max_size;
+    size_t size;
+    size_t free_slot;
+    size_t disp_index;
+    size_t i;
+    size_t j;
+    uint32_t disp;
+    int res;
+
+    pair_num = frozen->pair_num;
+    disp_num = frozen->disp_num;
+    starts = (uint32_t *)calloc(disp_num + 1, sizeof(uint32_t));
+    order = (uint32_t *)malloc(pair_num * sizeof(uint32_t));
+    sorted = (uint32_t *)malloc(disp_num * sizeof(uint32_t));
+    taken = (uint8_t *)calloc(pair_num, 1);
+    if (starts == NULL || order == NULL || sorted == NULL || taken == NULL)
+    {
+        res = KV_ERR_BAD_MEM;
+        goto err_temp;
+    }
+
+    /* group the keys by their buckets */
+    for (i = 0; i < pair_num; i++)
+    {
+        starts[DISP_INDEX(hashes[i], disp_num) + 1]++;
+    }
+    max_size = 0;
+    for (i = 0; i < disp_num; i++)
+    {
+        max_size = starts[i + 1] > max_size ? starts[i + 1] : max_size;
+        starts[i + 1] += starts[i];
+    }
+    for (i = 0; i < pair_num; i++)
+    {
+        disp_index = DISP_INDEX(hashes[i], disp_num);
+        order[starts[disp_index]++] = (uint32_t)i;
+    }
+    for (i = disp_num; i > 0; i--)
+    {
+        starts[i] = starts[i - 1];
+    }
+    starts[0] = 0;
+
+    /* sort the buckets by their sizes, the biggest first */
+    size_starts = (uint32_t *)calloc(max_size + 2, sizeof(uint32_t));
+    slots = (size_t *)malloc((max_size + 1) * sizeof(size_t));
+    if (size_starts == NULL || slots == NULL)
+    {
+        res = KV_ERR_BAD_MEM;
+        goto err_size;
+    }
+    for (i = 0; i < disp_num; i++)
+    {
+        size_starts[max_size - (starts[i + 1] - starts[i]) + 1]++;
+    }
+    for (i = 0; i <= max_size; i++)
+    {
+        size_starts[i + 1] += size_starts[i];
+    }
+    for (i = 0; i < disp_num; i++)
+    {
+        sorted[size_starts[max_size - (starts[i + 1] - starts[i])]++] = (uint32_t)i;
+    }
+
+    memset(frozen->disps, 0, disp_num * sizeof(uint32_t));
+    free_slot = 0;
+    for (i = 0; i < disp_num; i++)
+    {
+        disp_index = sorted[i];
+        size = starts[disp_index + 1] - starts[disp_index];
+        if (size == 0)
+        {
+            break;
+        }
+
+        if (size == 1)
+        {
+            while (taken[free_slot])
+            {
+                free_slot++;
+            }
+            taken[free_slot] = 1;
+            slot_keys[free_slot] = order[starts[disp_index]];
+            frozen->disps[disp_index] = DISP_SLOT | (uint32_t)free_slot;
+            continue;
+        }
+
+        /* find a displacement sending all the keys of the bucket to free slots */
+        for (disp = 0; disp < DISP_MAX_TRY; disp++)
+        {
+            for (j = 0; j < size; j++)
+            {
+                slots[j] = kv_frozen_slot(hashes[order[starts[disp_index] + j]], disp, pair_num);
+                if (taken[slots[j]])
+                {
+                    break;
+                }
+                taken[slots[j]] = 1;
+            }
+            if (j == size)
+            {
+                break;
+            }
+            while (j > 0)
+            {
+                taken[slots[--j]] = 0;
+            }
+        }
+        if (disp == DISP_MAX_TRY)
+        {
+            res = KV_ERR_KEY_NOT_FOUND;
+            goto err_size;
+        }
+
+        for (j = 0; j < size; j++)
+        {
+            slot_keys[slots[j]] = order[starts[disp_index] + j];
+        }
+        frozen->disps[disp_index] = disp + 1;
+    }
+
+    res = KV_OK;
+err_size:
+    free(size_starts);
+    free(slots);
+err_temp:
+    free(starts);
+    free(order);
+    free(sorted);
+    free(taken);
+    return res;
+}
+
+/**
+ * @brief build a frozen kv set holding a copy of all the key-value pairs in
+ *        the kv set.
+ * @note  the keys are mapped to their slots by a minimal perfect hash in the
+ *        way of CHD(compress, hash and displace): the keys are grouped into
+ *        buckets of about KEYS_PER_DISP keys, and every bucket gets a
+ *        displacement which sends its keys to free slots. a lookup hashes the
+ *        key once, reads the displacement and the slot, and compares the key
+ *        of the record once. the records are packed in one allocation.
+ *        the kv set isn't modified besides reclaiming its expired pairs, and
+ *        can be destroyed afterwards. the pairs don't expire in the frozen
+ *        set.
+ *
+ * @param set     kv set pointer.
+ * @param frozen  address of frozen kv set pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_freeze(kv_set_t *set, kv_frozen_t **frozen)
+{
+    kv_frozen_t *inner_frozen;
+    kv_frozen_ctx_t ctx;
+    kv_frozen_record_t *record;
+    kv_bucket_t *bucket;
+    uint64_t *hashes;
+    uint32_t *slot_keys;
+    size_t records_size;
+    size_t offset;
+    int res;
+
+    if (set == NULL || frozen == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+    if (set->wheel != NULL)
+    {
+        kv_ttl_advance(set, kv_ttl_now(set), SIZE_MAX);
+    }
+    if (set->pair_num >= DISP_SLOT)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    inner_frozen = (kv_frozen_t *)malloc(sizeof(kv_frozen_t));
+    if (inner_frozen == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    memset(inner_frozen, 0, sizeof(kv_frozen_t));
+    inner_frozen->pair_num = set->pair_num;
+    inner_frozen->disp_num = set->pair_num / KEYS_PER_DISP + 1;
+
+    ctx.buckets = (kv_bucket_t **)malloc((set->pair_num + 1) * sizeof(kv_bucket_t *));
+    hashes = (uint64_t *)malloc((set->pair_num + 1) * sizeof(uint64_t));
+    slot_keys = (uint32_t *)malloc((set->pair_num + 1) * sizeof(uint32_t));
+    inner_frozen->disps = (uint32_t *)malloc(inner_frozen->disp_num * sizeof(uint32_t));
+    inner_frozen->offsets = (uint32_t *)malloc((set->pair_num + 1) * sizeof(uint32_t));
+    if (ctx.buckets == NULL || hashes == NULL || slot_keys == NULL ||
+        inner_frozen->disps == NULL || inner_frozen->offsets == NULL)
+    {
+        res = KV_ERR_BAD_MEM;
+        goto err_temp;
+    }
+    ctx.bucket_num = 0;
+    set->engine->foreach(set, kv_frozen_collect, &ctx);
+
+    records_size = 0;
+    for (size_t i = 0; i < ctx.bucket_num; i++)
+    {
+        records_size += RECORD_SIZE(ctx.buckets[i]->key_len, ctx.buckets[i]->value_len);
+    }
+    if (records_size / 8 > UINT32_MAX)
+    {
+        res = KV_ERR_BAD_ARG;
+        goto err_temp;
+    }
+
+    /* a new seed is drawn if some bucket can't be displaced */
+    res = inner_frozen->pair_num != 0 ? KV_ERR_KEY_NOT_FOUND : KV_OK;
+    for (int i = 0; i < SEED_MAX_TRY && res == KV_ERR_KEY_NOT_FOUND; i++)
+    {
+        inner_frozen->hash_seed = kv_hash_seed(inner_frozen);
+        for (size_t j = 0; j < ctx.bucket_num; j++)
+        {
+            bucket = ctx.buckets[j];
+            hashes[j] = kv_wyhash(KV_BUCKET_KEY(bucket), bucket->key_len, inner_frozen->hash_seed);
+        }
+        res = kv_frozen_place(inner_frozen, hashes, slot_keys);
+    }
+    if (res != KV_OK)
+    {
+        goto err_temp;
+    }
+
+    /* pack the records in the order of their slots */
+    inner_frozen->records = (uint8_t *)malloc(records_size + 8);
+    if (inner_frozen->records == NULL)
+    {
+        res = KV_ERR_BAD_MEM;
+        goto err_temp;
+    }
+    offset = 0;
+    for (size_t i = 0; i < inner_frozen->pair_num; i++)
+    {
+        bucket = ctx.buckets[slot_keys[i]];
+        record = (kv_frozen_record_t *)(inner_frozen->records + offset);
+        record->key_len = bucket->key_len;
+        record->value_len = bucket->value_len;
+        memcpy(record->data, KV_BUCKET_KEY(bucket), bucket->key_len + 1);
+        memcpy(record->data + bucket->key_len + 1, KV_BUCKET_VALUE(bucket), bucket->value_len + 1);
+        inner_frozen->offsets[i] = (uint32_t)(offset / 8);
+        offset += RECORD_SIZE(bucket->key_len, bucket->value_len);
+    }
+    inner_frozen->size = inner_frozen->disp_num * sizeof(uint32_t) +
+                         inner_frozen->pair_num * sizeof(uint32_t) + records_size;
+
+    free(ctx.buckets);
+    free(hashes);
+    free(slot_keys);
+
+    *frozen = inner_frozen;
+
+    return KV_OK;
+
+err_temp:
+    free(ctx.buckets);
+    free(hashes);
+    free(slot_keys);
+    free(inner_frozen->disps);
+    free(inner_frozen->offsets);
+    free(inner_frozen);
+    return res;
+}
+
+/**
+ * @brief destroy the frozen kv set.
+ *
+ * @param frozen  frozen kv set pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_frozen_destroy(kv_frozen_t *frozen)
+{
+    if (frozen == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    free(frozen->disps);
+    free(frozen->offsets);
+    free(frozen->records);
+    free(frozen);
+
+    return KV_OK;
+}
+
+/**
+ * @brief check if the frozen kv set contains the key.
+ *
+ * @param frozen  frozen kv set pointer.
+ * @param key     key string pointer.
+ * @return  return KV_TRUE if the key exists, return KV_FALSE if the key
+ *          doesn't exist, otherwise return other value.
+ */
+int kv_frozen_contain(kv_frozen_t *frozen, const char *key)
+{
+    if (frozen == NULL || key == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    return kv_frozen_find(frozen, key, strlen(key)) != NULL ? KV_TRUE : KV_FALSE;
+}
+
+/**
+ * @brief get the number of the key-value pairs in the frozen kv set.
+ *
+ * @param frozen  frozen kv set pointer.
+ * @param size    pointer to a variable for storing the number.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_frozen_size(kv_frozen_t *frozen, size_t *size)
+{
+    if (frozen == NULL || size == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    *size = frozen->pair_num;
+
+    return KV_OK;
+}
+
+/**
+ * @brief get the value of the key in the frozen kv set.
+ * @note  the value is valid until the frozen kv set is destroyed.
+ *
+ * @param frozen  frozen kv set pointer.
+ * @param key     key string pointer.
+ * @param value   pointer to a variable for storing value string pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_frozen_get(kv_frozen_t *frozen, const char *key, const char **value)
+{
+    const kv_frozen_record_t *record;
+
+    if (frozen == NULL || key == NULL || value == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    record = kv_frozen_find(frozen, key, strlen(key));
+    if (record == NULL)
+    {
+        return KV_ERR_KEY_NOT_FOUND;
+    }
+    *value = record->data + record->key_len + 1;
+
+    return KV_OK;
+}
+
+/**
+ * @brief iterate all the key-value pairs in the frozen kv set.
+ *
+ * @param frozen      frozen kv set pointer.
+ * @param foreach_cb  pointer to iteration callback function.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_frozen_foreach(kv_frozen_t *frozen, kv_foreach_cb_t foreach_cb, void *arg)
+{
+    const kv_frozen_record_t *record;
+
+    if (frozen == NULL || foreach_cb == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    for (size_t i = 0; i < frozen->pair_num; i++)
+    {
+        record = (const kv_frozen_record_t *)(frozen->records + (size_t)frozen->offsets[i] * 8);
+        foreach_cb(arg, record->data, record->data + record->key_len + 1);
+    }
+
+    return KV_OK;
+}
+
+/**
+ * @brief check if the frozen kv set contains the key of the specified length.
+ *
+ * @param frozen  frozen kv set pointer.
+ * @param key     key pointer.
+ * @param key_len length of the key.
+ * @return  return KV_TRUE if the key exists, return KV_FALSE if the key
+ *          doesn't exist, otherwise return other value.
+ */
+int kv_frozen_contain_n(kv_frozen_t *frozen, const void *key, size_t key_len)
+{
+    if (frozen == NULL || key == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    return kv_frozen_find(frozen, key, key_len) != NULL ? KV_TRUE : KV_FALSE;
+}
+
+/**
+ * @brief get the value of the key of the specified length in the frozen kv
+ *        set.
+ * @note  the value is valid until the frozen kv set is destroyed.
+ *
+ * @param frozen    frozen kv set pointer.
+ * @param key       key pointer.
+ * @param key_len   length of the key.
+ * @param value     pointer to a variable for storing value pointer.
+ * @param value_len pointer to a variable for storing value length.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_frozen_get_n(kv_frozen_t *frozen, const void *key, size_t key_len, const void **value, size_t *value_len)
+{
+    const kv_frozen_record_t *record;
+
+    if (frozen == NULL || key == NULL || value == NULL || value_len == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    record = kv_frozen_find(frozen, key, key_len);
+    if (record == NULL)
+    {
+        return KV_ERR_KEY_NOT_FOUND;
+    }
+    *value = record->data + record->key_len + 1;
+    *value_len = record->value_len;
+
+    return KV_OK;
+}
+
+/**
+ * @brief iterate all the key-value pairs in the frozen kv set along with
+ *        their lengths.
+ *
+ * @param frozen      frozen kv set pointer.
+ * @param foreach_cb  pointer to iteration callback function.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_frozen_foreach_n(kv_frozen_t *frozen, kv_foreach_n_cb_t foreach_cb, void *arg)
+{
+    const kv_frozen_record_t *record;
+
+    if (frozen == NULL || foreach_cb == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    for (size_t i = 0; i < frozen->pair_num; i++)
+    {
+        record = (const kv_frozen_record_t *)(frozen->records + (size_t)frozen->offsets[i] * 8);
+        foreach_cb(arg, record->data, record->key_len, record->data + record->key_len + 1, record->value_len);
+    }
+
+    return KV_OK;
+}
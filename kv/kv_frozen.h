@@ -0,0 +1,59 @@
+#ifndef __KV_FROZEN_H__
+#define __KV_FROZEN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kv.h"
+
+/**
+ * frozen kv set structure, built once by kv_freeze() and then only read, so
+ * it's safe to be shared by threads without any lock.
+ */
+typedef struct kv_frozen
+{
+    /* number of the key-value pairs, also the number of slots */
+    size_t pair_num;
+
+    /* number of the displacement buckets in member 'disps' */
+    size_t disp_num;
+
+    /* seed of the hash */
+    uint64_t hash_seed;
+
+    /**
+     * displacement of every bucket of keys, 0 if the bucket is empty, the
+     * slot itself with the high bit set if it holds one key, otherwise the
+     * displacement plus 1.
+     */
+    uint32_t *disps;
+
+    /* offset of the record of every slot, in units of 8 bytes */
+    uint32_t *offsets;
+
+    /* records, every one holds the lengths, the key and the value */
+    uint8_t *records;
+
+    /* bytes of member 'disps', 'offsets' and 'records' */
+    size_t size;
+} kv_frozen_t;
+
+int kv_freeze(kv_set_t *set, kv_frozen_t **frozen);
+
+int kv_frozen_destroy(kv_frozen_t *frozen);
+
+int kv_frozen_contain(kv_frozen_t *frozen, const char *key);
+
+int kv_frozen_size(kv_frozen_t *frozen, size_t *size);
+
+int kv_frozen_get(kv_frozen_t *frozen, const char *key, const char **value);
+
+int kv_frozen_foreach(kv_frozen_t *frozen, kv_foreach_cb_t foreach_cb, void *arg);
+
+int kv_frozen_contain_n(kv_frozen_t *frozen, const void *key, size_t key_len);
+
+int kv_frozen_get_n(kv_frozen_t *frozen, const void *key, size_t key_len, const void **value, size_t *value_len);
+
+int kv_frozen_foreach_n(kv_frozen_t *frozen, kv_foreach_n_cb_t foreach_cb, void *arg);
+
+#endif
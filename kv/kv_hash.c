@@ -0,0 +1,276 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "kv.h"
+#include "kv_inner.h"
+
+/* default secret parameters of wyhash */
+static const uint64_t wy_secret[4] =
+{
+    0xA0761D6478BD642FULL, 0xE7037ED1A0B428DBULL,
+    0x8EBC6AF09C88C6E3ULL, 0x589965CC75374CC3ULL,
+};
+
+#define XXH_PRIME64_1   0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2   0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3   0x165667B19E3779F9ULL
+#define XXH_PRIME64_4   0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5   0x27D4EB2F165667C5ULL
+
+static uint64_t kv_read64(const uint8_t *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+static uint64_t kv_read32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+static uint64_t kv_rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+/**
+ * @brief multiply two 64-bit integers, the low half of the 128-bit product is
+ *        stored in 'a' and the high half in 'b'.
+ */
+static void kv_mum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)*a * *b;
+
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static uint64_t kv_mix(uint64_t a, uint64_t b)
+{
+    kv_mum(&a, &b);
+
+    return a ^ b;
+}
+
+/**
+ * @brief hash the key with wyhash(final version 4), which consumes 16 bytes
+ *        per 128-bit multiplication.
+ * 
+ * @param key     key pointer.
+ * @param key_len length of the key.
+ * @param seed    seed of the hash.
+ * @return  64-bit hash value.
+ */
+uint64_t kv_wyhash(const void *key, size_t key_len, uint64_t seed)
+{
+    const uint8_t *p = (const uint8_t *)key;
+    const uint64_t *s = wy_secret;
+    uint64_t a;
+    uint64_t b;
+    uint64_t see1;
+    uint64_t see2;
+    size_t i;
+
+    seed ^= kv_mix(seed ^ s[0], s[1]);
+    if (key_len <= 16)
+    {
+        if (key_len >= 4)
+        {
+            a = (kv_read32(p) << 32) | kv_read32(p + ((key_len >> 3) << 2));
+            b = (kv_read32(p + key_len - 4) << 32) | kv_read32(p + key_len - 4 - ((key_len >> 3) << 2));
+        }
+        else if (key_len > 0)
+        {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[key_len >> 1] << 8) | p[key_len - 1];
+            b = 0;
+        }
+        else
+        {
+            a = 0;
+            b = 0;
+        }
+    }
+    else
+    {
+        i = key_len;
+        if (i > 48)
+        {
+            see1 = seed;
+            see2 = seed;
+            do
+            {
+                seed = kv_mix(kv_read64(p) ^ s[1], kv_read64(p + 8) ^ seed);
+                see1 = kv_mix(kv_read64(p + 16) ^ s[2], kv_read64(p + 24) ^ see1);
+                see2 = kv_mix(kv_read64(p + 32) ^ s[3], kv_read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16)
+        {
+            seed = kv_mix(kv_read64(p) ^ s[1], kv_read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = kv_read64(p + i - 16);
+        b = kv_read64(p + i - 8);
+    }
+
+    a ^= s[1];
+    b ^= seed;
+    kv_mum(&a, &b);
+
+    return kv_mix(a ^ s[0] ^ key_len, b ^ s[1]);
+}
+
+static uint64_t kv_xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    acc = kv_rotl64(acc, 31);
+    acc *= XXH_PRIME64_1;
+
+    return acc;
+}
+
+static uint64_t kv_xxh64_merge(uint64_t acc, uint64_t val)
+{
+    acc ^= kv_xxh64_round(0, val);
+    acc = acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+
+    return acc;
+}
+
+/**
+ * @brief hash the key with XXH64, which consumes 32 bytes per round in four
+ *        independent lanes.
+ * 
+ * @param key     key pointer.
+ * @param key_len length of the key.
+ * @param seed    seed of the hash.
+ * @return  64-bit hash value.
+ */
+uint64_t kv_xxh64(const void *key, size_t key_len, uint64_t seed)
+{
+    const uint8_t *p = (const uint8_t *)key;
+    const uint8_t *end = p + key_len;
+    uint64_t v1, v2, v3, v4;
+    uint64_t h;
+
+    if (key_len >= 32)
+    {
+        v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        v2 = seed + XXH_PRIME64_2;
+        v3 = seed;
+        v4 = seed - XXH_PRIME64_1;
+        do
+        {
+            v1 = kv_xxh64_round(v1, kv_read64(p));
+            v2 = kv_xxh64_round(v2, kv_read64(p + 8));
+            v3 = kv_xxh64_round(v3, kv_read64(p + 16));
+            v4 = kv_xxh64_round(v4, kv_read64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+
+        h = kv_rotl64(v1, 1) + kv_rotl64(v2, 7) + kv_rotl64(v3, 12) + kv_rotl64(v4, 18);
+        h = kv_xxh64_merge(h, v1);
+        h = kv_xxh64_merge(h, v2);
+        h = kv_xxh64_merge(h, v3);
+        h = kv_xxh64_merge(h, v4);
+    }
+    else
+    {
+        h = seed + XXH_PRIME64_5;
+    }
+
+    h += key_len;
+
+    while (end - p >= 8)
+    {
+        h ^= kv_xxh64_round(0, kv_read64(p));
+        h = kv_rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+    }
+    if (end - p >= 4)
+    {
+        h ^= kv_read32(p) * XXH_PRIME64_1;
+        h = kv_rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    while (p < end)
+    {
+        h ^= *p * XXH_PRIME64_5;
+        h = kv_rotl64(h, 11) * XXH_PRIME64_1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+/**
+ * @brief hash the key with djb2, one byte per iteration, the seed is ignored.
+ * @note  this is the hash used before the seeded ones were added, keep it for
+ *        compatibility only.
+ * 
+ * @param key     key pointer.
+ * @param key_len length of the key.
+ * @param seed    ignored.
+ * @return  hash value.
+ */
+uint64_t kv_djb2(const void *key, size_t key_len, uint64_t seed)
+{
+    const uint8_t *data = (const uint8_t *)key;
+    uint32_t hash = 5381;
+
+    for (size_t i = 0; i < key_len; i++)
+    {
+        hash = ((hash << 5) + hash) + data[i];
+    }
+
+    return hash;
+}
+
+/**
+ * @brief generate a seed for a new set.
+ * @note  the seed mixes the clock, the address of the set(randomized by ASLR)
+ *        and a counter, so sets created at the same time differ as well.
+ * 
+ * @param addr  address of the set.
+ * @return  seed value.
+ */
+uint64_t kv_hash_seed(const void *addr)
+{
+    static uint64_t counter;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return kv_mix(((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec) ^ wy_secret[2],
+                  (uint64_t)(uintptr_t)addr ^ __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED) * wy_secret[3]);
+}
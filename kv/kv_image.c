@@ -0,0 +1,621 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "kv.h"
+#include "kv_inner.h"
+
+/* magic bytes at the beginning of the image */
+#define IMAGE_MAGIC         "KVIMAGE"
+
+/* version of the image format */
+#define IMAGE_VERSION       1
+
+/* written in the byte order of the host, to reject images of other hosts */
+#define IMAGE_BYTE_ORDER    0x01020304
+
+/* hash type of the images whose keys are hashed by a callback */
+#define IMAGE_HASH_CALLBACK 0xFFFFFFFF
+
+/* map the hash to a slot by its high bits, no division is needed */
+#define SLOT_INDEX(hash, slot_num)  ((size_t)(((uint64_t)(hash) * (slot_num)) >> 32))
+
+/* get the size of the record holding the key and value */
+#define RECORD_SIZE(key_len, value_len) \
+    ((sizeof(kv_bucket_t) + (key_len) + 1 + (value_len) + 1 + 7) & ~(size_t)7)
+
+/**
+ * header of the image, followed by the slots of the hash index, and then by
+ * the records, which have the same layout as kv_bucket_t.
+ */
+typedef struct kv_image_header
+{
+    /* IMAGE_MAGIC */
+    char magic[8];
+
+    /* IMAGE_VERSION */
+    uint32_t version;
+
+    /* IMAGE_BYTE_ORDER */
+    uint32_t byte_order;
+
+    /* built-in hash type, or IMAGE_HASH_CALLBACK */
+    uint32_t hash_type;
+
+    /* size of kv_bucket_t on the host writing the image */
+    uint32_t record_header_size;
+
+    /* seed of the built-in hash */
+    uint64_t hash_seed;
+
+    /* number of the key-value pairs */
+    uint64_t pair_num;
+
+    /* number of the slots */
+    uint64_t slot_num;
+
+    /* offset of the slots in the image */
+    uint64_t slot_offset;
+
+    /* offset of the records in the image */
+    uint64_t record_offset;
+
+    /* total size of the records */
+    uint64_t record_size;
+} kv_image_header_t;
+
+/* slot of the open addressing hash index */
+typedef struct kv_image_slot
+{
+    /* offset of the record from the first record plus 1, 0 if empty */
+    uint64_t offset;
+
+    /* hash value of the key */
+    uint32_t hash;
+
+    uint32_t reserved;
+} kv_image_slot_t;
+
+/* context used to collect the buckets of the set being saved */
+typedef struct kv_image_ctx
+{
+    kv_bucket_t **buckets;
+    size_t bucket_num;
+} kv_image_ctx_t;
+
+static const kv_image_header_t *kv_image_header(kv_set_t *set)
+{
+    return (const kv_image_header_t *)set->image;
+}
+
+static const kv_image_slot_t *kv_image_slots(kv_set_t *set)
+{
+    return (const kv_image_slot_t *)(set->image + kv_image_header(set)->slot_offset);
+}
+
+static const uint8_t *kv_image_records(kv_set_t *set)
+{
+    return set->image + kv_image_header(set)->record_offset;
+}
+
+static int kv_image_create(kv_set_t *set, const kv_conf_t *conf)
+{
+    return KV_ERR_READ_ONLY;
+}
+
+/* the pairs live in the image, there is nothing to free one by one */
+static void kv_image_clear(kv_set_t *set)
+{
+}
+
+static void kv_image_destroy(kv_set_t *set)
+{
+    munmap((void *)set->image, set->image_size);
+}
+
+/**
+ * @brief probe the slots of the index for the record holding the key.
+ * @note  the records are only touched if the hash values are the same. the
+ *        slots and the records have been checked by kv_image_check(), so the
+ *        probe ends at an empty slot, and never leaves the image.
+ */
+static kv_bucket_t *kv_image_find(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    const kv_image_header_t *header;
+    const kv_image_slot_t *slots;
+    kv_bucket_t *bucket;
+    size_t index;
+
+    header = kv_image_header(set);
+    slots = kv_image_slots(set);
+    index = SLOT_INDEX(hash, header->slot_num);
+    while (slots[index].offset != 0)
+    {
+        if (slots[index].hash == hash)
+        {
+            bucket = (kv_bucket_t *)(kv_image_records(set) + slots[index].offset - 1);
+            if (KV_BUCKET_MATCH(bucket, key, key_len, hash))
+            {
+                return bucket;
+            }
+        }
+        index = index + 1 < header->slot_num ? index + 1 : 0;
+    }
+
+    return NULL;
+}
+
+/* location returned by kv_image_locate(), never written */
+static kv_bucket_t *kv_image_nowhere;
+
+/**
+ * @brief no pair of the image can be located to be modified.
+ * @note  the image is read-only, the set is looked up by kv_image_find()
+ *        since member 'read_shared' is set, so nothing is written by the
+ *        concurrent readers.
+ */
+static kv_bucket_t **kv_image_locate(kv_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    return &kv_image_nowhere;
+}
+
+static void kv_image_prefetch(kv_set_t *set, uint32_t hash, int stage)
+{
+    const kv_image_slot_t *slot;
+
+    slot = kv_image_slots(set) + SLOT_INDEX(hash, kv_image_header(set)->slot_num);
+    if (stage == 0)
+    {
+        __builtin_prefetch(slot);
+    }
+    else if (slot->offset != 0)
+    {
+        __builtin_prefetch(kv_image_records(set) + slot->offset - 1);
+    }
+}
+
+static int kv_image_link(kv_set_t *set, kv_bucket_t **link, kv_bucket_t *bucket)
+{
+    return KV_ERR_READ_ONLY;
+}
+
+static void kv_image_unlink(kv_set_t *set, kv_bucket_t **link)
+{
+}
+
+/* the records are visited in the order they are stored */
+static void kv_image_foreach(kv_set_t *set, kv_visit_cb_t visit_cb, void *arg)
+{
+    const uint8_t *record;
+    const uint8_t *end;
+    kv_bucket_t *bucket;
+
+    record = kv_image_records(set);
+    end = record + kv_image_header(set)->record_size;
+    while (end - record >= (ptrdiff_t)sizeof(kv_bucket_t))
+    {
+        bucket = (kv_bucket_t *)record;
+        visit_cb(arg, bucket);
+        record += RECORD_SIZE(bucket->key_len, bucket->value_len);
+    }
+}
+
+/**
+ * @brief the image is only mapped once, it isn't shared with a clone.
+ */
+static int kv_image_clone(kv_set_t *set, kv_set_t *clone)
+{
+    return KV_ERR_BAD_CONF;
+}
+
+/* read-only engine serving the pairs straight from the image */
+static const kv_engine_t kv_image_engine =
+{
+    .create = kv_image_create,
+    .clear = kv_image_clear,
+    .destroy = kv_image_destroy,
+    .locate = kv_image_locate,
+    .find = kv_image_find,
+    .prefetch = kv_image_prefetch,
+    .link = kv_image_link,
+    .unlink = kv_image_unlink,
+    .foreach = kv_image_foreach,
+    .clone = kv_image_clone,
+};
+
+static void kv_image_collect(void *arg, kv_bucket_t *bucket)
+{
+    kv_image_ctx_t *ctx = (kv_image_ctx_t *)arg;
+
+    ctx->buckets[ctx->bucket_num++] = bucket;
+}
+
+/**
+ * @brief get the hash type recorded in the image of the set.
+ */
+static uint32_t kv_image_hash_type(kv_set_t *set)
+{
+    if (set->hash != NULL || set->hash_n != NULL)
+    {
+        return IMAGE_HASH_CALLBACK;
+    }
+    if (set->hash_seeded == kv_xxh64)
+    {
+        return KV_HASH_XXH64;
+    }
+    if (set->hash_seeded == kv_djb2)
+    {
+        return KV_HASH_DJB2;
+    }
+
+    return KV_HASH_WYHASH;
+}
+
+/**
+ * @brief write the header, the slots and the records to the file.
+ */
+static int kv_image_write(kv_set_t *set, FILE *file, kv_bucket_t **buckets, size_t bucket_num)
+{
+    kv_image_header_t header;
+    kv_image_slot_t *slots;
+    kv_bucket_t record;
+    uint64_t offset;
+    size_t index;
+    size_t size;
+    static const char padding[8];
+
+    memset(&header, 0, sizeof(kv_image_header_t));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    header.version = IMAGE_VERSION;
+    header.byte_order = IMAGE_BYTE_ORDER;
+    header.hash_type = kv_image_hash_type(set);
+    header.record_header_size = sizeof(kv_bucket_t);
+    header.hash_seed = set->hash_seed;
+    header.pair_num = bucket_num;
+
+    /* keep the index at most half full */
+    header.slot_num = bucket_num * 2 > 16 ? bucket_num * 2 : 16;
+    header.slot_offset = sizeof(kv_image_header_t);
+    header.record_offset = header.slot_offset + header.slot_num * sizeof(kv_image_slot_t);
+
+    slots = (kv_image_slot_t *)calloc(header.slot_num, sizeof(kv_image_slot_t));
+    if (slots == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+
+    offset = 0;
+    for (size_t i = 0; i < bucket_num; i++)
+    {
+        index = SLOT_INDEX(buckets[i]->hash, header.slot_num);
+        while (slots[index].offset != 0)
+        {
+            index = index + 1 < header.slot_num ? index + 1 : 0;
+        }
+        slots[index].offset = offset + 1;
+        slots[index].hash = buckets[i]->hash;
+        offset += RECORD_SIZE(buckets[i]->key_len, buckets[i]->value_len);
+    }
+    header.record_size = offset;
+
+    if (fwrite(&header, sizeof(kv_image_header_t), 1, file) != 1 ||
+        fwrite(slots, sizeof(kv_image_slot_t), header.slot_num, file) != header.slot_num)
+    {
+        free(slots);
+        return KV_ERR_BAD_FILE;
+    }
+    free(slots);
+
+    /* the value of a record has no slack, unlike the one of a bucket */
+    for (size_t i = 0; i < bucket_num; i++)
+    {
+        memset(&record, 0, sizeof(kv_bucket_t));
+        record.hash = buckets[i]->hash;
+        record.key_len = buckets[i]->key_len;
+        record.value_len = buckets[i]->value_len;
+        size = RECORD_SIZE(record.key_len, record.value_len);
+        record.value_cap = (uint32_t)(size - sizeof(kv_bucket_t) - record.key_len - 1);
+        if (fwrite(&record, sizeof(kv_bucket_t), 1, file) != 1 ||
+            fwrite(KV_BUCKET_KEY(buckets[i]), 1, record.key_len + 1, file) != record.key_len + 1 ||
+            fwrite(KV_BUCKET_VALUE(buckets[i]), 1, record.value_len + 1, file) != record.value_len + 1 ||
+            fwrite(padding, 1, size - sizeof(kv_bucket_t) - record.key_len - record.value_len - 2, file) !=
+                size - sizeof(kv_bucket_t) - record.key_len - record.value_len - 2)
+        {
+            return KV_ERR_BAD_FILE;
+        }
+    }
+
+    return KV_OK;
+}
+
+/**
+ * @brief save the kv set to an image file, which can be served later by
+ *        kv_open_mapped() without rebuilding the set.
+ * @note  the image holds a hash index followed by the packed key-value pairs,
+ *        it's written to a temporary file first, which then replaces the
+ *        specified one, so the file is never seen half written.
+ *        the image can only be opened on hosts of the same byte order, and
+ *        if the set hashes with a callback, the same callback must be given
+ *        to kv_open_mapped(). the expired pairs are reclaimed first, the
+ *        others are saved without their time to live.
+ *
+ * @param set   kv set pointer.
+ * @param path  path of the image file.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_save(kv_set_t *set, const char *path)
+{
+    kv_image_ctx_t ctx;
+    char *tmp_path;
+    FILE *file;
+    int res;
+
+    if (set == NULL || path == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+    if (set->wheel != NULL)
+    {
+        kv_ttl_advance(set, kv_ttl_now(set), SIZE_MAX);
+    }
+
+    ctx.bucket_num = 0;
+    ctx.buckets = (kv_bucket_t **)malloc((set->pair_num != 0 ? set->pair_num : 1) * sizeof(kv_bucket_t *));
+    if (ctx.buckets == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    set->engine->foreach(set, kv_image_collect, &ctx);
+
+    tmp_path = (char *)malloc(strlen(path) + sizeof(".tmp"));
+    if (tmp_path == NULL)
+    {
+        res = KV_ERR_BAD_MEM;
+        goto err_path;
+    }
+    strcpy(tmp_path, path);
+    strcat(tmp_path, ".tmp");
+
+    file = fopen(tmp_path, "wb");
+    if (file == NULL)
+    {
+        res = KV_ERR_BAD_FILE;
+        goto err_file;
+    }
+
+    res = kv_image_write(set, file, ctx.buckets, ctx.bucket_num);
+    if (res == KV_OK && (fflush(file) != 0 || fsync(fileno(file)) != 0))
+    {
+        res = KV_ERR_BAD_FILE;
+    }
+    if (fclose(file) != 0 && res == KV_OK)
+    {
+        res = KV_ERR_BAD_FILE;
+    }
+    if (res == KV_OK && rename(tmp_path, path) != 0)
+    {
+        res = KV_ERR_BAD_FILE;
+    }
+    if (res != KV_OK)
+    {
+        remove(tmp_path);
+    }
+
+err_file:
+    free(tmp_path);
+err_path:
+    free(ctx.buckets);
+    return res;
+}
+
+/**
+ * @brief check if a whole record starts at the offset of the records, with
+ *        its key and value terminated.
+ */
+static int kv_image_record_check(const kv_image_header_t *header, const uint8_t *records, uint64_t offset)
+{
+    const kv_bucket_t *bucket;
+
+    if (offset % 8 != 0 || header->record_size < sizeof(kv_bucket_t) ||
+        offset > header->record_size - sizeof(kv_bucket_t))
+    {
+        return KV_ERR_BAD_FILE;
+    }
+
+    bucket = (const kv_bucket_t *)(records + offset);
+    if (RECORD_SIZE(bucket->key_len, bucket->value_len) > header->record_size - offset ||
+        KV_BUCKET_KEY(bucket)[bucket->key_len] != '\0' ||
+        KV_BUCKET_VALUE(bucket)[bucket->value_len] != '\0')
+    {
+        return KV_ERR_BAD_FILE;
+    }
+
+    return KV_OK;
+}
+
+/**
+ * @brief check the header, the slots and the records of the image against
+ *        the size of the file.
+ * @note  the records must follow one another up to the end, and every slot
+ *        in use must point to one of them. as many slots as pairs are in
+ *        use, so at least one is empty and every probe ends.
+ */
+static int kv_image_check(const uint8_t *image, size_t image_size)
+{
+    const kv_image_header_t *header;
+    const kv_image_slot_t *slots;
+    const uint8_t *records;
+    const kv_bucket_t *bucket;
+    uint64_t offset;
+    uint64_t num;
+
+    header = (const kv_image_header_t *)image;
+    if (image_size < sizeof(kv_image_header_t) ||
+        memcmp(header->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0 ||
+        header->version != IMAGE_VERSION ||
+        header->byte_order != IMAGE_BYTE_ORDER ||
+        header->record_header_size != sizeof(kv_bucket_t))
+    {
+        return KV_ERR_BAD_FILE;
+    }
+
+    if (header->slot_num == 0 || header->slot_num <= header->pair_num ||
+        header->slot_num > (image_size - sizeof(kv_image_header_t)) / sizeof(kv_image_slot_t) ||
+        header->slot_offset != sizeof(kv_image_header_t) ||
+        header->record_offset != header->slot_offset + header->slot_num * sizeof(kv_image_slot_t) ||
+        header->record_size > image_size - header->record_offset)
+    {
+        return KV_ERR_BAD_FILE;
+    }
+
+    records = image + header->record_offset;
+    offset = 0;
+    num = 0;
+    while (offset < header->record_size)
+    {
+        if (kv_image_record_check(header, records, offset) != KV_OK)
+        {
+            return KV_ERR_BAD_FILE;
+        }
+        bucket = (const kv_bucket_t *)(records + offset);
+        offset += RECORD_SIZE(bucket->key_len, bucket->value_len);
+        num++;
+    }
+    if (num != header->pair_num)
+    {
+        return KV_ERR_BAD_FILE;
+    }
+
+    slots = (const kv_image_slot_t *)(image + header->slot_offset);
+    num = 0;
+    for (uint64_t i = 0; i < header->slot_num; i++)
+    {
+        if (slots[i].offset == 0)
+        {
+            continue;
+        }
+        if (kv_image_record_check(header, records, slots[i].offset - 1) != KV_OK)
+        {
+            return KV_ERR_BAD_FILE;
+        }
+        num++;
+    }
+    if (num != header->pair_num)
+    {
+        return KV_ERR_BAD_FILE;
+    }
+
+    return KV_OK;
+}
+
+/**
+ * @brief open the image file saved by kv_save() as a read-only kv set.
+ * @note  the file is mapped into memory and the pairs are served straight
+ *        from the mapping by kv_get(), kv_contain(), kv_foreach() and the
+ *        like, nothing is allocated or parsed per pair. the slots and the
+ *        records are checked once when the file is opened, a truncated or
+ *        corrupted image is rejected with KV_ERR_BAD_FILE. the functions
+ *        modifying the set return KV_ERR_READ_ONLY, and kv_destroy() unmaps
+ *        the file.
+ *        'conf' is only used if the keys of the image are hashed by a
+ *        callback, it must give the same callback then.
+ *
+ * @param set   address of kv set pointer.
+ * @param path  path of the image file.
+ * @param conf  configuration pointer, can be NULL.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_open_mapped(kv_set_t **set, const char *path, const kv_conf_t *conf)
+{
+    kv_set_t *inner_set;
+    const kv_image_header_t *header;
+    kv_conf_t hash_conf;
+    struct stat st;
+    void *image;
+    int fd;
+    int res;
+
+    if (set == NULL || path == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return KV_ERR_BAD_FILE;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(kv_image_header_t))
+    {
+        close(fd);
+        return KV_ERR_BAD_FILE;
+    }
+    image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED)
+    {
+        return KV_ERR_BAD_FILE;
+    }
+
+    header = (const kv_image_header_t *)image;
+    res = kv_image_check((const uint8_t *)image, st.st_size);
+    if (res != KV_OK)
+    {
+        goto err_image;
+    }
+
+    /* hash the keys in the same way as the saved set */
+    if (header->hash_type == IMAGE_HASH_CALLBACK)
+    {
+        if (conf == NULL || (conf->hash_cb == NULL && conf->hash_n_cb == NULL))
+        {
+            res = KV_ERR_BAD_CONF;
+            goto err_image;
+        }
+        hash_conf = *conf;
+    }
+    else
+    {
+        memset(&hash_conf, 0, sizeof(kv_conf_t));
+        hash_conf.hash_type = header->hash_type;
+        hash_conf.hash_seed = header->hash_seed;
+    }
+
+    inner_set = (kv_set_t *)malloc(sizeof(kv_set_t));
+    if (inner_set == NULL)
+    {
+        res = KV_ERR_BAD_MEM;
+        goto err_image;
+    }
+    memset(inner_set, 0, sizeof(kv_set_t));
+
+    res = kv_hash_init(inner_set, &hash_conf);
+    if (res != KV_OK)
+    {
+        res = KV_ERR_BAD_FILE;
+        goto err_set;
+    }
+    inner_set->hash_seed = header->hash_seed;
+    inner_set->engine = &kv_image_engine;
+    inner_set->pair_num = header->pair_num;
+    inner_set->bucket_num = header->slot_num;
+    inner_set->image = (const uint8_t *)image;
+    inner_set->image_size = st.st_size;
+    inner_set->read_shared = KV_TRUE;
+
+    *set = inner_set;
+
+    return KV_OK;
+
+err_set:
+    free(inner_set);
+err_image:
+    munmap(image, st.st_size);
+    return res;
+}
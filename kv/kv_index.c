@@ -0,0 +1,408 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kv.h"
+#include "kv_inner.h"
+
+/* maximum level of the skiplist, enough for 4^24 keys */
+#define INDEX_MAX_LEVEL     24
+
+/* node of the skiplist, one per key-value pair */
+typedef struct kv_index_node
+{
+    /* bucket holding the key, the node doesn't copy the key */
+    kv_bucket_t *bucket;
+
+    /* next nodes on every level the node is linked on */
+    struct kv_index_node *next[];
+} kv_index_node_t;
+
+/* ordered index of the keys, a skiplist kept alongside the hash table */
+typedef struct kv_index
+{
+    /* number of the levels in use */
+    int level;
+
+    /* state of the generator of the node levels */
+    uint64_t rand;
+
+    /* bytes of the nodes */
+    size_t size;
+
+    /* first nodes on every level */
+    kv_index_node_t *head[INDEX_MAX_LEVEL];
+} kv_index_t;
+
+/* context of the scans, telling where they stop */
+typedef struct kv_scan_ctx
+{
+    /* prefix of the keys visited, or the key right after the range */
+    const char *bound;
+
+    /* length of member 'bound' */
+    size_t bound_len;
+
+    /* iteration callback function and its argument */
+    kv_foreach_n_cb_t foreach_cb;
+    void *arg;
+} kv_scan_ctx_t;
+
+/**
+ * @brief compare the key of the bucket with the key in byte order, a key
+ *        comes before all the longer keys it is a prefix of.
+ */
+static int kv_index_cmp(const kv_bucket_t *bucket, const char *key, size_t key_len)
+{
+    int res;
+
+    res = memcmp(KV_BUCKET_KEY(bucket), key, bucket->key_len < key_len ? bucket->key_len : key_len);
+    if (res != 0)
+    {
+        return res;
+    }
+    if (bucket->key_len != key_len)
+    {
+        return bucket->key_len < key_len ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief find the first node whose key isn't less than the key.
+ *
+ * @param index   ordered index pointer.
+ * @param key     key pointer.
+ * @param key_len length of the key.
+ * @param update  array for storing the next arrays holding the last node
+ *                before the key on every level, or NULL.
+ * @return  the node found, or NULL if all the keys are less.
+ */
+static kv_index_node_t *kv_index_seek(kv_index_t *index, const char *key, size_t key_len,
+                                      kv_index_node_t ***update)
+{
+    kv_index_node_t **curt_next;
+
+    curt_next = index->head;
+    for (int i = index->level - 1; i >= 0; i--)
+    {
+        while (curt_next[i] != NULL && kv_index_cmp(curt_next[i]->bucket, key, key_len) < 0)
+        {
+            curt_next = curt_next[i]->next;
+        }
+        if (update != NULL)
+        {
+            update[i] = curt_next;
+        }
+    }
+
+    return curt_next[0];
+}
+
+/**
+ * @brief pick the level of a new node, a node reaches the next level with a
+ *        probability of 1/4.
+ */
+static int kv_index_level(kv_index_t *index)
+{
+    uint64_t r;
+    int level;
+
+    index->rand ^= index->rand << 13;
+    index->rand ^= index->rand >> 7;
+    index->rand ^= index->rand << 17;
+    r = index->rand | (1ULL << (2 * (INDEX_MAX_LEVEL - 1)));
+    level = __builtin_ctzll(r) / 2 + 1;
+
+    return level;
+}
+
+int kv_index_create(kv_set_t *set)
+{
+    kv_index_t *index;
+
+    index = (kv_index_t *)malloc(sizeof(kv_index_t));
+    if (index == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    memset(index, 0, sizeof(kv_index_t));
+    index->rand = kv_hash_seed(index) | 1;
+
+    set->index = index;
+
+    return KV_OK;
+}
+
+void kv_index_clear(kv_set_t *set)
+{
+    kv_index_t *index;
+    kv_index_node_t *curt_node;
+    kv_index_node_t *next_node;
+
+    index = set->index;
+    next_node = index->head[0];
+    while (next_node != NULL)
+    {
+        curt_node = next_node;
+        next_node = curt_node->next[0];
+        free(curt_node);
+    }
+    memset(index->head, 0, sizeof(index->head));
+    index->level = 0;
+    index->size = 0;
+}
+
+void kv_index_destroy(kv_set_t *set)
+{
+    kv_index_clear(set);
+    free(set->index);
+    set->index = NULL;
+}
+
+/**
+ * @brief add the bucket of a new key to the index.
+ *
+ * @param set     kv set pointer.
+ * @param bucket  bucket pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_index_insert(kv_set_t *set, kv_bucket_t *bucket)
+{
+    kv_index_t *index;
+    kv_index_node_t **update[INDEX_MAX_LEVEL];
+    kv_index_node_t *new_node;
+    int level;
+
+    index = set->index;
+    kv_index_seek(index, KV_BUCKET_KEY(bucket), bucket->key_len, update);
+
+    level = kv_index_level(index);
+    new_node = (kv_index_node_t *)malloc(sizeof(kv_index_node_t) + level * sizeof(kv_index_node_t *));
+    if (new_node == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    new_node->bucket = bucket;
+    index->size += sizeof(kv_index_node_t) + level * sizeof(kv_index_node_t *);
+
+    for (int i = index->level; i < level; i++)
+    {
+        update[i] = index->head;
+    }
+    if (level > index->level)
+    {
+        index->level = level;
+    }
+
+    for (int i = 0; i < level; i++)
+    {
+        new_node->next[i] = update[i][i];
+        update[i][i] = new_node;
+    }
+
+    return KV_OK;
+}
+
+/**
+ * @brief let the index refer to the bucket which took the place of the old
+ *        one holding the same key.
+ */
+void kv_index_replace(kv_set_t *set, kv_bucket_t *old_bucket, kv_bucket_t *new_bucket)
+{
+    kv_index_node_t *curt_node;
+
+    curt_node = kv_index_seek(set->index, KV_BUCKET_KEY(old_bucket), old_bucket->key_len, NULL);
+    if (curt_node != NULL && curt_node->bucket == old_bucket)
+    {
+        curt_node->bucket = new_bucket;
+    }
+}
+
+/**
+ * @brief remove the bucket from the index before it's freed.
+ */
+void kv_index_remove(kv_set_t *set, kv_bucket_t *bucket)
+{
+    kv_index_t *index;
+    kv_index_node_t **update[INDEX_MAX_LEVEL];
+    kv_index_node_t *curt_node;
+    int level;
+
+    index = set->index;
+    curt_node = kv_index_seek(index, KV_BUCKET_KEY(bucket), bucket->key_len, update);
+    if (curt_node == NULL || curt_node->bucket != bucket)
+    {
+        return;
+    }
+
+    for (level = 0; level < index->level && update[level][level] == curt_node; level++)
+    {
+        update[level][level] = curt_node->next[level];
+    }
+    index->size -= sizeof(kv_index_node_t) + level * sizeof(kv_index_node_t *);
+    while (index->level > 0 && index->head[index->level - 1] == NULL)
+    {
+        index->level--;
+    }
+    free(curt_node);
+}
+
+/**
+ * @brief add the bytes of the index.
+ */
+void kv_index_stats(kv_set_t *set, kv_stats_t *stats)
+{
+    stats->memory_bytes += sizeof(kv_index_t) + set->index->size;
+}
+
+/**
+ * @brief visit the buckets in the index from the first key which isn't less
+ *        than 'start', until the callback returns KV_FALSE.
+ */
+static void kv_index_scan(kv_set_t *set, const char *start, size_t start_len, kv_scan_cb_t scan_cb, void *arg)
+{
+    kv_index_node_t *curt_node;
+
+    curt_node = kv_index_seek(set->index, start, start_len, NULL);
+    while (curt_node != NULL && scan_cb(arg, curt_node->bucket) == KV_TRUE)
+    {
+        curt_node = curt_node->next[0];
+    }
+}
+
+static int kv_scan_prefix_visit(void *arg, kv_bucket_t *bucket)
+{
+    kv_scan_ctx_t *ctx = (kv_scan_ctx_t *)arg;
+
+    if (bucket->key_len < ctx->bound_len || memcmp(KV_BUCKET_KEY(bucket), ctx->bound, ctx->bound_len) != 0)
+    {
+        return KV_FALSE;
+    }
+    ctx->foreach_cb(ctx->arg, KV_BUCKET_KEY(bucket), bucket->key_len, KV_BUCKET_VALUE(bucket), bucket->value_len);
+
+    return KV_TRUE;
+}
+
+static int kv_scan_range_visit(void *arg, kv_bucket_t *bucket)
+{
+    kv_scan_ctx_t *ctx = (kv_scan_ctx_t *)arg;
+
+    if (ctx->bound != NULL && kv_index_cmp(bucket, ctx->bound, ctx->bound_len) >= 0)
+    {
+        return KV_FALSE;
+    }
+    ctx->foreach_cb(ctx->arg, KV_BUCKET_KEY(bucket), bucket->key_len, KV_BUCKET_VALUE(bucket), bucket->value_len);
+
+    return KV_TRUE;
+}
+
+/**
+ * @brief iterate the key-value pairs whose keys start with the prefix, in
+ *        the byte order of the keys.
+ * @note  the set must be created with 'conf->ordered' set, or with the
+ *        KV_ENGINE_ART engine. the iteration costs O(log n + k) for k pairs
+ *        visited(O(prefix length + k) with KV_ENGINE_ART). the set mustn't be
+ *        modified by the callback function.
+ *
+ * @param set         kv set pointer.
+ * @param prefix      prefix pointer.
+ * @param prefix_len  length of the prefix.
+ * @param foreach_cb  pointer to iteration callback function.
+ * @return  return KV_OK if success, or return KV_ERR_BAD_CONF if the set
+ *          isn't ordered, otherwise return other value.
+ */
+int kv_scan_prefix(kv_set_t *set, const void *prefix, size_t prefix_len, kv_foreach_n_cb_t foreach_cb, void *arg)
+{
+    kv_scan_ctx_t ctx;
+
+    if (set == NULL || prefix == NULL || foreach_cb == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    if (set->wheel != NULL)
+    {
+        kv_ttl_advance(set, kv_ttl_now(set), SIZE_MAX);
+    }
+
+    ctx.bound = prefix;
+    ctx.bound_len = prefix_len;
+    ctx.foreach_cb = foreach_cb;
+    ctx.arg = arg;
+    if (set->index != NULL)
+    {
+        kv_index_scan(set, prefix, prefix_len, kv_scan_prefix_visit, &ctx);
+    }
+    else if (set->engine->scan != NULL)
+    {
+        set->engine->scan(set, prefix, prefix_len, kv_scan_prefix_visit, &ctx);
+    }
+    else
+    {
+        return KV_ERR_BAD_CONF;
+    }
+
+    return KV_OK;
+}
+
+/**
+ * @brief iterate the key-value pairs whose keys are in the range
+ *        ['start', 'end'), in the byte order of the keys.
+ * @note  the set must be created with 'conf->ordered' set, or with the
+ *        KV_ENGINE_ART engine. the iteration costs O(log n + k) for k pairs
+ *        visited(O(key length + k) with KV_ENGINE_ART). the set mustn't be
+ *        modified by the callback function.
+ *
+ * @param set         kv set pointer.
+ * @param start       first key of the range, or NULL to start from the
+ *                    smallest key.
+ * @param start_len   length of the first key.
+ * @param end         key right after the range, or NULL to end after the
+ *                    largest key.
+ * @param end_len     length of the key right after the range.
+ * @param foreach_cb  pointer to iteration callback function.
+ * @return  return KV_OK if success, or return KV_ERR_BAD_CONF if the set
+ *          isn't ordered, otherwise return other value.
+ */
+int kv_scan_range(kv_set_t *set, const void *start, size_t start_len, const void *end, size_t end_len,
+                  kv_foreach_n_cb_t foreach_cb, void *arg)
+{
+    kv_scan_ctx_t ctx;
+
+    if (set == NULL || foreach_cb == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+    if (start == NULL)
+    {
+        start = "";
+        start_len = 0;
+    }
+
+    if (set->wheel != NULL)
+    {
+        kv_ttl_advance(set, kv_ttl_now(set), SIZE_MAX);
+    }
+
+    ctx.bound = end;
+    ctx.bound_len = end_len;
+    ctx.foreach_cb = foreach_cb;
+    ctx.arg = arg;
+    if (set->index != NULL)
+    {
+        kv_index_scan(set, start, start_len, kv_scan_range_visit, &ctx);
+    }
+    else if (set->engine->scan != NULL)
+    {
+        set->engine->scan(set, start, start_len, kv_scan_range_visit, &ctx);
+    }
+    else
+    {
+        return KV_ERR_BAD_CONF;
+    }
+
+    return KV_OK;
+}
@@ -0,0 +1,432 @@
+#ifndef __KV_INNER_H__
+#define __KV_INNER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "kv.h"
+
+/* largest allocation of a bucket(the prefix included) kept in the pool */
+#define KV_POOL_MAX_SIZE        128
+
+/* get the key string of the bucket */
+#define KV_BUCKET_KEY(bucket)   ((bucket)->data)
+
+/* get the value string of the bucket */
+#define KV_BUCKET_VALUE(bucket) ((bucket)->data + (bucket)->key_len + 1)
+
+/* get the allocation size of the bucket */
+#define KV_BUCKET_SIZE(bucket)  (sizeof(kv_bucket_t) + (bucket)->key_len + 1 + (bucket)->value_cap)
+
+/* check if the bucket holds the key */
+#define KV_BUCKET_MATCH(bucket, key, key_len, hash)                 \
+    ((bucket)->hash == (hash) && (bucket)->key_len == (key_len) &&  \
+     memcmp(KV_BUCKET_KEY(bucket), (key), (key_len)) == 0)
+
+/* get the cache entry stored right in front of the bucket in the cache mode */
+#define KV_CACHE_ENTRY(bucket)  ((kv_cache_entry_t *)(bucket) - 1)
+
+/* get the expiry entry stored at the start of the allocation of the bucket */
+#define KV_TTL_ENTRY(set, bucket)   ((kv_ttl_entry_t *)((char *)(bucket) - (set)->bucket_prefix))
+
+/**
+ * count an event of the set for kv_stats(), the counters compile away if
+ * KV_STATS_DISABLE is defined. readers sharing a lock may count at the same
+ * time, so the counters are added atomically.
+ */
+#ifndef KV_STATS_DISABLE
+#define KV_STATS_INC(set, counter)  ((void)__atomic_fetch_add(&(set)->counter, 1, __ATOMIC_RELAXED))
+#else
+#define KV_STATS_INC(set, counter)  ((void)0)
+#endif
+
+typedef void (* kv_visit_cb_t)(void *, kv_bucket_t *);
+typedef int (* kv_scan_cb_t)(void *, kv_bucket_t *);
+
+/* operations recorded in the write-ahead log */
+enum
+{
+    KV_WAL_PUT              = 1,
+    KV_WAL_DEL              = 2,
+    KV_WAL_CLEAR            = 3,
+};
+
+/* slab of the arena, buckets are carved from it one after another */
+typedef struct kv_slab
+{
+    /* point to the next slab in the arena */
+    struct kv_slab *next;
+
+    /* size of member 'data' */
+    size_t size;
+
+    /* bytes already carved from member 'data' */
+    size_t used;
+
+    /* space for buckets */
+    char data[];
+} kv_slab_t;
+
+/* state of a bucket in the cache mode, stored right in front of the bucket */
+typedef struct kv_cache_entry
+{
+    /* position of the bucket in the ring of the clock */
+    uint32_t slot;
+
+    /* whether the bucket was used since the hand last passed it */
+    uint32_t referenced;
+} kv_cache_entry_t;
+
+/* expiry state of a bucket, stored in front of the bucket(and its cache entry) */
+typedef struct kv_ttl_entry
+{
+    /* next entry in the same slot of the wheel */
+    struct kv_ttl_entry *next;
+
+    /* location which points to this entry, NULL if it isn't in the wheel */
+    struct kv_ttl_entry **link;
+
+    /* time the pair expires at, 0 if it never expires */
+    uint64_t deadline;
+} kv_ttl_entry_t;
+
+/* operations provided by every storage engine */
+typedef struct kv_engine
+{
+    /* allocate the storage of the set */
+    int (*create)(kv_set_t *set, const kv_conf_t *conf);
+
+    /**
+     * empty the set, the buckets are freed one by one only if the arena is
+     * disabled, otherwise the arena releases them all at once.
+     */
+    void (*clear)(kv_set_t *set);
+
+    /* free the storage of the set */
+    void (*destroy)(kv_set_t *set);
+
+    /**
+     * find the location which points to the bucket holding the key, if the
+     * key isn't found, the location points to NULL and can be passed to
+     * 'link' for inserting. if the key is found, the bucket can be replaced
+     * by storing a copy of it(member 'next' included) at the location.
+     */
+    kv_bucket_t **(*locate)(kv_set_t *set, const char *key, size_t key_len, uint32_t hash);
+
+    /**
+     * find the bucket holding the key, or NULL. unlike 'locate', the set is
+     * never modified, so it's safe for concurrent readers.
+     */
+    kv_bucket_t *(*find)(kv_set_t *set, const char *key, size_t key_len, uint32_t hash);
+
+    /**
+     * prefetch the memory 'find' is going to touch for the hash, stage 0
+     * prefetches the slot, stage 1 prefetches the first bucket the slot
+     * points to, which is only worth it once the slot has arrived.
+     */
+    void (*prefetch)(kv_set_t *set, uint32_t hash, int stage);
+
+    /* store a new bucket at the location returned by 'locate' */
+    int (*link)(kv_set_t *set, kv_bucket_t **link, kv_bucket_t *bucket);
+
+    /* remove the bucket at the location returned by 'locate' */
+    void (*unlink)(kv_set_t *set, kv_bucket_t **link);
+
+    /* visit all the buckets in the set */
+    void (*foreach)(kv_set_t *set, kv_visit_cb_t visit_cb, void *arg);
+
+    /**
+     * visit the buckets in the byte order of their keys, starting from the
+     * first key which isn't less than 'start', until the callback returns
+     * KV_FALSE. NULL if the engine doesn't keep the keys in order.
+     */
+    void (*scan)(kv_set_t *set, const char *start, size_t start_len, kv_scan_cb_t scan_cb, void *arg);
+
+    /**
+     * fill the histogram and the longest length of 'stats', and add the bytes
+     * of the table(the buckets not included) to member 'memory_bytes'. NULL
+     * if the engine has nothing to report.
+     */
+    void (*measure)(kv_set_t *set, kv_stats_t *stats);
+
+    /**
+     * share the storage of the set with its clone, whose other members are
+     * copies of the set's, in a constant time. KV_ERR_BAD_CONF if the engine
+     * can't share its storage.
+     */
+    int (*clone)(kv_set_t *set, kv_set_t *clone);
+
+    /**
+     * give the set its own copy of the storage the key of the hash is in,
+     * before the key is modified. only called while member 'shared' of the
+     * set is KV_TRUE.
+     */
+    int (*own)(kv_set_t *set, uint32_t hash);
+} kv_engine_t;
+
+struct kv_wal;
+
+struct kv_index;
+
+struct kv_cache;
+
+struct kv_wheel;
+
+struct kv_entry;
+
+struct kv_table;
+
+/* key-value set structure */
+struct kv_set
+{
+    /* storage engine operations */
+    const struct kv_engine *engine;
+
+    /* number of the key-value pairs in this set */
+    size_t pair_num;
+
+    /* number of buckets in member 'array'(or 'table' of the chain engine) */
+    size_t bucket_num;
+
+    /* hash callback function pointer */
+    kv_hash_cb_t hash;
+
+    /* length-aware hash callback function pointer, or NULL */
+    kv_hash_n_cb_t hash_n;
+
+    /* built-in hash function pointer, used if both callbacks are NULL */
+    kv_hash_seeded_cb_t hash_seeded;
+
+    /* seed of the built-in hash */
+    uint64_t hash_seed;
+
+    /* load factor(in percent) that triggers growing */
+    size_t max_load;
+
+    /* store all the slots of the flat engine */
+    kv_bucket_t **array;
+
+    /* pages of the bucket chains of the chain engine */
+    struct kv_table *table;
+
+    /* table of the chain engine being drained by incremental rehashing, or NULL */
+    struct kv_table *old_table;
+
+    /* index of the next bucket in 'old_table' to be migrated */
+    size_t rehash_index;
+
+    /* control bytes of the flat engine, one per slot in 'array' */
+    uint8_t *ctrl;
+
+    /* number of empty slots the flat engine can fill before growing */
+    size_t growth_left;
+
+    /* root of the art engine, a bucket or a tagged node, or NULL */
+    kv_bucket_t *art_root;
+
+    /* index of the compact engine, positions in member 'entries' of the keys */
+    uint32_t *indices;
+
+    /* dense array of the compact engine, holding the buckets in insertion order */
+    struct kv_entry *entries;
+
+    /* number of the entries in member 'entries', the deleted ones included */
+    size_t entry_num;
+
+    /* number of the deleted entries in member 'entries' */
+    size_t dead_num;
+
+    /* size of the arena slabs, 0 if the arena is disabled */
+    size_t arena_size;
+
+    /* list of the arena slabs, the one being carved comes first */
+    struct kv_slab *slab;
+
+    /* bytes of the slabs owned by the arena */
+    size_t arena_reserved;
+
+    /* bytes of the buckets still alive in the arena */
+    size_t arena_live;
+
+    /* pool of the small buckets, or NULL */
+    struct kv_pool *pool;
+
+    /* Bloom filter of the keys, or NULL */
+    struct kv_bloom *bloom;
+
+    /* mapping of the image the set is served from, or NULL */
+    const uint8_t *image;
+
+    /* size of member 'image' */
+    size_t image_size;
+
+    /* write-ahead log the modifications are appended to, or NULL */
+    struct kv_wal *wal;
+
+    /* ordered index of the keys, or NULL */
+    struct kv_index *index;
+
+    /* clock evicting the cold pairs of the cache mode, or NULL */
+    struct kv_cache *cache;
+
+    /* timer wheel of the expiring pairs, or NULL */
+    struct kv_wheel *wheel;
+
+    /* bytes allocated in front of every bucket for the cache and the wheel */
+    size_t bucket_prefix;
+
+    /* whether the storage may be shared with the clones of the set */
+    int shared;
+
+    /* number of the pages of the chain engine found not to be shared any more */
+    size_t own_index;
+
+    /* whether readers look the set up concurrently, under a shared lock or in a mapped image */
+    int read_shared;
+
+    /* cumulative counters reported by kv_stats() */
+    uint64_t lookup_num;
+    uint64_t hit_num;
+    uint64_t miss_num;
+    uint64_t rehash_num;
+};
+
+extern const kv_engine_t kv_chain_engine;
+
+extern const kv_engine_t kv_flat_engine;
+
+extern const kv_engine_t kv_art_engine;
+
+extern const kv_engine_t kv_compact_engine;
+
+kv_bucket_t *kv_bucket_alloc(kv_set_t *set, uint32_t hash, const char *key, size_t key_len, const char *value, size_t value_len);
+
+void kv_bucket_free(kv_set_t *set, kv_bucket_t *bucket);
+
+void kv_bucket_drop(kv_set_t *set, kv_bucket_t *bucket);
+
+void kv_stats_length(kv_stats_t *stats, size_t length);
+
+uint64_t kv_hash_seed(const void *addr);
+
+int kv_hash_init(kv_set_t *set, const kv_conf_t *conf);
+
+uint32_t kv_hash_n(kv_set_t *set, const char *key, size_t key_len);
+
+uint32_t kv_hash_str(kv_set_t *set, const char *key, size_t key_len);
+
+int kv_wal_open(kv_set_t *set, const kv_conf_t *conf);
+
+int kv_wal_close(kv_set_t *set);
+
+int kv_wal_append(kv_set_t *set, int op, const char *key, size_t key_len, const char *value, size_t value_len);
+
+void kv_wal_compact(kv_set_t *set);
+
+void kv_wal_hold(kv_set_t *set, kv_bucket_t *bucket);
+
+int kv_wal_settle(kv_set_t *set);
+
+int kv_wal_sync(kv_set_t *set);
+
+int kv_index_create(kv_set_t *set);
+
+void kv_index_clear(kv_set_t *set);
+
+void kv_index_destroy(kv_set_t *set);
+
+int kv_index_insert(kv_set_t *set, kv_bucket_t *bucket);
+
+void kv_index_replace(kv_set_t *set, kv_bucket_t *old_bucket, kv_bucket_t *new_bucket);
+
+void kv_index_remove(kv_set_t *set, kv_bucket_t *bucket);
+
+void kv_index_stats(kv_set_t *set, kv_stats_t *stats);
+
+int kv_cache_create(kv_set_t *set, const kv_conf_t *conf);
+
+void kv_cache_clear(kv_set_t *set);
+
+void kv_cache_destroy(kv_set_t *set);
+
+int kv_cache_insert(kv_set_t *set, kv_bucket_t *bucket);
+
+void kv_cache_replace(kv_set_t *set, kv_bucket_t *old_bucket, kv_bucket_t *new_bucket);
+
+void kv_cache_remove(kv_set_t *set, kv_bucket_t *bucket);
+
+void kv_cache_touch(kv_set_t *set, kv_bucket_t *bucket);
+
+void kv_cache_evict(kv_set_t *set, kv_bucket_t *keep);
+
+void kv_cache_stats(kv_set_t *set, kv_stats_t *stats);
+
+int kv_pool_create(kv_set_t *set);
+
+void kv_pool_clear(kv_set_t *set);
+
+void kv_pool_destroy(kv_set_t *set);
+
+void *kv_pool_alloc(kv_set_t *set, size_t size);
+
+void kv_pool_free(kv_set_t *set, void *ptr, size_t size);
+
+void kv_pool_stats(kv_set_t *set, kv_stats_t *stats);
+
+int kv_bloom_create(kv_set_t *set, const kv_conf_t *conf);
+
+void kv_bloom_clear(kv_set_t *set);
+
+void kv_bloom_destroy(kv_set_t *set);
+
+int kv_bloom_rebuild(kv_set_t *set);
+
+void kv_bloom_insert(kv_set_t *set, uint32_t hash);
+
+void kv_bloom_remove(kv_set_t *set);
+
+int kv_bloom_test(kv_set_t *set, uint32_t hash);
+
+void kv_bloom_prefetch(kv_set_t *set, uint32_t hash);
+
+void kv_bloom_stats(kv_set_t *set, kv_stats_t *stats);
+
+int kv_ttl_create(kv_set_t *set, const kv_conf_t *conf);
+
+void kv_ttl_clear(kv_set_t *set);
+
+void kv_ttl_destroy(kv_set_t *set);
+
+uint64_t kv_ttl_now(kv_set_t *set);
+
+void kv_ttl_set(kv_set_t *set, kv_bucket_t *bucket, uint64_t deadline);
+
+void kv_ttl_remove(kv_set_t *set, kv_bucket_t *bucket);
+
+int kv_ttl_expired(kv_set_t *set, kv_bucket_t *bucket, uint64_t now);
+
+size_t kv_ttl_advance(kv_set_t *set, uint64_t now, size_t max_num);
+
+void kv_ttl_stats(kv_set_t *set, kv_stats_t *stats);
+
+int kv_contain_hashed(kv_set_t *set, const char *key, size_t key_len, uint32_t hash);
+
+int kv_put_hashed(kv_set_t *set, const char *key, size_t key_len, uint32_t hash,
+                  const char *value, size_t value_len);
+
+int kv_put_ttl_hashed(kv_set_t *set, const char *key, size_t key_len, uint32_t hash,
+                      const char *value, size_t value_len, uint64_t deadline);
+
+int kv_upsert_hashed(kv_set_t *set, const char *key, size_t key_len, uint32_t hash,
+                     kv_upsert_n_cb_t upsert_cb, void *arg);
+
+int kv_get_or_insert_hashed(kv_set_t *set, const char *key, size_t key_len, uint32_t hash,
+                            const char *value, size_t value_len, char **slot, size_t *slot_len);
+
+int kv_del_hashed(kv_set_t *set, const char *key, size_t key_len, uint32_t hash);
+
+int kv_get_hashed(kv_set_t *set, const char *key, size_t key_len, uint32_t hash,
+                  const char **value, size_t *value_len);
+
+#endif
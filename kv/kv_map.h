@@ -0,0 +1,482 @@
+#ifndef __KV_MAP_H__
+#define __KV_MAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "kv.h"
+
+/**
+ * type-specialized hash maps generated from the design of the flat engine.
+ * the keys and the values are stored unboxed in one array of entries, and
+ * the hash and the equality are inlined, so a map of integers formats no
+ * strings and allocates nothing per pair.
+ *
+ *     KV_MAP_INIT(u64, uint64_t, void *, kv_map_hash_u64, kv_map_equal)
+ *
+ * generates kv_map_u64_t and kv_map_u64_create(), kv_map_u64_destroy(),
+ * kv_map_u64_clear(), kv_map_u64_size(), kv_map_u64_contain(),
+ * kv_map_u64_put(), kv_map_u64_get(), kv_map_u64_del() and
+ * kv_map_u64_foreach(), which return the codes of kv.h. the hash returns a
+ * uint32_t whose low 7 bits and high 25 bits are both well mixed, and the
+ * equality returns non-zero if the keys are the same.
+ */
+
+/* number of slots probed at once */
+#define KV_MAP_GROUP_WIDTH      16
+
+/* control byte of a slot which has never been used */
+#define KV_MAP_CTRL_EMPTY       0x80
+
+/* control byte of a slot whose entry has been deleted */
+#define KV_MAP_CTRL_DELETED     0xFE
+
+/* high 25 bits of the hash select the group to start probing */
+#define KV_MAP_H1(hash)         ((hash) >> 7)
+
+/* low 7 bits of the hash are stored in the control byte of a full slot */
+#define KV_MAP_H2(hash)         ((uint8_t)((hash) & 0x7F))
+
+/* at most 7/8 of the slots are used before growing */
+#define KV_MAP_MAX_LOAD(cap)    ((cap) - (cap) / 8)
+
+/* equality of the keys comparable with == */
+#define kv_map_equal(a, b)      ((a) == (b))
+
+/**
+ * @brief hash a 64-bit integer key, the finalizer of MurmurHash3 folded into
+ *        32 bits.
+ */
+static inline uint32_t kv_map_hash_u64(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    key *= 0xC4CEB9FE1A85EC53ULL;
+    key ^= key >> 33;
+
+    return (uint32_t)key ^ (uint32_t)(key >> 32);
+}
+
+/**
+ * @brief hash a 32-bit integer key.
+ */
+static inline uint32_t kv_map_hash_u32(uint32_t key)
+{
+    key ^= key >> 16;
+    key *= 0x85EBCA6B;
+    key ^= key >> 13;
+    key *= 0xC2B2AE35;
+    key ^= key >> 16;
+
+    return key;
+}
+
+/**
+ * @brief get the mask of the slots in the group whose control byte equals to
+ *        the specified one.
+ */
+static inline uint32_t kv_map_group_match(const uint8_t *group, uint8_t ctrl)
+{
+#ifdef __SSE2__
+    __m128i group_ctrl = _mm_loadu_si128((const __m128i *)group);
+
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8((char)ctrl), group_ctrl));
+#else
+    uint32_t mask = 0;
+
+    for (int i = 0; i < KV_MAP_GROUP_WIDTH; i++)
+    {
+        if (group[i] == ctrl)
+        {
+            mask |= 1U << i;
+        }
+    }
+
+    return mask;
+#endif
+}
+
+/**
+ * @brief get the mask of the empty or deleted slots in the group.
+ */
+static inline uint32_t kv_map_group_match_free(const uint8_t *group)
+{
+#ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+    uint32_t mask = 0;
+
+    for (int i = 0; i < KV_MAP_GROUP_WIDTH; i++)
+    {
+        if (group[i] & 0x80)
+        {
+            mask |= 1U << i;
+        }
+    }
+
+    return mask;
+#endif
+}
+
+/**
+ * @brief generate the map type and its functions.
+ *
+ * @param name      suffix of the names generated.
+ * @param key_t     type of the keys.
+ * @param value_t   type of the values.
+ * @param hash_fn   hash function or macro, uint32_t (key_t).
+ * @param equal_fn  equality function or macro, int (key_t, key_t).
+ */
+#define KV_MAP_INIT(name, key_t, value_t, hash_fn, equal_fn)                                            \
+                                                                                                        \
+typedef struct kv_map_##name##_entry                                                                    \
+{                                                                                                       \
+    key_t key;                                                                                          \
+    value_t value;                                                                                      \
+} kv_map_##name##_entry_t;                                                                              \
+                                                                                                        \
+typedef void (* kv_map_##name##_foreach_cb_t)(void *, key_t, value_t *);                                \
+                                                                                                        \
+typedef struct kv_map_##name                                                                            \
+{                                                                                                       \
+    /* control bytes of the slots */                                                                    \
+    uint8_t *ctrl;                                                                                      \
+                                                                                                        \
+    /* entries of the slots */                                                                          \
+    kv_map_##name##_entry_t *entries;                                                                   \
+                                                                                                        \
+    /* number of the slots, a power of two */                                                           \
+    size_t cap;                                                                                         \
+                                                                                                        \
+    /* number of the pairs */                                                                           \
+    size_t pair_num;                                                                                    \
+                                                                                                        \
+    /* number of the empty slots which can still be used before growing */                              \
+    size_t growth_left;                                                                                 \
+} kv_map_##name##_t;                                                                                    \
+                                                                                                        \
+/* find the first empty or deleted slot on the probe sequence, there is always an empty one */          \
+static inline size_t kv_map_##name##_find_free(kv_map_##name##_t *map, uint32_t hash)                   \
+{                                                                                                       \
+    size_t group_mask;                                                                                  \
+    size_t group_index;                                                                                 \
+    uint32_t mask;                                                                                      \
+                                                                                                        \
+    group_mask = map->cap / KV_MAP_GROUP_WIDTH - 1;                                                     \
+    group_index = KV_MAP_H1(hash) & group_mask;                                                         \
+    for (size_t i = 1; ; i++)                                                                           \
+    {                                                                                                   \
+        mask = kv_map_group_match_free(map->ctrl + group_index * KV_MAP_GROUP_WIDTH);                   \
+        if (mask != 0)                                                                                  \
+        {                                                                                               \
+            return group_index * KV_MAP_GROUP_WIDTH + __builtin_ctz(mask);                              \
+        }                                                                                               \
+        group_index = (group_index + i) & group_mask;                                                   \
+    }                                                                                                   \
+}                                                                                                       \
+                                                                                                        \
+/* find the slot holding the key, or return the capacity if it isn't found */                           \
+static inline size_t kv_map_##name##_find(const kv_map_##name##_t *map, key_t key, uint32_t hash)       \
+{                                                                                                       \
+    size_t group_mask;                                                                                  \
+    size_t group_index;                                                                                 \
+    const uint8_t *group;                                                                               \
+    size_t index;                                                                                       \
+    uint32_t mask;                                                                                      \
+                                                                                                        \
+    group_mask = map->cap / KV_MAP_GROUP_WIDTH - 1;                                                     \
+    group_index = KV_MAP_H1(hash) & group_mask;                                                         \
+    for (size_t i = 1; ; i++)                                                                           \
+    {                                                                                                   \
+        group = map->ctrl + group_index * KV_MAP_GROUP_WIDTH;                                           \
+        mask = kv_map_group_match(group, KV_MAP_H2(hash));                                              \
+        while (mask != 0)                                                                               \
+        {                                                                                               \
+            index = group_index * KV_MAP_GROUP_WIDTH + __builtin_ctz(mask);                             \
+            if (equal_fn(map->entries[index].key, key))                                                 \
+            {                                                                                           \
+                return index;                                                                           \
+            }                                                                                           \
+            mask &= mask - 1;                                                                           \
+        }                                                                                               \
+                                                                                                        \
+        /* the key would have been put in this group if it existed */                                   \
+        if (kv_map_group_match(group, KV_MAP_CTRL_EMPTY) != 0)                                          \
+        {                                                                                               \
+            return map->cap;                                                                            \
+        }                                                                                               \
+        group_index = (group_index + i) & group_mask;                                                   \
+    }                                                                                                   \
+}                                                                                                       \
+                                                                                                        \
+/* rebuild the table, doubled if more than half of the usable slots are full, otherwise only purged */  \
+static inline int kv_map_##name##_rehash(kv_map_##name##_t *map)                                        \
+{                                                                                                       \
+    uint8_t *old_ctrl;                                                                                  \
+    kv_map_##name##_entry_t *old_entries;                                                               \
+    size_t old_cap;                                                                                     \
+    size_t new_cap;                                                                                     \
+    size_t index;                                                                                       \
+    uint32_t hash;                                                                                      \
+                                                                                                        \
+    old_cap = map->cap;                                                                                 \
+    new_cap = old_cap;                                                                                  \
+    if (map->pair_num >= KV_MAP_MAX_LOAD(old_cap) / 2)                                                  \
+    {                                                                                                   \
+        if (old_cap > SIZE_MAX / 2 / sizeof(kv_map_##name##_entry_t))                                   \
+        {                                                                                               \
+            return KV_ERR_BAD_MEM;                                                                      \
+        }                                                                                               \
+        new_cap = old_cap * 2;                                                                          \
+    }                                                                                                   \
+                                                                                                        \
+    old_ctrl = map->ctrl;                                                                               \
+    old_entries = map->entries;                                                                         \
+    map->ctrl = (uint8_t *)malloc(new_cap);                                                             \
+    map->entries = (kv_map_##name##_entry_t *)malloc(new_cap * sizeof(kv_map_##name##_entry_t));        \
+    if (map->ctrl == NULL || map->entries == NULL)                                                      \
+    {                                                                                                   \
+        free(map->ctrl);                                                                                \
+        free(map->entries);                                                                             \
+        map->ctrl = old_ctrl;                                                                           \
+        map->entries = old_entries;                                                                     \
+        return KV_ERR_BAD_MEM;                                                                          \
+    }                                                                                                   \
+    memset(map->ctrl, KV_MAP_CTRL_EMPTY, new_cap);                                                      \
+    map->cap = new_cap;                                                                                 \
+                                                                                                        \
+    for (size_t i = 0; i < old_cap; i++)                                                                \
+    {                                                                                                   \
+        if (old_ctrl[i] & 0x80)                                                                         \
+        {                                                                                               \
+            continue;                                                                                   \
+        }                                                                                               \
+        hash = hash_fn(old_entries[i].key);                                                             \
+        index = kv_map_##name##_find_free(map, hash);                                                   \
+        map->ctrl[index] = KV_MAP_H2(hash);                                                             \
+        map->entries[index] = old_entries[i];                                                           \
+    }                                                                                                   \
+    map->growth_left = KV_MAP_MAX_LOAD(new_cap) - map->pair_num;                                        \
+                                                                                                        \
+    free(old_ctrl);                                                                                     \
+    free(old_entries);                                                                                  \
+                                                                                                        \
+    return KV_OK;                                                                                       \
+}                                                                                                       \
+                                                                                                        \
+/* create a map, the capacity is rounded up to a power of two */                                        \
+static inline int kv_map_##name##_create(kv_map_##name##_t **map, size_t cap)                           \
+{                                                                                                       \
+    kv_map_##name##_t *inner_map;                                                                       \
+    size_t real_cap;                                                                                    \
+                                                                                                        \
+    if (map == NULL)                                                                                    \
+    {                                                                                                   \
+        return KV_ERR_BAD_ARG;                                                                          \
+    }                                                                                                   \
+                                                                                                        \
+    /* the map pointer is always assigned, NULL on failure */                                           \
+    *map = NULL;                                                                                        \
+    real_cap = KV_MAP_GROUP_WIDTH;                                                                      \
+    while (real_cap < cap)                                                                              \
+    {                                                                                                   \
+        real_cap *= 2;                                                                                  \
+    }                                                                                                   \
+                                                                                                        \
+    inner_map = (kv_map_##name##_t *)malloc(sizeof(kv_map_##name##_t));                                 \
+    if (inner_map == NULL)                                                                              \
+    {                                                                                                   \
+        return KV_ERR_BAD_MEM;                                                                          \
+    }                                                                                                   \
+    inner_map->ctrl = (uint8_t *)malloc(real_cap);                                                      \
+    inner_map->entries = (kv_map_##name##_entry_t *)malloc(real_cap * sizeof(kv_map_##name##_entry_t)); \
+    if (inner_map->ctrl == NULL || inner_map->entries == NULL)                                          \
+    {                                                                                                   \
+        free(inner_map->ctrl);                                                                          \
+        free(inner_map->entries);                                                                       \
+        free(inner_map);                                                                                \
+        return KV_ERR_BAD_MEM;                                                                          \
+    }                                                                                                   \
+    memset(inner_map->ctrl, KV_MAP_CTRL_EMPTY, real_cap);                                               \
+    inner_map->cap = real_cap;                                                                          \
+    inner_map->pair_num = 0;                                                                            \
+    inner_map->growth_left = KV_MAP_MAX_LOAD(real_cap);                                                 \
+                                                                                                        \
+    *map = inner_map;                                                                                   \
+                                                                                                        \
+    return KV_OK;                                                                                       \
+}                                                                                                       \
+                                                                                                        \
+static inline int kv_map_##name##_destroy(kv_map_##name##_t *map)                                       \
+{                                                                                                       \
+    if (map == NULL)                                                                                    \
+    {                                                                                                   \
+        return KV_ERR_BAD_ARG;                                                                          \
+    }                                                                                                   \
+                                                                                                        \
+    free(map->ctrl);                                                                                    \
+    free(map->entries);                                                                                 \
+    free(map);                                                                                          \
+                                                                                                        \
+    return KV_OK;                                                                                       \
+}                                                                                                       \
+                                                                                                        \
+static inline int kv_map_##name##_clear(kv_map_##name##_t *map)                                         \
+{                                                                                                       \
+    if (map == NULL)                                                                                    \
+    {                                                                                                   \
+        return KV_ERR_BAD_ARG;                                                                          \
+    }                                                                                                   \
+                                                                                                        \
+    memset(map->ctrl, KV_MAP_CTRL_EMPTY, map->cap);                                                     \
+    map->pair_num = 0;                                                                                  \
+    map->growth_left = KV_MAP_MAX_LOAD(map->cap);                                                       \
+                                                                                                        \
+    return KV_OK;                                                                                       \
+}                                                                                                       \
+                                                                                                        \
+static inline int kv_map_##name##_size(kv_map_##name##_t *map, size_t *size)                           \
+{                                                                                                       \
+    if (map == NULL || size == NULL)                                                                    \
+    {                                                                                                   \
+        return KV_ERR_BAD_ARG;                                                                          \
+    }                                                                                                   \
+                                                                                                        \
+    *size = map->pair_num;                                                                              \
+                                                                                                        \
+    return KV_OK;                                                                                       \
+}                                                                                                       \
+                                                                                                        \
+static inline int kv_map_##name##_contain(kv_map_##name##_t *map, key_t key)                            \
+{                                                                                                       \
+    if (map == NULL)                                                                                    \
+    {                                                                                                   \
+        return KV_ERR_BAD_ARG;                                                                          \
+    }                                                                                                   \
+                                                                                                        \
+    return kv_map_##name##_find(map, key, hash_fn(key)) != map->cap ? KV_TRUE : KV_FALSE;               \
+}                                                                                                       \
+                                                                                                        \
+/* put a pair in the map, the value of the key is replaced if it already exists */                      \
+static inline int kv_map_##name##_put(kv_map_##name##_t *map, key_t key, value_t value)                 \
+{                                                                                                       \
+    uint32_t hash;                                                                                      \
+    size_t index;                                                                                       \
+    int res;                                                                                            \
+                                                                                                        \
+    if (map == NULL)                                                                                    \
+    {                                                                                                   \
+        return KV_ERR_BAD_ARG;                                                                          \
+    }                                                                                                   \
+                                                                                                        \
+    hash = hash_fn(key);                                                                                \
+    index = kv_map_##name##_find(map, key, hash);                                                       \
+    if (index != map->cap)                                                                              \
+    {                                                                                                   \
+        map->entries[index].value = value;                                                              \
+        return KV_OK;                                                                                   \
+    }                                                                                                   \
+                                                                                                        \
+    index = kv_map_##name##_find_free(map, hash);                                                       \
+    if (map->growth_left == 0 && map->ctrl[index] == KV_MAP_CTRL_EMPTY)                                 \
+    {                                                                                                   \
+        res = kv_map_##name##_rehash(map);                                                              \
+        if (res != KV_OK)                                                                               \
+        {                                                                                               \
+            return res;                                                                                 \
+        }                                                                                               \
+        index = kv_map_##name##_find_free(map, hash);                                                   \
+    }                                                                                                   \
+                                                                                                        \
+    /* a deleted slot is reused without using up an empty one */                                        \
+    if (map->ctrl[index] == KV_MAP_CTRL_EMPTY)                                                          \
+    {                                                                                                   \
+        map->growth_left--;                                                                             \
+    }                                                                                                   \
+    map->ctrl[index] = KV_MAP_H2(hash);                                                                 \
+    map->entries[index].key = key;                                                                      \
+    map->entries[index].value = value;                                                                  \
+    map->pair_num++;                                                                                    \
+                                                                                                        \
+    return KV_OK;                                                                                       \
+}                                                                                                       \
+                                                                                                        \
+/* get the value of the key, the value isn't updated unless KV_OK is returned */                        \
+static inline int kv_map_##name##_get(kv_map_##name##_t *map, key_t key, value_t *value)                \
+{                                                                                                       \
+    size_t index;                                                                                       \
+                                                                                                        \
+    if (map == NULL || value == NULL)                                                                   \
+    {                                                                                                   \
+        return KV_ERR_BAD_ARG;                                                                          \
+    }                                                                                                   \
+                                                                                                        \
+    index = kv_map_##name##_find(map, key, hash_fn(key));                                               \
+    if (index == map->cap)                                                                              \
+    {                                                                                                   \
+        return KV_ERR_KEY_NOT_FOUND;                                                                    \
+    }                                                                                                   \
+    *value = map->entries[index].value;                                                                 \
+                                                                                                        \
+    return KV_OK;                                                                                       \
+}                                                                                                       \
+                                                                                                        \
+/* delete the pair, the slot becomes empty again if its group has never been full */                    \
+static inline int kv_map_##name##_del(kv_map_##name##_t *map, key_t key)                                \
+{                                                                                                       \
+    size_t index;                                                                                       \
+                                                                                                        \
+    if (map == NULL)                                                                                    \
+    {                                                                                                   \
+        return KV_ERR_BAD_ARG;                                                                          \
+    }                                                                                                   \
+                                                                                                        \
+    index = kv_map_##name##_find(map, key, hash_fn(key));                                               \
+    if (index == map->cap)                                                                              \
+    {                                                                                                   \
+        return KV_ERR_KEY_NOT_FOUND;                                                                    \
+    }                                                                                                   \
+                                                                                                        \
+    if (kv_map_group_match(map->ctrl + index / KV_MAP_GROUP_WIDTH * KV_MAP_GROUP_WIDTH,                 \
+                           KV_MAP_CTRL_EMPTY) != 0)                                                     \
+    {                                                                                                   \
+        map->ctrl[index] = KV_MAP_CTRL_EMPTY;                                                           \
+        map->growth_left++;                                                                             \
+    }                                                                                                   \
+    else                                                                                                \
+    {                                                                                                   \
+        map->ctrl[index] = KV_MAP_CTRL_DELETED;                                                         \
+    }                                                                                                   \
+    map->pair_num--;                                                                                    \
+                                                                                                        \
+    return KV_OK;                                                                                       \
+}                                                                                                       \
+                                                                                                        \
+/* visit all the pairs, the values may be modified through the pointers */                              \
+static inline int kv_map_##name##_foreach(kv_map_##name##_t *map, kv_map_##name##_foreach_cb_t foreach_cb, \
+                                          void *arg)                                                    \
+{                                                                                                       \
+    if (map == NULL || foreach_cb == NULL)                                                              \
+    {                                                                                                   \
+        return KV_ERR_BAD_ARG;                                                                          \
+    }                                                                                                   \
+                                                                                                        \
+    for (size_t i = 0; i < map->cap; i++)                                                               \
+    {                                                                                                   \
+        if ((map->ctrl[i] & 0x80) == 0)                                                                 \
+        {                                                                                               \
+            foreach_cb(arg, map->entries[i].key, &map->entries[i].value);                               \
+        }                                                                                               \
+    }                                                                                                   \
+                                                                                                        \
+    return KV_OK;                                                                                       \
+}
+
+#endif
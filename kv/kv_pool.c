@@ -0,0 +1,166 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kv.h"
+#include "kv_inner.h"
+
+/* granularity of the size classes, every bucket is rounded up to it anyway */
+#define POOL_CLASS_SIZE     8
+
+/* number of the size classes */
+#define POOL_CLASS_NUM      (KV_POOL_MAX_SIZE / POOL_CLASS_SIZE)
+
+/* size of the slabs the chunks are carved from */
+#define POOL_SLAB_SIZE      (64 * 1024)
+
+/* chunk on a free list, it overlays the memory of a freed bucket */
+typedef struct kv_pool_chunk
+{
+    /* next free chunk of the same size class */
+    struct kv_pool_chunk *next;
+} kv_pool_chunk_t;
+
+/**
+ * pool of the small buckets, they are carved from large slabs one after
+ * another, so they carry no header of the allocator and sit next to each
+ * other. a freed bucket goes to the free list of its size class, and is
+ * reused by the next bucket of that class.
+ */
+typedef struct kv_pool
+{
+    /* list of the slabs, the one being carved comes first */
+    kv_slab_t *slab;
+
+    /* free lists, one per size class */
+    kv_pool_chunk_t *free_lists[POOL_CLASS_NUM];
+
+    /* bytes of the slabs */
+    size_t reserved;
+
+    /* bytes of the chunks in use */
+    size_t live;
+} kv_pool_t;
+
+int kv_pool_create(kv_set_t *set)
+{
+    kv_pool_t *pool;
+
+    pool = (kv_pool_t *)malloc(sizeof(kv_pool_t));
+    if (pool == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    memset(pool, 0, sizeof(kv_pool_t));
+
+    set->pool = pool;
+
+    return KV_OK;
+}
+
+/**
+ * @brief release the slabs, all the chunks must have been freed, one slab is
+ *        kept for the following allocations.
+ */
+void kv_pool_clear(kv_set_t *set)
+{
+    kv_pool_t *pool;
+    kv_slab_t *curt_slab;
+    kv_slab_t *next_slab;
+
+    pool = set->pool;
+    if (pool->slab == NULL)
+    {
+        return;
+    }
+
+    next_slab = pool->slab->next;
+    while (next_slab != NULL)
+    {
+        curt_slab = next_slab;
+        next_slab = curt_slab->next;
+        free(curt_slab);
+    }
+    memset(pool->free_lists, 0, sizeof(pool->free_lists));
+    pool->slab->next = NULL;
+    pool->slab->used = 0;
+    pool->reserved = pool->slab->size;
+    pool->live = 0;
+}
+
+void kv_pool_destroy(kv_set_t *set)
+{
+    kv_pool_clear(set);
+    free(set->pool->slab);
+    free(set->pool);
+    set->pool = NULL;
+}
+
+/**
+ * @brief allocate a chunk, reusing a freed one of the same size class first.
+ *
+ * @param set   kv set pointer.
+ * @param size  size of the chunk, multiple of 8 and at most KV_POOL_MAX_SIZE.
+ * @return  chunk pointer, or NULL if out of memory.
+ */
+void *kv_pool_alloc(kv_set_t *set, size_t size)
+{
+    kv_pool_t *pool;
+    kv_pool_chunk_t *chunk;
+    kv_slab_t *slab;
+
+    pool = set->pool;
+    chunk = pool->free_lists[size / POOL_CLASS_SIZE - 1];
+    if (chunk != NULL)
+    {
+        pool->free_lists[size / POOL_CLASS_SIZE - 1] = chunk->next;
+        pool->live += size;
+        return chunk;
+    }
+
+    /* the tail of the full slab is left unused */
+    slab = pool->slab;
+    if (slab == NULL || slab->size - slab->used < size)
+    {
+        slab = (kv_slab_t *)malloc(sizeof(kv_slab_t) + POOL_SLAB_SIZE);
+        if (slab == NULL)
+        {
+            return NULL;
+        }
+        slab->size = POOL_SLAB_SIZE;
+        slab->used = 0;
+        slab->next = pool->slab;
+        pool->slab = slab;
+        pool->reserved += POOL_SLAB_SIZE;
+    }
+
+    slab->used += size;
+    pool->live += size;
+
+    return slab->data + slab->used - size;
+}
+
+/**
+ * @brief put the chunk on the free list of its size class.
+ */
+void kv_pool_free(kv_set_t *set, void *ptr, size_t size)
+{
+    kv_pool_t *pool;
+    kv_pool_chunk_t *chunk;
+
+    pool = set->pool;
+    chunk = (kv_pool_chunk_t *)ptr;
+    chunk->next = pool->free_lists[size / POOL_CLASS_SIZE - 1];
+    pool->free_lists[size / POOL_CLASS_SIZE - 1] = chunk;
+    pool->live -= size;
+}
+
+/**
+ * @brief count the slabs instead of the small buckets in them.
+ * @note  the buckets were already counted one by one.
+ */
+void kv_pool_stats(kv_set_t *set, kv_stats_t *stats)
+{
+    stats->memory_bytes += sizeof(kv_pool_t) + set->pool->reserved - set->pool->live;
+}
@@ -0,0 +1,856 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "kv.h"
+#include "kv_inner.h"
+#include "kv_rcu.h"
+
+/* default maximum number of reader threads */
+#define DEF_READER_NUM  64
+
+/* default initial number of buckets */
+#define DEF_BUCKET_NUM  128
+
+/* default load factor(in percent) that triggers growing */
+#define DEF_MAX_LOAD    100
+
+/* number of retired entries that triggers reclaiming */
+#define RECLAIM_NUM     64
+
+/* number of the lists of retired memory, one per epoch a reader may observe */
+#define LIMBO_NUM       3
+
+/* epoch of a reader outside the read-side section */
+#define EPOCH_IDLE      0
+
+/* map the hash to a bucket by its high bits, no division is needed */
+#define BUCKET_INDEX(hash, bucket_num)  ((size_t)(((uint64_t)(hash) * (bucket_num)) >> 32))
+
+/* bucket table, replaced as a whole when the set grows */
+typedef struct kv_rcu_table
+{
+    /* number of buckets in member 'array' */
+    size_t bucket_num;
+
+    /* heads of the bucket chains */
+    kv_bucket_t *array[];
+} kv_rcu_table_t;
+
+/* memory to be freed once no reader can reach it */
+typedef struct kv_rcu_retired
+{
+    /* bucket or table pointer */
+    void *ptr;
+
+    /* whether member 'ptr' is a table, freed along with its buckets, or not */
+    int table;
+} kv_rcu_retired_t;
+
+/* memory retired during one epoch */
+typedef struct kv_rcu_limbo
+{
+    /* retired entries */
+    kv_rcu_retired_t *retired;
+
+    /* number of the entries in member 'retired' */
+    size_t retired_num;
+
+    /* capacity of member 'retired' */
+    size_t retired_cap;
+} kv_rcu_limbo_t;
+
+/**
+ * read-optimized kv set structure, the readers never take a lock, and the
+ * writers are serialized by a mutex.
+ */
+struct kv_rcu_set
+{
+    /* hash of the set, number of the key-value pairs and load factor */
+    kv_set_t base;
+
+    /* bucket table published to the readers */
+    kv_rcu_table_t *table;
+
+    /* serialize the writers */
+    pthread_mutex_t mutex;
+
+    /* global epoch, advanced once every active reader has observed it */
+    uint64_t epoch;
+
+    /* number of the reader slots in member 'readers' */
+    size_t reader_num;
+
+    /* reader slots */
+    kv_rcu_reader_t *readers;
+
+    /**
+     * memory unlinked by the writers but maybe still used by the readers,
+     * the one retired during an epoch is in the list at the epoch modulo
+     * LIMBO_NUM.
+     */
+    kv_rcu_limbo_t limbo[LIMBO_NUM];
+
+    /* number of the entries in member 'limbo' */
+    size_t retired_num;
+
+    /* number of the entries in member 'limbo' that triggers reclaiming */
+    size_t reclaim_num;
+};
+
+/* default configuration */
+static const kv_rcu_conf_t def_conf =
+{
+    .reader_num = DEF_READER_NUM,
+    .set_conf = NULL,
+};
+
+static kv_rcu_table_t *kv_rcu_table_alloc(size_t bucket_num)
+{
+    kv_rcu_table_t *table;
+
+    if (bucket_num > (SIZE_MAX - sizeof(kv_rcu_table_t)) / sizeof(kv_bucket_t *))
+    {
+        return NULL;
+    }
+
+    table = (kv_rcu_table_t *)calloc(1, sizeof(kv_rcu_table_t) + bucket_num * sizeof(kv_bucket_t *));
+    if (table == NULL)
+    {
+        return NULL;
+    }
+    table->bucket_num = bucket_num;
+
+    return table;
+}
+
+/**
+ * @brief free the table along with all of its buckets right now.
+ */
+static void kv_rcu_table_free(kv_rcu_table_t *table)
+{
+    kv_bucket_t *curt_bucket;
+    kv_bucket_t *next_bucket;
+
+    for (size_t i = 0; i < table->bucket_num; i++)
+    {
+        next_bucket = table->array[i];
+        while (next_bucket != NULL)
+        {
+            curt_bucket = next_bucket;
+            next_bucket = curt_bucket->next;
+            free(curt_bucket);
+        }
+    }
+    free(table);
+}
+
+/**
+ * @brief free the memory retired during one epoch right now.
+ */
+static void kv_rcu_limbo_free(kv_rcu_set_t *set, kv_rcu_limbo_t *limbo)
+{
+    for (size_t i = 0; i < limbo->retired_num; i++)
+    {
+        if (limbo->retired[i].table == KV_TRUE)
+        {
+            kv_rcu_table_free((kv_rcu_table_t *)limbo->retired[i].ptr);
+        }
+        else
+        {
+            free(limbo->retired[i].ptr);
+        }
+    }
+    set->retired_num -= limbo->retired_num;
+    limbo->retired_num = 0;
+}
+
+/**
+ * @brief advance the global epoch if every active reader has observed it,
+ *        and free the memory which no reader can reach any longer.
+ * @note  the fence orders the preceding unlinks before reading the epochs of
+ *        the readers, a reader entering meanwhile either is seen here or sees
+ *        the unlinks. a reader may only be one epoch behind, so the memory
+ *        retired two epochs ago is unreachable once the epoch is advanced,
+ *        that's the list the new epoch would reuse.
+ *
+ * @param set read-optimized kv set pointer.
+ * @return  return KV_TRUE if the epoch is advanced, otherwise KV_FALSE.
+ */
+static int kv_rcu_advance(kv_rcu_set_t *set)
+{
+    uint64_t epoch;
+    uint64_t reader_epoch;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    epoch = set->epoch;
+    for (size_t i = 0; i < set->reader_num; i++)
+    {
+        reader_epoch = __atomic_load_n(&set->readers[i].epoch, __ATOMIC_ACQUIRE);
+        if (reader_epoch != EPOCH_IDLE && reader_epoch != epoch)
+        {
+            return KV_FALSE;
+        }
+    }
+    __atomic_store_n(&set->epoch, epoch + 1, __ATOMIC_RELEASE);
+    kv_rcu_limbo_free(set, set->limbo + (epoch + 1) % LIMBO_NUM);
+
+    return KV_TRUE;
+}
+
+/**
+ * @brief try to free the retired memory once enough of it piles up.
+ * @note  if a reader holds the epoch back, the readers aren't checked again
+ *        until twice as much memory is retired.
+ *
+ * @param set read-optimized kv set pointer.
+ */
+static void kv_rcu_reclaim(kv_rcu_set_t *set)
+{
+    if (kv_rcu_advance(set) == KV_TRUE)
+    {
+        set->reclaim_num = set->retired_num + RECLAIM_NUM;
+    }
+    else
+    {
+        set->reclaim_num = set->retired_num * 2;
+    }
+}
+
+/**
+ * @brief wait until no reader can reach the memory retired so far.
+ */
+static void kv_rcu_synchronize(kv_rcu_set_t *set)
+{
+    uint64_t target;
+
+    target = set->epoch + 2;
+    while (set->epoch < target)
+    {
+        if (kv_rcu_advance(set) != KV_TRUE)
+        {
+            sched_yield();
+        }
+    }
+}
+
+/**
+ * @brief free the bucket, or the table along with all of its buckets, once no
+ *        reader can reach it.
+ * @note  if the memory can't be recorded, the writer waits for the readers
+ *        and frees it at once.
+ *
+ * @param set   read-optimized kv set pointer.
+ * @param ptr   bucket or table pointer.
+ * @param table whether the memory is a table or not.
+ */
+static void kv_rcu_retire(kv_rcu_set_t *set, void *ptr, int table)
+{
+    kv_rcu_limbo_t *limbo;
+    kv_rcu_retired_t *retired;
+    size_t retired_cap;
+
+    limbo = set->limbo + set->epoch % LIMBO_NUM;
+    if (limbo->retired_num == limbo->retired_cap)
+    {
+        retired_cap = limbo->retired_cap != 0 ? limbo->retired_cap * 2 : RECLAIM_NUM;
+        retired = (kv_rcu_retired_t *)realloc(limbo->retired, retired_cap * sizeof(kv_rcu_retired_t));
+        if (retired == NULL)
+        {
+            kv_rcu_synchronize(set);
+            if (table == KV_TRUE)
+            {
+                kv_rcu_table_free((kv_rcu_table_t *)ptr);
+            }
+            else
+            {
+                free(ptr);
+            }
+            return;
+        }
+        limbo->retired = retired;
+        limbo->retired_cap = retired_cap;
+    }
+
+    limbo->retired[limbo->retired_num].ptr = ptr;
+    limbo->retired[limbo->retired_num].table = table;
+    limbo->retired_num++;
+    set->retired_num++;
+
+    if (set->retired_num >= set->reclaim_num)
+    {
+        kv_rcu_reclaim(set);
+    }
+}
+
+/**
+ * @brief publish a bigger table if the load factor is exceeded.
+ * @note  the buckets are copied instead of moved, since the readers may still
+ *        be walking the chains of the old table. if the new table can't be
+ *        built, the set just keeps using the current one.
+ *
+ * @param set read-optimized kv set pointer.
+ */
+static void kv_rcu_grow(kv_rcu_set_t *set)
+{
+    kv_rcu_table_t *old_table;
+    kv_rcu_table_t *new_table;
+    kv_bucket_t *curt_bucket;
+    kv_bucket_t *new_bucket;
+    size_t array_index;
+
+    old_table = set->table;
+    if (set->base.pair_num * 100 < old_table->bucket_num * set->base.max_load)
+    {
+        return;
+    }
+    if (old_table->bucket_num > SIZE_MAX / 2)
+    {
+        return;
+    }
+
+    new_table = kv_rcu_table_alloc(old_table->bucket_num * 2);
+    if (new_table == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < old_table->bucket_num; i++)
+    {
+        for (curt_bucket = old_table->array[i]; curt_bucket != NULL; curt_bucket = curt_bucket->next)
+        {
+            new_bucket = kv_bucket_alloc(&set->base, curt_bucket->hash,
+                                         KV_BUCKET_KEY(curt_bucket), curt_bucket->key_len,
+                                         KV_BUCKET_VALUE(curt_bucket), curt_bucket->value_len);
+            if (new_bucket == NULL)
+            {
+                kv_rcu_table_free(new_table);
+                return;
+            }
+            array_index = BUCKET_INDEX(new_bucket->hash, new_table->bucket_num);
+            new_bucket->next = new_table->array[array_index];
+            new_table->array[array_index] = new_bucket;
+        }
+    }
+
+    __atomic_store_n(&set->table, new_table, __ATOMIC_RELEASE);
+    kv_rcu_retire(set, old_table, KV_TRUE);
+}
+
+/**
+ * @brief find the link on chain which points to the bucket holding the key.
+ * @note  only the writer holding the mutex may call this function.
+ */
+static kv_bucket_t **kv_rcu_locate(kv_rcu_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    kv_bucket_t **bucket_next;
+
+    bucket_next = set->table->array + BUCKET_INDEX(hash, set->table->bucket_num);
+    while (*bucket_next != NULL)
+    {
+        if (KV_BUCKET_MATCH(*bucket_next, key, key_len, hash))
+        {
+            break;
+        }
+        bucket_next = &((*bucket_next)->next);
+    }
+
+    return bucket_next;
+}
+
+/**
+ * @brief find the bucket holding the key without taking any lock.
+ * @note  only the readers within the read-side section may call this
+ *        function.
+ */
+static kv_bucket_t *kv_rcu_find(kv_rcu_set_t *set, const char *key, size_t key_len, uint32_t hash)
+{
+    kv_rcu_table_t *table;
+    kv_bucket_t *curt_bucket;
+
+    table = __atomic_load_n(&set->table, __ATOMIC_ACQUIRE);
+    curt_bucket = __atomic_load_n(table->array + BUCKET_INDEX(hash, table->bucket_num), __ATOMIC_ACQUIRE);
+    while (curt_bucket != NULL)
+    {
+        if (KV_BUCKET_MATCH(curt_bucket, key, key_len, hash))
+        {
+            break;
+        }
+        curt_bucket = __atomic_load_n(&curt_bucket->next, __ATOMIC_ACQUIRE);
+    }
+
+    return curt_bucket;
+}
+
+/**
+ * @brief create read-optimized kv set.
+ * @note  the readers look up the pairs without taking any lock, while the
+ *        writers are serialized by a mutex and never modify a published
+ *        bucket: a put or delete links a new bucket or unlinks the old one
+ *        with an atomic pointer store, and the old bucket is freed only after
+ *        every reader which may still hold it has left its read-side section.
+ *        every reader thread has to be registered by kv_rcu_register(), at
+ *        most 'conf->reader_num' of them at a time.
+ *        the hash and the load factor are configured by 'conf->set_conf',
+ *        its 'engine', 'arena_size', 'wal_path', 'ordered', 'cache_bytes'
+ *        and 'ttl' are ignored.
+ *
+ * @param set   address of read-optimized kv set pointer.
+ * @param conf  configuration pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_rcu_create(kv_rcu_set_t **set, const kv_rcu_conf_t *conf)
+{
+    kv_rcu_set_t *inner_set;
+    const kv_rcu_conf_t *real_conf;
+    kv_conf_t set_conf;
+    size_t bucket_num;
+    int res;
+
+    if (set == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    real_conf = conf != NULL ? conf : &def_conf;
+    if (real_conf->set_conf != NULL)
+    {
+        set_conf = *real_conf->set_conf;
+    }
+    else
+    {
+        memset(&set_conf, 0, sizeof(kv_conf_t));
+    }
+
+    /* allocate memory space for set */
+    inner_set = (kv_rcu_set_t *)malloc(sizeof(kv_rcu_set_t));
+    if (inner_set == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    memset(inner_set, 0, sizeof(kv_rcu_set_t));
+
+    res = kv_hash_init(&inner_set->base, &set_conf);
+    if (res != KV_OK)
+    {
+        goto err_set;
+    }
+    inner_set->base.max_load = set_conf.max_load != 0 ? set_conf.max_load : DEF_MAX_LOAD;
+    inner_set->epoch = 1;
+    inner_set->reclaim_num = RECLAIM_NUM;
+
+    inner_set->reader_num = real_conf->reader_num != 0 ? real_conf->reader_num : DEF_READER_NUM;
+    inner_set->readers = (kv_rcu_reader_t *)aligned_alloc(sizeof(kv_rcu_reader_t),
+                                                          inner_set->reader_num * sizeof(kv_rcu_reader_t));
+    if (inner_set->readers == NULL)
+    {
+        res = KV_ERR_BAD_MEM;
+        goto err_set;
+    }
+    memset(inner_set->readers, 0, inner_set->reader_num * sizeof(kv_rcu_reader_t));
+
+    bucket_num = set_conf.bucket_num != 0 ? set_conf.bucket_num : DEF_BUCKET_NUM;
+    inner_set->table = kv_rcu_table_alloc(bucket_num);
+    if (inner_set->table == NULL)
+    {
+        res = KV_ERR_BAD_MEM;
+        goto err_readers;
+    }
+
+    if (pthread_mutex_init(&inner_set->mutex, NULL) != 0)
+    {
+        res = KV_ERR_BAD_LOCK;
+        goto err_table;
+    }
+
+    *set = inner_set;
+
+    return KV_OK;
+
+err_table:
+    free(inner_set->table);
+err_readers:
+    free(inner_set->readers);
+err_set:
+    free(inner_set);
+    return res;
+}
+
+/**
+ * @brief destroy the read-optimized kv set.
+ * @note  no thread may use the set any longer.
+ *
+ * @param set read-optimized kv set pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_rcu_destroy(kv_rcu_set_t *set)
+{
+    int res;
+
+    if (set == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    res = KV_OK;
+    if (pthread_mutex_destroy(&set->mutex) != 0)
+    {
+        res = KV_ERR_BAD_LOCK;
+    }
+    for (size_t i = 0; i < LIMBO_NUM; i++)
+    {
+        kv_rcu_limbo_free(set, set->limbo + i);
+        free(set->limbo[i].retired);
+    }
+    kv_rcu_table_free(set->table);
+    free(set->readers);
+    free(set);
+
+    return res;
+}
+
+/**
+ * @brief register the calling thread as a reader of the set.
+ *
+ * @param set     read-optimized kv set pointer.
+ * @param reader  address of reader pointer.
+ * @return  return KV_OK if success, or return KV_ERR_BAD_MEM if all the
+ *          reader slots are taken, otherwise return other value.
+ */
+int kv_rcu_register(kv_rcu_set_t *set, kv_rcu_reader_t **reader)
+{
+    int used;
+
+    if (set == NULL || reader == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    for (size_t i = 0; i < set->reader_num; i++)
+    {
+        used = KV_FALSE;
+        if (__atomic_compare_exchange_n(&set->readers[i].used, &used, KV_TRUE, KV_FALSE,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            set->readers[i].set = set;
+            *reader = set->readers + i;
+            return KV_OK;
+        }
+    }
+
+    return KV_ERR_BAD_MEM;
+}
+
+/**
+ * @brief unregister the reader, it mustn't be within the read-side section.
+ *
+ * @param reader  reader pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_rcu_unregister(kv_rcu_reader_t *reader)
+{
+    if (reader == NULL || reader->epoch != EPOCH_IDLE)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    __atomic_store_n(&reader->used, KV_FALSE, __ATOMIC_RELEASE);
+
+    return KV_OK;
+}
+
+/**
+ * @brief enter the read-side section.
+ * @note  the buckets found within the section, and the values returned by
+ *        kv_rcu_get(), stay valid until kv_rcu_read_unlock() is called. the
+ *        sections can't be nested.
+ *
+ * @param reader  reader pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_rcu_read_lock(kv_rcu_reader_t *reader)
+{
+    if (reader == NULL || reader->epoch != EPOCH_IDLE)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    __atomic_store_n(&reader->epoch, __atomic_load_n(&reader->set->epoch, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+
+    /* publish the epoch before reading any bucket */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    return KV_OK;
+}
+
+/**
+ * @brief leave the read-side section.
+ *
+ * @param reader  reader pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_rcu_read_unlock(kv_rcu_reader_t *reader)
+{
+    if (reader == NULL || reader->epoch == EPOCH_IDLE)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    __atomic_store_n(&reader->epoch, EPOCH_IDLE, __ATOMIC_RELEASE);
+
+    return KV_OK;
+}
+
+/**
+ * @brief check if key is in the read-optimized kv set or not.
+ * @note  the caller must be within the read-side section.
+ *
+ * @param set read-optimized kv set pointer.
+ * @param key key string pointer.
+ * @return  return KV_FALSE or KV_TRUE if success, otherwise return other value.
+ */
+int kv_rcu_contain(kv_rcu_set_t *set, const char *key)
+{
+    size_t key_len;
+
+    if (set == NULL || key == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    key_len = strlen(key);
+    if (kv_rcu_find(set, key, key_len, kv_hash_str(&set->base, key, key_len)) == NULL)
+    {
+        return KV_FALSE;
+    }
+
+    return KV_TRUE;
+}
+
+/**
+ * @brief get the number of key-value pairs in the read-optimized kv set.
+ *
+ * @param set   read-optimized kv set pointer.
+ * @param size  pointer to variable for storing size.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_rcu_size(kv_rcu_set_t *set, size_t *size)
+{
+    if (set == NULL || size == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    *size = __atomic_load_n(&set->base.pair_num, __ATOMIC_RELAXED);
+
+    return KV_OK;
+}
+
+/**
+ * @brief get the value string corresponding to the specified key in the
+ *        read-optimized kv set.
+ * @note  the caller must be within the read-side section, and the value
+ *        stays valid until the caller leaves it, even if the pair is modified
+ *        or deleted by other threads meanwhile.
+ *
+ * @param set   read-optimized kv set pointer.
+ * @param key   key string pointer.
+ * @param value pointer to a variable for storing value string pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_rcu_get(kv_rcu_set_t *set, const char *key, const char **value)
+{
+    kv_bucket_t *bucket;
+    size_t key_len;
+
+    if (set == NULL || key == NULL || value == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    key_len = strlen(key);
+    bucket = kv_rcu_find(set, key, key_len, kv_hash_str(&set->base, key, key_len));
+    if (bucket == NULL)
+    {
+        return KV_ERR_KEY_NOT_FOUND;
+    }
+
+    *value = KV_BUCKET_VALUE(bucket);
+
+    return KV_OK;
+}
+
+/**
+ * @brief put a key-value pair in the read-optimized kv set.
+ * @note  a new bucket always takes the place of the old one, the caller
+ *        mustn't be within the read-side section.
+ *
+ * @param set   read-optimized kv set pointer.
+ * @param key   key string pointer.
+ * @param value value string pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_rcu_put(kv_rcu_set_t *set, const char *key, const char *value)
+{
+    kv_bucket_t **bucket_next;
+    kv_bucket_t *curt_bucket;
+    kv_bucket_t *new_bucket;
+    size_t key_len;
+    uint32_t hash;
+
+    if (set == NULL || key == NULL || value == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    key_len = strlen(key);
+    hash = kv_hash_str(&set->base, key, key_len);
+    new_bucket = kv_bucket_alloc(&set->base, hash, key, key_len, value, strlen(value));
+    if (new_bucket == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+
+    pthread_mutex_lock(&set->mutex);
+
+    bucket_next = kv_rcu_locate(set, key, key_len, hash);
+    curt_bucket = *bucket_next;
+    if (curt_bucket != NULL)
+    {
+        new_bucket->next = curt_bucket->next;
+        __atomic_store_n(bucket_next, new_bucket, __ATOMIC_RELEASE);
+        kv_rcu_retire(set, curt_bucket, KV_FALSE);
+    }
+    else
+    {
+        /* the readers walking this chain see either the old or the new head */
+        bucket_next = set->table->array + BUCKET_INDEX(hash, set->table->bucket_num);
+        new_bucket->next = *bucket_next;
+        __atomic_store_n(bucket_next, new_bucket, __ATOMIC_RELEASE);
+        __atomic_store_n(&set->base.pair_num, set->base.pair_num + 1, __ATOMIC_RELAXED);
+        kv_rcu_grow(set);
+    }
+
+    pthread_mutex_unlock(&set->mutex);
+
+    return KV_OK;
+}
+
+/**
+ * @brief delete a key-value pair in the read-optimized kv set.
+ * @note  the caller mustn't be within the read-side section.
+ *
+ * @param set read-optimized kv set pointer.
+ * @param key key string pointer.
+ * @return  return KV_OK if success, or return KV_ERR_KEY_NOT_FOUND if the
+ *          specified key isn't found in kv set, otherwise return other value.
+ */
+int kv_rcu_del(kv_rcu_set_t *set, const char *key)
+{
+    kv_bucket_t **bucket_next;
+    kv_bucket_t *curt_bucket;
+    size_t key_len;
+    uint32_t hash;
+    int res;
+
+    if (set == NULL || key == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    key_len = strlen(key);
+    hash = kv_hash_str(&set->base, key, key_len);
+
+    pthread_mutex_lock(&set->mutex);
+
+    bucket_next = kv_rcu_locate(set, key, key_len, hash);
+    curt_bucket = *bucket_next;
+    if (curt_bucket == NULL)
+    {
+        res = KV_ERR_KEY_NOT_FOUND;
+        goto exit;
+    }
+
+    /* the unlinked bucket still points to the rest of the chain */
+    __atomic_store_n(bucket_next, curt_bucket->next, __ATOMIC_RELEASE);
+    __atomic_store_n(&set->base.pair_num, set->base.pair_num - 1, __ATOMIC_RELAXED);
+    kv_rcu_retire(set, curt_bucket, KV_FALSE);
+
+    res = KV_OK;
+exit:
+    pthread_mutex_unlock(&set->mutex);
+    return res;
+}
+
+/**
+ * @brief clear all key-value pairs in the read-optimized kv set.
+ * @note  an empty table of the same size is published, the caller mustn't be
+ *        within the read-side section.
+ *
+ * @param set read-optimized kv set pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_rcu_clear(kv_rcu_set_t *set)
+{
+    kv_rcu_table_t *old_table;
+    kv_rcu_table_t *new_table;
+
+    if (set == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    pthread_mutex_lock(&set->mutex);
+
+    old_table = set->table;
+    new_table = kv_rcu_table_alloc(old_table->bucket_num);
+    if (new_table == NULL)
+    {
+        pthread_mutex_unlock(&set->mutex);
+        return KV_ERR_BAD_MEM;
+    }
+    __atomic_store_n(&set->table, new_table, __ATOMIC_RELEASE);
+    __atomic_store_n(&set->base.pair_num, 0, __ATOMIC_RELAXED);
+    kv_rcu_retire(set, old_table, KV_TRUE);
+
+    pthread_mutex_unlock(&set->mutex);
+
+    return KV_OK;
+}
+
+/**
+ * @brief iterate all the key-value pairs in the read-optimized kv set.
+ * @note  the caller must be within the read-side section. the pairs put into
+ *        or deleted from the set meanwhile may or may not be visited.
+ *
+ * @param set         read-optimized kv set pointer.
+ * @param foreach_cb  pointer to iteration callback function.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_rcu_foreach(kv_rcu_set_t *set, kv_foreach_cb_t foreach_cb, void *arg)
+{
+    kv_rcu_table_t *table;
+    kv_bucket_t *curt_bucket;
+
+    if (set == NULL || foreach_cb == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    table = __atomic_load_n(&set->table, __ATOMIC_ACQUIRE);
+    for (size_t i = 0; i < table->bucket_num; i++)
+    {
+        curt_bucket = __atomic_load_n(table->array + i, __ATOMIC_ACQUIRE);
+        while (curt_bucket != NULL)
+        {
+            foreach_cb(arg, KV_BUCKET_KEY(curt_bucket), KV_BUCKET_VALUE(curt_bucket));
+            curt_bucket = __atomic_load_n(&curt_bucket->next, __ATOMIC_ACQUIRE);
+        }
+    }
+
+    return KV_OK;
+}
@@ -0,0 +1,64 @@
+#ifndef __KV_RCU_H__
+#define __KV_RCU_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "kv.h"
+
+struct kv_rcu_set;
+
+/* structure used to configure read-optimized kv set */
+typedef struct kv_rcu_conf
+{
+    /* maximum number of reader threads, 0 for the default */
+    size_t reader_num;
+
+    /* configuration of the kv set, NULL for the default */
+    const kv_conf_t *set_conf;
+} kv_rcu_conf_t;
+
+/* reader thread registered in the read-optimized kv set */
+typedef struct kv_rcu_reader
+{
+    /* set the reader belongs to */
+    struct kv_rcu_set *set;
+
+    /* epoch observed on entering the read-side section, or 0 if outside */
+    uint64_t epoch;
+
+    /* whether the reader is registered or not */
+    int used;
+} __attribute__((aligned(64))) kv_rcu_reader_t;
+
+/* read-optimized kv set structure, opaque to the users */
+typedef struct kv_rcu_set kv_rcu_set_t;
+
+int kv_rcu_create(kv_rcu_set_t **set, const kv_rcu_conf_t *conf);
+
+int kv_rcu_destroy(kv_rcu_set_t *set);
+
+int kv_rcu_register(kv_rcu_set_t *set, kv_rcu_reader_t **reader);
+
+int kv_rcu_unregister(kv_rcu_reader_t *reader);
+
+int kv_rcu_read_lock(kv_rcu_reader_t *reader);
+
+int kv_rcu_read_unlock(kv_rcu_reader_t *reader);
+
+int kv_rcu_contain(kv_rcu_set_t *set, const char *key);
+
+int kv_rcu_size(kv_rcu_set_t *set, size_t *size);
+
+int kv_rcu_get(kv_rcu_set_t *set, const char *key, const char **value);
+
+int kv_rcu_put(kv_rcu_set_t *set, const char *key, const char *value);
+
+int kv_rcu_del(kv_rcu_set_t *set, const char *key);
+
+int kv_rcu_clear(kv_rcu_set_t *set);
+
+int kv_rcu_foreach(kv_rcu_set_t *set, kv_foreach_cb_t foreach_cb, void *arg);
+
+#endif
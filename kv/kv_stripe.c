@@ -0,0 +1,815 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "kv.h"
+#include "kv_inner.h"
+#include "kv_stripe.h"
+
+/* default number of stripes */
+#define DEF_STRIPE_NUM  16
+
+/* maximum number of stripes */
+#define MAX_STRIPE_NUM  1024
+
+/* default initial size of bucket pointer array of every stripe */
+#define DEF_BUCKET_NUM  128
+
+/* maximum number of threads of the parallel operations */
+#define MAX_THREAD_NUM  64
+
+/* number of pairs hashed by a task of the bulk load */
+#define HASH_SLICE_SIZE 65536
+
+typedef struct kv_stripe_job kv_stripe_job_t;
+
+/* callback doing one task of a parallel operation on a worker thread */
+typedef int (* kv_stripe_task_cb_t)(kv_stripe_job_t *, size_t, size_t);
+
+/* parallel operation, its tasks are claimed by the workers one by one */
+struct kv_stripe_job
+{
+    kv_stripe_set_t *set;
+
+    /* callback doing a task */
+    kv_stripe_task_cb_t task_cb;
+
+    /* number of the tasks */
+    size_t task_num;
+
+    /* next task to be claimed */
+    size_t next_task;
+
+    /* result of the first task failed, or KV_OK */
+    int res;
+
+    /* iteration callback, and the argument of every worker */
+    kv_foreach_cb_t foreach_cb;
+    void **args;
+
+    /* pairs being loaded */
+    const char *const *keys;
+    const char *const *values;
+    size_t pair_num;
+
+    /* hash value of every pair */
+    uint32_t *hashes;
+
+    /* pairs sorted by their stripes, and where the pairs of every stripe start */
+    size_t *order;
+    size_t *starts;
+};
+
+/* worker thread of a parallel operation */
+typedef struct kv_stripe_worker
+{
+    kv_stripe_job_t *job;
+
+    /* index of the worker, 0 for the calling thread */
+    size_t index;
+
+    pthread_t thread;
+} kv_stripe_worker_t;
+
+/* default configuration */
+static const kv_stripe_conf_t def_conf =
+{
+    .stripe_num = DEF_STRIPE_NUM,
+    .lock_type = KV_LOCK_MUTEX,
+    .set_conf = NULL,
+};
+
+/**
+ * @brief select the stripe of the hash value.
+ * @note  the engines select buckets with the hash value as well, so it's
+ *        scrambled once more, otherwise every stripe would only use a narrow
+ *        range of its buckets.
+ */
+static kv_stripe_t *kv_stripe_select(kv_stripe_set_t *set, uint32_t hash)
+{
+    hash ^= hash >> 15;
+    hash *= 0x2C1B3C6D;
+    hash ^= hash >> 12;
+    hash *= 0x297A2D39;
+    hash ^= hash >> 15;
+
+    return set->stripes + (size_t)(((uint64_t)hash * set->stripe_num) >> 32);
+}
+
+static void kv_stripe_rdlock(kv_stripe_set_t *set, kv_stripe_t *stripe)
+{
+    if (set->lock_type == KV_LOCK_RWLOCK)
+    {
+        pthread_rwlock_rdlock(&stripe->lock.rwlock);
+    }
+    else
+    {
+        pthread_mutex_lock(&stripe->lock.mutex);
+    }
+}
+
+static void kv_stripe_wrlock(kv_stripe_set_t *set, kv_stripe_t *stripe)
+{
+    if (set->lock_type == KV_LOCK_RWLOCK)
+    {
+        pthread_rwlock_wrlock(&stripe->lock.rwlock);
+    }
+    else
+    {
+        pthread_mutex_lock(&stripe->lock.mutex);
+    }
+}
+
+static void kv_stripe_unlock(kv_stripe_set_t *set, kv_stripe_t *stripe)
+{
+    if (set->lock_type == KV_LOCK_RWLOCK)
+    {
+        pthread_rwlock_unlock(&stripe->lock.rwlock);
+    }
+    else
+    {
+        pthread_mutex_unlock(&stripe->lock.mutex);
+    }
+}
+
+/**
+ * @brief claim the tasks of the job until they run out, or one of them fails.
+ */
+static void *kv_stripe_work(void *arg)
+{
+    kv_stripe_worker_t *worker;
+    kv_stripe_job_t *job;
+    size_t task;
+    int expected;
+    int res;
+
+    worker = (kv_stripe_worker_t *)arg;
+    job = worker->job;
+    while (__atomic_load_n(&job->res, __ATOMIC_RELAXED) == KV_OK)
+    {
+        task = __atomic_fetch_add(&job->next_task, 1, __ATOMIC_RELAXED);
+        if (task >= job->task_num)
+        {
+            break;
+        }
+
+        res = job->task_cb(job, task, worker->index);
+        if (res != KV_OK)
+        {
+            expected = KV_OK;
+            __atomic_compare_exchange_n(&job->res, &expected, res, KV_FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief run the tasks of the job on 'thread_num' threads, the calling thread
+ *        included.
+ * @note  the tasks are claimed dynamically, so the threads failed to start
+ *        are only missed in speed, the others do their share of the work.
+ *
+ * @param job         job pointer.
+ * @param thread_num  number of threads, no more than MAX_THREAD_NUM.
+ * @param task_num    number of the tasks.
+ * @param task_cb     callback doing a task.
+ * @return  return KV_OK if all the tasks succeeded, otherwise return the
+ *          result of the first task failed.
+ */
+static int kv_stripe_run(kv_stripe_job_t *job, size_t thread_num, size_t task_num, kv_stripe_task_cb_t task_cb)
+{
+    kv_stripe_worker_t workers[MAX_THREAD_NUM];
+    size_t started_num;
+
+    job->task_cb = task_cb;
+    job->task_num = task_num;
+    job->next_task = 0;
+    job->res = KV_OK;
+    if (thread_num > task_num)
+    {
+        thread_num = task_num;
+    }
+
+    started_num = 1;
+    for (size_t i = 1; i < thread_num; i++)
+    {
+        workers[started_num].job = job;
+        workers[started_num].index = started_num;
+        if (pthread_create(&workers[started_num].thread, NULL, kv_stripe_work, workers + started_num) == 0)
+        {
+            started_num++;
+        }
+    }
+
+    workers[0].job = job;
+    workers[0].index = 0;
+    kv_stripe_work(workers);
+    for (size_t i = 1; i < started_num; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    return job->res;
+}
+
+/**
+ * @brief destroy the first 'stripe_num' stripes of the set, then the set.
+ */
+static int kv_stripe_free(kv_stripe_set_t *set, size_t stripe_num)
+{
+    int res;
+    int lock_res;
+
+    res = KV_OK;
+    for (size_t i = 0; i < stripe_num; i++)
+    {
+        if (set->lock_type == KV_LOCK_RWLOCK)
+        {
+            lock_res = pthread_rwlock_destroy(&set->stripes[i].lock.rwlock);
+        }
+        else
+        {
+            lock_res = pthread_mutex_destroy(&set->stripes[i].lock.mutex);
+        }
+        if (lock_res != 0)
+        {
+            res = KV_ERR_BAD_LOCK;
+        }
+        kv_destroy(set->stripes[i].set);
+    }
+    free(set->stripes);
+    free(set);
+
+    return res;
+}
+
+/**
+ * @brief create striped kv set, which can be shared by threads.
+ * @note  the pairs are partitioned into 'conf->stripe_num' kv sets by their
+ *        hash values, each of them is protected by its own lock, so threads
+ *        working on different stripes never wait for each other. with
+ *        'conf->lock_type' set to KV_LOCK_RWLOCK, readers of the same stripe
+ *        don't wait for each other either.
+ *        all the stripes are created with 'conf->set_conf' and share the same
+ *        hash seed, so every key is hashed only once.
+ * 
+ * @param set   address of striped kv set pointer.
+ * @param conf  configuration pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_stripe_create(kv_stripe_set_t **set, const kv_stripe_conf_t *conf)
+{
+    kv_stripe_set_t *inner_set;
+    const kv_stripe_conf_t *real_conf;
+    kv_conf_t set_conf;
+    size_t stripe_num;
+    size_t i;
+    int lock_res;
+    int res;
+
+    if (set == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    real_conf = conf != NULL ? conf : &def_conf;
+    stripe_num = real_conf->stripe_num != 0 ? real_conf->stripe_num : DEF_STRIPE_NUM;
+    if (stripe_num > MAX_STRIPE_NUM)
+    {
+        return KV_ERR_BAD_CONF;
+    }
+    if (real_conf->lock_type != KV_LOCK_MUTEX && real_conf->lock_type != KV_LOCK_RWLOCK)
+    {
+        return KV_ERR_BAD_CONF;
+    }
+
+    /* the stripes can't share one log */
+    if (real_conf->set_conf != NULL && real_conf->set_conf->wal_path != NULL)
+    {
+        return KV_ERR_BAD_CONF;
+    }
+
+    /* allocate memory space for set and its stripes */
+    inner_set = (kv_stripe_set_t *)malloc(sizeof(kv_stripe_set_t));
+    if (inner_set == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    inner_set->stripe_num = stripe_num;
+    inner_set->lock_type = real_conf->lock_type;
+    inner_set->stripes = (kv_stripe_t *)aligned_alloc(sizeof(kv_stripe_t), stripe_num * sizeof(kv_stripe_t));
+    if (inner_set->stripes == NULL)
+    {
+        free(inner_set);
+        return KV_ERR_BAD_MEM;
+    }
+
+    /* all the stripes hash the keys in the same way */
+    if (real_conf->set_conf != NULL)
+    {
+        set_conf = *real_conf->set_conf;
+    }
+    else
+    {
+        memset(&set_conf, 0, sizeof(kv_conf_t));
+        set_conf.bucket_num = DEF_BUCKET_NUM;
+    }
+    if (set_conf.hash_seed == 0)
+    {
+        set_conf.hash_seed = kv_hash_seed(inner_set);
+    }
+
+    for (i = 0; i < stripe_num; i++)
+    {
+        res = kv_create(&inner_set->stripes[i].set, &set_conf);
+        if (res != KV_OK)
+        {
+            goto err_stripe;
+        }
+        inner_set->stripes[i].set->read_shared = inner_set->lock_type == KV_LOCK_RWLOCK ? KV_TRUE : KV_FALSE;
+
+        if (inner_set->lock_type == KV_LOCK_RWLOCK)
+        {
+            lock_res = pthread_rwlock_init(&inner_set->stripes[i].lock.rwlock, NULL);
+        }
+        else
+        {
+            lock_res = pthread_mutex_init(&inner_set->stripes[i].lock.mutex, NULL);
+        }
+        if (lock_res != 0)
+        {
+            kv_destroy(inner_set->stripes[i].set);
+            res = KV_ERR_BAD_LOCK;
+            goto err_stripe;
+        }
+    }
+
+    *set = inner_set;
+
+    return KV_OK;
+
+err_stripe:
+    kv_stripe_free(inner_set, i);
+    return res;
+}
+
+/**
+ * @brief destroy the striped kv set.
+ * @note  no thread may use the set any longer.
+ * 
+ * @param set striped kv set pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_stripe_destroy(kv_stripe_set_t *set)
+{
+    if (set == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    return kv_stripe_free(set, set->stripe_num);
+}
+
+/**
+ * @brief check if key is in the striped kv set or not.
+ * 
+ * @param set striped kv set pointer.
+ * @param key key string pointer.
+ * @return  return KV_FALSE or KV_TRUE if success, otherwise return other value.
+ */
+int kv_stripe_contain(kv_stripe_set_t *set, const char *key)
+{
+    kv_stripe_t *stripe;
+    size_t key_len;
+    uint32_t hash;
+    int res;
+
+    if (set == NULL || key == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    key_len = strlen(key);
+    hash = kv_hash_str(set->stripes[0].set, key, key_len);
+    stripe = kv_stripe_select(set, hash);
+
+    kv_stripe_rdlock(set, stripe);
+    res = kv_contain_hashed(stripe->set, key, key_len, hash);
+    kv_stripe_unlock(set, stripe);
+
+    return res;
+}
+
+/**
+ * @brief get the number of key-value pairs in the striped kv set.
+ * @note  the stripes are counted one by one, so the number may be stale if
+ *        other threads are modifying the set.
+ * 
+ * @param set   striped kv set pointer.
+ * @param size  pointer to variable for storing size.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_stripe_size(kv_stripe_set_t *set, size_t *size)
+{
+    size_t pair_num;
+
+    if (set == NULL || size == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    pair_num = 0;
+    for (size_t i = 0; i < set->stripe_num; i++)
+    {
+        kv_stripe_rdlock(set, set->stripes + i);
+        pair_num += set->stripes[i].set->pair_num;
+        kv_stripe_unlock(set, set->stripes + i);
+    }
+    *size = pair_num;
+
+    return KV_OK;
+}
+
+/**
+ * @brief put a key-value pair in the striped kv set.
+ * 
+ * @param set   striped kv set pointer.
+ * @param key   key string pointer.
+ * @param value value string pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_stripe_put(kv_stripe_set_t *set, const char *key, const char *value)
+{
+    kv_stripe_t *stripe;
+    size_t key_len;
+    uint32_t hash;
+    int res;
+
+    if (set == NULL || key == NULL || value == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    key_len = strlen(key);
+    hash = kv_hash_str(set->stripes[0].set, key, key_len);
+    stripe = kv_stripe_select(set, hash);
+
+    kv_stripe_wrlock(set, stripe);
+    res = kv_put_hashed(stripe->set, key, key_len, hash, value, strlen(value));
+    kv_stripe_unlock(set, stripe);
+
+    return res;
+}
+
+/**
+ * @brief delete a key-value pair in the striped kv set.
+ * 
+ * @param set striped kv set pointer.
+ * @param key key string pointer.
+ * @return  return KV_OK if success, or return KV_ERR_KEY_NOT_FOUND if the
+ *          specified key isn't found in kv set, otherwise return other value.
+ */
+int kv_stripe_del(kv_stripe_set_t *set, const char *key)
+{
+    kv_stripe_t *stripe;
+    size_t key_len;
+    uint32_t hash;
+    int res;
+
+    if (set == NULL || key == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    key_len = strlen(key);
+    hash = kv_hash_str(set->stripes[0].set, key, key_len);
+    stripe = kv_stripe_select(set, hash);
+
+    kv_stripe_wrlock(set, stripe);
+    res = kv_del_hashed(stripe->set, key, key_len, hash);
+    kv_stripe_unlock(set, stripe);
+
+    return res;
+}
+
+/**
+ * @brief get the value string corresponding to the specified key in the
+ *        striped kv set.
+ * @note  if this function returns KV_OK, the stripe of the key stays locked
+ *        for reading until kv_stripe_release() is called with 'guard', so the
+ *        value can't be modified or freed by other threads meanwhile. the
+ *        thread holding the guard mustn't modify the set, or it deadlocks.
+ *        the value pointed by 'value' won't update if this function doesn't
+ *        return KV_OK, and there is nothing to release.
+ * 
+ * @param set   striped kv set pointer.
+ * @param key   key string pointer.
+ * @param value pointer to a variable for storing value string pointer.
+ * @param guard pointer to a variable for storing the read guard.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_stripe_get(kv_stripe_set_t *set, const char *key, const char **value, kv_guard_t *guard)
+{
+    kv_stripe_t *stripe;
+    size_t key_len;
+    uint32_t hash;
+    int res;
+
+    if (set == NULL || key == NULL || value == NULL || guard == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    key_len = strlen(key);
+    hash = kv_hash_str(set->stripes[0].set, key, key_len);
+    stripe = kv_stripe_select(set, hash);
+
+    kv_stripe_rdlock(set, stripe);
+    res = kv_get_hashed(stripe->set, key, key_len, hash, value, NULL);
+    if (res != KV_OK)
+    {
+        kv_stripe_unlock(set, stripe);
+        return res;
+    }
+
+    guard->set = set;
+    guard->stripe = stripe;
+
+    return KV_OK;
+}
+
+/**
+ * @brief release the read guard returned by kv_stripe_get().
+ * @note  the value returned along with the guard mustn't be used any longer.
+ * 
+ * @param guard read guard pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_stripe_release(kv_guard_t *guard)
+{
+    if (guard == NULL || guard->stripe == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    kv_stripe_unlock(guard->set, guard->stripe);
+    guard->stripe = NULL;
+
+    return KV_OK;
+}
+
+/**
+ * @brief clear all key-value pairs in the striped kv set.
+ * @note  the stripes are cleared one by one.
+ * 
+ * @param set striped kv set pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_stripe_clear(kv_stripe_set_t *set)
+{
+    if (set == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    for (size_t i = 0; i < set->stripe_num; i++)
+    {
+        kv_stripe_wrlock(set, set->stripes + i);
+        kv_clear(set->stripes[i].set);
+        kv_stripe_unlock(set, set->stripes + i);
+    }
+
+    return KV_OK;
+}
+
+/**
+ * @brief iterate all the key-value pairs in the striped kv set.
+ * @note  the stripes are locked for reading one by one, so the pairs put into
+ *        or deleted from other stripes meanwhile may or may not be visited.
+ *        the callback mustn't modify the set, or it deadlocks.
+ * 
+ * @param set         striped kv set pointer.
+ * @param foreach_cb  pointer to iteration callback function.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_stripe_foreach(kv_stripe_set_t *set, kv_foreach_cb_t foreach_cb, void *arg)
+{
+    if (set == NULL || foreach_cb == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    for (size_t i = 0; i < set->stripe_num; i++)
+    {
+        kv_stripe_rdlock(set, set->stripes + i);
+        kv_foreach(set->stripes[i].set, foreach_cb, arg);
+        kv_stripe_unlock(set, set->stripes + i);
+    }
+
+    return KV_OK;
+}
+
+static int kv_stripe_foreach_task(kv_stripe_job_t *job, size_t task, size_t worker)
+{
+    kv_stripe_t *stripe;
+
+    stripe = job->set->stripes + task;
+    kv_stripe_rdlock(job->set, stripe);
+    kv_foreach(stripe->set, job->foreach_cb, job->args != NULL ? job->args[worker] : NULL);
+    kv_stripe_unlock(job->set, stripe);
+
+    return KV_OK;
+}
+
+/**
+ * @brief iterate all the key-value pairs in the striped kv set on several
+ *        threads.
+ * @note  the stripes are handed out to the threads one at a time, and every
+ *        stripe is visited under its read lock by one thread, so the callback
+ *        runs concurrently on different stripes. the callback of the thread
+ *        with index i is passed 'args[i]', so every thread can collect its
+ *        own results without synchronization, or NULL if 'args' is NULL.
+ *        the callback mustn't modify the set, or it deadlocks.
+ *
+ * @param set         striped kv set pointer.
+ * @param thread_num  number of threads, the calling thread included, from 1
+ *                    to 64.
+ * @param foreach_cb  pointer to iteration callback function.
+ * @param args        array of 'thread_num' callback arguments, or NULL.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_stripe_foreach_parallel(kv_stripe_set_t *set, size_t thread_num, kv_foreach_cb_t foreach_cb, void **args)
+{
+    kv_stripe_job_t job;
+
+    if (set == NULL || thread_num == 0 || thread_num > MAX_THREAD_NUM || foreach_cb == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    memset(&job, 0, sizeof(kv_stripe_job_t));
+    job.set = set;
+    job.foreach_cb = foreach_cb;
+    job.args = args;
+
+    return kv_stripe_run(&job, thread_num, set->stripe_num, kv_stripe_foreach_task);
+}
+
+static int kv_stripe_clear_task(kv_stripe_job_t *job, size_t task, size_t worker)
+{
+    kv_stripe_t *stripe;
+
+    stripe = job->set->stripes + task;
+    kv_stripe_wrlock(job->set, stripe);
+    kv_clear(stripe->set);
+    kv_stripe_unlock(job->set, stripe);
+
+    return KV_OK;
+}
+
+/**
+ * @brief clear all key-value pairs in the striped kv set on several threads.
+ * @note  freeing the pairs is the bulk of the work, the stripes are cleared
+ *        concurrently as in kv_stripe_foreach_parallel().
+ *
+ * @param set         striped kv set pointer.
+ * @param thread_num  number of threads, the calling thread included, from 1
+ *                    to 64.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_stripe_clear_parallel(kv_stripe_set_t *set, size_t thread_num)
+{
+    kv_stripe_job_t job;
+
+    if (set == NULL || thread_num == 0 || thread_num > MAX_THREAD_NUM)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    memset(&job, 0, sizeof(kv_stripe_job_t));
+    job.set = set;
+
+    return kv_stripe_run(&job, thread_num, set->stripe_num, kv_stripe_clear_task);
+}
+
+static int kv_stripe_hash_task(kv_stripe_job_t *job, size_t task, size_t worker)
+{
+    size_t end;
+
+    end = (task + 1) * HASH_SLICE_SIZE < job->pair_num ? (task + 1) * HASH_SLICE_SIZE : job->pair_num;
+    for (size_t i = task * HASH_SLICE_SIZE; i < end; i++)
+    {
+        if (job->keys[i] == NULL || job->values[i] == NULL)
+        {
+            return KV_ERR_BAD_ARG;
+        }
+        job->hashes[i] = kv_hash_str(job->set->stripes[0].set, job->keys[i], strlen(job->keys[i]));
+    }
+
+    return KV_OK;
+}
+
+static int kv_stripe_load_task(kv_stripe_job_t *job, size_t task, size_t worker)
+{
+    kv_stripe_t *stripe;
+    size_t index;
+    int res;
+
+    res = KV_OK;
+    stripe = job->set->stripes + task;
+    kv_stripe_wrlock(job->set, stripe);
+    for (size_t i = job->starts[task]; i < job->starts[task + 1] && res == KV_OK; i++)
+    {
+        index = job->order[i];
+        res = kv_put_hashed(stripe->set, job->keys[index], strlen(job->keys[index]), job->hashes[index],
+                            job->values[index], strlen(job->values[index]));
+    }
+    kv_stripe_unlock(job->set, stripe);
+
+    return res;
+}
+
+/**
+ * @brief put many key-value pairs in the striped kv set on several threads.
+ * @note  the keys are hashed in parallel, then the pairs are partitioned by
+ *        their stripes, and every stripe is filled by one thread holding its
+ *        write lock, so the threads never contend. the pairs of the same key
+ *        are put in the order they're given, the last one wins as if they
+ *        were put one by one.
+ *        nothing is put if any key or value is NULL. if out of memory, the
+ *        pairs put so far stay in the set.
+ *
+ * @param set         striped kv set pointer.
+ * @param thread_num  number of threads, the calling thread included, from 1
+ *                    to 64.
+ * @param keys        array of key string pointers.
+ * @param values      array of value string pointers.
+ * @param pair_num    number of the pairs.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_stripe_bulk_load(kv_stripe_set_t *set, size_t thread_num, const char *const *keys,
+                        const char *const *values, size_t pair_num)
+{
+    kv_stripe_job_t job;
+    size_t stripe_index;
+    int res;
+
+    if (set == NULL || thread_num == 0 || thread_num > MAX_THREAD_NUM || keys == NULL || values == NULL)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+    if (pair_num == 0)
+    {
+        return KV_OK;
+    }
+
+    memset(&job, 0, sizeof(kv_stripe_job_t));
+    job.set = set;
+    job.keys = keys;
+    job.values = values;
+    job.pair_num = pair_num;
+    job.hashes = (uint32_t *)malloc(pair_num * sizeof(uint32_t));
+    job.order = (size_t *)malloc(pair_num * sizeof(size_t));
+    job.starts = (size_t *)calloc(set->stripe_num + 1, sizeof(size_t));
+    if (job.hashes == NULL || job.order == NULL || job.starts == NULL)
+    {
+        res = KV_ERR_BAD_MEM;
+        goto exit;
+    }
+
+    res = kv_stripe_run(&job, thread_num, (pair_num + HASH_SLICE_SIZE - 1) / HASH_SLICE_SIZE, kv_stripe_hash_task);
+    if (res != KV_OK)
+    {
+        goto exit;
+    }
+
+    /* counting sort by the stripes, it keeps the order of the pairs in every stripe */
+    for (size_t i = 0; i < pair_num; i++)
+    {
+        job.starts[kv_stripe_select(set, job.hashes[i]) - set->stripes + 1]++;
+    }
+    for (size_t i = 0; i < set->stripe_num; i++)
+    {
+        job.starts[i + 1] += job.starts[i];
+    }
+    for (size_t i = 0; i < pair_num; i++)
+    {
+        stripe_index = kv_stripe_select(set, job.hashes[i]) - set->stripes;
+        job.order[job.starts[stripe_index]++] = i;
+    }
+
+    /* every start was moved to the next one */
+    memmove(job.starts + 1, job.starts, set->stripe_num * sizeof(size_t));
+    job.starts[0] = 0;
+
+    res = kv_stripe_run(&job, thread_num, set->stripe_num, kv_stripe_load_task);
+
+exit:
+    free(job.hashes);
+    free(job.order);
+    free(job.starts);
+    return res;
+}
@@ -0,0 +1,89 @@
+#ifndef __KV_STRIPE_H__
+#define __KV_STRIPE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "kv.h"
+
+enum
+{
+    /* lock types */
+    KV_LOCK_MUTEX           = 0,
+    KV_LOCK_RWLOCK          = 1,
+};
+
+/* structure used to configure striped kv set */
+typedef struct kv_stripe_conf
+{
+    /* number of stripes, 0 for the default */
+    size_t stripe_num;
+
+    /* lock of every stripe, KV_LOCK_MUTEX by default */
+    int lock_type;
+
+    /* configuration of the kv set of every stripe, NULL for the default */
+    const kv_conf_t *set_conf;
+} kv_stripe_conf_t;
+
+/* one stripe, a kv set and the lock protecting it */
+typedef struct kv_stripe
+{
+    union
+    {
+        pthread_mutex_t mutex;
+        pthread_rwlock_t rwlock;
+    } lock;
+
+    kv_set_t *set;
+} __attribute__((aligned(64))) kv_stripe_t;
+
+/* striped kv set structure, safe to be shared by threads */
+typedef struct kv_stripe_set
+{
+    /* number of stripes in member 'stripes' */
+    size_t stripe_num;
+
+    /* lock of every stripe */
+    int lock_type;
+
+    /* all the stripes */
+    kv_stripe_t *stripes;
+} kv_stripe_set_t;
+
+/* read guard of a stripe, returned along with a value reference */
+typedef struct kv_guard
+{
+    kv_stripe_set_t *set;
+    kv_stripe_t *stripe;
+} kv_guard_t;
+
+int kv_stripe_create(kv_stripe_set_t **set, const kv_stripe_conf_t *conf);
+
+int kv_stripe_destroy(kv_stripe_set_t *set);
+
+int kv_stripe_contain(kv_stripe_set_t *set, const char *key);
+
+int kv_stripe_size(kv_stripe_set_t *set, size_t *size);
+
+int kv_stripe_put(kv_stripe_set_t *set, const char *key, const char *value);
+
+int kv_stripe_del(kv_stripe_set_t *set, const char *key);
+
+int kv_stripe_get(kv_stripe_set_t *set, const char *key, const char **value, kv_guard_t *guard);
+
+int kv_stripe_release(kv_guard_t *guard);
+
+int kv_stripe_clear(kv_stripe_set_t *set);
+
+int kv_stripe_foreach(kv_stripe_set_t *set, kv_foreach_cb_t foreach_cb, void *arg);
+
+int kv_stripe_foreach_parallel(kv_stripe_set_t *set, size_t thread_num, kv_foreach_cb_t foreach_cb, void **args);
+
+int kv_stripe_clear_parallel(kv_stripe_set_t *set, size_t thread_num);
+
+int kv_stripe_bulk_load(kv_stripe_set_t *set, size_t thread_num, const char *const *keys,
+                        const char *const *values, size_t pair_num);
+
+#endif
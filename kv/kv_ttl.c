@@ -0,0 +1,367 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "kv.h"
+#include "kv_inner.h"
+
+/* number of the bits of a slot index */
+#define WHEEL_SLOT_BITS     6
+
+/* number of the slots on every level */
+#define WHEEL_SLOT_NUM      (1 << WHEEL_SLOT_BITS)
+
+/* mask of a slot index */
+#define WHEEL_SLOT_MASK     (WHEEL_SLOT_NUM - 1)
+
+/* number of the levels, the last one spans 2^24 ms, about 4.6 hours */
+#define WHEEL_LEVEL_NUM     4
+
+/* deadlines further than this are parked on the last level and placed again */
+#define WHEEL_MAX_DELTA     (1ULL << (WHEEL_SLOT_BITS * WHEEL_LEVEL_NUM))
+
+/* get the bucket the expiry entry is stored in front of */
+#define TTL_ENTRY_BUCKET(set, entry)    ((kv_bucket_t *)((char *)(entry) + (set)->bucket_prefix))
+
+/**
+ * hierarchical timer wheel of the expiring pairs, ticking once per millisecond.
+ * the slots of level 0 hold the entries expiring in the next 64 ticks, the
+ * slots of level 1 hold those expiring in the next 64 * 64 ticks, and so on.
+ * when the ticks wrap around level 0, the entries in the next slot of level 1
+ * are cascaded down to level 0.
+ */
+typedef struct kv_wheel
+{
+    /* clock the deadlines are measured with, or NULL */
+    kv_clock_cb_t clock_cb;
+
+    /* next tick to be processed, all the earlier ones are done */
+    uint64_t tick;
+
+    /* number of the entries in the wheel */
+    size_t entry_num;
+
+    /**
+     * occupied slots of level 0, a bit may stay set after its slot is
+     * emptied by deletes, it's cleared once the tick reaches the slot.
+     */
+    uint64_t bitmap;
+
+    /* lists of the entries */
+    kv_ttl_entry_t *slots[WHEEL_LEVEL_NUM][WHEEL_SLOT_NUM];
+} kv_wheel_t;
+
+/**
+ * @brief add the entry to the slot its deadline falls in.
+ */
+static void kv_ttl_link(kv_wheel_t *wheel, kv_ttl_entry_t *entry)
+{
+    kv_ttl_entry_t **link;
+    uint64_t expires;
+    uint64_t delta;
+    int level;
+    size_t index;
+
+    expires = entry->deadline > wheel->tick ? entry->deadline : wheel->tick;
+    delta = expires - wheel->tick;
+    if (delta >= WHEEL_MAX_DELTA)
+    {
+        delta = WHEEL_MAX_DELTA - 1;
+        expires = wheel->tick + delta;
+    }
+
+    level = 0;
+    while (level < WHEEL_LEVEL_NUM - 1 && (delta >> ((level + 1) * WHEEL_SLOT_BITS)) != 0)
+    {
+        level++;
+    }
+    index = (expires >> (level * WHEEL_SLOT_BITS)) & WHEEL_SLOT_MASK;
+    if (level == 0)
+    {
+        wheel->bitmap |= 1ULL << index;
+    }
+
+    link = &wheel->slots[level][index];
+    entry->next = *link;
+    if (entry->next != NULL)
+    {
+        entry->next->link = &entry->next;
+    }
+    entry->link = link;
+    *link = entry;
+}
+
+/**
+ * @brief remove the entry from its slot.
+ */
+static void kv_ttl_unlink(kv_ttl_entry_t *entry)
+{
+    *entry->link = entry->next;
+    if (entry->next != NULL)
+    {
+        entry->next->link = entry->link;
+    }
+    entry->next = NULL;
+    entry->link = NULL;
+}
+
+/**
+ * @brief move the entries in the slots reached by the tick down to the lower
+ *        levels, the tick must be at the start of a round of level 0.
+ */
+static void kv_ttl_cascade(kv_wheel_t *wheel)
+{
+    kv_ttl_entry_t *curt_entry;
+    kv_ttl_entry_t *next_entry;
+    size_t index;
+
+    for (int level = 1; level < WHEEL_LEVEL_NUM; level++)
+    {
+        index = (wheel->tick >> (level * WHEEL_SLOT_BITS)) & WHEEL_SLOT_MASK;
+        next_entry = wheel->slots[level][index];
+        wheel->slots[level][index] = NULL;
+        while (next_entry != NULL)
+        {
+            curt_entry = next_entry;
+            next_entry = curt_entry->next;
+            kv_ttl_link(wheel, curt_entry);
+        }
+
+        /* the higher levels only move at the start of a round of this one */
+        if (index != 0)
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief get the next tick cascading an occupied slot of the higher levels.
+ * @note  the slot at index i of level l is cascaded at the ticks whose low
+ *        l * 6 bits are 0, and whose next 6 bits are i. the work is bounded by
+ *        the number of the slots, whatever the time to the tick is.
+ *
+ * @return  the tick, later than the current one, or UINT64_MAX if the
+ *          higher levels are empty.
+ */
+static uint64_t kv_ttl_next_cascade(kv_wheel_t *wheel)
+{
+    uint64_t next_tick;
+    uint64_t span;
+    uint64_t round;
+    uint64_t tick;
+
+    next_tick = UINT64_MAX;
+    for (int level = 1; level < WHEEL_LEVEL_NUM; level++)
+    {
+        span = 1ULL << (level * WHEEL_SLOT_BITS);
+        round = span << WHEEL_SLOT_BITS;
+        for (size_t i = 0; i < WHEEL_SLOT_NUM; i++)
+        {
+            if (wheel->slots[level][i] == NULL)
+            {
+                continue;
+            }
+            tick = (wheel->tick & ~(round - 1)) + i * span;
+            if (tick <= wheel->tick)
+            {
+                tick += round;
+            }
+            next_tick = tick < next_tick ? tick : next_tick;
+        }
+    }
+
+    return next_tick;
+}
+
+int kv_ttl_create(kv_set_t *set, const kv_conf_t *conf)
+{
+    kv_wheel_t *wheel;
+
+    wheel = (kv_wheel_t *)malloc(sizeof(kv_wheel_t));
+    if (wheel == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    memset(wheel, 0, sizeof(kv_wheel_t));
+    wheel->clock_cb = conf->clock_cb;
+
+    set->wheel = wheel;
+    wheel->tick = kv_ttl_now(set);
+
+    return KV_OK;
+}
+
+void kv_ttl_clear(kv_set_t *set)
+{
+    memset(set->wheel->slots, 0, sizeof(set->wheel->slots));
+    set->wheel->bitmap = 0;
+    set->wheel->entry_num = 0;
+}
+
+void kv_ttl_destroy(kv_set_t *set)
+{
+    free(set->wheel);
+    set->wheel = NULL;
+}
+
+/**
+ * @brief get the current time of the set in milliseconds.
+ */
+uint64_t kv_ttl_now(kv_set_t *set)
+{
+    struct timespec ts;
+
+    if (set->wheel->clock_cb != NULL)
+    {
+        return set->wheel->clock_cb();
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief set the deadline of the bucket, 0 if it never expires.
+ */
+void kv_ttl_set(kv_set_t *set, kv_bucket_t *bucket, uint64_t deadline)
+{
+    kv_ttl_entry_t *entry;
+
+    entry = KV_TTL_ENTRY(set, bucket);
+    if (entry->link != NULL)
+    {
+        kv_ttl_unlink(entry);
+        set->wheel->entry_num--;
+    }
+
+    entry->deadline = deadline;
+    if (deadline != 0)
+    {
+        kv_ttl_link(set->wheel, entry);
+        set->wheel->entry_num++;
+    }
+}
+
+/**
+ * @brief remove the bucket from the wheel before it's freed.
+ */
+void kv_ttl_remove(kv_set_t *set, kv_bucket_t *bucket)
+{
+    kv_ttl_entry_t *entry;
+
+    entry = KV_TTL_ENTRY(set, bucket);
+    if (entry->link != NULL)
+    {
+        kv_ttl_unlink(entry);
+        set->wheel->entry_num--;
+    }
+}
+
+/**
+ * @brief check if the bucket expired at the time.
+ */
+int kv_ttl_expired(kv_set_t *set, kv_bucket_t *bucket, uint64_t now)
+{
+    uint64_t deadline;
+
+    deadline = KV_TTL_ENTRY(set, bucket)->deadline;
+
+    return deadline != 0 && deadline <= now ? KV_TRUE : KV_FALSE;
+}
+
+/**
+ * @brief add the bytes of the wheel.
+ */
+void kv_ttl_stats(kv_set_t *set, kv_stats_t *stats)
+{
+    stats->memory_bytes += sizeof(kv_wheel_t);
+}
+
+/**
+ * @brief turn the wheel up to the time, and reclaim the pairs expired.
+ * @note  the work is bounded by 'max_num' pairs, the wheel stops at the tick
+ *        where it runs out and goes on from there next time. the empty slots
+ *        of level 0 are skipped with the bitmap, and once level 0 is empty,
+ *        the wheel jumps to the next tick cascading an occupied slot, so an
+ *        idle wheel costs one step per occupied slot rather than per round
+ *        of level 0. an empty wheel jumps to the time at once.
+ *
+ * @param set      kv set pointer.
+ * @param now      current time.
+ * @param max_num  maximum number of the pairs reclaimed.
+ * @return  number of the pairs reclaimed.
+ */
+size_t kv_ttl_advance(kv_set_t *set, uint64_t now, size_t max_num)
+{
+    kv_wheel_t *wheel;
+    kv_ttl_entry_t *entry;
+    uint64_t next_tick;
+    uint64_t bits;
+    size_t index;
+    size_t expired_num;
+
+    wheel = set->wheel;
+    expired_num = 0;
+    while (wheel->tick <= now)
+    {
+        /* nothing to wait for, jump to the time */
+        if (wheel->entry_num == 0)
+        {
+            wheel->tick = now + 1;
+            wheel->bitmap = 0;
+            break;
+        }
+
+        index = wheel->tick & WHEEL_SLOT_MASK;
+        if (index == 0)
+        {
+            kv_ttl_cascade(wheel);
+        }
+
+        while (wheel->slots[0][index] != NULL)
+        {
+            if (expired_num == max_num)
+            {
+                return expired_num;
+            }
+
+            entry = wheel->slots[0][index];
+            kv_ttl_unlink(entry);
+            wheel->entry_num--;
+
+            /* a deadline parked on the last level may still be far */
+            if (entry->deadline > wheel->tick)
+            {
+                kv_ttl_link(wheel, entry);
+                wheel->entry_num++;
+                continue;
+            }
+
+            kv_bucket_drop(set, TTL_ENTRY_BUCKET(set, entry));
+            expired_num++;
+        }
+        wheel->bitmap &= ~(1ULL << index);
+
+        /* skip to the next occupied slot, to the start of the next round, or to the next cascade */
+        bits = index == WHEEL_SLOT_MASK ? 0 : wheel->bitmap & (~0ULL << (index + 1));
+        if (bits != 0)
+        {
+            next_tick = (wheel->tick & ~(uint64_t)WHEEL_SLOT_MASK) + __builtin_ctzll(bits);
+        }
+        else if (wheel->bitmap != 0)
+        {
+            next_tick = (wheel->tick & ~(uint64_t)WHEEL_SLOT_MASK) + WHEEL_SLOT_NUM;
+        }
+        else
+        {
+            next_tick = kv_ttl_next_cascade(wheel);
+        }
+        wheel->tick = next_tick <= now + 1 ? next_tick : now + 1;
+    }
+
+    return expired_num;
+}
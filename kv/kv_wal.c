@@ -0,0 +1,976 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "kv.h"
+#include "kv_inner.h"
+
+/* magic bytes at the beginning of the log */
+#define WAL_MAGIC           "KVWAL01"
+
+/* default bytes of records fsync'ed together */
+#define DEF_SYNC_BYTES      (64 * 1024)
+
+/* default milliseconds a record may wait for its group */
+#define DEF_SYNC_MS         10
+
+/* the log isn't compacted until it holds this many records */
+#define COMPACT_MIN_NUM     1024
+
+/* bytes of the records following the snapshot kept for the compacted log, the compaction is dropped beyond */
+#define COMPACT_TAIL_MAX    (16 * 1024 * 1024)
+
+/* states of the compaction */
+#define COMPACT_IDLE        0
+#define COMPACT_RUNNING     1
+#define COMPACT_DONE        2
+#define COMPACT_FAILED      3
+
+/* header of a record, followed by the key bytes and the value bytes */
+typedef struct kv_wal_record
+{
+    /* checksum of the rest of the header, the key and the value */
+    uint32_t check;
+
+    /* KV_WAL_PUT, KV_WAL_DEL or KV_WAL_CLEAR */
+    uint32_t op;
+
+    /* length of the key */
+    uint32_t key_len;
+
+    /* length of the value */
+    uint32_t value_len;
+} kv_wal_record_t;
+
+/* growable byte buffer */
+typedef struct kv_wal_buf
+{
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} kv_wal_buf_t;
+
+/* write-ahead log of a durable set */
+typedef struct kv_wal
+{
+    /* path of the log */
+    char *path;
+
+    /* path of the log being rewritten by the compaction */
+    char *compact_path;
+
+    /* path of the directory of the log */
+    char *dir_path;
+
+    /* whether the log replaced by the compaction isn't durable until the directory is fsync'ed */
+    int dir_dirty;
+
+    /* file descriptor of the log */
+    int fd;
+
+    /* fsync policy */
+    int sync;
+
+    /* bytes of records fsync'ed together */
+    size_t sync_bytes;
+
+    /* milliseconds a record may wait for its group */
+    uint32_t sync_ms;
+
+    /* number of the records in the log, buffered ones included */
+    size_t record_num;
+
+    /* bytes of the log written so far */
+    uint64_t size;
+
+    /* records not written to the log yet */
+    kv_wal_buf_t buf;
+
+    /* bucket whose value was handed out to be written in place, or NULL */
+    kv_bucket_t *slot;
+
+    /* hash of the value of member 'slot' when it was handed out */
+    uint64_t slot_check;
+
+    /* protect all the members below and above, shared with the thread */
+    pthread_mutex_t mutex;
+
+    /* wake the background thread up */
+    pthread_cond_t cond;
+
+    /* wake the threads waiting for the compaction up */
+    pthread_cond_t done_cond;
+
+    /* background thread committing groups and compacting the log */
+    pthread_t thread;
+
+    /* whether the background thread should exit or not */
+    int stop;
+
+    /* state of the compaction */
+    int compact_state;
+
+    /* clone of the set the snapshot is encoded from by the thread, or NULL */
+    kv_set_t *clone;
+
+    /* live pairs to be written to the compacted log */
+    kv_wal_buf_t snap;
+
+    /* number of the records in member 'snap' */
+    size_t snap_num;
+
+    /* records appended since the snapshot was taken */
+    kv_wal_buf_t tail;
+
+    /* number of the records in member 'tail' */
+    size_t tail_num;
+
+    /* whether a record couldn't be added to member 'tail' or not */
+    int tail_failed;
+
+    /* file descriptor of the compacted log */
+    int compact_fd;
+} kv_wal_t;
+
+static int kv_wal_buf_append(kv_wal_buf_t *buf, const void *data, size_t len)
+{
+    uint8_t *new_data;
+    size_t new_cap;
+
+    if (len == 0)
+    {
+        return KV_OK;
+    }
+
+    if (buf->cap - buf->len < len)
+    {
+        new_cap = buf->cap != 0 ? buf->cap : 4096;
+        while (new_cap - buf->len < len)
+        {
+            if (new_cap > SIZE_MAX / 2)
+            {
+                return KV_ERR_BAD_MEM;
+            }
+            new_cap *= 2;
+        }
+        new_data = (uint8_t *)realloc(buf->data, new_cap);
+        if (new_data == NULL)
+        {
+            return KV_ERR_BAD_MEM;
+        }
+        buf->data = new_data;
+        buf->cap = new_cap;
+    }
+
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+
+    return KV_OK;
+}
+
+static void kv_wal_buf_free(kv_wal_buf_t *buf)
+{
+    free(buf->data);
+    buf->data = NULL;
+    buf->len = 0;
+    buf->cap = 0;
+}
+
+static uint32_t kv_wal_check(uint32_t op, const void *key, size_t key_len, const void *value, size_t value_len)
+{
+    uint64_t seed;
+
+    seed = ((uint64_t)key_len << 32 | value_len) + op;
+
+    return (uint32_t)kv_xxh64(value, value_len, kv_xxh64(key, key_len, seed));
+}
+
+/**
+ * @brief encode a record to the end of the buffer.
+ */
+static int kv_wal_encode(kv_wal_buf_t *buf, int op, const char *key, size_t key_len, const char *value, size_t value_len)
+{
+    kv_wal_record_t record;
+    size_t len;
+
+    record.op = (uint32_t)op;
+    record.key_len = (uint32_t)key_len;
+    record.value_len = (uint32_t)value_len;
+    record.check = kv_wal_check(record.op, key, key_len, value, value_len);
+
+    len = buf->len;
+    if (kv_wal_buf_append(buf, &record, sizeof(kv_wal_record_t)) != KV_OK ||
+        kv_wal_buf_append(buf, key, key_len) != KV_OK ||
+        kv_wal_buf_append(buf, value, value_len) != KV_OK)
+    {
+        buf->len = len;
+        return KV_ERR_BAD_MEM;
+    }
+
+    return KV_OK;
+}
+
+static int kv_wal_write_all(int fd, const uint8_t *data, size_t len)
+{
+    ssize_t written;
+
+    while (len > 0)
+    {
+        written = write(fd, data, len);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return KV_ERR_BAD_FILE;
+        }
+        data += written;
+        len -= written;
+    }
+
+    return KV_OK;
+}
+
+/**
+ * @brief fsync the directory of the log, so the log renamed into it is there
+ *        after a crash.
+ */
+static int kv_wal_sync_dir(kv_wal_t *wal)
+{
+    int fd;
+    int res;
+
+    fd = open(wal->dir_path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+    {
+        return KV_ERR_BAD_FILE;
+    }
+    res = fsync(fd) == 0 ? KV_OK : KV_ERR_BAD_FILE;
+    close(fd);
+    if (res == KV_OK)
+    {
+        wal->dir_dirty = KV_FALSE;
+    }
+
+    return res;
+}
+
+/**
+ * @brief write the buffered records to the log, and fsync it if required.
+ * @note  the caller holds the mutex. the records stay buffered if they can't
+ *        be written. the directory is fsync'ed along with the log if it
+ *        couldn't be when the log was replaced.
+ */
+static int kv_wal_flush(kv_wal_t *wal, int sync)
+{
+    if (wal->buf.len != 0)
+    {
+        /* never leave a torn record in front of the following ones */
+        if (kv_wal_write_all(wal->fd, wal->buf.data, wal->buf.len) != KV_OK)
+        {
+            if (ftruncate(wal->fd, wal->size) == 0)
+            {
+                lseek(wal->fd, wal->size, SEEK_SET);
+            }
+            return KV_ERR_BAD_FILE;
+        }
+        wal->size += wal->buf.len;
+        wal->buf.len = 0;
+    }
+    if (sync == KV_TRUE && fsync(wal->fd) != 0)
+    {
+        return KV_ERR_BAD_FILE;
+    }
+    if (sync == KV_TRUE && wal->dir_dirty == KV_TRUE && kv_wal_sync_dir(wal) != KV_OK)
+    {
+        return KV_ERR_BAD_FILE;
+    }
+
+    return KV_OK;
+}
+
+static void kv_wal_snap_visit(void *arg, kv_bucket_t *bucket)
+{
+    kv_wal_t *wal = (kv_wal_t *)arg;
+
+    if (wal->snap_num != SIZE_MAX)
+    {
+        if (kv_wal_encode(&wal->snap, KV_WAL_PUT, KV_BUCKET_KEY(bucket), bucket->key_len,
+                          KV_BUCKET_VALUE(bucket), bucket->value_len) != KV_OK)
+        {
+            wal->snap_num = SIZE_MAX;
+        }
+        else
+        {
+            wal->snap_num++;
+        }
+    }
+}
+
+/**
+ * @brief encode the live pairs into the snapshot.
+ * @note  member 'snap_num' is SIZE_MAX if the snapshot can't be encoded.
+ */
+static int kv_wal_encode_snap(kv_set_t *set, kv_wal_t *wal)
+{
+    set->engine->foreach(set, kv_wal_snap_visit, wal);
+
+    return wal->snap_num != SIZE_MAX ? KV_OK : KV_ERR_BAD_MEM;
+}
+
+/**
+ * @brief encode the snapshot from the clone of the set if there is one, then
+ *        write the header and the snapshot to the compacted log.
+ * @note  the mutex isn't held, the snapshot and the clone aren't touched by
+ *        others meanwhile. the clone is destroyed once it's encoded.
+ */
+static int kv_wal_write_snap(kv_wal_t *wal)
+{
+    int fd;
+
+    if (wal->clone != NULL)
+    {
+        kv_wal_encode_snap(wal->clone, wal);
+        kv_destroy(wal->clone);
+        wal->clone = NULL;
+        if (wal->snap_num == SIZE_MAX)
+        {
+            return KV_ERR_BAD_MEM;
+        }
+    }
+
+    fd = open(wal->compact_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return KV_ERR_BAD_FILE;
+    }
+    if (kv_wal_write_all(fd, (const uint8_t *)WAL_MAGIC, sizeof(WAL_MAGIC)) != KV_OK ||
+        kv_wal_write_all(fd, wal->snap.data, wal->snap.len) != KV_OK ||
+        fsync(fd) != 0)
+    {
+        close(fd);
+        unlink(wal->compact_path);
+        return KV_ERR_BAD_FILE;
+    }
+    wal->compact_fd = fd;
+
+    return KV_OK;
+}
+
+/**
+ * @brief replace the log with the compacted one once it has been written.
+ * @note  the caller holds the mutex. every buffered record is either in the
+ *        snapshot or in the tail, so the buffer is dropped. the directory is
+ *        fsync'ed right after the rename, before the current log is closed,
+ *        if it fails, the next fsync of the log tries again and fails until
+ *        it's done, since the renamed log can't be taken back.
+ */
+static void kv_wal_switch(kv_wal_t *wal)
+{
+    if (wal->compact_state == COMPACT_DONE)
+    {
+        if (wal->tail_failed == KV_FALSE &&
+            kv_wal_write_all(wal->compact_fd, wal->tail.data, wal->tail.len) == KV_OK &&
+            fsync(wal->compact_fd) == 0 &&
+            rename(wal->compact_path, wal->path) == 0)
+        {
+            wal->dir_dirty = KV_TRUE;
+            kv_wal_sync_dir(wal);
+            close(wal->fd);
+            wal->fd = wal->compact_fd;
+            wal->size = sizeof(WAL_MAGIC) + wal->snap.len + wal->tail.len;
+            wal->record_num = wal->snap_num + wal->tail_num;
+            wal->buf.len = 0;
+        }
+        else
+        {
+            close(wal->compact_fd);
+            unlink(wal->compact_path);
+        }
+    }
+    else if (wal->compact_state != COMPACT_FAILED)
+    {
+        return;
+    }
+
+    kv_wal_buf_free(&wal->snap);
+    kv_wal_buf_free(&wal->tail);
+    wal->snap_num = 0;
+    wal->tail_num = 0;
+    wal->tail_failed = KV_FALSE;
+    wal->compact_fd = -1;
+    wal->compact_state = COMPACT_IDLE;
+}
+
+/**
+ * @brief commit the buffered records every 'sync_ms' milliseconds, and write
+ *        the compacted log once a snapshot is handed over, the compacted log
+ *        replaces the current one as soon as it's written.
+ */
+static void *kv_wal_main(void *arg)
+{
+    kv_wal_t *wal = (kv_wal_t *)arg;
+    struct timespec ts;
+    int res;
+
+    pthread_mutex_lock(&wal->mutex);
+    while (KV_TRUE)
+    {
+        if (wal->compact_state == COMPACT_RUNNING)
+        {
+            pthread_mutex_unlock(&wal->mutex);
+            res = kv_wal_write_snap(wal);
+            pthread_mutex_lock(&wal->mutex);
+            wal->compact_state = res == KV_OK ? COMPACT_DONE : COMPACT_FAILED;
+            kv_wal_switch(wal);
+            pthread_cond_broadcast(&wal->done_cond);
+            continue;
+        }
+        if (wal->stop == KV_TRUE)
+        {
+            break;
+        }
+
+        if (wal->sync == KV_SYNC_GROUP)
+        {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += wal->sync_ms / 1000;
+            ts.tv_nsec += (long)(wal->sync_ms % 1000) * 1000000;
+            if (ts.tv_nsec >= 1000000000)
+            {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&wal->cond, &wal->mutex, &ts);
+            if (wal->buf.len != 0)
+            {
+                kv_wal_flush(wal, KV_TRUE);
+            }
+        }
+        else
+        {
+            pthread_cond_wait(&wal->cond, &wal->mutex);
+        }
+    }
+    pthread_mutex_unlock(&wal->mutex);
+
+    return NULL;
+}
+
+/**
+ * @brief replay the log into the set.
+ * @note  the replay stops at the first record which is truncated or doesn't
+ *        match its checksum, e.g. the one being written when the process
+ *        crashed, and the log is truncated there so the following records are
+ *        appended right after the intact ones.
+ *
+ * @param set kv set pointer.
+ * @param wal write-ahead log pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+static int kv_wal_replay(kv_set_t *set, kv_wal_t *wal)
+{
+    FILE *file;
+    char magic[sizeof(WAL_MAGIC)];
+    kv_wal_record_t record;
+    char *scratch;
+    size_t scratch_cap;
+    uint64_t offset;
+    size_t len;
+    const char *key;
+    const char *value;
+    int res;
+
+    file = fopen(wal->path, "rb");
+    if (file == NULL)
+    {
+        return KV_ERR_BAD_FILE;
+    }
+
+    /* a new log only gets its header */
+    if (fread(magic, 1, sizeof(WAL_MAGIC), file) != sizeof(WAL_MAGIC))
+    {
+        fclose(file);
+        if (ftruncate(wal->fd, 0) != 0 ||
+            kv_wal_write_all(wal->fd, (const uint8_t *)WAL_MAGIC, sizeof(WAL_MAGIC)) != KV_OK)
+        {
+            return KV_ERR_BAD_FILE;
+        }
+        wal->size = sizeof(WAL_MAGIC);
+        return KV_OK;
+    }
+    if (memcmp(magic, WAL_MAGIC, sizeof(WAL_MAGIC)) != 0)
+    {
+        fclose(file);
+        return KV_ERR_BAD_FILE;
+    }
+
+    scratch = NULL;
+    scratch_cap = 0;
+    offset = sizeof(WAL_MAGIC);
+    res = KV_OK;
+    while (fread(&record, sizeof(kv_wal_record_t), 1, file) == 1)
+    {
+        if (record.key_len > UINT32_MAX / 2 || record.value_len > UINT32_MAX / 2)
+        {
+            break;
+        }
+        len = (size_t)record.key_len + record.value_len;
+        if (len >= scratch_cap)
+        {
+            free(scratch);
+            scratch_cap = len + 1;
+            scratch = (char *)malloc(scratch_cap);
+            if (scratch == NULL)
+            {
+                res = KV_ERR_BAD_MEM;
+                break;
+            }
+        }
+        if (fread(scratch, 1, len, file) != len)
+        {
+            break;
+        }
+        key = scratch;
+        value = key + record.key_len;
+        if (record.check != kv_wal_check(record.op, key, record.key_len, value, record.value_len))
+        {
+            break;
+        }
+
+        switch (record.op)
+        {
+        case KV_WAL_PUT:
+            res = kv_put_hashed(set, key, record.key_len, kv_hash_str(set, key, record.key_len),
+                                value, record.value_len);
+            break;
+
+        case KV_WAL_DEL:
+            res = kv_del_hashed(set, key, record.key_len, kv_hash_str(set, key, record.key_len));
+            if (res == KV_ERR_KEY_NOT_FOUND)
+            {
+                res = KV_OK;
+            }
+            break;
+
+        case KV_WAL_CLEAR:
+            res = kv_clear(set);
+            break;
+
+        default:
+            res = KV_ERR_BAD_FILE;
+            break;
+        }
+        if (res != KV_OK)
+        {
+            break;
+        }
+
+        offset += sizeof(kv_wal_record_t) + len;
+        wal->record_num++;
+    }
+    free(scratch);
+    fclose(file);
+
+    if (res == KV_OK && ftruncate(wal->fd, offset) != 0)
+    {
+        res = KV_ERR_BAD_FILE;
+    }
+    wal->size = offset;
+
+    return res;
+}
+
+/**
+ * @brief open the write-ahead log of the set, and replay it.
+ * @note  the log is created if it doesn't exist.
+ *
+ * @param set   kv set pointer.
+ * @param conf  configuration pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_wal_open(kv_set_t *set, const kv_conf_t *conf)
+{
+    kv_wal_t *wal;
+    char *separator;
+    int res;
+
+    if (conf->wal_sync != KV_SYNC_GROUP && conf->wal_sync != KV_SYNC_ALWAYS && conf->wal_sync != KV_SYNC_NONE)
+    {
+        return KV_ERR_BAD_CONF;
+    }
+
+    wal = (kv_wal_t *)malloc(sizeof(kv_wal_t));
+    if (wal == NULL)
+    {
+        return KV_ERR_BAD_MEM;
+    }
+    memset(wal, 0, sizeof(kv_wal_t));
+    wal->compact_fd = -1;
+    wal->sync = conf->wal_sync;
+    wal->sync_bytes = conf->wal_sync_bytes != 0 ? conf->wal_sync_bytes : DEF_SYNC_BYTES;
+    wal->sync_ms = conf->wal_sync_ms != 0 ? conf->wal_sync_ms : DEF_SYNC_MS;
+
+    wal->path = (char *)malloc(strlen(conf->wal_path) + 1);
+    wal->compact_path = (char *)malloc(strlen(conf->wal_path) + sizeof(".compact"));
+    wal->dir_path = (char *)malloc(strlen(conf->wal_path) + sizeof("."));
+    if (wal->path == NULL || wal->compact_path == NULL || wal->dir_path == NULL)
+    {
+        res = KV_ERR_BAD_MEM;
+        goto err_path;
+    }
+    strcpy(wal->path, conf->wal_path);
+    strcpy(wal->compact_path, conf->wal_path);
+    strcat(wal->compact_path, ".compact");
+
+    /* the directory is the path up to the last slash, or the current one */
+    strcpy(wal->dir_path, conf->wal_path);
+    separator = strrchr(wal->dir_path, '/');
+    if (separator == NULL)
+    {
+        strcpy(wal->dir_path, ".");
+    }
+    else
+    {
+        separator[separator == wal->dir_path ? 1 : 0] = '\0';
+    }
+
+    wal->fd = open(wal->path, O_RDWR | O_CREAT, 0644);
+    if (wal->fd < 0)
+    {
+        res = KV_ERR_BAD_FILE;
+        goto err_path;
+    }
+
+    res = kv_wal_replay(set, wal);
+    if (res != KV_OK)
+    {
+        goto err_fd;
+    }
+    if (lseek(wal->fd, 0, SEEK_END) < 0)
+    {
+        res = KV_ERR_BAD_FILE;
+        goto err_fd;
+    }
+
+    if (pthread_mutex_init(&wal->mutex, NULL) != 0)
+    {
+        res = KV_ERR_BAD_LOCK;
+        goto err_fd;
+    }
+    if (pthread_cond_init(&wal->cond, NULL) != 0)
+    {
+        res = KV_ERR_BAD_LOCK;
+        goto err_mutex;
+    }
+    if (pthread_cond_init(&wal->done_cond, NULL) != 0)
+    {
+        res = KV_ERR_BAD_LOCK;
+        goto err_cond;
+    }
+    if (pthread_create(&wal->thread, NULL, kv_wal_main, wal) != 0)
+    {
+        res = KV_ERR_BAD_LOCK;
+        goto err_done_cond;
+    }
+
+    set->wal = wal;
+
+    return KV_OK;
+
+err_done_cond:
+    pthread_cond_destroy(&wal->done_cond);
+err_cond:
+    pthread_cond_destroy(&wal->cond);
+err_mutex:
+    pthread_mutex_destroy(&wal->mutex);
+err_fd:
+    close(wal->fd);
+err_path:
+    free(wal->path);
+    free(wal->compact_path);
+    free(wal->dir_path);
+    free(wal);
+    return res;
+}
+
+/**
+ * @brief commit the buffered records and close the log.
+ * @note  a running compaction is waited for and completed.
+ *
+ * @param set kv set pointer.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_wal_close(kv_set_t *set)
+{
+    kv_wal_t *wal;
+    int res;
+
+    res = kv_wal_settle(set);
+    wal = set->wal;
+    set->wal = NULL;
+
+    pthread_mutex_lock(&wal->mutex);
+    wal->stop = KV_TRUE;
+    pthread_cond_signal(&wal->cond);
+    pthread_mutex_unlock(&wal->mutex);
+    pthread_join(wal->thread, NULL);
+
+    kv_wal_switch(wal);
+    if (kv_wal_flush(wal, wal->sync != KV_SYNC_NONE ? KV_TRUE : KV_FALSE) != KV_OK || close(wal->fd) != 0)
+    {
+        res = KV_ERR_BAD_FILE;
+    }
+
+    pthread_cond_destroy(&wal->done_cond);
+    pthread_cond_destroy(&wal->cond);
+    pthread_mutex_destroy(&wal->mutex);
+    kv_wal_buf_free(&wal->buf);
+    free(wal->path);
+    free(wal->compact_path);
+    free(wal->dir_path);
+    free(wal);
+
+    return res;
+}
+
+/**
+ * @brief append a record to the log once the set is modified.
+ * @note  if the record can't be appended, the modification stays in the set
+ *        but isn't durable, and the error is returned. with KV_SYNC_ALWAYS, the record is fsync'ed before this function
+ *        returns. with KV_SYNC_GROUP, the records are buffered and fsync'ed
+ *        together once 'sync_bytes' of them are buffered, or by the
+ *        background thread once the oldest one has waited 'sync_ms'. with
+ *        KV_SYNC_NONE, the record is written at once but never fsync'ed.
+ *
+ * @param set       kv set pointer.
+ * @param op        KV_WAL_PUT, KV_WAL_DEL or KV_WAL_CLEAR.
+ * @param key       key pointer.
+ * @param key_len   length of the key.
+ * @param value     value pointer.
+ * @param value_len length of the value.
+ * @return  return KV_OK if success, otherwise return other value.
+ */
+int kv_wal_append(kv_set_t *set, int op, const char *key, size_t key_len, const char *value, size_t value_len)
+{
+    kv_wal_t *wal;
+    size_t len;
+    int res;
+
+    if (key_len > UINT32_MAX / 2 || value_len > UINT32_MAX / 2)
+    {
+        return KV_ERR_BAD_ARG;
+    }
+
+    wal = set->wal;
+    pthread_mutex_lock(&wal->mutex);
+
+    kv_wal_switch(wal);
+
+    len = wal->buf.len;
+    res = kv_wal_encode(&wal->buf, op, key, key_len, value, value_len);
+    if (res != KV_OK)
+    {
+        goto exit;
+    }
+
+    switch (wal->sync)
+    {
+    case KV_SYNC_ALWAYS:
+        res = kv_wal_flush(wal, KV_TRUE);
+        break;
+
+    case KV_SYNC_NONE:
+        res = kv_wal_flush(wal, KV_FALSE);
+        break;
+
+    default:
+        if (wal->buf.len >= wal->sync_bytes)
+        {
+            res = kv_wal_flush(wal, KV_TRUE);
+        }
+        break;
+    }
+    if (res != KV_OK)
+    {
+        /* the record isn't committed, nor should it be written later */
+        if (wal->buf.len != 0)
+        {
+            wal->buf.len = len;
+        }
+        goto exit;
+    }
+
+    /* the records following the snapshot are appended to the compacted log, unless too many of them */
+    if (wal->compact_state == COMPACT_RUNNING && wal->tail_failed == KV_FALSE)
+    {
+        if (wal->tail.len >= COMPACT_TAIL_MAX ||
+            kv_wal_encode(&wal->tail, op, key, key_len, value, value_len) != KV_OK)
+        {
+            wal->tail_failed = KV_TRUE;
+            kv_wal_buf_free(&wal->tail);
+        }
+        wal->tail_num++;
+    }
+    wal->record_num++;
+
+    /* the value handed out is gone along with its bucket */
+    if (op == KV_WAL_CLEAR)
+    {
+        wal->slot = NULL;
+    }
+
+exit:
+    pthread_mutex_unlock(&wal->mutex);
+    return res;
+}
+
+/**
+ * @brief check if the dead records dominate the log.
+ * @note  the caller holds the mutex. the log isn't compacted while a slot is
+ *        held, since the clone of the set would share the bucket written
+ *        through the slot.
+ */
+static int kv_wal_compact_due(kv_set_t *set, kv_wal_t *wal)
+{
+    return wal->compact_state == COMPACT_IDLE && wal->slot == NULL &&
+           wal->record_num >= COMPACT_MIN_NUM && wal->record_num > set->pair_num * 2 ? KV_TRUE : KV_FALSE;
+}
+
+/**
+ * @brief hand a clone of the set over to the background thread, which
+ *        encodes the snapshot from it.
+ * @note  the caller holds the mutex. the snapshot is encoded right away if
+ *        the set can't be cloned.
+ */
+static void kv_wal_compact_start(kv_set_t *set, kv_wal_t *wal)
+{
+    if (kv_clone(set, &wal->clone) != KV_OK)
+    {
+        wal->clone = NULL;
+        if (kv_wal_encode_snap(set, wal) != KV_OK)
+        {
+            wal->compact_state = COMPACT_FAILED;
+            kv_wal_switch(wal);
+            return;
+        }
+    }
+
+    wal->compact_state = COMPACT_RUNNING;
+    pthread_cond_signal(&wal->cond);
+}
+
+/**
+ * @brief start compacting the log once the dead records dominate it.
+ * @note  the set is cloned in a constant time, the background thread then
+ *        encodes the live pairs of the clone into a snapshot, writes it to a
+ *        new log and fsyncs it, while the following records keep being
+ *        appended to the current log, and to a tail of at most
+ *        COMPACT_TAIL_MAX bytes. the thread copies the tail to the new log
+ *        and replaces the current one as soon as the snapshot is written,
+ *        the compaction is dropped if the tail outgrows its limit. the sets
+ *        which can't be cloned have their snapshot encoded right away.
+ *
+ * @param set kv set pointer.
+ */
+void kv_wal_compact(kv_set_t *set)
+{
+    kv_wal_t *wal;
+
+    wal = set->wal;
+    pthread_mutex_lock(&wal->mutex);
+
+    if (kv_wal_compact_due(set, wal) == KV_TRUE)
+    {
+        kv_wal_compact_start(set, wal);
+    }
+
+    pthread_mutex_unlock(&wal->mutex);
+}
+
+/**
+ * @brief remember the bucket whose value is handed out to be written in
+ *        place, its value is logged by kv_wal_settle().
+ */
+void kv_wal_hold(kv_set_t *set, kv_bucket_t *bucket)
+{
+    set->wal->slot = bucket;
+    set->wal->slot_check = kv_xxh64(KV_BUCKET_VALUE(bucket), bucket->value_len, 0);
+}
+
+/**
+ * @brief log the value handed out by kv_wal_hold() if it has been written.
+ * @note  called before the set is modified, while the bucket is still there.
+ */
+int kv_wal_settle(kv_set_t *set)
+{
+    kv_bucket_t *bucket;
+    int res;
+
+    bucket = set->wal->slot;
+    if (bucket == NULL)
+    {
+        return KV_OK;
+    }
+
+    if (kv_xxh64(KV_BUCKET_VALUE(bucket), bucket->value_len, 0) != set->wal->slot_check)
+    {
+        res = kv_wal_append(set, KV_WAL_PUT, KV_BUCKET_KEY(bucket), bucket->key_len,
+                            KV_BUCKET_VALUE(bucket), bucket->value_len);
+        if (res != KV_OK)
+        {
+            return res;
+        }
+    }
+    set->wal->slot = NULL;
+
+    return KV_OK;
+}
+
+/**
+ * @brief write and fsync all the records appended so far.
+ * @note  a running compaction is waited for and completed, and the log is
+ *        compacted again if the dead records still dominate it, so the log
+ *        holds at most twice as many records as the live pairs(or fewer than
+ *        COMPACT_MIN_NUM) once this function returns.
+ */
+int kv_wal_sync(kv_set_t *set)
+{
+    kv_wal_t *wal;
+    int res;
+
+    res = kv_wal_settle(set);
+    if (res != KV_OK)
+    {
+        return res;
+    }
+
+    wal = set->wal;
+    pthread_mutex_lock(&wal->mutex);
+    while (KV_TRUE)
+    {
+        while (wal->compact_state == COMPACT_RUNNING)
+        {
+            pthread_cond_wait(&wal->done_cond, &wal->mutex);
+        }
+        kv_wal_switch(wal);
+        if (kv_wal_compact_due(set, wal) == KV_FALSE)
+        {
+            break;
+        }
+        kv_wal_compact_start(set, wal);
+    }
+    res = kv_wal_flush(wal, KV_TRUE);
+    pthread_mutex_unlock(&wal->mutex);
+
+    return res;
+}
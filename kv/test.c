@@ -1,9 +1,18 @@
 #include <assert.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "kv.h"
+#include "kv_stripe.h"
+#include "kv_rcu.h"
+#include "kv_frozen.h"
+#include "kv_map.h"
 
 const char *keys[] = 
 {
@@ -67,6 +76,3031 @@ uint32_t sample_hash(const char * str) {
     return sum;
 }
 
+void test_many_pairs(const kv_conf_t *conf, size_t pair_num)
+{
+    int res;
+    kv_set_t *set;
+    kv_stats_t stats;
+    size_t size;
+    const char *value;
+    char key[32];
+    char val[32];
+
+    res = kv_create(&set, conf);
+    assert(res == KV_OK);
+
+    /* keep checking while the buckets are being migrated */
+    for (size_t i = 0; i < pair_num; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        sprintf(val, "value-%zu", i);
+        res = kv_put(set, key, val);
+        assert(res == KV_OK);
+
+        sprintf(key, "key-%zu", i / 2);
+        sprintf(val, "value-%zu", i / 2);
+        res = kv_get(set, key, &value);
+        assert(res == KV_OK);
+        assert(strcmp(val, value) == 0);
+    }
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.bucket_num >= pair_num / 2);
+
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == pair_num);
+
+    for (size_t i = 0; i < pair_num; i += 2)
+    {
+        sprintf(key, "key-%zu", i);
+        res = kv_del(set, key);
+        assert(res == KV_OK);
+    }
+
+    for (size_t i = 0; i < pair_num; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        res = kv_contain(set, key);
+        assert(res == (i % 2 == 0 ? KV_FALSE : KV_TRUE));
+    }
+
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == pair_num / 2);
+
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+}
+
+void test_overwriting(const kv_conf_t *conf)
+{
+    int res;
+    kv_set_t *set;
+    const char *value;
+    const char *old_value;
+
+    res = kv_create(&set, conf);
+    assert(res == KV_OK);
+
+    res = kv_put(set, keys[0], "a rather long value string");
+    assert(res == KV_OK);
+    res = kv_get(set, keys[0], &old_value);
+    assert(res == KV_OK);
+
+    /* shorter value is overwritten in place */
+    res = kv_put(set, keys[0], values[0]);
+    assert(res == KV_OK);
+    res = kv_get(set, keys[0], &value);
+    assert(res == KV_OK);
+    assert(value == old_value);
+    assert(strcmp(values[0], value) == 0);
+
+    /* longer value needs a new bucket */
+    res = kv_put(set, keys[0], "an even longer value string than the first one");
+    assert(res == KV_OK);
+    res = kv_get(set, keys[0], &value);
+    assert(res == KV_OK);
+    assert(strcmp("an even longer value string than the first one", value) == 0);
+
+    res = kv_put(set, keys[1], "");
+    assert(res == KV_OK);
+    res = kv_get(set, keys[1], &value);
+    assert(res == KV_OK);
+    assert(strcmp("", value) == 0);
+
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+}
+
+void test_get_batch(const kv_conf_t *conf)
+{
+    int res;
+    kv_set_t *set;
+    char key_bufs[100][32];
+    const char *batch_keys[100];
+    const char *batch_values[100];
+    const char *value;
+    char val[32];
+
+    res = kv_create(&set, conf);
+    assert(res == KV_OK);
+
+    /* only the even keys are put, and the set grows meanwhile */
+    for (size_t i = 0; i < 100; i++)
+    {
+        sprintf(key_bufs[i], "key-%zu", i);
+        batch_keys[i] = key_bufs[i];
+        if (i % 2 == 0)
+        {
+            sprintf(val, "value-%zu", i);
+            res = kv_put(set, key_bufs[i], val);
+            assert(res == KV_OK);
+        }
+    }
+
+    res = kv_get_batch(set, batch_keys, 100, batch_values);
+    assert(res == KV_OK);
+    for (size_t i = 0; i < 100; i++)
+    {
+        if (i % 2 == 0)
+        {
+            res = kv_get(set, batch_keys[i], &value);
+            assert(res == KV_OK);
+            assert(batch_values[i] == value);
+        }
+        else
+        {
+            assert(batch_values[i] == NULL);
+        }
+    }
+
+    /* less keys than a batch */
+    res = kv_get_batch(set, batch_keys + 1, 3, batch_values);
+    assert(res == KV_OK);
+    assert(batch_values[0] == NULL);
+    assert(strcmp(batch_values[1], "value-2") == 0);
+    assert(batch_values[2] == NULL);
+
+    res = kv_get_batch(set, batch_keys, 0, batch_values);
+    assert(res == KV_OK);
+    batch_keys[5] = NULL;
+    res = kv_get_batch(set, batch_keys, 10, batch_values);
+    assert(res == KV_ERR_BAD_ARG);
+
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+}
+
+void test_arena(const kv_conf_t *conf)
+{
+    int res;
+    kv_set_t *set;
+    kv_stats_t stats;
+    size_t size;
+    size_t live;
+    const char *value;
+    char big_value[1024];
+
+    res = kv_create(&set, conf);
+    assert(res == KV_OK);
+
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.arena_reserved == 0);
+    assert(stats.arena_live == 0);
+
+    add_key_value_pairs(set);
+
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.pair_num == KV_PAIR_NUM);
+    assert(stats.arena_reserved == conf->arena_size);
+    assert(stats.arena_live > 0 && stats.arena_live <= stats.arena_reserved);
+    live = stats.arena_live;
+
+    res = kv_del(set, keys[0]);
+    assert(res == KV_OK);
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.arena_live < live);
+
+    /* a value larger than a slab gets its own one */
+    memset(big_value, 'x', sizeof(big_value) - 1);
+    big_value[sizeof(big_value) - 1] = '\0';
+    res = kv_put(set, keys[1], big_value);
+    assert(res == KV_OK);
+    res = kv_get(set, keys[1], &value);
+    assert(res == KV_OK);
+    assert(strcmp(big_value, value) == 0);
+    res = kv_get(set, keys[2], &value);
+    assert(res == KV_OK);
+    assert(strcmp(values[2], value) == 0);
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.arena_reserved > conf->arena_size + sizeof(big_value));
+
+    res = kv_clear(set);
+    assert(res == KV_OK);
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.arena_reserved == conf->arena_size);
+    assert(stats.arena_live == 0);
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == 0);
+    res = kv_contain(set, keys[3]);
+    assert(res == KV_FALSE);
+
+    /* the kept slab is reused */
+    add_key_value_pairs(set);
+    res = kv_get(set, keys[3], &value);
+    assert(res == KV_OK);
+    assert(strcmp(values[3], value) == 0);
+
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+}
+
+static size_t hash_call_num;
+
+uint32_t counting_hash(const char *str)
+{
+    uint32_t hash = 0;
+
+    hash_call_num++;
+    while (*str != '\0')
+    {
+        hash = hash * 31 + (uint8_t)*str++;
+    }
+
+    return hash;
+}
+
+void test_cached_hash(int engine)
+{
+    int res;
+    kv_set_t *set;
+    kv_stats_t stats;
+    kv_conf_t conf;
+    char key[32];
+    const size_t pair_num = 10000;
+
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.hash_cb = counting_hash;
+    conf.engine = engine;
+
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+
+    /* growing the set must not hash the keys again */
+    hash_call_num = 0;
+    for (size_t i = 0; i < pair_num; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        res = kv_put(set, key, key);
+        assert(res == KV_OK);
+    }
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.bucket_num > 16);
+    assert(hash_call_num == pair_num);
+
+    for (size_t i = 0; i < pair_num; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        res = kv_contain(set, key);
+        assert(res == KV_TRUE);
+    }
+    assert(hash_call_num == pair_num * 2);
+
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+}
+
+void foreach_n_cb(void *arg, const void *key, size_t key_len, const void *value, size_t value_len)
+{
+    size_t *total_len = (size_t *)arg;
+
+    *total_len += key_len + value_len;
+}
+
+void test_binary_safe(const kv_conf_t *conf)
+{
+    int res;
+    kv_set_t *set;
+    kv_conf_t legacy_conf;
+    const void *value;
+    size_t value_len;
+    size_t total_len;
+    const char *str_value;
+    static const char recv_buff[] = "GET /index.html\0Host: example.com\0\x01\x02";
+    static const uint8_t bin_value[] = {0x00, 0xFF, 0x00, 0x7F};
+
+    res = kv_create(&set, conf);
+    assert(res == KV_OK);
+
+    /* slices of the buffer are used as keys without copying */
+    res = kv_put_n(set, recv_buff, 3, bin_value, sizeof(bin_value));
+    assert(res == KV_OK);
+    res = kv_put_n(set, recv_buff + 16, 4, recv_buff + 22, 11);
+    assert(res == KV_OK);
+
+    /* keys with embedded null bytes are distinct */
+    res = kv_put_n(set, "a\0b", 3, "first", 5);
+    assert(res == KV_OK);
+    res = kv_put_n(set, "a\0c", 3, "second", 6);
+    assert(res == KV_OK);
+    res = kv_put_n(set, "a", 1, "third", 5);
+    assert(res == KV_OK);
+
+    res = kv_get_n(set, "GET", 3, &value, &value_len);
+    assert(res == KV_OK);
+    assert(value_len == sizeof(bin_value));
+    assert(memcmp(bin_value, value, sizeof(bin_value)) == 0);
+
+    res = kv_get_n(set, "Host", 4, &value, &value_len);
+    assert(res == KV_OK);
+    assert(value_len == 11);
+    assert(memcmp("example.com", value, 11) == 0);
+
+    res = kv_get_n(set, "a\0c", 3, &value, &value_len);
+    assert(res == KV_OK);
+    assert(value_len == 6 && memcmp("second", value, 6) == 0);
+
+    res = kv_contain_n(set, "a\0d", 3);
+    assert(res == KV_FALSE);
+
+    /* the string api sees the same pairs */
+    res = kv_get(set, "a", &str_value);
+    assert(res == KV_OK);
+    assert(strcmp("third", str_value) == 0);
+    res = kv_get(set, "Host", &str_value);
+    assert(res == KV_OK);
+    assert(strcmp("example.com", str_value) == 0);
+
+    res = kv_del_n(set, "a\0b", 3);
+    assert(res == KV_OK);
+    res = kv_del_n(set, "a\0b", 3);
+    assert(res == KV_ERR_KEY_NOT_FOUND);
+
+    total_len = 0;
+    res = kv_foreach_n(set, foreach_n_cb, &total_len);
+    assert(res == KV_OK);
+    assert(total_len == 3 + sizeof(bin_value) + 4 + 11 + 3 + 6 + 1 + 5);
+
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+
+    /* a set hashing null-terminated strings only can't take binary keys */
+    memset(&legacy_conf, 0, sizeof(kv_conf_t));
+    legacy_conf.bucket_num = 16;
+    legacy_conf.hash_cb = sample_hash;
+    res = kv_create(&set, &legacy_conf);
+    assert(res == KV_OK);
+    res = kv_put_n(set, "GET", 3, "", 0);
+    assert(res == KV_ERR_BAD_CONF);
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+}
+
+void order_cb(void *arg, const char *key, const char *value)
+{
+    char *order = (char *)arg;
+
+    strcat(order, key);
+}
+
+static uint32_t fnv_hash_n(const void *key, size_t key_len)
+{
+    uint32_t hash = 2166136261U;
+
+    for (size_t i = 0; i < key_len; i++)
+    {
+        hash = (hash ^ ((const uint8_t *)key)[i]) * 16777619U;
+    }
+
+    return hash;
+}
+
+void test_builtin_hash(void)
+{
+    int res;
+    kv_set_t *set;
+    kv_set_t *another_set;
+    kv_conf_t conf;
+    char order[256];
+    char another_order[256];
+    const void *bin_value;
+    size_t bin_len;
+    const char *value;
+    const char *long_key = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+
+    /* reference vectors */
+    assert(kv_xxh64("", 0, 0) == 0xEF46DB3751D8E999ULL);
+    assert(kv_xxh64("abc", 3, 0) == 0x44BC2CF5AD770999ULL);
+    assert(kv_xxh64("Nobody inspects the spammish repetition", 39, 0) == 0xFBCEA83C8A378BF1ULL);
+    assert(kv_wyhash("", 0, 0) == 0x0409638EE2BDE459ULL);
+    assert(kv_wyhash("abc", 3, 2) == 0x32DD92E4B2915153ULL);
+    assert(kv_wyhash("message digest", 14, 3) == 0x8619124089A3A16BULL);
+    assert(kv_wyhash(long_key, strlen(long_key), 5) == 0xFF42329B90E50D58ULL);
+
+    /* different seeds scatter the keys differently */
+    assert(kv_wyhash("abc", 3, 1) != kv_wyhash("abc", 3, 2));
+    assert(kv_xxh64("abc", 3, 1) != kv_xxh64("abc", 3, 2));
+
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.hash_type = KV_HASH_XXH64;
+    test_many_pairs(&conf, 10000);
+    conf.hash_type = KV_HASH_DJB2;
+    test_many_pairs(&conf, 10000);
+    conf.engine = KV_ENGINE_FLAT;
+    test_many_pairs(&conf, 10000);
+
+    conf.hash_type = 100;
+    res = kv_create(&set, &conf);
+    assert(res == KV_ERR_BAD_CONF);
+
+    /* the same seed gives the same layout */
+    conf.engine = KV_ENGINE_CHAIN;
+    conf.hash_type = KV_HASH_WYHASH;
+    conf.hash_seed = 0x1234;
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+    res = kv_create(&another_set, &conf);
+    assert(res == KV_OK);
+    add_key_value_pairs(set);
+    add_key_value_pairs(another_set);
+    order[0] = '\0';
+    another_order[0] = '\0';
+    res = kv_foreach(set, order_cb, order);
+    assert(res == KV_OK);
+    res = kv_foreach(another_set, order_cb, another_order);
+    assert(res == KV_OK);
+    assert(strcmp(order, another_order) == 0);
+
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+    res = kv_destroy(another_set);
+    assert(res == KV_OK);
+
+    /* the length-aware callback replaces the built-in hash */
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.hash_n_cb = fnv_hash_n;
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+    res = kv_put_n(set, "a\0b", 3, "1", 1);
+    assert(res == KV_OK);
+    res = kv_put(set, "a", "2");
+    assert(res == KV_OK);
+    res = kv_get_n(set, "a\0b", 3, &bin_value, &bin_len);
+    assert(res == KV_OK && bin_len == 1 && memcmp(bin_value, "1", 1) == 0);
+    res = kv_get(set, "a", &value);
+    assert(res == KV_OK && strcmp(value, "2") == 0);
+    res = kv_del_n(set, "a\0b", 3);
+    assert(res == KV_OK);
+    res = kv_contain_n(set, "a\0b", 3);
+    assert(res == KV_FALSE);
+    res = kv_contain(set, "a");
+    assert(res == KV_TRUE);
+    test_many_pairs(&conf, 10000);
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+}
+
+#define IMAGE_PATH "test.kvimage"
+
+static size_t image_visit_num;
+
+void image_foreach_cb(void *arg, const void *key, size_t key_len, const void *value, size_t value_len)
+{
+    kv_set_t *set = (kv_set_t *)arg;
+    const void *saved_value;
+    size_t saved_value_len;
+    int res;
+
+    res = kv_get_n(set, key, key_len, &saved_value, &saved_value_len);
+    assert(res == KV_OK);
+    assert(saved_value_len == value_len && memcmp(saved_value, value, value_len) == 0);
+    image_visit_num++;
+}
+
+static void *image_reader_main(void *arg)
+{
+    kv_set_t *set = (kv_set_t *)arg;
+    const char *value;
+    char key[32];
+    char val[32];
+    int res;
+
+    for (size_t i = 0; i < 1000; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        sprintf(val, "value-%zu", i);
+        res = kv_get(set, key, &value);
+        assert(res == KV_OK);
+        assert(strcmp(val, value) == 0);
+        assert(kv_contain(set, "key-missing") == KV_FALSE);
+    }
+
+    return NULL;
+}
+
+void test_image(const kv_conf_t *conf)
+{
+    int res;
+    kv_set_t *set;
+    kv_set_t *mapped_set;
+    kv_set_t *remapped_set;
+    size_t size;
+    const char *value;
+    const void *value_n;
+    size_t value_len;
+    const char *batch_keys[3];
+    const char *batch_values[3];
+    pthread_t readers[2];
+    char key[32];
+    char val[32];
+
+    res = kv_create(&set, conf);
+    assert(res == KV_OK);
+    for (size_t i = 0; i < 1000; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        sprintf(val, "value-%zu", i);
+        res = kv_put(set, key, val);
+        assert(res == KV_OK);
+    }
+    res = kv_put_n(set, "bin\0key", 7, "bin\0value", 9);
+    assert(res == KV_OK);
+
+    res = kv_save(set, IMAGE_PATH);
+    assert(res == KV_OK);
+    res = kv_open_mapped(&mapped_set, IMAGE_PATH, NULL);
+    assert(res == KV_OK);
+
+    res = kv_size(mapped_set, &size);
+    assert(res == KV_OK);
+    assert(size == 1001);
+    for (size_t i = 0; i < 1000; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        sprintf(val, "value-%zu", i);
+        res = kv_get(mapped_set, key, &value);
+        assert(res == KV_OK);
+        assert(strcmp(val, value) == 0);
+    }
+    res = kv_contain(mapped_set, "key-1000");
+    assert(res == KV_FALSE);
+    res = kv_get_n(mapped_set, "bin\0key", 7, &value_n, &value_len);
+    assert(res == KV_OK);
+    assert(value_len == 9 && memcmp(value_n, "bin\0value", 9) == 0);
+
+    batch_keys[0] = "key-7";
+    batch_keys[1] = "key-missing";
+    batch_keys[2] = "key-999";
+    res = kv_get_batch(mapped_set, batch_keys, 3, batch_values);
+    assert(res == KV_OK);
+    assert(strcmp(batch_values[0], "value-7") == 0);
+    assert(batch_values[1] == NULL);
+    assert(strcmp(batch_values[2], "value-999") == 0);
+
+    /* the readers of a mapped image write nothing they share */
+    for (size_t i = 0; i < 2; i++)
+    {
+        res = pthread_create(readers + i, NULL, image_reader_main, mapped_set);
+        assert(res == 0);
+    }
+    for (size_t i = 0; i < 2; i++)
+    {
+        res = pthread_join(readers[i], NULL);
+        assert(res == 0);
+    }
+
+    image_visit_num = 0;
+    res = kv_foreach_n(mapped_set, image_foreach_cb, set);
+    assert(res == KV_OK);
+    assert(image_visit_num == 1001);
+
+    /* the image is read-only */
+    res = kv_put(mapped_set, "key-0", "value");
+    assert(res == KV_ERR_READ_ONLY);
+    res = kv_del(mapped_set, "key-0");
+    assert(res == KV_ERR_READ_ONLY);
+    res = kv_clear(mapped_set);
+    assert(res == KV_ERR_READ_ONLY);
+
+    /* a mapped set can be saved again */
+    res = kv_save(mapped_set, IMAGE_PATH ".copy");
+    assert(res == KV_OK);
+    res = kv_open_mapped(&remapped_set, IMAGE_PATH ".copy", NULL);
+    assert(res == KV_OK);
+    image_visit_num = 0;
+    res = kv_foreach_n(remapped_set, image_foreach_cb, set);
+    assert(res == KV_OK);
+    assert(image_visit_num == 1001);
+
+    res = kv_destroy(remapped_set);
+    assert(res == KV_OK);
+    res = kv_destroy(mapped_set);
+    assert(res == KV_OK);
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+    remove(IMAGE_PATH);
+    remove(IMAGE_PATH ".copy");
+}
+
+void test_image_callback(void)
+{
+    int res;
+    kv_set_t *set;
+    kv_set_t *mapped_set;
+    kv_conf_t conf;
+    const char *value;
+    FILE *file;
+
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.hash_cb = sample_hash;
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+    add_key_value_pairs(set);
+    res = kv_save(set, IMAGE_PATH);
+    assert(res == KV_OK);
+
+    /* the callback must be given again */
+    res = kv_open_mapped(&mapped_set, IMAGE_PATH, NULL);
+    assert(res == KV_ERR_BAD_CONF);
+    res = kv_open_mapped(&mapped_set, IMAGE_PATH, &conf);
+    assert(res == KV_OK);
+    res = kv_get(mapped_set, keys[3], &value);
+    assert(res == KV_OK);
+    assert(strcmp(values[3], value) == 0);
+    res = kv_destroy(mapped_set);
+    assert(res == KV_OK);
+
+    /* the file isn't an image */
+    file = fopen(IMAGE_PATH, "wb");
+    assert(file != NULL);
+    fprintf(file, "%0128d", 0);
+    fclose(file);
+    res = kv_open_mapped(&mapped_set, IMAGE_PATH, NULL);
+    assert(res == KV_ERR_BAD_FILE);
+    remove(IMAGE_PATH);
+    res = kv_open_mapped(&mapped_set, IMAGE_PATH, NULL);
+    assert(res == KV_ERR_BAD_FILE);
+
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+}
+
+#define STRIPE_THREAD_NUM   8
+#define STRIPE_PAIR_NUM     5000
+
+/* context of a thread working on the striped kv set */
+typedef struct stripe_worker
+{
+    kv_stripe_set_t *set;
+    size_t id;
+} stripe_worker_t;
+
+void *stripe_worker_main(void *arg)
+{
+    stripe_worker_t *worker = (stripe_worker_t *)arg;
+    kv_guard_t guard;
+    const char *value;
+    char key[32];
+    char val[32];
+    int res;
+
+    for (size_t i = 0; i < STRIPE_PAIR_NUM; i++)
+    {
+        sprintf(key, "key-%zu-%zu", worker->id, i);
+        sprintf(val, "value-%zu-%zu", worker->id, i);
+        res = kv_stripe_put(worker->set, key, val);
+        assert(res == KV_OK);
+
+        res = kv_stripe_get(worker->set, key, &value, &guard);
+        assert(res == KV_OK);
+        assert(strcmp(val, value) == 0);
+        res = kv_stripe_release(&guard);
+        assert(res == KV_OK);
+
+        /* every thread keeps overwriting the shared key */
+        res = kv_stripe_put(worker->set, "shared", val);
+        assert(res == KV_OK);
+        res = kv_stripe_get(worker->set, "shared", &value, &guard);
+        assert(res == KV_OK);
+        assert(strncmp(value, "value-", 6) == 0);
+        res = kv_stripe_release(&guard);
+        assert(res == KV_OK);
+    }
+
+    for (size_t i = 0; i < STRIPE_PAIR_NUM; i += 2)
+    {
+        sprintf(key, "key-%zu-%zu", worker->id, i);
+        res = kv_stripe_del(worker->set, key);
+        assert(res == KV_OK);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief write the image with its bytes in [offset, offset + len) set to
+ *        the byte, and check it's rejected.
+ */
+static void image_corrupt_check(const uint8_t *image, size_t image_size, size_t offset, size_t len, int byte)
+{
+    uint8_t *corrupted;
+    kv_set_t *mapped_set;
+    FILE *file;
+    int res;
+
+    corrupted = (uint8_t *)malloc(image_size);
+    assert(corrupted != NULL);
+    memcpy(corrupted, image, image_size);
+    memset(corrupted + offset, byte, len);
+    file = fopen(IMAGE_PATH, "wb");
+    assert(file != NULL);
+    assert(fwrite(corrupted, 1, image_size, file) == image_size);
+    fclose(file);
+    free(corrupted);
+
+    res = kv_open_mapped(&mapped_set, IMAGE_PATH, NULL);
+    assert(res == KV_ERR_BAD_FILE);
+}
+
+void test_image_corrupted(void)
+{
+    int res;
+    kv_set_t *set;
+    uint8_t *image;
+    size_t image_size;
+    uint64_t slot_offset;
+    uint64_t record_offset;
+    uint64_t slot_num;
+    size_t used;
+    struct stat st;
+    FILE *file;
+
+    res = kv_create(&set, NULL);
+    assert(res == KV_OK);
+    add_key_value_pairs(set);
+    res = kv_save(set, IMAGE_PATH);
+    assert(res == KV_OK);
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+
+    assert(stat(IMAGE_PATH, &st) == 0);
+    image_size = (size_t)st.st_size;
+    image = (uint8_t *)malloc(image_size);
+    assert(image != NULL);
+    file = fopen(IMAGE_PATH, "rb");
+    assert(file != NULL);
+    assert(fread(image, 1, image_size, file) == image_size);
+    fclose(file);
+
+    /* the slot count and the offsets follow the magic, 4 words and 2 longs of the header */
+    memcpy(&slot_num, image + 40, sizeof(uint64_t));
+    memcpy(&slot_offset, image + 48, sizeof(uint64_t));
+    memcpy(&record_offset, image + 56, sizeof(uint64_t));
+    assert(slot_offset + slot_num * 16 == record_offset);
+
+    /* no slot is empty, so a probe for a missing key never ends */
+    image_corrupt_check(image, image_size, slot_offset, slot_num * 16, 1);
+
+    /* a slot in use points past the records */
+    for (used = 0; image[slot_offset + used * 16] == 0; used++)
+    {
+    }
+    image_corrupt_check(image, image_size, slot_offset + used * 16 + 1, 1, 0x7F);
+
+    /* the lengths of the records run past the end of the file */
+    image_corrupt_check(image, image_size, record_offset, image_size - record_offset, 0xFF);
+
+    /* the file is truncated */
+    image_corrupt_check(image, image_size - 8, 0, 0, 0);
+
+    free(image);
+    remove(IMAGE_PATH);
+}
+
+static void stripe_count_cb(void *arg, const char *key, const char *value)
+{
+    (*(size_t *)arg)++;
+}
+
+static void *stripe_reader_main(void *arg)
+{
+    stripe_worker_t *worker = (stripe_worker_t *)arg;
+    size_t count;
+    size_t size;
+    int res;
+
+    count = 0;
+    res = kv_stripe_foreach(worker->set, stripe_count_cb, &count);
+    assert(res == KV_OK);
+    res = kv_stripe_size(worker->set, &size);
+    assert(res == KV_OK && count == size);
+
+    return NULL;
+}
+
+void test_stripe(int lock_type, const kv_conf_t *set_conf)
+{
+    int res;
+    kv_stripe_set_t *set;
+    kv_stripe_conf_t conf;
+    pthread_t threads[STRIPE_THREAD_NUM];
+    stripe_worker_t workers[STRIPE_THREAD_NUM];
+    kv_guard_t guard;
+    const char *value;
+    size_t size;
+    char key[32];
+
+    memset(&conf, 0, sizeof(kv_stripe_conf_t));
+    conf.stripe_num = 7;
+    conf.lock_type = lock_type;
+    conf.set_conf = set_conf;
+    res = kv_stripe_create(&set, &conf);
+    assert(res == KV_OK);
+
+    for (size_t i = 0; i < STRIPE_THREAD_NUM; i++)
+    {
+        workers[i].set = set;
+        workers[i].id = i;
+        res = pthread_create(threads + i, NULL, stripe_worker_main, workers + i);
+        assert(res == 0);
+    }
+    for (size_t i = 0; i < STRIPE_THREAD_NUM; i++)
+    {
+        res = pthread_join(threads[i], NULL);
+        assert(res == 0);
+    }
+
+    res = kv_stripe_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == STRIPE_THREAD_NUM * STRIPE_PAIR_NUM / 2 + 1);
+
+    /* the readers iterate the stripes together */
+    for (size_t i = 0; i < STRIPE_THREAD_NUM; i++)
+    {
+        res = pthread_create(threads + i, NULL, stripe_reader_main, workers + i);
+        assert(res == 0);
+    }
+    for (size_t i = 0; i < STRIPE_THREAD_NUM; i++)
+    {
+        res = pthread_join(threads[i], NULL);
+        assert(res == 0);
+    }
+
+    for (size_t i = 0; i < STRIPE_THREAD_NUM; i++)
+    {
+        for (size_t j = 0; j < STRIPE_PAIR_NUM; j++)
+        {
+            sprintf(key, "key-%zu-%zu", i, j);
+            res = kv_stripe_contain(set, key);
+            assert(res == (j % 2 == 0 ? KV_FALSE : KV_TRUE));
+        }
+    }
+
+    res = kv_stripe_get(set, "key-0-0", &value, &guard);
+    assert(res == KV_ERR_KEY_NOT_FOUND);
+
+    res = kv_stripe_clear(set);
+    assert(res == KV_OK);
+    res = kv_stripe_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == 0);
+
+    res = kv_stripe_destroy(set);
+    assert(res == KV_OK);
+}
+
+/* number of pairs loaded by the parallel test */
+#define PARALLEL_PAIR_NUM   100000
+
+/* number of threads of the parallel test */
+#define PARALLEL_THREAD_NUM 4
+
+static void parallel_count_cb(void *arg, const char *key, const char *value)
+{
+    size_t *count = (size_t *)arg;
+
+    assert(strcmp(key + 1, value + 1) == 0);
+    (*count)++;
+}
+
+void test_stripe_parallel(const kv_conf_t *set_conf)
+{
+    int res;
+    kv_stripe_set_t *set;
+    kv_stripe_conf_t conf;
+    char **keys;
+    char **values;
+    size_t counts[PARALLEL_THREAD_NUM];
+    void *args[PARALLEL_THREAD_NUM];
+    kv_guard_t guard;
+    const char *value;
+    size_t size;
+
+    memset(&conf, 0, sizeof(kv_stripe_conf_t));
+    conf.stripe_num = 13;
+    conf.lock_type = KV_LOCK_RWLOCK;
+    conf.set_conf = set_conf;
+    res = kv_stripe_create(&set, &conf);
+    assert(res == KV_OK);
+
+    /* the second half repeats the keys of the first half with other values */
+    keys = (char **)malloc(PARALLEL_PAIR_NUM * sizeof(char *));
+    values = (char **)malloc(PARALLEL_PAIR_NUM * sizeof(char *));
+    assert(keys != NULL && values != NULL);
+    for (size_t i = 0; i < PARALLEL_PAIR_NUM; i++)
+    {
+        keys[i] = (char *)malloc(32);
+        values[i] = (char *)malloc(32);
+        assert(keys[i] != NULL && values[i] != NULL);
+        sprintf(keys[i], "k%zu", i % (PARALLEL_PAIR_NUM / 2));
+        sprintf(values[i], "%c%zu", i < PARALLEL_PAIR_NUM / 2 ? 'a' : 'b', i % (PARALLEL_PAIR_NUM / 2));
+    }
+
+    res = kv_stripe_bulk_load(set, 0, (const char *const *)keys, (const char *const *)values, PARALLEL_PAIR_NUM);
+    assert(res == KV_ERR_BAD_ARG);
+
+    /* nothing is loaded if a key is missing */
+    free(keys[PARALLEL_PAIR_NUM - 1]);
+    keys[PARALLEL_PAIR_NUM - 1] = NULL;
+    res = kv_stripe_bulk_load(set, PARALLEL_THREAD_NUM, (const char *const *)keys, (const char *const *)values,
+                              PARALLEL_PAIR_NUM);
+    assert(res == KV_ERR_BAD_ARG);
+    res = kv_stripe_size(set, &size);
+    assert(res == KV_OK && size == 0);
+    keys[PARALLEL_PAIR_NUM - 1] = (char *)malloc(32);
+    assert(keys[PARALLEL_PAIR_NUM - 1] != NULL);
+    sprintf(keys[PARALLEL_PAIR_NUM - 1], "k%d", PARALLEL_PAIR_NUM / 2 - 1);
+
+    res = kv_stripe_bulk_load(set, PARALLEL_THREAD_NUM, (const char *const *)keys, (const char *const *)values,
+                              PARALLEL_PAIR_NUM);
+    assert(res == KV_OK);
+    res = kv_stripe_size(set, &size);
+    assert(res == KV_OK && size == PARALLEL_PAIR_NUM / 2);
+
+    /* the later pairs of the same keys win */
+    for (size_t i = 0; i < PARALLEL_PAIR_NUM / 2; i++)
+    {
+        res = kv_stripe_get(set, keys[i], &value, &guard);
+        assert(res == KV_OK);
+        assert(strcmp(value, values[i + PARALLEL_PAIR_NUM / 2]) == 0);
+        kv_stripe_release(&guard);
+    }
+
+    /* every thread counts the pairs it visits */
+    for (size_t i = 0; i < PARALLEL_THREAD_NUM; i++)
+    {
+        counts[i] = 0;
+        args[i] = counts + i;
+    }
+    res = kv_stripe_foreach_parallel(set, PARALLEL_THREAD_NUM, NULL, args);
+    assert(res == KV_ERR_BAD_ARG);
+    res = kv_stripe_foreach_parallel(set, PARALLEL_THREAD_NUM, parallel_count_cb, args);
+    assert(res == KV_OK);
+    size = 0;
+    for (size_t i = 0; i < PARALLEL_THREAD_NUM; i++)
+    {
+        size += counts[i];
+    }
+    assert(size == PARALLEL_PAIR_NUM / 2);
+
+    /* a single thread visits every stripe */
+    counts[0] = 0;
+    res = kv_stripe_foreach_parallel(set, 1, parallel_count_cb, args);
+    assert(res == KV_OK && counts[0] == PARALLEL_PAIR_NUM / 2);
+
+    res = kv_stripe_clear_parallel(set, PARALLEL_THREAD_NUM);
+    assert(res == KV_OK);
+    res = kv_stripe_size(set, &size);
+    assert(res == KV_OK && size == 0);
+    res = kv_stripe_contain(set, keys[0]);
+    assert(res == KV_FALSE);
+
+    for (size_t i = 0; i < PARALLEL_PAIR_NUM; i++)
+    {
+        free(keys[i]);
+        free(values[i]);
+    }
+    free(keys);
+    free(values);
+    kv_stripe_destroy(set);
+}
+
+#define RCU_READER_NUM      4
+#define RCU_PAIR_NUM        2000
+#define RCU_ROUND_NUM       20
+
+/* context of a thread reading the read-optimized kv set */
+typedef struct rcu_worker
+{
+    kv_rcu_set_t *set;
+    int stop;
+} rcu_worker_t;
+
+void *rcu_reader_main(void *arg)
+{
+    rcu_worker_t *worker = (rcu_worker_t *)arg;
+    kv_rcu_reader_t *reader;
+    const char *value;
+    char key[32];
+    size_t key_len;
+    size_t i;
+    int res;
+
+    res = kv_rcu_register(worker->set, &reader);
+    assert(res == KV_OK);
+
+    for (i = 0; __atomic_load_n(&worker->stop, __ATOMIC_ACQUIRE) == KV_FALSE; i++)
+    {
+        sprintf(key, "key-%zu", i % RCU_PAIR_NUM);
+        key_len = strlen(key);
+
+        res = kv_rcu_read_lock(reader);
+        assert(res == KV_OK);
+        res = kv_rcu_get(worker->set, key, &value);
+        if (res == KV_OK)
+        {
+            /* the value is "<key>/<round>" and can't change under the reader */
+            assert(strncmp(value, key, key_len) == 0 && value[key_len] == '/');
+            sched_yield();
+            assert(strncmp(value, key, key_len) == 0 && value[key_len] == '/');
+        }
+        else
+        {
+            assert(res == KV_ERR_KEY_NOT_FOUND);
+        }
+        res = kv_rcu_read_unlock(reader);
+        assert(res == KV_OK);
+    }
+
+    res = kv_rcu_unregister(reader);
+    assert(res == KV_OK);
+
+    return NULL;
+}
+
+/* overwrite the pairs while the main thread stays in the read-side section */
+void *rcu_writer_main(void *arg)
+{
+    rcu_worker_t *worker = (rcu_worker_t *)arg;
+    char key[32];
+    int res;
+
+    for (size_t i = 0; i < RCU_PAIR_NUM * RCU_ROUND_NUM; i++)
+    {
+        sprintf(key, "key-%zu", i % RCU_PAIR_NUM);
+        res = kv_rcu_put(worker->set, key, "key-x/0");
+        assert(res == KV_OK);
+    }
+    res = kv_rcu_clear(worker->set);
+    assert(res == KV_OK);
+
+    return NULL;
+}
+
+void test_rcu(void)
+{
+    int res;
+    kv_rcu_set_t *set;
+    kv_rcu_conf_t conf;
+    kv_conf_t set_conf;
+    kv_rcu_reader_t *reader;
+    pthread_t threads[RCU_READER_NUM];
+    rcu_worker_t worker;
+    const char *value;
+    size_t size;
+    char key[32];
+    char val[64];
+
+    memset(&set_conf, 0, sizeof(kv_conf_t));
+    set_conf.bucket_num = 16;
+    memset(&conf, 0, sizeof(kv_rcu_conf_t));
+    conf.reader_num = RCU_READER_NUM + 1;
+    conf.set_conf = &set_conf;
+    res = kv_rcu_create(&set, &conf);
+    assert(res == KV_OK);
+
+    worker.set = set;
+    worker.stop = KV_FALSE;
+    for (size_t i = 0; i < RCU_READER_NUM; i++)
+    {
+        res = pthread_create(threads + i, NULL, rcu_reader_main, &worker);
+        assert(res == 0);
+    }
+
+    /* the set grows, and every pair is overwritten and deleted meanwhile */
+    for (size_t round = 0; round < RCU_ROUND_NUM; round++)
+    {
+        for (size_t i = 0; i < RCU_PAIR_NUM; i++)
+        {
+            sprintf(key, "key-%zu", i);
+            sprintf(val, "%s/%zu", key, round);
+            res = kv_rcu_put(set, key, val);
+            assert(res == KV_OK);
+        }
+        for (size_t i = round % 2; i < RCU_PAIR_NUM; i += 2)
+        {
+            sprintf(key, "key-%zu", i);
+            res = kv_rcu_del(set, key);
+            assert(res == KV_OK);
+        }
+    }
+
+    __atomic_store_n(&worker.stop, KV_TRUE, __ATOMIC_RELEASE);
+    for (size_t i = 0; i < RCU_READER_NUM; i++)
+    {
+        res = pthread_join(threads[i], NULL);
+        assert(res == 0);
+    }
+
+    res = kv_rcu_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == RCU_PAIR_NUM / 2);
+
+    res = kv_rcu_register(set, &reader);
+    assert(res == KV_OK);
+    res = kv_rcu_read_lock(reader);
+    assert(res == KV_OK);
+    res = kv_rcu_contain(set, "key-0");
+    assert(res == KV_TRUE);
+    res = kv_rcu_contain(set, "key-1");
+    assert(res == KV_FALSE);
+    res = kv_rcu_get(set, "key-0", &value);
+    assert(res == KV_OK);
+    sprintf(val, "key-0/%d", RCU_ROUND_NUM - 1);
+    assert(strcmp(val, value) == 0);
+
+    /* nothing is freed under the reader, however much is retired meanwhile */
+    res = pthread_create(threads, NULL, rcu_writer_main, &worker);
+    assert(res == 0);
+    res = pthread_join(threads[0], NULL);
+    assert(res == 0);
+    assert(strcmp(val, value) == 0);
+    res = kv_rcu_read_unlock(reader);
+    assert(res == KV_OK);
+    res = kv_rcu_unregister(reader);
+    assert(res == KV_OK);
+
+    res = kv_rcu_clear(set);
+    assert(res == KV_OK);
+    res = kv_rcu_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == 0);
+
+    res = kv_rcu_destroy(set);
+    assert(res == KV_OK);
+}
+
+/* keys visited by the scan, in the visiting order */
+static char scan_keys[2000][32];
+static size_t scan_key_num;
+
+void scan_cb(void *arg, const void *key, size_t key_len, const void *value, size_t value_len)
+{
+    kv_set_t *set = (kv_set_t *)arg;
+    const void *saved_value;
+    size_t saved_value_len;
+    int res;
+
+    res = kv_get_n(set, key, key_len, &saved_value, &saved_value_len);
+    assert(res == KV_OK);
+    assert(saved_value == value && saved_value_len == value_len);
+    assert(key_len < sizeof(scan_keys[0]));
+    memcpy(scan_keys[scan_key_num], key, key_len);
+    scan_keys[scan_key_num][key_len] = '\0';
+    scan_key_num++;
+}
+
+void test_scan(const kv_conf_t *conf)
+{
+    int res;
+    kv_set_t *set;
+    kv_conf_t real_conf;
+    size_t size;
+    const void *value;
+    size_t value_len;
+    char key[32];
+    char val[64];
+    size_t i;
+
+    memset(&real_conf, 0, sizeof(kv_conf_t));
+    real_conf.bucket_num = 16;
+    if (conf != NULL)
+    {
+        real_conf = *conf;
+    }
+
+    /* the set isn't ordered, unless the engine keeps the keys in order */
+    res = kv_create(&set, &real_conf);
+    assert(res == KV_OK);
+    res = kv_scan_prefix(set, "", 0, scan_cb, set);
+    assert(res == (real_conf.engine == KV_ENGINE_ART ? KV_OK : KV_ERR_BAD_CONF));
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+
+    real_conf.ordered = KV_TRUE;
+    res = kv_create(&set, &real_conf);
+    assert(res == KV_OK);
+
+    /* put the keys in a scrambled order, 1000 is coprime to 7 */
+    for (size_t j = 0; j < 1000; j++)
+    {
+        i = j * 7 % 1000;
+        sprintf(key, "user:%03zu:%zu", i / 10, i % 10);
+        res = kv_put(set, key, "value");
+        assert(res == KV_OK);
+    }
+    for (i = 0; i < 1000; i += 3)
+    {
+        sprintf(key, "user:%03zu:%zu", i / 10, i % 10);
+        res = kv_del(set, key);
+        assert(res == KV_OK);
+    }
+
+    /* longer values take new buckets */
+    for (i = 1; i < 1000; i += 3)
+    {
+        sprintf(key, "user:%03zu:%zu", i / 10, i % 10);
+        sprintf(val, "a much longer value of %s", key);
+        res = kv_put(set, key, val);
+        assert(res == KV_OK);
+    }
+
+    scan_key_num = 0;
+    res = kv_scan_prefix(set, "user:042:", 9, scan_cb, set);
+    assert(res == KV_OK);
+    for (size_t j = 0; j < scan_key_num; j++)
+    {
+        assert(strncmp(scan_keys[j], "user:042:", 9) == 0);
+        assert(j == 0 || strcmp(scan_keys[j - 1], scan_keys[j]) < 0);
+    }
+    assert(scan_key_num == 6);
+
+    scan_key_num = 0;
+    res = kv_scan_range(set, "user:010", 8, "user:020", 8, scan_cb, set);
+    assert(res == KV_OK);
+    assert(scan_key_num == 67);
+    assert(strcmp(scan_keys[0], "user:010:0") == 0);
+    assert(strcmp(scan_keys[scan_key_num - 1], "user:019:9") == 0);
+
+    scan_key_num = 0;
+    res = kv_scan_range(set, NULL, 0, NULL, 0, scan_cb, set);
+    assert(res == KV_OK);
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(scan_key_num == size);
+    for (size_t j = 1; j < scan_key_num; j++)
+    {
+        assert(strcmp(scan_keys[j - 1], scan_keys[j]) < 0);
+    }
+
+    scan_key_num = 0;
+    res = kv_scan_prefix(set, "user:1000", 9, scan_cb, set);
+    assert(res == KV_OK);
+    assert(scan_key_num == 0);
+
+    /* a key comes before the longer keys it is a prefix of */
+    res = kv_put_n(set, "a", 1, "1", 1);
+    assert(res == KV_OK);
+    res = kv_put_n(set, "ab", 2, "3", 1);
+    assert(res == KV_OK);
+    res = kv_put_n(set, "a\0", 2, "2", 1);
+    assert(res == KV_OK);
+    scan_key_num = 0;
+    res = kv_scan_prefix(set, "a", 1, scan_cb, set);
+    assert(res == KV_OK);
+    assert(scan_key_num == 3);
+    assert(strcmp(scan_keys[0], "a") == 0);
+    assert(scan_keys[1][0] == 'a' && scan_keys[1][1] == '\0');
+    assert(strcmp(scan_keys[2], "ab") == 0);
+    res = kv_get_n(set, "a\0", 2, &value, &value_len);
+    assert(res == KV_OK);
+    assert(value_len == 1 && memcmp(value, "2", 1) == 0);
+
+    res = kv_clear(set);
+    assert(res == KV_OK);
+    scan_key_num = 0;
+    res = kv_scan_range(set, NULL, 0, NULL, 0, scan_cb, set);
+    assert(res == KV_OK);
+    assert(scan_key_num == 0);
+    res = kv_put(set, "b", "value");
+    assert(res == KV_OK);
+    res = kv_scan_prefix(set, "", 0, scan_cb, set);
+    assert(res == KV_OK);
+    assert(scan_key_num == 1);
+
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+}
+
+/* number of the distinct keys of the art engine test */
+#define ART_KEY_NUM 3000
+
+static char art_last_key[64];
+static size_t art_last_len;
+static size_t art_visit_num;
+
+void art_order_cb(void *arg, const void *key, size_t key_len, const void *value, size_t value_len)
+{
+    size_t min_len = key_len < art_last_len ? key_len : art_last_len;
+    int res;
+
+    if (art_visit_num != 0)
+    {
+        res = memcmp(art_last_key, key, min_len);
+        assert(res < 0 || (res == 0 && art_last_len < key_len));
+    }
+    assert(key_len < sizeof(art_last_key));
+    memcpy(art_last_key, key, key_len);
+    art_last_len = key_len;
+    art_visit_num++;
+}
+
+void test_art(void)
+{
+    int res;
+    kv_set_t *set;
+    kv_conf_t conf;
+    kv_stats_t stats;
+    size_t size;
+    const void *value;
+    size_t value_len;
+    static char keys_art[ART_KEY_NUM][64];
+    static int versions[ART_KEY_NUM];
+    char val[64];
+    uint64_t seed;
+    size_t live_num;
+    size_t i;
+
+    /* long shared paths, keys being prefixes of others, and the empty key */
+    for (i = 0; i < ART_KEY_NUM; i++)
+    {
+        switch (i % 4)
+        {
+        case 0:
+            sprintf(keys_art[i], "/srv/data/region-%zu/shard-%02zu/object-%zu", i % 7, i % 13, i);
+            break;
+
+        case 1:
+            sprintf(keys_art[i], "/srv/data/region-%zu", i / 4);
+            break;
+
+        case 2:
+            sprintf(keys_art[i], "/srv/data/archive/very/deep/path/%zu", i);
+            break;
+
+        default:
+            sprintf(keys_art[i], "%c%zu", (char)('a' + i % 26), i);
+            break;
+        }
+    }
+    keys_art[ART_KEY_NUM - 1][0] = '\0';
+
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.engine = KV_ENGINE_ART;
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+
+    /* mirror random puts and deletes, the values grow to replace buckets */
+    memset(versions, 0, sizeof(versions));
+    live_num = 0;
+    seed = 1;
+    for (size_t j = 0; j < 40000; j++)
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        i = (size_t)(seed >> 33) % ART_KEY_NUM;
+        if ((seed >> 20) % 3 != 0)
+        {
+            versions[i] = versions[i] > 0 ? versions[i] + 1 : 1;
+            sprintf(val, "%0*d", versions[i] % 40 + 1, versions[i]);
+            res = kv_put_n(set, keys_art[i], strlen(keys_art[i]), val, strlen(val));
+            assert(res == KV_OK);
+            if (versions[i] == 1)
+            {
+                live_num++;
+            }
+        }
+        else
+        {
+            res = kv_del_n(set, keys_art[i], strlen(keys_art[i]));
+            assert(res == (versions[i] > 0 ? KV_OK : KV_ERR_KEY_NOT_FOUND));
+            if (versions[i] > 0)
+            {
+                versions[i] = 0;
+                live_num--;
+            }
+        }
+    }
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == live_num);
+
+    for (i = 0; i < ART_KEY_NUM; i++)
+    {
+        res = kv_get_n(set, keys_art[i], strlen(keys_art[i]), &value, &value_len);
+        if (versions[i] == 0)
+        {
+            assert(res == KV_ERR_KEY_NOT_FOUND);
+            continue;
+        }
+        assert(res == KV_OK);
+        sprintf(val, "%0*d", versions[i] % 40 + 1, versions[i]);
+        assert(value_len == strlen(val) && memcmp(value, val, value_len) == 0);
+    }
+
+    /* the pairs are visited in key order */
+    art_visit_num = 0;
+    res = kv_foreach_n(set, art_order_cb, NULL);
+    assert(res == KV_OK);
+    assert(art_visit_num == live_num);
+    art_visit_num = 0;
+    res = kv_scan_range(set, "/srv/data/region-3", 18, "/srv/data/region-4", 18, art_order_cb, NULL);
+    assert(res == KV_OK);
+    live_num = 0;
+    for (i = 0; i < ART_KEY_NUM; i++)
+    {
+        if (versions[i] > 0 && strcmp(keys_art[i], "/srv/data/region-3") >= 0 &&
+            strcmp(keys_art[i], "/srv/data/region-4") < 0)
+        {
+            live_num++;
+        }
+    }
+    assert(art_visit_num == live_num);
+
+    /* every node is freed along with the last key */
+    for (i = 0; i < ART_KEY_NUM; i++)
+    {
+        if (versions[i] > 0)
+        {
+            res = kv_del_n(set, keys_art[i], strlen(keys_art[i]));
+            assert(res == KV_OK);
+        }
+    }
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.pair_num == 0);
+    assert(stats.bucket_num == 0);
+
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+}
+
+static size_t frozen_visit_num;
+
+void frozen_foreach_cb(void *arg, const char *key, const char *value)
+{
+    kv_frozen_t *frozen = (kv_frozen_t *)arg;
+    const char *saved_value;
+    int res;
+
+    /* the binary key is cut at its null byte */
+    res = kv_frozen_get(frozen, key, &saved_value);
+    assert(res == KV_OK ? saved_value == value : strcmp(key, "bin") == 0);
+    frozen_visit_num++;
+}
+
+void frozen_foreach_n_cb(void *arg, const void *key, size_t key_len, const void *value, size_t value_len)
+{
+    kv_frozen_t *frozen = (kv_frozen_t *)arg;
+    const void *saved_value;
+    size_t saved_value_len;
+    int res;
+
+    res = kv_frozen_get_n(frozen, key, key_len, &saved_value, &saved_value_len);
+    assert(res == KV_OK);
+    assert(saved_value == value && saved_value_len == value_len);
+    frozen_visit_num++;
+}
+
+void test_frozen(const kv_conf_t *conf)
+{
+    int res;
+    kv_set_t *set;
+    kv_frozen_t *frozen;
+    size_t size;
+    const char *value;
+    const void *value_n;
+    size_t value_len;
+    char key[32];
+    char val[32];
+
+    /* an empty set */
+    res = kv_create(&set, conf);
+    assert(res == KV_OK);
+    res = kv_freeze(set, &frozen);
+    assert(res == KV_OK);
+    res = kv_frozen_size(frozen, &size);
+    assert(res == KV_OK);
+    assert(size == 0);
+    assert(kv_frozen_contain(frozen, "key") == KV_FALSE);
+    res = kv_frozen_destroy(frozen);
+    assert(res == KV_OK);
+
+    for (size_t i = 0; i < 20000; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        sprintf(val, "value-%zu", i);
+        res = kv_put(set, key, val);
+        assert(res == KV_OK);
+    }
+    res = kv_put_n(set, "bin\0key", 7, "bin\0value", 9);
+    assert(res == KV_OK);
+    res = kv_put(set, "empty", "");
+    assert(res == KV_OK);
+
+    /* the frozen set doesn't depend on the set */
+    res = kv_freeze(set, &frozen);
+    assert(res == KV_OK);
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+
+    res = kv_frozen_size(frozen, &size);
+    assert(res == KV_OK);
+    assert(size == 20002);
+    for (size_t i = 0; i < 20000; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        sprintf(val, "value-%zu", i);
+        res = kv_frozen_get(frozen, key, &value);
+        assert(res == KV_OK);
+        assert(strcmp(val, value) == 0);
+        assert(kv_frozen_contain(frozen, key) == KV_TRUE);
+
+        sprintf(key, "missing-%zu", i);
+        res = kv_frozen_get(frozen, key, &value);
+        assert(res == KV_ERR_KEY_NOT_FOUND);
+        assert(kv_frozen_contain(frozen, key) == KV_FALSE);
+    }
+    res = kv_frozen_get_n(frozen, "bin\0key", 7, &value_n, &value_len);
+    assert(res == KV_OK);
+    assert(value_len == 9 && memcmp(value_n, "bin\0value", 9) == 0);
+    assert(kv_frozen_contain_n(frozen, "bin", 3) == KV_FALSE);
+    res = kv_frozen_get(frozen, "empty", &value);
+    assert(res == KV_OK);
+    assert(strcmp(value, "") == 0);
+
+    frozen_visit_num = 0;
+    res = kv_frozen_foreach_n(frozen, frozen_foreach_n_cb, frozen);
+    assert(res == KV_OK);
+    assert(frozen_visit_num == 20002);
+    frozen_visit_num = 0;
+    res = kv_frozen_foreach(frozen, frozen_foreach_cb, frozen);
+    assert(res == KV_OK);
+    assert(frozen_visit_num == 20002);
+
+    /* the records are packed, a small pair takes a few dozen bytes */
+    assert(frozen->size < 20002 * 48);
+
+    res = kv_frozen_destroy(frozen);
+    assert(res == KV_OK);
+}
+
+static long wal_file_size(const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st) != 0)
+    {
+        return -1;
+    }
+
+    return (long)st.st_size;
+}
+
+#define COMPACT_TEST_NUM    1100
+
+static const char *wal_upsert_cb(void *arg, const char *value)
+{
+    (void)arg;
+
+    return value != NULL ? "upserted" : NULL;
+}
+
+void test_wal(int sync)
+{
+    int res;
+    kv_set_t *set;
+    kv_conf_t conf;
+    size_t size;
+    const char *value;
+    char *slot;
+    long log_size;
+    FILE *file;
+    int fd;
+    char wal_path[] = "/tmp/kv-test-XXXXXX";
+    char key[32];
+    char val[32];
+
+    /* the empty file created is taken as a new log */
+    fd = mkstemp(wal_path);
+    assert(fd >= 0);
+    close(fd);
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.wal_path = wal_path;
+    conf.wal_sync = sync;
+
+    /* a plain set has nothing to sync */
+    res = kv_create(&set, NULL);
+    assert(res == KV_OK);
+    res = kv_sync(set);
+    assert(res == KV_ERR_BAD_CONF);
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+    res = kv_put(set, "dropped", "value");
+    assert(res == KV_OK);
+    res = kv_clear(set);
+    assert(res == KV_OK);
+    for (size_t i = 0; i < 100; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        sprintf(val, "value-%zu", i);
+        res = kv_put(set, key, val);
+        assert(res == KV_OK);
+    }
+    for (size_t i = 0; i < 100; i += 2)
+    {
+        sprintf(key, "key-%zu", i);
+        res = kv_del(set, key);
+        assert(res == KV_OK);
+    }
+    res = kv_put(set, "key-1", "changed");
+    assert(res == KV_OK);
+    res = kv_put_n(set, "bin\0key", 7, "bin\0value", 9);
+    assert(res == KV_OK);
+
+    /* the values made by the callback and written through the slot are logged */
+    res = kv_upsert(set, "key-3", wal_upsert_cb, NULL);
+    assert(res == KV_OK);
+    res = kv_get_or_insert(set, "slot", "0000", &slot);
+    assert(res == KV_TRUE);
+    slot[0] = '1';
+    res = kv_get_or_insert(set, "slot", "ignored", &slot);
+    assert(res == KV_FALSE);
+    slot[1] = '2';
+    res = kv_sync(set);
+    assert(res == KV_OK);
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+
+    /* the set is rebuilt from the log */
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == 52);
+    assert(kv_contain(set, "dropped") == KV_FALSE);
+    for (size_t i = 0; i < 100; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        sprintf(val, "value-%zu", i);
+        res = kv_get(set, key, &value);
+        if (i % 2 == 0)
+        {
+            assert(res == KV_ERR_KEY_NOT_FOUND);
+        }
+        else
+        {
+            assert(res == KV_OK);
+            assert(strcmp(i == 1 ? "changed" : i == 3 ? "upserted" : val, value) == 0);
+        }
+    }
+    assert(kv_contain_n(set, "bin\0key", 7) == KV_TRUE);
+    res = kv_get(set, "slot", &value);
+    assert(res == KV_OK);
+    assert(strcmp(value, "1200") == 0);
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+
+    /* a torn record at the end is dropped */
+    log_size = wal_file_size(wal_path);
+    file = fopen(wal_path, "ab");
+    assert(file != NULL);
+    fwrite("\x12\x34\x56\x78\x01\x00\x00\x00\x20", 1, 9, file);
+    fclose(file);
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+    assert(wal_file_size(wal_path) == log_size);
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == 52);
+    res = kv_put(set, "after-torn", "value");
+    assert(res == KV_OK);
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+
+    /* the overwritten pairs are compacted away */
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+    assert(kv_contain(set, "after-torn") == KV_TRUE);
+    for (size_t round = 0; round < 100; round++)
+    {
+        for (size_t i = 0; i < 100; i++)
+        {
+            sprintf(key, "key-%zu", i);
+            sprintf(val, "value-%zu-%zu", i, round);
+            res = kv_put(set, key, val);
+            assert(res == KV_OK);
+        }
+    }
+
+    /* the compaction is completed by the sync, whenever it started */
+    res = kv_sync(set);
+    assert(res == KV_OK);
+    assert(wal_file_size(wal_path) < 10000 * 24);
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == 103);
+    for (size_t i = 0; i < 100; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        sprintf(val, "value-%zu-99", i);
+        res = kv_get(set, key, &value);
+        assert(res == KV_OK);
+        assert(strcmp(val, value) == 0);
+    }
+
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+
+    /* the slot is written right after the insert which finds the log due for compaction */
+    remove(wal_path);
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+    for (size_t i = 0; i < COMPACT_TEST_NUM; i++)
+    {
+        sprintf(key, "key-%zu", i);
+        res = kv_put(set, key, "value");
+        assert(res == KV_OK);
+    }
+    res = kv_clear(set);
+    assert(res == KV_OK);
+    res = kv_get_or_insert(set, "slot", "00000000", &slot);
+    assert(res == KV_TRUE);
+    memset(slot, 'a', 8);
+    res = kv_put(set, "after-slot", "value");
+    assert(res == KV_OK);
+    res = kv_sync(set);
+    assert(res == KV_OK);
+    assert(wal_file_size(wal_path) < 1000);
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+    res = kv_size(set, &size);
+    assert(res == KV_OK && size == 2);
+    res = kv_get(set, "slot", &value);
+    assert(res == KV_OK);
+    assert(strcmp(value, "aaaaaaaa") == 0);
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+
+    remove(wal_path);
+}
+
+static size_t cache_visit_num;
+
+void cache_scan_cb(void *arg, const void *key, size_t key_len, const void *value, size_t value_len)
+{
+    kv_set_t *set = (kv_set_t *)arg;
+
+    /* every pair visited is still in the cache */
+    assert(kv_contain_n(set, key, key_len) == KV_TRUE);
+    assert(value_len == strlen("cold value"));
+    cache_visit_num++;
+}
+
+void test_cache(const kv_conf_t *conf)
+{
+    kv_set_t *set;
+    kv_conf_t cache_conf;
+    kv_stats_t stats;
+    char key[32];
+    char big_value[512];
+    const char *value;
+    size_t size;
+    size_t used;
+    int res;
+
+    if (conf != NULL)
+    {
+        cache_conf = *conf;
+    }
+    else
+    {
+        memset(&cache_conf, 0, sizeof(kv_conf_t));
+        cache_conf.bucket_num = 16;
+    }
+    cache_conf.cache_bytes = 8192;
+
+    /* the buckets of a cache can't be carved from the arena */
+    cache_conf.arena_size = 4096;
+    res = kv_create(&set, &cache_conf);
+    assert(res == KV_ERR_BAD_CONF);
+    cache_conf.arena_size = 0;
+
+    res = kv_create(&set, &cache_conf);
+    assert(res == KV_OK);
+
+    /* the hot key is got after every put, so the hand always spares it */
+    res = kv_put(set, "hot", "hot value");
+    assert(res == KV_OK);
+    for (int i = 0; i < 2000; i++)
+    {
+        sprintf(key, "cold:%04d", i);
+        res = kv_put(set, key, "cold value");
+        assert(res == KV_OK);
+        res = kv_get(set, "hot", &value);
+        assert(res == KV_OK);
+        assert(strcmp(value, "hot value") == 0);
+
+        res = kv_stats(set, &stats);
+        assert(res == KV_OK);
+        assert(stats.cache_used <= cache_conf.cache_bytes);
+    }
+
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(size > 100 && size < 2001);
+    assert(stats.cache_evictions == 2001 - size);
+    assert(stats.cache_hits == 2000);
+    assert(stats.cache_misses == 0);
+
+    /* the latest key always survives, the first ones are long gone */
+    res = kv_get(set, "cold:1999", &value);
+    assert(res == KV_OK);
+    res = kv_get(set, "cold:0000", &value);
+    assert(res == KV_ERR_KEY_NOT_FOUND);
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.cache_hits == 2001);
+    assert(stats.cache_misses == 1);
+
+    /* the evicted pairs are gone from the ordered index too */
+    cache_visit_num = 0;
+    res = kv_scan_prefix(set, "cold:", 5, cache_scan_cb, set);
+    if (res == KV_OK)
+    {
+        assert(cache_visit_num == size - 1);
+    }
+
+    /* a larger value is charged to the budget, and evicts more pairs */
+    memset(big_value, 'v', sizeof(big_value) - 1);
+    big_value[sizeof(big_value) - 1] = '\0';
+    res = kv_put(set, "hot", big_value);
+    assert(res == KV_OK);
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.cache_used <= cache_conf.cache_bytes);
+    assert(stats.cache_evictions > 2001 - size);
+    res = kv_get(set, "hot", &value);
+    assert(res == KV_OK);
+    assert(strcmp(value, big_value) == 0);
+
+    /* a pair larger than the whole budget stays alone */
+    for (int i = 0; i < 20; i++)
+    {
+        sprintf(key, "big:%02d", i);
+        res = kv_put(set, key, big_value);
+        assert(res == KV_OK);
+    }
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(size <= cache_conf.cache_bytes / sizeof(big_value));
+
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    used = stats.cache_used;
+    res = kv_del(set, "big:19");
+    assert(res == KV_OK);
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.cache_used < used);
+
+    res = kv_clear(set);
+    assert(res == KV_OK);
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.cache_used == 0);
+
+    res = kv_put(set, "hot", "hot value");
+    assert(res == KV_OK);
+    res = kv_get(set, "hot", &value);
+    assert(res == KV_OK);
+
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+}
+
+static uint64_t ttl_now;
+
+uint64_t ttl_clock(void)
+{
+    return ttl_now;
+}
+
+static size_t ttl_visit_num;
+
+void ttl_foreach_cb(void *arg, const char *key, const char *value)
+{
+    /* only the pairs which never expire are left */
+    assert(strncmp(key, "forever:", 8) == 0);
+    ttl_visit_num++;
+}
+
+void test_ttl(const kv_conf_t *conf)
+{
+    kv_set_t *set;
+    kv_conf_t ttl_conf;
+    uint64_t deadlines[3000];
+    uint64_t seed;
+    size_t alive_num;
+    char key[32];
+    char big_value[256];
+    const char *value;
+    size_t size;
+    int res;
+
+    if (conf != NULL)
+    {
+        ttl_conf = *conf;
+    }
+    else
+    {
+        memset(&ttl_conf, 0, sizeof(kv_conf_t));
+        ttl_conf.bucket_num = 16;
+    }
+    ttl_conf.clock_cb = ttl_clock;
+    ttl_now = 1000;
+
+    /* the pairs of a plain set can't expire */
+    res = kv_create(&set, &ttl_conf);
+    assert(res == KV_OK);
+    res = kv_put_ttl(set, "key", "value", 100);
+    assert(res == KV_ERR_BAD_CONF);
+    res = kv_expire(set, SIZE_MAX);
+    assert(res == KV_ERR_BAD_CONF);
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+
+    /* the deadlines aren't logged */
+    ttl_conf.ttl = KV_TRUE;
+    ttl_conf.wal_path = "test.kvwal";
+    res = kv_create(&set, &ttl_conf);
+    assert(res == KV_ERR_BAD_CONF);
+    ttl_conf.wal_path = NULL;
+
+    res = kv_create(&set, &ttl_conf);
+    assert(res == KV_OK);
+    res = kv_put_ttl(set, "key", "value", 0);
+    assert(res == KV_ERR_BAD_ARG);
+
+    /* an expired pair is gone at once, even before the wheel reaches it */
+    res = kv_put_ttl(set, "short", "value", 100);
+    assert(res == KV_OK);
+    res = kv_put(set, "forever:0", "value");
+    assert(res == KV_OK);
+    ttl_now += 99;
+    res = kv_get(set, "short", &value);
+    assert(res == KV_OK);
+    ttl_now += 1;
+    res = kv_contain(set, "short");
+    assert(res == KV_FALSE);
+    res = kv_del(set, "short");
+    assert(res == KV_ERR_KEY_NOT_FOUND);
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == 1);
+
+    /* kv_put() lets the pair live forever, kv_put_ttl() sets a new deadline */
+    memset(big_value, 'v', sizeof(big_value) - 1);
+    big_value[sizeof(big_value) - 1] = '\0';
+    res = kv_put_ttl(set, "forever:1", "value", 10);
+    assert(res == KV_OK);
+    res = kv_put(set, "forever:1", big_value);
+    assert(res == KV_OK);
+    res = kv_put_ttl(set, "renewed", "value", 10);
+    assert(res == KV_OK);
+    res = kv_put_ttl(set, "renewed", big_value, 1000);
+    assert(res == KV_OK);
+    res = kv_put_ttl(set, "deleted", "value", 10);
+    assert(res == KV_OK);
+    res = kv_del(set, "deleted");
+    assert(res == KV_OK);
+    ttl_now += 500;
+    res = kv_expire(set, SIZE_MAX);
+    assert(res == KV_OK);
+    res = kv_get(set, "forever:1", &value);
+    assert(res == KV_OK);
+    assert(strcmp(value, big_value) == 0);
+    res = kv_get(set, "renewed", &value);
+    assert(res == KV_OK);
+    ttl_now += 500;
+    res = kv_get(set, "renewed", &value);
+    assert(res == KV_ERR_KEY_NOT_FOUND);
+
+    /* the deadlines spread over all the levels of the wheel and beyond */
+    seed = 1;
+    for (int i = 0; i < 3000; i++)
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        deadlines[i] = (seed >> 33) % (1ULL << (i % 27)) + 1;
+        sprintf(key, "ttl:%d", i);
+        res = kv_put_ttl(set, key, "value", deadlines[i]);
+        assert(res == KV_OK);
+        deadlines[i] += ttl_now;
+    }
+
+    /* the budget bounds the pairs reclaimed at a time */
+    ttl_now += 4;
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    res = kv_expire(set, 1);
+    assert(res == KV_OK);
+    res = kv_size(set, &alive_num);
+    assert(res == KV_OK);
+    assert(alive_num == size - 1);
+
+    /* the wheel reclaims exactly the pairs expired, whatever the steps are */
+    while (ttl_now < deadlines[0] + (1ULL << 28))
+    {
+        ttl_now += (ttl_now % 7 + 1) * (ttl_now % 1000 < 500 ? 3 : ttl_now / 64);
+        res = kv_expire(set, SIZE_MAX);
+        assert(res == KV_OK);
+
+        alive_num = 2;
+        for (int i = 0; i < 3000; i++)
+        {
+            alive_num += deadlines[i] > ttl_now ? 1 : 0;
+        }
+        res = kv_size(set, &size);
+        assert(res == KV_OK);
+        assert(size == alive_num);
+    }
+
+    /* a long idle gap is crossed from one occupied slot to the next */
+    res = kv_put_ttl(set, "ttl:near", "value", 1ULL << 20);
+    assert(res == KV_OK);
+    res = kv_put_ttl(set, "ttl:far", "value", 1ULL << 40);
+    assert(res == KV_OK);
+    ttl_now += 1ULL << 39;
+    res = kv_expire(set, SIZE_MAX);
+    assert(res == KV_OK);
+    assert(kv_contain(set, "ttl:near") == KV_FALSE);
+    assert(kv_contain(set, "ttl:far") == KV_TRUE);
+    ttl_now += 1ULL << 39;
+    res = kv_expire(set, SIZE_MAX);
+    assert(res == KV_OK);
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == 2);
+
+    ttl_visit_num = 0;
+    res = kv_foreach(set, ttl_foreach_cb, NULL);
+    assert(res == KV_OK);
+    assert(ttl_visit_num == 2);
+
+    /* the pairs expire during other operations too */
+    for (int i = 0; i < 100; i++)
+    {
+        sprintf(key, "ttl:%d", i);
+        res = kv_put_ttl_n(set, key, strlen(key), "value", 5, 10);
+        assert(res == KV_OK);
+    }
+    ttl_now += 10;
+    for (int i = 0; i < 20; i++)
+    {
+        res = kv_put(set, "forever:2", "value");
+        assert(res == KV_OK);
+    }
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == 3);
+
+    for (int i = 0; i < 100; i++)
+    {
+        sprintf(key, "ttl:%d", i);
+        res = kv_put_ttl(set, key, "value", 10);
+        assert(res == KV_OK);
+    }
+    res = kv_clear(set);
+    assert(res == KV_OK);
+    ttl_now += 10;
+    res = kv_expire(set, SIZE_MAX);
+    assert(res == KV_OK);
+    res = kv_put_ttl(set, "short", "value", 10);
+    assert(res == KV_OK);
+
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+}
+
+static size_t compact_visit_num;
+
+void compact_order_cb(void *arg, const char *key, const char *value)
+{
+    int *order = (int *)arg;
+    int i;
+
+    /* the pairs are visited in the order they were first put */
+    assert(sscanf(key, "key:%d", &i) == 1);
+    assert(i == order[compact_visit_num]);
+    compact_visit_num++;
+}
+
+void test_compact(void)
+{
+    kv_set_t *set;
+    kv_conf_t conf;
+    kv_stats_t stats;
+    int order[2000];
+    size_t order_num;
+    size_t bucket_num;
+    char key[32];
+    const char *value;
+    int res;
+
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.engine = KV_ENGINE_COMPACT;
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+
+    /* the keys are put in a scrambled order */
+    order_num = 0;
+    for (int i = 0; i < 2000; i++)
+    {
+        order[order_num] = (int)((i * 7919) % 2000);
+        sprintf(key, "key:%d", order[order_num]);
+        res = kv_put(set, key, "value");
+        assert(res == KV_OK);
+        order_num++;
+    }
+    compact_visit_num = 0;
+    res = kv_foreach(set, compact_order_cb, order);
+    assert(res == KV_OK);
+    assert(compact_visit_num == 2000);
+
+    /* overwriting keeps the position, deleting and putting again moves to the end */
+    res = kv_put(set, "key:0", "another value");
+    assert(res == KV_OK);
+    for (size_t i = 0; i < 1000; i++)
+    {
+        sprintf(key, "key:%d", order[i]);
+        res = kv_del(set, key);
+        assert(res == KV_OK);
+    }
+    memmove(order, order + 1000, 1000 * sizeof(int));
+    order_num = 1000;
+    for (int i = 0; i < 500; i++)
+    {
+        order[order_num] = (int)((i * 7919) % 2000);
+        sprintf(key, "key:%d", order[order_num]);
+        res = kv_put(set, key, "value");
+        assert(res == KV_OK);
+        order_num++;
+    }
+    compact_visit_num = 0;
+    res = kv_foreach(set, compact_order_cb, order);
+    assert(res == KV_OK);
+    assert(compact_visit_num == 1500);
+    for (size_t i = 0; i < order_num; i++)
+    {
+        sprintf(key, "key:%d", order[i]);
+        res = kv_get(set, key, &value);
+        assert(res == KV_OK);
+        assert(strcmp(value, order[i] == 0 && i < 1000 ? "another value" : "value") == 0);
+    }
+
+    /* churning through a few keys squeezes the tombstones instead of growing on */
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    bucket_num = stats.bucket_num;
+    for (int i = 0; i < 100000; i++)
+    {
+        sprintf(key, "churn:%d", i);
+        res = kv_put(set, key, "value");
+        assert(res == KV_OK);
+        res = kv_del(set, key);
+        assert(res == KV_OK);
+    }
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.bucket_num <= bucket_num * 2);
+    assert(stats.pair_num == 1500);
+    compact_visit_num = 0;
+    res = kv_foreach(set, compact_order_cb, order);
+    assert(res == KV_OK);
+    assert(compact_visit_num == 1500);
+
+    res = kv_clear(set);
+    assert(res == KV_OK);
+    compact_visit_num = 0;
+    res = kv_foreach(set, compact_order_cb, order);
+    assert(res == KV_OK);
+    assert(compact_visit_num == 0);
+
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+}
+
+void test_stats(const kv_conf_t *conf)
+{
+    kv_set_t *set;
+    kv_stats_t stats;
+    char key[32];
+    const char *value;
+    size_t hist_num;
+    size_t length_sum;
+    size_t memory_bytes;
+    int res;
+
+    res = kv_create(&set, conf);
+    assert(res == KV_OK);
+
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.load_factor == 0);
+    assert(stats.longest_chain <= 1);
+    assert(stats.memory_bytes > 0);
+    memory_bytes = stats.memory_bytes;
+
+    for (int i = 0; i < 1000; i++)
+    {
+        sprintf(key, "key:%04d", i);
+        res = kv_put(set, key, "value");
+        assert(res == KV_OK);
+    }
+    for (int i = 0; i < 1500; i++)
+    {
+        sprintf(key, "key:%04d", i);
+        res = kv_get(set, key, &value);
+        assert(res == (i < 1000 ? KV_OK : KV_ERR_KEY_NOT_FOUND));
+    }
+    res = kv_contain(set, "key:0000");
+    assert(res == KV_TRUE);
+
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.pair_num == 1000);
+    assert(stats.load_factor == stats.pair_num * 100 / stats.bucket_num);
+    assert(stats.memory_bytes > memory_bytes + 1000 * (sizeof(kv_bucket_t) + 8));
+
+    /* every pair is counted once, by the chain it's on or by its probe length */
+    hist_num = 0;
+    length_sum = 0;
+    for (int i = 0; i < KV_STATS_HIST_NUM; i++)
+    {
+        hist_num += stats.chain_hist[i];
+        length_sum += i * stats.chain_hist[i];
+        if (stats.chain_hist[i] != 0)
+        {
+            assert((size_t)i <= stats.longest_chain);
+        }
+    }
+    assert(stats.longest_chain >= 1);
+    if (conf == NULL || conf->engine == KV_ENGINE_CHAIN)
+    {
+        assert(stats.longest_chain >= KV_STATS_HIST_NUM || length_sum == 1000);
+        assert(hist_num >= stats.bucket_num);
+    }
+    else
+    {
+        assert(hist_num == 1000);
+        assert(stats.chain_hist[0] == 0);
+    }
+
+#ifndef KV_STATS_DISABLE
+    assert(stats.lookups == 1501);
+    assert(stats.hits == 1001);
+    assert(stats.misses == 500);
+    if (conf == NULL || conf->engine != KV_ENGINE_ART)
+    {
+        assert(stats.rehashes > 0);
+    }
+#endif
+
+    kv_destroy(set);
+}
+
+/* buffer of the value made by the upsert callbacks */
+static char upsert_buf[64];
+
+static const char *upsert_count_cb(void *arg, const char *value)
+{
+    int *calls = (int *)arg;
+
+    (*calls)++;
+    sprintf(upsert_buf, "%d", value != NULL ? atoi(value) + 1 : 1);
+
+    return upsert_buf;
+}
+
+static const char *upsert_skip_cb(void *arg, const char *value)
+{
+    return NULL;
+}
+
+static const void *upsert_append_cb(void *arg, const void *value, size_t value_len, size_t *new_len)
+{
+    /* the new value is the old one, longer by one byte, read from the old bucket */
+    memcpy(upsert_buf, value, value_len);
+    upsert_buf[value_len] = 'x';
+    *new_len = value_len + 1;
+
+    return upsert_buf;
+}
+
+static const void *upsert_same_cb(void *arg, const void *value, size_t value_len, size_t *new_len)
+{
+    *new_len = value_len;
+
+    return value;
+}
+
+void test_upsert(const kv_conf_t *conf)
+{
+    kv_set_t *set;
+    char key[32];
+    const char *value;
+    const void *value_n;
+    char *slot;
+    void *slot_n;
+    size_t value_len;
+    size_t size;
+    int calls;
+    int res;
+
+    res = kv_create(&set, conf);
+    assert(res == KV_OK);
+
+    res = kv_upsert(NULL, "key", upsert_count_cb, &calls);
+    assert(res == KV_ERR_BAD_ARG);
+    res = kv_upsert(set, "key", NULL, &calls);
+    assert(res == KV_ERR_BAD_ARG);
+    res = kv_get_or_insert(set, "key", "value", NULL);
+    assert(res == KV_ERR_BAD_ARG);
+
+    /* count every key 1 + i % 5 times */
+    calls = 0;
+    for (int i = 0; i < 500; i++)
+    {
+        for (int j = 0; j <= i % 5; j++)
+        {
+            sprintf(key, "counter:%d", i);
+            res = kv_upsert(set, key, upsert_count_cb, &calls);
+            assert(res == KV_OK);
+        }
+    }
+    assert(calls == 1500);
+    for (int i = 0; i < 500; i++)
+    {
+        sprintf(key, "counter:%d", i);
+        res = kv_get(set, key, &value);
+        assert(res == KV_OK);
+        assert(atoi(value) == 1 + i % 5);
+    }
+
+    /* a NULL value leaves the set as it is */
+    res = kv_upsert(set, "counter:0", upsert_skip_cb, NULL);
+    assert(res == KV_OK);
+    res = kv_upsert(set, "missing", upsert_skip_cb, NULL);
+    assert(res == KV_OK);
+    res = kv_contain(set, "missing");
+    assert(res == KV_FALSE);
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == 500);
+
+    /* the new value may be read from the old bucket, or be the old value */
+    res = kv_put_n(set, "grow", 4, "", 0);
+    assert(res == KV_OK);
+    for (int i = 0; i < 40; i++)
+    {
+        res = kv_upsert_n(set, "grow", 4, upsert_append_cb, NULL);
+        assert(res == KV_OK);
+        res = kv_upsert_n(set, "grow", 4, upsert_same_cb, NULL);
+        assert(res == KV_OK);
+    }
+    res = kv_get_n(set, "grow", 4, &value_n, &value_len);
+    assert(res == KV_OK);
+    assert(value_len == 40);
+    for (int i = 0; i < 40; i++)
+    {
+        assert(((const char *)value_n)[i] == 'x');
+    }
+
+    /* the slot is inserted once, and written in place */
+    res = kv_get_or_insert(set, "slot", "0000", &slot);
+    assert(res == KV_TRUE);
+    assert(strcmp(slot, "0000") == 0);
+    slot[0] = '1';
+    res = kv_get_or_insert(set, "slot", "ignored", &slot);
+    assert(res == KV_FALSE);
+    assert(strcmp(slot, "1000") == 0);
+    res = kv_get(set, "slot", &value);
+    assert(res == KV_OK);
+    assert(strcmp(value, "1000") == 0);
+
+    res = kv_get_or_insert_n(set, "slot\0n", 6, "\0\1", 2, &slot_n, &value_len);
+    assert(res == KV_TRUE);
+    assert(value_len == 2 && memcmp(slot_n, "\0\1", 2) == 0);
+    ((char *)slot_n)[1] = 2;
+    res = kv_get_or_insert_n(set, "slot\0n", 6, "", 0, &slot_n, &value_len);
+    assert(res == KV_FALSE);
+    assert(value_len == 2 && memcmp(slot_n, "\0\2", 2) == 0);
+
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == 503);
+
+    kv_destroy(set);
+}
+
+void test_pool(const kv_conf_t *conf)
+{
+    kv_set_t *set;
+    kv_conf_t pool_conf;
+    kv_stats_t stats;
+    char key[32];
+    char big_value[256];
+    const char *value;
+    size_t memory_bytes;
+    size_t size;
+    int res;
+
+    if (conf != NULL)
+    {
+        pool_conf = *conf;
+    }
+    else
+    {
+        memset(&pool_conf, 0, sizeof(kv_conf_t));
+        pool_conf.bucket_num = 16;
+    }
+    pool_conf.pool = KV_TRUE;
+
+    /* the pool can't be used along with the arena */
+    pool_conf.arena_size = 4096;
+    res = kv_create(&set, &pool_conf);
+    assert(res == KV_ERR_BAD_CONF);
+    pool_conf.arena_size = 0;
+
+    res = kv_create(&set, &pool_conf);
+    assert(res == KV_OK);
+
+    /* short pairs of a few size classes, and long ones which aren't pooled */
+    memset(big_value, 'x', sizeof(big_value) - 1);
+    big_value[sizeof(big_value) - 1] = '\0';
+    for (int i = 0; i < 3000; i++)
+    {
+        sprintf(key, "key:%d", i);
+        res = kv_put(set, key, i % 10 == 0 ? big_value : big_value + sizeof(big_value) - 1 - i % 20);
+        assert(res == KV_OK);
+    }
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    memory_bytes = stats.memory_bytes;
+
+    /* the freed buckets are reused by the buckets of the same sizes */
+    for (int i = 0; i < 3000; i++)
+    {
+        sprintf(key, "key:%d", i);
+        res = kv_del(set, key);
+        assert(res == KV_OK);
+    }
+    for (int i = 0; i < 3000; i++)
+    {
+        sprintf(key, "yek:%d", i);
+        res = kv_put(set, key, i % 10 == 0 ? big_value : big_value + sizeof(big_value) - 1 - i % 20);
+        assert(res == KV_OK);
+    }
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.memory_bytes == memory_bytes);
+
+    /* a value growing out of its size class moves to another one */
+    for (int i = 0; i < 3000; i++)
+    {
+        sprintf(key, "yek:%d", i);
+        res = kv_get(set, key, &value);
+        assert(res == KV_OK);
+        assert(strcmp(value, i % 10 == 0 ? big_value : big_value + sizeof(big_value) - 1 - i % 20) == 0);
+        res = kv_put(set, key, big_value + sizeof(big_value) - 41);
+        assert(res == KV_OK);
+    }
+    for (int i = 0; i < 3000; i++)
+    {
+        sprintf(key, "yek:%d", i);
+        res = kv_get(set, key, &value);
+        assert(res == KV_OK);
+        assert(strlen(value) == 40);
+    }
+
+    res = kv_clear(set);
+    assert(res == KV_OK);
+    res = kv_size(set, &size);
+    assert(res == KV_OK);
+    assert(size == 0);
+    res = kv_put(set, "key", "value");
+    assert(res == KV_OK);
+    res = kv_get(set, "key", &value);
+    assert(res == KV_OK);
+    assert(strcmp(value, "value") == 0);
+
+    res = kv_destroy(set);
+    assert(res == KV_OK);
+}
+
+void test_bloom(const kv_conf_t *conf)
+{
+    kv_set_t *set;
+    kv_conf_t bloom_conf;
+    kv_stats_t stats;
+    char key[32];
+    const char *value;
+    const char *batch_keys[4];
+    const char *batch_values[4];
+    size_t memory_bytes;
+    int res;
+
+    if (conf != NULL)
+    {
+        bloom_conf = *conf;
+    }
+    else
+    {
+        memset(&bloom_conf, 0, sizeof(kv_conf_t));
+        bloom_conf.bucket_num = 16;
+    }
+
+    res = kv_create(&set, &bloom_conf);
+    assert(res == KV_OK);
+    res = kv_rebuild_bloom(set);
+    assert(res == KV_ERR_BAD_CONF);
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    memory_bytes = stats.memory_bytes;
+    kv_destroy(set);
+
+    bloom_conf.bloom_fpp = 1;
+    res = kv_create(&set, &bloom_conf);
+    assert(res == KV_ERR_BAD_CONF);
+    bloom_conf.bloom_fpp = -0.01;
+    res = kv_create(&set, &bloom_conf);
+    assert(res == KV_ERR_BAD_CONF);
+
+    bloom_conf.bloom_fpp = 0.01;
+    res = kv_create(&set, &bloom_conf);
+    assert(res == KV_OK);
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.memory_bytes > memory_bytes);
+
+    /* no key put is ever turned away, while the filter grows */
+    for (int i = 0; i < 20000; i++)
+    {
+        sprintf(key, "key:%d", i);
+        res = kv_put(set, key, "value");
+        assert(res == KV_OK);
+        if (i % 97 == 0)
+        {
+            for (int j = 0; j <= i; j += 13)
+            {
+                sprintf(key, "key:%d", j);
+                res = kv_contain(set, key);
+                assert(res == KV_TRUE);
+            }
+        }
+    }
+    for (int i = 0; i < 40000; i++)
+    {
+        sprintf(key, "key:%d", i);
+        res = kv_get(set, key, &value);
+        assert(res == (i < 20000 ? KV_OK : KV_ERR_KEY_NOT_FOUND));
+    }
+    batch_keys[0] = "key:1";
+    batch_keys[1] = "key:20001";
+    batch_keys[2] = "key:19999";
+    batch_keys[3] = "";
+    res = kv_get_batch(set, batch_keys, 4, batch_values);
+    assert(res == KV_OK);
+    assert(batch_values[0] != NULL && batch_values[1] == NULL);
+    assert(batch_values[2] != NULL && batch_values[3] == NULL);
+
+    /* the filter is rebuilt by the deletes, and still holds the others */
+    for (int i = 0; i < 20000; i++)
+    {
+        if (i % 10 != 0)
+        {
+            sprintf(key, "key:%d", i);
+            res = kv_del(set, key);
+            assert(res == KV_OK);
+        }
+    }
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    memory_bytes = stats.memory_bytes;
+    res = kv_rebuild_bloom(set);
+    assert(res == KV_OK);
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    assert(stats.memory_bytes <= memory_bytes);
+    for (int i = 0; i < 20000; i++)
+    {
+        sprintf(key, "key:%d", i);
+        res = kv_contain(set, key);
+        assert(res == (i % 10 == 0 ? KV_TRUE : KV_FALSE));
+    }
+
+    res = kv_clear(set);
+    assert(res == KV_OK);
+    res = kv_contain(set, "key:0");
+    assert(res == KV_FALSE);
+    res = kv_put(set, "key:0", "value");
+    assert(res == KV_OK);
+    res = kv_contain(set, "key:0");
+    assert(res == KV_TRUE);
+
+    kv_destroy(set);
+}
+
+/* number of pairs of the clone test */
+#define CLONE_PAIR_NUM      20000
+
+/* check that every key of the set maps to the value of its round, or is missing if the round is negative */
+static void clone_check(kv_set_t *set, const int *rounds, size_t pair_num)
+{
+    char key[32];
+    char expected[32];
+    const char *value;
+    size_t size;
+    size_t found_num;
+    int res;
+
+    found_num = 0;
+    for (size_t i = 0; i < pair_num; i++)
+    {
+        sprintf(key, "clone-%zu", i);
+        res = kv_get(set, key, &value);
+        if (rounds[i] < 0)
+        {
+            assert(res == KV_ERR_KEY_NOT_FOUND);
+            continue;
+        }
+        assert(res == KV_OK);
+        sprintf(expected, "%zu-%d", i, rounds[i]);
+        assert(strcmp(value, expected) == 0);
+        found_num++;
+    }
+    res = kv_size(set, &size);
+    assert(res == KV_OK && size == found_num);
+}
+
+static void clone_count_cb(void *arg, const char *key, const char *value)
+{
+    (*(size_t *)arg)++;
+}
+
+static void *clone_writer_main(void *arg)
+{
+    kv_set_t *set = (kv_set_t *)arg;
+    char key[32];
+    char value[32];
+    int res;
+
+    for (size_t i = 0; i < CLONE_PAIR_NUM * 2; i++)
+    {
+        sprintf(key, "clone-%zu", i);
+        sprintf(value, "%zu-9", i);
+        res = kv_put(set, key, value);
+        assert(res == KV_OK);
+    }
+
+    return NULL;
+}
+
+void test_clone(void)
+{
+    kv_set_t *set;
+    kv_set_t *clone;
+    kv_set_t *clone_2;
+    kv_conf_t conf;
+    int *set_rounds;
+    int *clone_rounds;
+    int *clone_2_rounds;
+    char key[32];
+    char value[32];
+    char *slot;
+    pthread_t writer;
+    kv_stats_t stats;
+    size_t bucket_num;
+    size_t size;
+    size_t count;
+    int res;
+
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+
+    /* only the chains of the default engine can be shared */
+    conf.engine = KV_ENGINE_FLAT;
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+    res = kv_clone(set, &clone);
+    assert(res == KV_ERR_BAD_CONF);
+    kv_destroy(set);
+    conf.engine = KV_ENGINE_CHAIN;
+    conf.ttl = KV_TRUE;
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+    res = kv_clone(set, &clone);
+    assert(res == KV_ERR_BAD_CONF);
+    kv_destroy(set);
+    conf.ttl = KV_FALSE;
+
+    res = kv_create(&set, &conf);
+    assert(res == KV_OK);
+    res = kv_clone(NULL, &clone);
+    assert(res == KV_ERR_BAD_ARG);
+    res = kv_clone(set, NULL);
+    assert(res == KV_ERR_BAD_ARG);
+
+    set_rounds = (int *)malloc(CLONE_PAIR_NUM * 2 * sizeof(int));
+    clone_rounds = (int *)malloc(CLONE_PAIR_NUM * 2 * sizeof(int));
+    clone_2_rounds = (int *)malloc(CLONE_PAIR_NUM * 2 * sizeof(int));
+    assert(set_rounds != NULL && clone_rounds != NULL && clone_2_rounds != NULL);
+
+    /* the set is cloned in the middle of rehashing */
+    for (size_t i = 0; i < CLONE_PAIR_NUM; i++)
+    {
+        sprintf(key, "clone-%zu", i);
+        sprintf(value, "%zu-0", i);
+        res = kv_put(set, key, value);
+        assert(res == KV_OK);
+        set_rounds[i] = 0;
+    }
+    for (size_t i = CLONE_PAIR_NUM; i < CLONE_PAIR_NUM * 2; i++)
+    {
+        set_rounds[i] = -1;
+    }
+    res = kv_clone(set, &clone);
+    assert(res == KV_OK);
+    memcpy(clone_rounds, set_rounds, CLONE_PAIR_NUM * 2 * sizeof(int));
+
+    /* overwrite, delete and add pairs on the set, enough to grow it */
+    for (size_t i = 0; i < CLONE_PAIR_NUM * 2; i++)
+    {
+        sprintf(key, "clone-%zu", i);
+        if (i % 3 == 0)
+        {
+            res = kv_del(set, key);
+            assert(res == (i < CLONE_PAIR_NUM ? KV_OK : KV_ERR_KEY_NOT_FOUND));
+            set_rounds[i] = -1;
+            continue;
+        }
+        sprintf(value, "%zu-1", i);
+        res = kv_put(set, key, value);
+        assert(res == KV_OK);
+        set_rounds[i] = 1;
+    }
+    clone_check(set, set_rounds, CLONE_PAIR_NUM * 2);
+    clone_check(clone, clone_rounds, CLONE_PAIR_NUM * 2);
+    res = kv_size(clone, &size);
+    assert(res == KV_OK && size == CLONE_PAIR_NUM);
+
+    /* a clone of the clone, then both of them are modified */
+    res = kv_clone(clone, &clone_2);
+    assert(res == KV_OK);
+    memcpy(clone_2_rounds, clone_rounds, CLONE_PAIR_NUM * 2 * sizeof(int));
+    for (size_t i = 0; i < CLONE_PAIR_NUM; i += 2)
+    {
+        sprintf(key, "clone-%zu", i);
+        sprintf(value, "%zu-2", i);
+        res = kv_put(clone, key, value);
+        assert(res == KV_OK);
+        clone_rounds[i] = 2;
+    }
+    for (size_t i = 1; i < CLONE_PAIR_NUM; i += 2)
+    {
+        sprintf(key, "clone-%zu", i);
+        res = kv_get_or_insert(clone_2, key, "unused", &slot);
+        assert(res == KV_FALSE);
+        slot[strlen(slot) - 1] = '3';
+        clone_2_rounds[i] = 3;
+    }
+    clone_check(set, set_rounds, CLONE_PAIR_NUM * 2);
+    clone_check(clone, clone_rounds, CLONE_PAIR_NUM * 2);
+    clone_check(clone_2, clone_2_rounds, CLONE_PAIR_NUM * 2);
+
+    /* the clone in the middle goes first, the others still see their pairs */
+    kv_destroy(clone);
+    clone_check(clone_2, clone_2_rounds, CLONE_PAIR_NUM * 2);
+    res = kv_clear(clone_2);
+    assert(res == KV_OK);
+    res = kv_size(clone_2, &size);
+    assert(res == KV_OK && size == 0);
+    res = kv_put(clone_2, "clone-0", "0-4");
+    assert(res == KV_OK);
+    kv_destroy(clone_2);
+    clone_check(set, set_rounds, CLONE_PAIR_NUM * 2);
+
+    /* a writer keeps modifying the set while the clone is read */
+    res = kv_clone(set, &clone);
+    assert(res == KV_OK);
+    res = pthread_create(&writer, NULL, clone_writer_main, set);
+    assert(res == 0);
+    clone_check(clone, set_rounds, CLONE_PAIR_NUM * 2);
+    count = 0;
+    res = kv_foreach(clone, clone_count_cb, &count);
+    assert(res == KV_OK);
+    res = kv_size(clone, &size);
+    assert(res == KV_OK && count == size);
+    kv_destroy(clone);
+    res = pthread_join(writer, NULL);
+    assert(res == 0);
+    for (size_t i = 0; i < CLONE_PAIR_NUM * 2; i++)
+    {
+        set_rounds[i] = 9;
+    }
+    clone_check(set, set_rounds, CLONE_PAIR_NUM * 2);
+
+    /* a cleared clone keeps the size of its table */
+    res = kv_clone(set, &clone);
+    assert(res == KV_OK);
+    res = kv_stats(set, &stats);
+    assert(res == KV_OK);
+    bucket_num = stats.bucket_num;
+    res = kv_clear(clone);
+    assert(res == KV_OK);
+    res = kv_stats(clone, &stats);
+    assert(res == KV_OK && stats.bucket_num == bucket_num);
+    kv_destroy(clone);
+
+    /* the set stops sharing once the clones are gone, and shares again with a new one */
+    for (size_t round = 10; round < 12; round++)
+    {
+        for (size_t i = 0; i < CLONE_PAIR_NUM * 2; i++)
+        {
+            sprintf(key, "clone-%zu", i);
+            sprintf(value, "%zu-%zu", i, round);
+            res = kv_put(set, key, value);
+            assert(res == KV_OK);
+            set_rounds[i] = (int)round;
+        }
+        res = kv_clone(set, &clone);
+        assert(res == KV_OK);
+        memcpy(clone_rounds, set_rounds, CLONE_PAIR_NUM * 2 * sizeof(int));
+        for (size_t i = 0; i < CLONE_PAIR_NUM * 2; i += 3)
+        {
+            sprintf(key, "clone-%zu", i);
+            res = kv_del(set, key);
+            assert(res == KV_OK);
+            set_rounds[i] = -1;
+        }
+        clone_check(set, set_rounds, CLONE_PAIR_NUM * 2);
+        clone_check(clone, clone_rounds, CLONE_PAIR_NUM * 2);
+        kv_destroy(clone);
+    }
+
+    free(set_rounds);
+    free(clone_rounds);
+    free(clone_2_rounds);
+    kv_destroy(set);
+}
+
+/* equality of the string keys */
+#define map_str_equal(a, b)     (strcmp((a), (b)) == 0)
+
+static uint32_t map_str_hash(const char *key)
+{
+    uint32_t hash = 2166136261U;
+
+    while (*key != '\0')
+    {
+        hash = (hash ^ (uint8_t)*key++) * 16777619U;
+    }
+
+    return kv_map_hash_u32(hash);
+}
+
+KV_MAP_INIT(u64, uint64_t, uint64_t, kv_map_hash_u64, kv_map_equal)
+KV_MAP_INIT(str, const char *, int, map_str_hash, map_str_equal)
+
+static uint64_t map_visit_sum;
+
+static void map_visit_cb(void *arg, uint64_t key, uint64_t *value)
+{
+    assert(*value == key * 3);
+    map_visit_sum += key;
+    *value = key;
+}
+
+void test_map(void)
+{
+    kv_map_u64_t *map;
+    kv_map_str_t *str_map;
+    uint64_t value;
+    int str_value;
+    size_t size;
+    int res;
+
+    res = kv_map_u64_create(NULL, 0);
+    assert(res == KV_ERR_BAD_ARG);
+    res = kv_map_u64_create(&map, 0);
+    assert(res == KV_OK);
+
+    /* grow from the smallest table */
+    for (uint64_t i = 0; i < 100000; i++)
+    {
+        res = kv_map_u64_put(map, i * 7, i);
+        assert(res == KV_OK);
+    }
+    res = kv_map_u64_size(map, &size);
+    assert(res == KV_OK && size == 100000);
+    for (uint64_t i = 0; i < 100000; i++)
+    {
+        res = kv_map_u64_get(map, i * 7, &value);
+        assert(res == KV_OK && value == i);
+        res = kv_map_u64_contain(map, i * 7 + 1);
+        assert(res == KV_FALSE);
+    }
+    res = kv_map_u64_get(map, 1, &value);
+    assert(res == KV_ERR_KEY_NOT_FOUND);
+
+    /* overwrite */
+    for (uint64_t i = 0; i < 100000; i++)
+    {
+        res = kv_map_u64_put(map, i * 7, i * 21);
+        assert(res == KV_OK);
+    }
+    res = kv_map_u64_size(map, &size);
+    assert(res == KV_OK && size == 100000);
+
+    map_visit_sum = 0;
+    res = kv_map_u64_foreach(map, map_visit_cb, NULL);
+    assert(res == KV_OK);
+    assert(map_visit_sum == 7ULL * 99999 * 100000 / 2);
+    res = kv_map_u64_get(map, 70, &value);
+    assert(res == KV_OK && value == 70);
+
+    /* delete half of the keys, and churn the other keys through the freed slots */
+    for (uint64_t i = 0; i < 100000; i += 2)
+    {
+        res = kv_map_u64_del(map, i * 7);
+        assert(res == KV_OK);
+    }
+    res = kv_map_u64_del(map, 0);
+    assert(res == KV_ERR_KEY_NOT_FOUND);
+    for (int round = 0; round < 4; round++)
+    {
+        for (uint64_t i = 0; i < 50000; i++)
+        {
+            res = kv_map_u64_put(map, (uint64_t)(round + 1) << 40 | i, i);
+            assert(res == KV_OK);
+        }
+        for (uint64_t i = 0; i < 50000; i++)
+        {
+            res = kv_map_u64_del(map, (uint64_t)(round + 1) << 40 | i);
+            assert(res == KV_OK);
+        }
+    }
+    res = kv_map_u64_size(map, &size);
+    assert(res == KV_OK && size == 50000);
+    for (uint64_t i = 0; i < 100000; i++)
+    {
+        res = kv_map_u64_contain(map, i * 7);
+        assert(res == (i % 2 == 0 ? KV_FALSE : KV_TRUE));
+    }
+
+    res = kv_map_u64_clear(map);
+    assert(res == KV_OK);
+    res = kv_map_u64_size(map, &size);
+    assert(res == KV_OK && size == 0);
+    res = kv_map_u64_contain(map, 7);
+    assert(res == KV_FALSE);
+    kv_map_u64_destroy(map);
+
+    /* the keys may be of any type the hash and the equality take */
+    res = kv_map_str_create(&str_map, 16);
+    assert(res == KV_OK);
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+    {
+        res = kv_map_str_put(str_map, keys[i], (int)i);
+        assert(res == KV_OK);
+    }
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+    {
+        res = kv_map_str_get(str_map, keys[i], &str_value);
+        assert(res == KV_OK && str_value == (int)i);
+    }
+    res = kv_map_str_get(str_map, "Hackster.io", &str_value);
+    assert(res == KV_ERR_KEY_NOT_FOUND);
+    kv_map_str_destroy(str_map);
+}
+
 int main(int argc, char *argv[])
 {
     int res;
@@ -81,6 +3115,8 @@ int main(int argc, char *argv[])
     res = kv_destroy(set);
     assert(res == KV_OK);
 
+    res = kv_conf_init(&conf);
+    assert(res == KV_OK);
     conf.hash_cb = sample_hash;
     conf.bucket_num = 32;
 
@@ -154,5 +3190,209 @@ int main(int argc, char *argv[])
     res = kv_destroy(set);
     assert(res == KV_OK);
 
+    test_many_pairs(NULL, 100000);
+    test_overwriting(NULL);
+    test_get_batch(NULL);
+    test_binary_safe(NULL);
+
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.arena_size = 512;
+    test_arena(&conf);
+    test_many_pairs(&conf, 10000);
+    test_overwriting(&conf);
+
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.engine = KV_ENGINE_FLAT;
+    test_many_pairs(&conf, 100000);
+    test_overwriting(&conf);
+    test_get_batch(&conf);
+    test_binary_safe(&conf);
+    conf.arena_size = 512;
+    test_arena(&conf);
+    conf.arena_size = 0;
+
+    /* the weak hash leaves most of the bits unused */
+    conf.hash_cb = sample_hash;
+    test_many_pairs(&conf, 2000);
+
+    test_cached_hash(KV_ENGINE_CHAIN);
+    test_cached_hash(KV_ENGINE_FLAT);
+
+    test_builtin_hash();
+
+    test_image(NULL);
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.engine = KV_ENGINE_FLAT;
+    conf.hash_type = KV_HASH_XXH64;
+    test_image(&conf);
+    test_image_callback();
+    test_image_corrupted();
+
+    test_stripe(KV_LOCK_MUTEX, NULL);
+    test_stripe(KV_LOCK_RWLOCK, NULL);
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.engine = KV_ENGINE_FLAT;
+    conf.arena_size = 4096;
+    test_stripe(KV_LOCK_RWLOCK, &conf);
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.ttl = KV_TRUE;
+    test_stripe(KV_LOCK_RWLOCK, &conf);
+
+    test_rcu();
+
+    test_wal(KV_SYNC_GROUP);
+    test_wal(KV_SYNC_ALWAYS);
+    test_wal(KV_SYNC_NONE);
+
+    test_scan(NULL);
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.engine = KV_ENGINE_FLAT;
+    conf.arena_size = 4096;
+    test_scan(&conf);
+
+    test_art();
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.engine = KV_ENGINE_ART;
+    test_overwriting(&conf);
+    test_get_batch(&conf);
+    test_binary_safe(&conf);
+    test_scan(&conf);
+    test_image(&conf);
+    conf.arena_size = 512;
+    test_arena(&conf);
+
+    test_frozen(NULL);
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.engine = KV_ENGINE_ART;
+    test_frozen(&conf);
+
+    test_cache(NULL);
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.ordered = KV_TRUE;
+    test_cache(&conf);
+    conf.ordered = KV_FALSE;
+    conf.engine = KV_ENGINE_FLAT;
+    test_cache(&conf);
+    conf.engine = KV_ENGINE_ART;
+    test_cache(&conf);
+
+    test_ttl(NULL);
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.engine = KV_ENGINE_FLAT;
+    conf.ordered = KV_TRUE;
+    test_ttl(&conf);
+    conf.engine = KV_ENGINE_ART;
+    conf.cache_bytes = SIZE_MAX;
+    test_ttl(&conf);
+    conf.engine = KV_ENGINE_CHAIN;
+    conf.cache_bytes = 0;
+    conf.arena_size = 4096;
+    test_ttl(&conf);
+
+    test_compact();
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.engine = KV_ENGINE_COMPACT;
+    test_many_pairs(&conf, 100000);
+    test_overwriting(&conf);
+    test_get_batch(&conf);
+    test_binary_safe(&conf);
+    test_scan(&conf);
+    test_image(&conf);
+    test_frozen(&conf);
+    test_cache(&conf);
+    test_ttl(&conf);
+    conf.arena_size = 512;
+    test_arena(&conf);
+
+    test_stats(NULL);
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.engine = KV_ENGINE_FLAT;
+    test_stats(&conf);
+    conf.engine = KV_ENGINE_ART;
+    conf.ordered = KV_TRUE;
+    test_stats(&conf);
+    conf.engine = KV_ENGINE_COMPACT;
+    conf.ordered = KV_FALSE;
+    conf.ttl = KV_TRUE;
+    test_stats(&conf);
+
+    test_upsert(NULL);
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.engine = KV_ENGINE_FLAT;
+    conf.ordered = KV_TRUE;
+    test_upsert(&conf);
+    conf.engine = KV_ENGINE_ART;
+    conf.ordered = KV_FALSE;
+    conf.cache_bytes = SIZE_MAX;
+    test_upsert(&conf);
+    conf.engine = KV_ENGINE_COMPACT;
+    conf.cache_bytes = 0;
+    conf.arena_size = 4096;
+    test_upsert(&conf);
+
+    test_pool(NULL);
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.engine = KV_ENGINE_FLAT;
+    test_pool(&conf);
+    conf.engine = KV_ENGINE_ART;
+    conf.cache_bytes = SIZE_MAX;
+    conf.ttl = KV_TRUE;
+    test_pool(&conf);
+    conf.engine = KV_ENGINE_COMPACT;
+    conf.cache_bytes = 0;
+    conf.ttl = KV_FALSE;
+    test_pool(&conf);
+    conf.engine = KV_ENGINE_CHAIN;
+    conf.pool = KV_TRUE;
+    test_many_pairs(&conf, 100000);
+    test_overwriting(&conf);
+    test_binary_safe(&conf);
+    test_scan(&conf);
+    test_image(&conf);
+
+    test_bloom(NULL);
+    memset(&conf, 0, sizeof(kv_conf_t));
+    conf.bucket_num = 16;
+    conf.engine = KV_ENGINE_FLAT;
+    conf.pool = KV_TRUE;
+    test_bloom(&conf);
+    conf.engine = KV_ENGINE_ART;
+    conf.ttl = KV_TRUE;
+    conf.cache_bytes = SIZE_MAX;
+    test_bloom(&conf);
+    conf.engine = KV_ENGINE_COMPACT;
+    conf.ordered = KV_TRUE;
+    test_bloom(&conf);
+    conf.bloom_fpp = 0.001;
+    conf.ttl = KV_FALSE;
+    test_cache(&conf);
+    test_ttl(&conf);
+    test_upsert(&conf);
+    conf.engine = KV_ENGINE_CHAIN;
+    conf.cache_bytes = 0;
+    conf.ordered = KV_FALSE;
+    test_many_pairs(&conf, 100000);
+    test_get_batch(&conf);
+    test_stripe(KV_LOCK_RWLOCK, &conf);
+    test_stripe_parallel(NULL);
+    test_stripe_parallel(&conf);
+
+    test_map();
+    test_clone();
+
     return 0;
 }